@@ -33,6 +33,8 @@ struct AnimationObject {
 	bool useLighting = true;
 	bool cullFace = true;
 	bool billboard = false;
+	// Drawn into OcclusionCulling's depth buffer whatever its size or shape
+	bool occluder = false;
 	Axis forwardDirection = Axis::X;
 
 	float size = 1.0f;
@@ -87,6 +89,7 @@ struct AnimationObject {
 		useLighting = rhs.useLighting;
 		cullFace = rhs.cullFace;
 		billboard = rhs.billboard;
+		occluder = rhs.occluder;
 		forwardDirection = rhs.forwardDirection;
 
 		meshName = rhs.meshName;
@@ -105,6 +108,10 @@ struct AnimationObject {
 
 	void updateMatrix(bool force = false);
 
+	// Rotation part of a world matrix, with any shear a non-uniformly scaled parent adds
+	// taken out. False, leaving rotation alone, if an axis is scaled to zero.
+	static bool extractRotation(const mat4& m, quaternion& rotation);
+
 	bool renderUI();
 };
 
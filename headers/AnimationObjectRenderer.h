@@ -1,13 +1,40 @@
 #pragma once
 #include "Buffer.h"
+#include "Culling.h"
+#include "GeometryPool.h"
 #include "Meshing.h"
 #include "Shader.h"
+#include "ShaderPermutations.h"
+#include "StreamBuffer.h"
 #include "Uniform.h"
 
+// Bits of AnimationObjectInstance::data.y, standing in for the per-object uniforms of the
+// non-instanced path
+enum InstanceFlag : int {
+	InstanceSelected = 1,
+	InstanceLight = 2,
+	InstanceUnlit = 4,
+	InstanceVertexTransform = 8,
+	// Textures aren't color keyed on near black, for glTF materials
+	InstanceNoColorKey = 16,
+	InstanceHovered = 32
+};
+
+// Per-instance attributes for staticmesh_instanced.vert and staticshadow_instanced.vert
+struct AnimationObjectInstance {
+	mat4 model;
+	vec4 color;
+	// x: mesh id, y: InstanceFlag bits
+	ivec2 data;
+	float size;
+	float padding;
+};
 
 struct AnimationObjectRenderData {
 	GLuint vao = 0;
 	GLuint shadowVAO = 0;
+	GLuint instancedVAO = 0;
+	GLuint instancedShadowVAO = 0;
 
 	AnimationObjectType shapeType = AnimationObjectType::sphere;
 	std::string objectName = "sphere";
@@ -15,14 +42,24 @@ struct AnimationObjectRenderData {
 	s_ptr<VectorBuffer<PlainOldVertex>> vertexVBO;
 	s_ptr<Shader> shader;
 	s_ptr<Shader> shadowShader;
+	s_ptr<Shader> instancedShader;
+	s_ptr<Shader> instancedShadowShader;
 	s_ptr<MeshData> mesh;
 
+	// Object space bounds of the vertices, before AnimationObject::size is applied
+	Bounds bounds;
+
+	// Copy of the vertices and indices in GeometryPool, made the first time it's drawn indirectly
+	GeometrySlice slice;
+
 	AnimationObjectRenderData() { }
 	AnimationObjectRenderData(AnimationObjectType st);
 	AnimationObjectRenderData(std::string filename);
 
 
 	bool initShader();
+	bool initInstancedShader();
+	void computeBounds();
 };
 
 
@@ -43,8 +80,49 @@ public:
 	vec4 globalColor = vec4(1.f);
 	vec2 shadowBias = vec2(0.005f);
 
+	// Draw objects that share a shape or mesh with glDrawElementsInstanced, one draw per
+	// texture and culling state, rather than one glDrawElements per object
+	bool useInstancing = true;
+
+	// AnimationObject::index drawn with the hover tint, set by SelectTool
+	int hoveredIndex = -1;
+
+	// Draw instanced objects with staticmesh variants that have the texture, shadow and
+	// fragment transform switches compiled in, rather than branching on uniforms
+	bool useShaderVariants = true;
+
+	struct InstancingStats {
+		size_t draws = 0;
+		size_t instances = 0;
+		// Times a run needed a different variant than the one before it
+		size_t variantSwitches = 0;
+	} instancingStats;
+
 	bool init();
 
+	// Shared per-instance stream, created on first use so render data can bind it. Instance
+	// attributes read from instanceOffset, which moves to each run's range before it draws.
+	StreamBuffer& getInstanceStream();
+	GLintptr instanceOffset = 0;
+
+	// Attributes every instanced shader binds to fixed locations, so one VAO serves all variants
+	static const string_vector InstancedAttributes;
+
+	// Variants of the instanced staticmesh shader, shared by every shape and mesh
+	ShaderPermutations& getInstancedVariants();
+
+	// Finds or loads the render data for a model object
+	AnimationObjectRenderData& getMeshData(const AnimationObject& shape);
+
+	// Render data for the object's shape, or its mesh if it's a model
+	AnimationObjectRenderData& getRenderData(const AnimationObject& shape);
+
+	// InstanceFlag bits for the object
+	static int getInstanceFlags(const AnimationObject& shape);
+
+	// Object space bounds of the shape or mesh the object draws with
+	const Bounds& getLocalBounds(const AnimationObject& shape);
+
 	void beginBatchRender(AnimationObjectType shapeType, bool overrideColor = false, const vec4& batchColor = vec4(1.f), bool isShadow = false);
 	void beginBatchRender(const AnimationObject& shape, bool overrideColor = false, const vec4& batchColor = vec4(1.f), bool isShadow = false);
 	void render(AnimationObjectType shapeType, const mat4& mat, bool singular = true, bool isShadow = false);
@@ -54,10 +132,24 @@ public:
 	void renderBatchWithOwnColor(const AnimationObject& shape, bool isShadow = false, bool useShapeColor = true);
 	void endBatchRender(bool isShadow = false);
 
+	void renderInstanced(AnimationObjectType shapeType, const std::vector<const AnimationObject*>& shapes, bool isShadow = false);
+	void renderInstanced(AnimationObjectRenderData& renderData, const std::vector<const AnimationObject*>& shapes, bool isShadow = false);
+
+	void bindShadowMap(const s_ptr<Shader>& shader);
+	// Depth comparison sampler for the shadow map, white outside the border
+	static GLuint getShadowSampler(GLint compareFunc = GL_LEQUAL);
+	// The object's own texture, falling back to its mesh's diffuse texture
+	s_ptr<Texture> getObjectTexture(const AnimationObject& shape, const AnimationObjectRenderData& renderData) const;
+
 	void renderUI();
 
 private:
 	int wireframeMode = 0;
+
+	u_ptr<StreamBuffer> instanceStream;
+	u_ptr<ShaderPermutations> instancedVariants;
+	std::vector<std::pair<uint64_t, const AnimationObject*>> instanceBatches;
+
 	AnimationObjectRenderer() { }
 	virtual ~AnimationObjectRenderer() { }
 };
\ No newline at end of file
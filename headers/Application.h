@@ -24,6 +24,9 @@ class Application
 
 		bool quit = false;
 
+		// Draw with SoftwareRenderer instead of OpenGLRenderer, set by --software
+		bool useSoftwareRenderer = false;
+
 		double startedAt = 0;
 		double lastFrameAt = 0;
 		double pausedAt = 0;
@@ -34,6 +37,8 @@ class Application
 		double deltaTime = 0.;
 		double updateTime = 0.;
 		double renderTime = 0.;
+		// Wall clock seconds from startup until the first frame was presented, 0 until then
+		double timeToFirstFrame = 0.;
 		double targetFPS = 60.;
 		double sleepTime = 0.;
 
@@ -2,6 +2,8 @@
 
 #include "globals.h"
 
+#include "ResourceRegistry.h"
+
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
@@ -16,17 +18,25 @@ public:
 
 	bool shouldUpdateBuffer = true;
 
+	ResourceRegistry::Handle memoryHandle = 0;
+
 	Buffer() { }
 
-	Buffer(GLenum target, GLsizeiptr size, GLvoid* data, GLenum usage)
+	// file and line are the allocating call site, for ResourceRegistry
+	Buffer(GLenum target, GLsizeiptr size, GLvoid* data, GLenum usage,
+		const char* file = __builtin_FILE(), int line = __builtin_LINE())
 		: bindTarget(target), bufferSize(size), bufferData(data), usagePattern(usage)
 	{
 		glGenBuffers(1, &buffer);
 		update(true, true);
+		memoryHandle = ResourceRegistry::get().add(ResourceCategory::Buffer, fmt::format("Buffer {0}", buffer),
+			(size_t)bufferSize, 0, file, line);
 	}
 
 	~Buffer()
 	{
+		ResourceRegistry::get().remove(memoryHandle);
+
 		if (buffer != 0)
 		{
 			auto gld = glDeleteBuffers;
@@ -98,23 +108,31 @@ public:
 	std::vector<T> data;
 	s_ptr<Buffer> buffer;
 
+	// Where this was created, passed on to the Buffer for ResourceRegistry
+	const char* file = nullptr;
+	int line = 0;
+
 	VectorBuffer() { }
 
 	// Allocates the storage with the desired amount and initializes the Buffer
-	VectorBuffer(GLenum target, GLsizeiptr count, GLenum usage)
+	VectorBuffer(GLenum target, GLsizeiptr count, GLenum usage,
+		const char* _file = __builtin_FILE(), int _line = __builtin_LINE())
+		: file(_file), line(_line)
 	{
 		data.resize(count);
 		initBuffer(target, usage);
 	}
 
-	VectorBuffer(GLenum target, const std::vector<T>& _data, GLenum usage)
-		: data(_data)
+	VectorBuffer(GLenum target, const std::vector<T>& _data, GLenum usage,
+		const char* _file = __builtin_FILE(), int _line = __builtin_LINE())
+		: data(_data), file(_file), line(_line)
 	{
 		initBuffer(target, usage);
 	}
 
-	VectorBuffer(GLenum target, std::vector<T>&& _data, GLenum usage)
-		: data(_data)
+	VectorBuffer(GLenum target, std::vector<T>&& _data, GLenum usage,
+		const char* _file = __builtin_FILE(), int _line = __builtin_LINE())
+		: data(_data), file(_file), line(_line)
 	{
 		initBuffer(target, usage);
 	}
@@ -139,7 +157,10 @@ public:
 
 	void initBuffer(GLenum target, GLenum usage)
 	{
-		buffer = s_ptr<Buffer>(new Buffer(target, sizeof(T) * data.size(), (GLvoid*)data.data(), usage));
+		buffer = s_ptr<Buffer>(new Buffer(target, sizeof(T) * data.size(), (GLvoid*)data.data(), usage, file, line));
+
+		// The vector is the CPU copy
+		ResourceRegistry::get().update(buffer->memoryHandle, (size_t)buffer->bufferSize, sizeof(T) * data.capacity());
 	}
 
 	void bind()
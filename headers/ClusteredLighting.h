@@ -0,0 +1,120 @@
+#pragma once
+
+#include "globals.h"
+#include "Lighting.h"
+
+class Camera;
+
+namespace GPU
+{
+	// Point and spot lights past the three in LightData, shaded per froxel.
+	//
+	// The view frustum is cut into a grid of froxels, dims.x by dims.y screen tiles and dims.z
+	// slices in view depth: the first up to nearDistance, the last from farDistance on, and the
+	// rest spaced exponentially in between. Each frame begin() bounds every light by a sphere of
+	// its range (spot lights too, so their cones are covered loosely), finds the slices it
+	// overlaps, and within each slice tests the candidates against every froxel's view space box,
+	// four lights at a time with SSE where available. The result is three texture buffers the
+	// lighting() function in lights.frag reads: per froxel an offset and count into the index
+	// list, the index list itself, and the lights as six vec4s each. A fragment finds its froxel
+	// from gl_FragCoord and its view depth and only loops over the lights listed there.
+	//
+	// Texture buffers rather than storage buffers keep this working on a 3.3 context.
+	struct LightClusters {
+
+		static LightClusters& get();
+
+		struct Stats {
+			size_t lights = 0;
+			// Lights left after dropping the ones entirely behind the camera
+			size_t visible = 0;
+			size_t indices = 0;
+			size_t maxPerCluster = 0;
+			// Light references dropped because a cluster was full
+			size_t overflow = 0;
+			double buildTime = 0.0;
+		} stats;
+
+		bool enabled = true;
+
+		// Froxels across, down and deep
+		ivec3 dims = ivec3(16, 9, 24);
+
+		// View depths the first slice ends and the last one starts at
+		float nearDistance = 0.5f;
+		float farDistance = 100.0f;
+
+		// Lights shaded at most per froxel
+		int maxPerCluster = 128;
+
+		// Intensity a light's range is cut off at when attenuation.w is 0
+		float cutoff = 1.0f / 256.0f;
+
+		// Position w is 1, spot.x above 90 for a point light. attenuation.w is the range, 0 to
+		// work it out from the attenuation and cutoff.
+		std::vector<Light> lights;
+
+		bool init();
+
+		// Assigns lights to froxels for this camera and target size, uploads the lists, binds
+		// them and points FrameData at them. Call before the pass's FrameUniforms::update.
+		void begin(const Camera& camera, const ivec2& resolution);
+
+		// Turns clustered lights off in FrameData for the passes after this one
+		void end();
+
+		// Scatters count point and spot lights through a box for testing
+		void addTestLights(int count, const vec3& center, const vec3& extent);
+
+		// Distance past which the light adds less than cutoff
+		float range(const Light& light) const;
+
+		void renderUI();
+
+	protected:
+		struct TextureBuffer {
+			spBuffer buffer;
+			GLuint texture = 0;
+		};
+
+		TextureBuffer grid, indices, lightData;
+
+		// Per froxel: offset into the index list, count
+		std::vector<uvec2> gridData;
+		std::vector<GLuint> indexData;
+		std::vector<Light> uploadData;
+
+		// View space box of every froxel, x fastest then y then z
+		std::vector<vec3> froxelMin, froxelMax;
+
+		// Lights reaching one slice, split by component so four load at once. Padded to a multiple
+		// of four with a negative squared radius, which nothing passes.
+		struct Candidates {
+			std::vector<float> x, y, z, radius2;
+			std::vector<GLuint> index;
+
+			void clear() {
+				x.clear(); y.clear(); z.clear(); radius2.clear(); index.clear();
+			}
+
+			void push(const vec3& c, float r2, GLuint i) {
+				x.push_back(c.x); y.push_back(c.y); z.push_back(c.z); radius2.push_back(r2); index.push_back(i);
+			}
+
+			void pad() {
+				while (x.size() % 4 != 0) push(vec3(0.f), -1.f, 0);
+			}
+		};
+
+		// One per depth slice, kept between frames so their storage is reused
+		std::vector<Candidates> slices;
+
+		void createTextureBuffer(TextureBuffer& tb, GLenum format);
+		void upload(TextureBuffer& tb, const void* data, size_t bytes);
+		void buildFroxels(const mat4& projection, float cameraNear, float cameraFar);
+		int sliceOf(float depth) const;
+		void assign(const mat4& view);
+
+		LightClusters() { }
+	};
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "globals.h"
+#include "AnimationObject.h"
+
+MAKE_ENUM(ConstraintType, int, Parent, Point, Orient, Aim, Billboard, Orbit, Spin);
+
+// Solves constraints on AnimationObjects once per frame, after animation has written local
+// transforms and before anything is rendered.
+//
+// Constraints are kept in one array per type and each type is solved in a single pass over
+// its array, so there is no per-object branching on constraint kind. Aim, orient, point and
+// parent constraints are added explicitly and refer to objects by index. Billboard, orbit and
+// spin come from the flags on AnimationObject (billboard, orbitRotation, constantRotation)
+// and are gathered each frame.
+//
+// Orbit and spin drive local channels, so they run first and the affected matrices are
+// rebuilt. The world-space constraints then run level by level: an object's level is one more
+// than the highest level of any object it is constrained to, and within a level the types are
+// solved in ConstraintType order. Children of constrained objects are refreshed after each
+// level so the next level sees their final transforms.
+//
+// Solved poses are written back to the local channels so a later updateMatrix(true) keeps
+// them. Weighted constraints blend from the object's authored pose, not from last frame's
+// solved one, or a weight of 0.5 would creep to full strength over a few frames. The solver
+// remembers the local channels it wrote; if they're still there next frame the authored
+// ones are put back before solving, and if anything else changed them those become the
+// authored pose.
+class ConstraintSolver {
+public:
+	static ConstraintSolver& get();
+
+	struct Constraint {
+		int object = -1;
+		int target = -1;
+		float weight = 1.f;
+		bool enabled = true;
+	};
+
+	// Keeps the object's world transform relative to the target's, as it was when added
+	struct ParentConstraint : Constraint {
+		mat4 offset = mat4(1.f);
+	};
+
+	struct PointConstraint : Constraint {
+		vec3 offset = vec3(0.f);
+	};
+
+	struct OrientConstraint : Constraint {
+		vec3 offset = vec3(0.f);		// Euler angles
+	};
+
+	// Points the object's forward axis at the target
+	struct AimConstraint : Constraint {
+		Axis forward = Axis::X;
+		vec3 up = vec3(0.f, 1.f, 0.f);
+	};
+
+	std::vector<ParentConstraint> parents;
+	std::vector<PointConstraint> points;
+	std::vector<OrientConstraint> orients;
+	std::vector<AimConstraint> aims;
+
+	bool enabled = true;
+
+	struct Stats {
+		size_t counts[ConstraintType::_size()] = {};
+		int levels = 0;
+		size_t refreshed = 0;
+		double time = 0.0;
+	} stats;
+
+	// Adds a parent constraint that holds object where it currently is relative to target
+	void addParent(const AnimationObject& object, const AnimationObject& target, float weight = 1.f);
+	void addPoint(const AnimationObject& object, const AnimationObject& target, const vec3& offset = vec3(0.f), float weight = 1.f);
+	void addOrient(const AnimationObject& object, const AnimationObject& target, const vec3& offset = vec3(0.f), float weight = 1.f);
+	void addAim(const AnimationObject& object, const AnimationObject& target, Axis forward = Axis::X, float weight = 1.f);
+
+	// Removes every explicit constraint on or targeting this object
+	void remove(int objectIndex);
+
+	void clear();
+
+	void solve(double dt);
+
+	void renderUI();
+
+protected:
+	ConstraintSolver() { }
+
+	// A constraint resolved against this frame's objects
+	struct Resolved {
+		AnimationObject* object = nullptr;
+		AnimationObject* target = nullptr;
+		size_t source = 0;
+		int level = 0;
+	};
+
+	ptr_vector<AnimationObject> scene;
+	std::unordered_map<int, AnimationObject*> byIndex;
+	std::unordered_map<AnimationObject*, ptr_vector<AnimationObject>> targets;
+	std::unordered_map<int, int> levels;
+	std::unordered_set<AnimationObject*> solved;
+
+	std::vector<Resolved> resolved[ConstraintType::_size()];
+
+	struct LocalPose {
+		vec3 position = vec3(0.f);
+		vec3 rotation = vec3(0.f);
+		vec3 scale = vec3(1.f);
+
+		bool operator==(const LocalPose& rhs) const {
+			return position == rhs.position && rotation == rhs.rotation && scale == rhs.scale;
+		}
+	};
+
+	// Per object index with explicit constraints: the pose before solving, and what was written
+	struct PoseCache {
+		LocalPose authored;
+		LocalPose written;
+	};
+	std::unordered_map<int, PoseCache> poses;
+
+	void gather();
+	int levelOf(AnimationObject* object, int depth = 0);
+	void refreshChildren();
+	void restoreAuthored(AnimationObject& object);
+	void prunePoses();
+
+	void solveOrbits(double dt);
+	void solveSpins();
+	void solveParents(size_t begin, size_t end);
+	void solvePoints(size_t begin, size_t end);
+	void solveOrients(size_t begin, size_t end);
+	void solveAims(size_t begin, size_t end);
+	void solveBillboards(size_t begin, size_t end);
+};
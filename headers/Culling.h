@@ -0,0 +1,213 @@
+#pragma once
+
+#include "globals.h"
+
+struct AnimationObject;
+
+MAKE_ENUM(CullResult, int, Outside, Intersecting, Inside);
+
+// Which shadow casters isVisible lets through: all of them, only the ones that have held
+// still (drawn once into the cached shadow map), or only the ones that haven't
+MAKE_ENUM(CasterSet, int, All, Static, Dynamic);
+
+// Axis-aligned box, plus the sphere around it
+struct Bounds {
+	vec3 min = vec3(FLT_MAX);
+	vec3 max = vec3(-FLT_MAX);
+
+	Bounds() { }
+	Bounds(const vec3& _min, const vec3& _max) : min(_min), max(_max) { }
+
+	bool valid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+
+	vec3 center() const { return (min + max) * 0.5f; }
+	vec3 extents() const { return (max - min) * 0.5f; }
+	float radius() const { return glm::length(extents()); }
+
+	// Surface area, the cost the BVH minimizes when choosing where to insert
+	float area() const {
+		vec3 d = max - min;
+		return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	void expand(const vec3& p) {
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+
+	void expand(const Bounds& b) {
+		min = glm::min(min, b.min);
+		max = glm::max(max, b.max);
+	}
+
+	bool contains(const Bounds& b) const {
+		return glm::all(glm::lessThanEqual(min, b.min)) && glm::all(glm::greaterThanEqual(max, b.max));
+	}
+
+	Bounds padded(float amount) const { return Bounds(min - vec3(amount), max + vec3(amount)); }
+
+	static Bounds merge(const Bounds& a, const Bounds& b) {
+		return Bounds(glm::min(a.min, b.min), glm::max(a.max, b.max));
+	}
+
+	// The box around this box after transforming it
+	Bounds transformed(const mat4& m) const;
+};
+
+// Six normalized planes facing inward, laid out as structure of arrays so four planes are
+// tested against a box at once. The last two slots hold planes nothing is outside of.
+struct Frustum {
+	alignas(16) float nx[8];
+	alignas(16) float ny[8];
+	alignas(16) float nz[8];
+	alignas(16) float d[8];
+
+	Frustum() : Frustum(mat4(1.f)) { }
+	Frustum(const mat4& viewproj);
+	// Camera::frustumPlanes order: left, right, bottom, top, near, far
+	Frustum(const vec4 planes[6]);
+
+	CullResult test(const Bounds& b) const;
+	bool isVisible(const Bounds& b) const { return test(b) != +CullResult::Outside; }
+	bool isVisible(const vec3& center, float radius) const;
+};
+
+// Bounding volume tree over scene objects. Leaves store a padded ("fat") box, so an object
+// moving a little doesn't change the tree at all. Once it leaves its fat box, the leaf is
+// removed and reinserted where it adds the least surface area, refitting and rebalancing
+// its ancestors on the way up.
+class DynamicBVH {
+public:
+	// Padding around each leaf's box
+	float margin = 0.1f;
+
+	// Returns the proxy id for the new leaf
+	int insert(const Bounds& bounds, int userData);
+	void remove(int proxy);
+	// Returns true if the leaf had to be reinserted
+	bool update(int proxy, const Bounds& bounds);
+	void clear();
+
+	// Appends the userData of every leaf not outside the frustum. Subtrees entirely inside
+	// are taken whole without testing their leaves.
+	void query(const Frustum& frustum, std::vector<int>& out, size_t* tests = nullptr) const;
+
+	int getUserData(int proxy) const { return nodes[proxy].userData; }
+	const Bounds& getFatBounds(int proxy) const { return nodes[proxy].bounds; }
+
+	int getHeight() const { return root == -1 ? 0 : nodes[root].height; }
+	size_t getLeafCount() const { return leafCount; }
+	size_t getNodeCount() const { return nodes.size() - freeCount; }
+
+protected:
+	struct Node {
+		Bounds bounds;
+		int parent = -1;				// next free node when on the free list
+		int left = -1;
+		int right = -1;
+		int userData = -1;
+		int height = -1;				// -1 when free, 0 for leaves
+
+		bool isLeaf() const { return left == -1; }
+	};
+
+	std::vector<Node> nodes;
+	int root = -1;
+	int freeList = -1;
+	size_t freeCount = 0;
+	size_t leafCount = 0;
+
+	int allocate();
+	void release(int node);
+	void insertLeaf(int leaf);
+	void removeLeaf(int leaf);
+	// Rotates a child up if the subtree at a is unbalanced, returns the subtree's new root
+	int balance(int a);
+	void refit(int node);
+	void collect(int node, std::vector<int>& out) const;
+};
+
+// Keeps world bounds for every object in Application::objects inside a DynamicBVH and
+// answers which of them a camera or the shadow light can see.
+//
+// It also tells static objects from moving ones for shadow caching: an object is static
+// once its transform has held for staticFrames syncs. staticVersion changes whenever the
+// set of static objects or where they are does, which is when a cached static shadow map
+// has to be redrawn.
+class SceneCulling {
+public:
+	static SceneCulling& get();
+
+	bool enabled = true;
+
+	// Syncs an object has to hold still before it counts as static
+	int staticFrames = 30;
+
+	// Filter isVisible applies on top of the cull, set around the shadow passes
+	CasterSet casters = CasterSet::All;
+
+	struct Stats {
+		size_t tested = 0;
+		size_t visible = 0;
+		size_t culled = 0;
+		// Of the culled, how many OcclusionCulling hid
+		size_t occluded = 0;
+		double time = 0.0;
+	} cameraStats, shadowStats;
+
+	// Brings the tree up to date with the objects' current transforms. Objects that haven't
+	// moved cost a matrix compare; objects that moved within their fat box cost a box update.
+	void sync(const std::vector<AnimationObject>& objects);
+
+	// Marks which objects are inside the frustum, for isVisible. Also resets the pass's stats.
+	void cull(const Frustum& frustum, bool isShadow);
+
+	// Whether the object at this position in Application::objects survived the last cull
+	bool isVisible(size_t objectPosition) const {
+		if (casters != +CasterSet::All && isStatic(objectPosition) != (casters == +CasterSet::Static)) return false;
+		return !enabled || objectPosition >= visibility.size() || visibility[objectPosition] != 0;
+	}
+
+	// Whether the object at this position hasn't moved for staticFrames syncs
+	bool isStatic(size_t objectPosition) const {
+		return objectPosition < staticFlags.size() && staticFlags[objectPosition] != 0;
+	}
+
+	uint64_t getStaticVersion() const { return staticVersion; }
+
+	// Counts something culled outside the tree, like a glTF node, in this pass's stats
+	void record(bool visible, bool isShadow);
+
+	// Marks an object the camera pass found visible as hidden behind occluders
+	void hide(size_t objectPosition);
+
+	// World bounds of an object by index, nullptr if it isn't tracked
+	const Bounds* getBounds(int objectIndex) const;
+
+	void renderUI();
+
+protected:
+	struct Proxy {
+		int node = -1;
+		size_t position = 0;
+		uint64_t lastSeen = 0;
+		uint64_t lastMoved = 0;
+		mat4 transform = mat4(0.f);
+		float size = 0.f;
+		Bounds bounds;
+	};
+
+	DynamicBVH tree;
+	std::unordered_map<int, Proxy> proxies;
+	std::vector<uint8_t> visibility;
+	// By position, filled in by sync
+	std::vector<uint8_t> staticFlags;
+	uint64_t staticVersion = 0;
+	std::vector<int> queryResults;
+	uint64_t syncCount = 0;
+	size_t objectCount = 0;
+	size_t reinserts = 0;
+	double syncTime = 0.0;
+
+	SceneCulling() { }
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "globals.h"
+#include "Properties.h"
+
+// Evaluates driven keys lazily. Values are nodes and each driven key is a node whose
+// inputs are other nodes. Every frame the input nodes are polled for changes, dirtiness is
+// pushed downstream, and only the dirty nodes are evaluated, in topological order.
+//
+// Inputs must exist before the nodes they drive, so the graph can never contain a cycle
+// and a node's level (1 + the highest level of its inputs) is known when it is added.
+// Nodes on the same level never depend on each other, which is what lets a level's dirty
+// nodes be evaluated in parallel.
+class DependencyGraph {
+public:
+	using NodeId = int;
+	using Evaluate = std::function<void()>;
+	using Changed = std::function<bool()>;
+
+	struct Node {
+		std::string name;
+		// Source nodes poll this to find out whether their value changed since last frame
+		Changed changed;
+		// Driven nodes write their outputs here
+		Evaluate evaluate;
+		std::vector<NodeId> inputs;
+		std::vector<NodeId> outputs;
+		int level = 0;
+		// Nodes that touch GL or other shared state run on the calling thread
+		bool threadSafe = true;
+		bool dirty = true;
+
+		unsigned long lastEvaluatedFrame = 0;
+		size_t evaluationCount = 0;
+		double lastEvaluationTime = 0.0;
+	};
+
+	std::string name;
+	std::vector<Node> nodes;
+
+	// Evaluate a level's dirty nodes on the WorkerPool once there are at least this many.
+	// Off by default, since most driven keys are cheaper than waking the workers.
+	bool parallel = false;
+	int minParallelNodes = 8;
+
+	DependencyGraph(const std::string& _name = "Dependency graph") : name(_name) { }
+
+	// Adds a source node that is dirty whenever changed() returns true
+	NodeId addInput(const std::string& nodeName, Changed changed);
+
+	// Adds a source node that watches a value by keeping a copy of it
+	template <typename T>
+	NodeId addInput(const std::string& nodeName, const T* value) {
+		auto last = std::make_shared<T>(*value);
+		return addInput(nodeName, [value, last]() {
+			if (*value == *last) return false;
+			*last = *value;
+			return true;
+		});
+	}
+
+	// Adds a source node that watches a property's value. It's polled like any other value
+	// rather than hooked into the property's change events, which have no way to unsubscribe
+	// and would outlive the node.
+	template <typename T>
+	NodeId addInput(const std::string& nodeName, const Property<T>& property) {
+		return addInput(nodeName, &property.value);
+	}
+
+	// Adds a driven node. Every input must already be in the graph.
+	NodeId addDriven(const std::string& nodeName, const std::vector<NodeId>& inputs, Evaluate evaluate, bool threadSafe = true);
+
+	// Forces a node (and everything downstream of it) to be evaluated next frame
+	void markDirty(NodeId id);
+
+	// Polls inputs and evaluates dirty nodes. Returns the number of nodes evaluated.
+	size_t evaluate();
+
+	// True if the node was evaluated by the most recent call to evaluate()
+	bool evaluatedThisFrame(NodeId id) const;
+
+	void clear();
+
+	void renderUI();
+
+protected:
+	std::vector<std::vector<NodeId>> levels;
+	unsigned long frame = 0;
+	size_t lastEvaluatedCount = 0;
+	double lastEvaluationTime = 0.0;
+
+	void evaluateNode(Node& node);
+};
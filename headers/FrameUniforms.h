@@ -0,0 +1,27 @@
+#pragma once
+
+#include "globals.h"
+#include "Lighting.h"
+
+class Camera;
+
+namespace GPU
+{
+	// Owns the FrameBlock uniform buffer (shaders/frame.glsl). Programs get the block on
+	// GPU_FRAME_BINDING_SPOT when they link, so after update() every shader sees the pass's
+	// matrices without any per-draw uniform calls.
+	struct FrameUniforms {
+
+		static FrameUniforms& get();
+
+		FrameData data;
+
+		spBuffer gpu;
+
+		bool init();
+
+		// Copies the camera's matrices into data, uploads it and binds the buffer. Call at the
+		// start of each pass, after the pass's camera is set.
+		void update(const Camera& camera);
+	};
+}
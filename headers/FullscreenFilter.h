@@ -0,0 +1,38 @@
+#pragma once
+
+#include "globals.h"
+
+#include "Buffer.h"
+#include "Shader.h"
+
+// A fragment shader from shaders/filters drawn over a whole target, e.g. as a render graph pass.
+//
+// __UNIFORMS__ in the shader becomes iTime and resolution. The color being filtered is bound
+// to filterInput on unit 0 and the scene depth to depthInput on unit 1; the result goes to
+// fragColor. The quad comes from fullscreenfilter.vert, which only needs vertex indices.
+class FullscreenFilter {
+public:
+	std::string name;
+	// Path under shaders/
+	std::string fragPath;
+
+	bool enabled = false;
+
+	FullscreenFilter(const std::string& fragPath, bool enabled = false);
+
+	// Builds the shader and quad. Called by the first render, or again to reload.
+	bool init();
+
+	// Draws into whatever framebuffer is bound
+	void render(GLuint input, GLuint depth, const ivec2& resolution);
+
+	void renderUI();
+
+protected:
+	bool initialized = false;
+
+	GLuint vao = 0;
+	s_ptr<VectorBuffer<GLuint>> indexVBO;
+	s_ptr<VectorBuffer<GLuint>> vertexVBO;
+	s_ptr<Shader> shader;
+};
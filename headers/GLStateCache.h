@@ -0,0 +1,84 @@
+#pragma once
+
+#include "globals.h"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <tuple>
+
+// Drop-in replacements for the GL state calls made while drawing. Each one remembers what
+// it last set and skips the call when nothing would change. Everything outside src/imgui
+// goes through these, so the shadow copy only goes stale when the ImGui backend runs, and
+// it restores what it touches.
+//
+// State is forgotten at the start of each frame, and whenever invalidate() is called after
+// code that changes state behind these functions' backs.
+namespace GLState
+{
+	// Sampler object parameters, replacing glTexParameteri on every draw
+	struct SamplerState {
+		GLint magFilter = GL_LINEAR;
+		GLint minFilter = GL_LINEAR;
+		GLint wrapS = GL_REPEAT;
+		GLint wrapT = GL_REPEAT;
+		// GL_NONE or GL_COMPARE_REF_TO_TEXTURE
+		GLint compareMode = GL_NONE;
+		GLint compareFunc = GL_LEQUAL;
+		vec4 borderColor = vec4(0.f);
+
+		bool operator<(const SamplerState& rhs) const {
+			return std::tie(magFilter, minFilter, wrapS, wrapT, compareMode, compareFunc, borderColor.r, borderColor.g, borderColor.b, borderColor.a)
+				< std::tie(rhs.magFilter, rhs.minFilter, rhs.wrapS, rhs.wrapT, rhs.compareMode, rhs.compareFunc,
+					rhs.borderColor.r, rhs.borderColor.g, rhs.borderColor.b, rhs.borderColor.a);
+		}
+	};
+
+	struct Stats {
+		size_t calls = 0;
+		size_t filtered = 0;
+	};
+
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vao);
+
+	void activeTexture(GLenum unit);
+	// Binds to the active unit. 2D, 2D array, cube map and buffer texture bindings are tracked.
+	void bindTexture(GLenum target, GLuint texture);
+	void bindSampler(GLuint unit, GLuint sampler);
+	// Puts sampler 0 back on every unit with a sampler bound, so textures use their own parameters
+	void unbindSamplers();
+
+	// A sampler object with these parameters, created the first time they're asked for
+	GLuint getSampler(const SamplerState& state);
+
+	// Only blend, cull face, depth test, scissor test and stencil test are tracked
+	void enable(GLenum cap);
+	void disable(GLenum cap);
+	void setEnabled(GLenum cap, bool enabled);
+	// What's set now, asking GL when the cache doesn't know, so a caller can put it back after
+	bool isEnabled(GLenum cap);
+
+	void cullFace(GLenum mode);
+	GLenum getCullFace();
+	void frontFace(GLenum mode);
+	void blendFunc(GLenum src, GLenum dst);
+	void blendEquation(GLenum mode);
+	void depthFunc(GLenum func);
+	void depthMask(GLboolean flag);
+
+	// Call after deleting an object, since GL unbinds it and may hand its name out again
+	void forgetTexture(GLuint texture);
+	void forgetProgram(GLuint program);
+
+	// Forgets everything so the next call of each kind goes through
+	void invalidate();
+
+	// Invalidates and starts counting a new frame
+	void beginFrame();
+
+	// Counts for the frame before this one
+	const Stats& lastFrame();
+
+	void renderUI();
+}
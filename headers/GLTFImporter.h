@@ -2,6 +2,9 @@
 
 #include "globals.h"
 #include "Texture.h"
+#include "Culling.h"
+#include "GeometryPool.h"
+#include "StreamBuffer.h"
 
 MAKE_ENUM(GLTFNodeType, int, node, mesh, camera, skin);
 
@@ -198,6 +201,20 @@ struct GLTFRenderContext {
 	// Key: image index
 	// Value: loaded texture
 	std::map<uint32_t, s_ptr<Texture>> imageTextures;
+
+	// Key: mesh index
+	// Value: object space bounds of all its primitives, from the POSITION accessors' min/max
+	std::map<uint32_t, Bounds> meshBounds;
+
+	// Key: mesh index
+	// Value: GeometryPool slices of its primitives. Empty unless every primitive in the file
+	// could be pooled, in which case it's drawn with IndirectRenderer.
+	std::map<uint32_t, std::vector<GeometrySlice>> meshSlices;
+
+	// ResourceRegistry entry for the vertex and index buffers
+	uint64_t memoryHandle = 0;
+
+	~GLTFRenderContext();
 };
 
 struct GLTFData {
@@ -220,20 +237,45 @@ struct GLTFData {
 class GLTFImporter {
 public:
 	static s_ptr<GLTFData> import(std::string file);
+
+	// Copies a triangle primitive out as PlainOldVertex vertices and indices. Returns false for
+	// other primitive modes and attributes that aren't floats.
+	static bool readTriangles(const GLTFData& gltf, const GLTFPrimitive& prim, std::vector<PlainOldVertex>& vertices, std::vector<GLuint>& indices);
 };
 
 
 class Framebuffer;
+class ShaderPermutations;
 class GLTFRenderer {
 	bool initialized = false;
 
+	u_ptr<StreamBuffer> jointStream;
+	s_ptr<ShaderPermutations> variants;
+
 public:
 	static GLTFRenderer& get() {
 		static GLTFRenderer renderer;
 		return renderer;
 	}
+
+	// Attributes gltfmesh binds to fixed locations, so one VAO serves all its variants
+	static const string_vector Attributes;
+
+	// Draw primitives with gltfmesh variants that have the material's texture and lighting
+	// and the shadow map compiled in, rather than branching on uniforms
+	bool useShaderVariants = true;
+
+	// Variants of gltfmesh, shared by every file
+	ShaderPermutations& getVariants();
 	void init(s_ptr<GLTFData> gltf);
 	void render(const mat4& projection, const mat4& view, s_ptr<GLTFData> gltf, s_ptr<Framebuffer> framebuffer, bool isShadow);
 
+	// Queues the visible meshes with IndirectRenderer. Returns false if they have to be drawn
+	// with render instead.
+	bool renderIndirect(const mat4& projection, const mat4& view, s_ptr<GLTFData> gltf, bool isShadow);
+
+	// Streams a skin's joint matrices into the JointBlock uniform block
+	void bindJointPalette(const std::vector<mat4>& jointMatrices);
+
 	static void renderUI(s_ptr<GLTFData> gltf);
 };
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "globals.h"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+// Times named stages of a frame on the GPU without waiting for it.
+//
+// Each stage puts a GL_TIMESTAMP query at its start and end. Timestamps rather than
+// GL_TIME_ELAPSED so stages can nest (the main pass contains the glTF draws, and so on).
+// Queries go into one of FrameLatency query sets; a set is read back when it comes round
+// again, FrameLatency frames later. If its results still aren't available that frame's
+// timings are dropped rather than stalling for them.
+class GPUProfiler {
+public:
+	static GPUProfiler& get();
+
+	static const int FrameLatency = 3;
+	static const size_t HistoryLength = 240;
+
+	bool enabled = true;
+
+	// One stage's times in a read back frame
+	struct StageTime {
+		std::string path;
+		float gpu = 0.f, cpu = 0.f;
+	};
+
+	// Read back frames are also queued here for takeResolved() when set. Headless runs use
+	// this to write their timing report.
+	bool keepResolved = false;
+
+	// Timer queries are core in 3.3
+	static bool isSupported();
+
+	// Reads back the oldest query set and starts the "Frame" stage
+	void beginFrame();
+	// Closes any open stages, including "Frame"
+	void endFrame();
+
+	void push(const std::string& name);
+	void pop();
+
+	// Frames read back since the last call, numbered by beginFrame() calls from 0
+	std::vector<std::pair<uint64_t, std::vector<StageTime>>> takeResolved();
+
+	// Waits for every frame still in flight and reads it back. Only for the end of a run.
+	void flush();
+
+	void renderUI();
+
+protected:
+	struct Marker {
+		// Parent stage names joined with '/', so stages with the same name in different passes stay apart
+		std::string path;
+		std::string name;
+		int depth = 0;
+		GLuint begin = 0, end = 0;
+		double cpuBegin = 0.0, cpuEnd = 0.0;
+	};
+
+	struct QuerySet {
+		std::vector<Marker> markers;
+		std::vector<GLuint> queries;
+		size_t used = 0;
+		bool pending = false;
+		uint64_t frame = 0;
+	};
+
+	struct Timing {
+		std::string path;
+		std::string name;
+		int depth = 0;
+		std::vector<float> gpu;
+		std::vector<float> cpu;
+		// Summed over every time the stage ran in the frame being read back
+		float frameGPU = 0.f, frameCPU = 0.f;
+		bool seen = false;
+	};
+
+	QuerySet sets[FrameLatency];
+	int current = 0;
+	uint64_t frame = 0;
+	bool frameActive = false;
+	std::vector<size_t> stack;
+
+	std::vector<Timing> timings;
+	size_t droppedFrames = 0;
+
+	std::vector<std::pair<uint64_t, std::vector<StageTime>>> resolved;
+
+	GLuint nextQuery(QuerySet& set);
+	void resolve(QuerySet& set);
+	Timing& getTiming(const Marker& marker);
+
+	GPUProfiler() { }
+};
+
+// Times the enclosing block as a GPUProfiler stage
+struct GPUScope {
+	GPUScope(const std::string& name) { GPUProfiler::get().push(name); }
+	~GPUScope() { GPUProfiler::get().pop(); }
+};
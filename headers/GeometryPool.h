@@ -0,0 +1,67 @@
+#pragma once
+
+#include "globals.h"
+#include "Buffer.h"
+#include "Meshing.h"
+
+// Where a mesh's vertices and indices live inside GeometryPool. Indices are relative to
+// the mesh's first vertex, so baseVertex is added when drawing.
+struct GeometrySlice {
+	int page = -1;
+	GLuint firstIndex = 0;
+	GLuint indexCount = 0;
+	GLint baseVertex = 0;
+	GLuint vertexCount = 0;
+
+	bool valid() const { return page >= 0; }
+};
+
+// Static geometry suballocated from a few large vertex and index buffers that all share
+// the PlainOldVertex format, so anything in the same page can be drawn by one
+// glMultiDrawElementsIndirect call without changing the vertex array.
+//
+// Each page has one vertex array with the vertex format on attributes 0-3, and a per
+// instance draw id on attribute 4 read from the buffer given to setDrawIDBuffer.
+// Allocations are never freed; static meshes live as long as the program.
+class GeometryPool {
+public:
+	static GeometryPool& get();
+
+	// Size of a new page, unless a single mesh needs more than this
+	GLuint pageVertices = 1 << 18;
+	GLuint pageIndices = 1 << 20;
+
+	struct Page {
+		GLuint vao = 0;
+		spBuffer vertices;
+		spBuffer indices;
+		GLuint vertexCount = 0;
+		GLuint indexCount = 0;
+		GLuint vertexCapacity = 0;
+		GLuint indexCapacity = 0;
+	};
+
+	// Copies the mesh into the first page with room for it. Returns an invalid slice for
+	// empty meshes.
+	GeometrySlice allocate(const PlainOldVertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount);
+	GeometrySlice allocate(const std::vector<PlainOldVertex>& vertices, const std::vector<GLuint>& indices) {
+		return allocate(vertices.data(), vertices.size(), indices.data(), indices.size());
+	}
+
+	// Uses buffer (one GLuint per draw) for attribute 4 in every page, now and later
+	void setDrawIDBuffer(GLuint buffer);
+
+	const Page& getPage(int page) const { return pages[page]; }
+	size_t getPageCount() const { return pages.size(); }
+
+	void renderUI();
+
+protected:
+	std::vector<Page> pages;
+	GLuint drawIDBuffer = 0;
+
+	int createPage(GLuint vertexCapacity, GLuint indexCapacity);
+	void bindDrawIDs(const Page& page);
+
+	GeometryPool() { }
+};
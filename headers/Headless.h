@@ -0,0 +1,68 @@
+#pragma once
+
+#include "globals.h"
+
+// Runs the application without a visible window for a fixed number of frames.
+//
+// Started with --headless. Time is stepped by a fixed dt each frame, so getTime() and
+// Application::deltaTime are the same every run. The gbuffer's color, object index and
+// primitive index are written out as PNGs, and a JSON report records wall clock and GPU
+// stage timings for every frame, for performance runs and golden image comparisons.
+//
+// Options:
+//   --headless           enable
+//   --frames N           frames to run (120)
+//   --dt SECONDS         simulated time per frame (1/60)
+//   --size WxH           window and gbuffer resolution (1280x720)
+//   --out DIR            where images and timings.json go (headless)
+//   --dump-every N       dump images every N frames, 0 for only the last frame (0)
+//   --software           draw with SoftwareRenderer, read by main
+//   --no-shader-cache    compile every shader program from source, read by main
+class Headless {
+public:
+	static Headless& get();
+
+	bool enabled = false;
+	int frames = 120;
+	double dt = 1.0 / 60.0;
+	ivec2 size = ivec2(1280, 720);
+	std::string outputDir = "headless";
+	int dumpEvery = 0;
+
+	// Frames finished so far
+	int frame = 0;
+
+	// Picks out the options above. Returns false and logs if one is malformed.
+	bool parseArgs(int argc, char** argv);
+
+	// After the application has initialized: hides the UI and turns off vsync
+	void init();
+
+	// Steps the clock. Call before Application::update.
+	void beginFrame();
+	// Records the frame's timing and dumps images if due. Call after Application::render.
+	void endFrame();
+
+	bool done() const { return frame >= frames; }
+
+	// Collects the last GPU timings and writes timings.json
+	void finish();
+
+	// The stepped clock, what getTime() returns while enabled
+	double clock = 0.0;
+
+protected:
+	struct FrameTiming {
+		double update = 0.0, render = 0.0, total = 0.0;
+		std::vector<std::pair<std::string, float>> gpu, cpu;
+	};
+
+	std::vector<FrameTiming> timings;
+	std::vector<std::string> dumped;
+	_time frameStart;
+
+	void collectGPUTimes();
+	void dumpImages();
+
+	Headless() { }
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "globals.h"
+#include "Buffer.h"
+#include "GeometryPool.h"
+#include "Lighting.h"
+#include "StreamBuffer.h"
+
+class Shader;
+struct AnimationObject;
+
+// Command layout glMultiDrawElementsIndirect reads from the draw indirect buffer
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Face culling a draw asks for. Default keeps the culling the pass had when submit() started.
+MAKE_ENUM(IndirectCull, int, Default, None, Back, Front);
+
+// Fragment shader a draw is shaded with: staticmesh.frag, or gltfmesh.frag to match
+// GLTFRenderer's own draws
+MAKE_ENUM(IndirectShading, int, StaticMesh, GLTF);
+
+// Texture and sampler state for one indirect draw
+struct IndirectTexture {
+	GLuint id = 0;
+	// Drawn with a sampler object for these parameters when true, otherwise with the texture's own
+	bool setParameters = false;
+	GLint magFilter = GL_LINEAR;
+	GLint minFilter = GL_LINEAR;
+	GLint wrapS = GL_REPEAT;
+	GLint wrapT = GL_REPEAT;
+};
+
+// Draws the opaque pass out of GeometryPool with a few glMultiDrawElementsIndirect calls.
+//
+// Draws are queued between begin() and submit(). submit() sorts them by the state one
+// multi-draw can't vary per draw (shading, pool page, texture, face culling, fragment transform),
+// writes every draw's DrawData and command straight into stream buffers, then issues one
+// multi-draw per run of equal state.
+//
+// Shaders find their DrawData through a per instance draw id attribute: each command
+// draws one instance with baseInstance set to the draw's index, and the draw id buffer
+// just holds 0, 1, 2, ... This only needs GL 4.3, so it runs on Mesa's llvmpipe without
+// ARB_shader_draw_parameters or bindless textures.
+class IndirectRenderer {
+public:
+	static IndirectRenderer& get();
+
+	bool enabled = true;
+
+	struct Stats {
+		size_t draws = 0;
+		size_t multiDraws = 0;
+	} stats;
+
+	// Whether the context has multi-draw indirect and storage buffers
+	static bool isSupported();
+
+	// Supported, enabled and the shaders built
+	bool isAvailable();
+
+	void begin(bool isShadow);
+
+	// Queues an object's shape or mesh, copying it into the pool the first time
+	void add(const AnimationObject& shape);
+
+	// Queues a pooled slice with its own per-draw data
+	void add(const GeometrySlice& slice, const GPU::DrawData& data, const IndirectTexture& texture = IndirectTexture(),
+		IndirectCull cull = IndirectCull::Default, bool fragmentTransform = false, IndirectShading shading = IndirectShading::StaticMesh);
+
+	void submit();
+
+	// Rebuilds the shaders the next time the renderer is used
+	void reloadShaders() { initialized = false; }
+
+	void renderUI();
+
+protected:
+	struct Draw {
+		uint64_t key;
+		GeometrySlice slice;
+		GPU::DrawData data;
+		IndirectTexture texture;
+		IndirectCull cull = IndirectCull::Default;
+		bool fragmentTransform = false;
+		IndirectShading shading = IndirectShading::StaticMesh;
+	};
+
+	bool initialized = false;
+	bool isShadow = false;
+
+	// Face culling when submit() started, put back for Default draws and afterwards
+	bool passCulling = true;
+	GLenum passCullFace = GL_BACK;
+
+	s_ptr<Shader> shader;
+	s_ptr<Shader> gltfShader;
+	s_ptr<Shader> shadowShader;
+
+	u_ptr<StreamBuffer> drawStream;
+	u_ptr<StreamBuffer> commandStream;
+	spBuffer drawIDs;
+	GLuint drawIDCapacity = 0;
+
+	std::vector<Draw> draws;
+	std::vector<uint32_t> order;
+
+	bool init();
+	void reserveDrawIDs(size_t count);
+	void startProgram(const s_ptr<Shader>& program);
+	void applyState(const Draw& draw, const s_ptr<Shader>& program);
+
+	IndirectRenderer() { }
+};
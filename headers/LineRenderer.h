@@ -6,7 +6,15 @@
 #include "Shader.h"
 #include "Uniform.h"
 
-
+class StreamBuffer;
+
+// One segment as the vertex shader reads it
+struct LineInstance {
+	// xyz: first endpoint, w: width
+	vec4 start;
+	vec4 end;
+	vec4 color;
+};
 
 struct LineRenderData {
 
@@ -22,12 +30,29 @@ struct LineRenderData {
 };
 
 
+// Draws camera-facing line segments. Segments added between begin() and end() are queued,
+// streamed into one buffer at end() and drawn with a single instanced call, each instance a
+// quad the vertex shader widens sideways to the camera.
 class LineRenderer
 {
 	s_ptr<LineRenderData> renderData;
+	u_ptr<StreamBuffer> stream;
+	std::vector<LineInstance> segments;
+	bool batching = false;
 public:
 	static LineRenderer& get();
 
+	// Where the instance attributes read from, moved to each batch's range before it draws
+	GLintptr currentOffset = 0;
+
+	struct Stats {
+		size_t segments = 0;
+		size_t draws = 0;
+	};
+
+	// Counts for the current frame so far, and the whole of the frame before it
+	Stats frameStats, lastFrameStats;
+
 	UniformMap uniforms;
 
 	bool initialized = false;
@@ -38,14 +63,22 @@ public:
 	bool init();
 
 	void begin();
+	// Draws one segment right away, for code outside a batch
 	void render(const vec3& p1, const vec3& p2, const vec4& color = vec4(1.0f), float width = 0.1f);
+	// Queues a segment for end()
 	void renderSingle(const vec3& p1, const vec3& p2, const vec4& color = vec4(1.0f), float width = 0.1f);
 	void end();
 
+	StreamBuffer& getStream();
+
 	void renderUI();
 
 private:
 	int wireframeMode = 0;
-	LineRenderer() { }
-	virtual ~LineRenderer() { }
+	unsigned long statsFrame = 0;
+
+	void flush();
+
+	LineRenderer();
+	virtual ~LineRenderer();
 };
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "globals.h"
+#include "Culling.h"
+
+struct AnimationObject;
+
+// Hides objects that large occluders in front of them cover, after frustum culling and
+// before anything is queued for drawing.
+//
+// Occluders are objects marked with AnimationObject::occluder, plus boxes, quads and
+// triangles at least minOccluderSize across. Their triangles are drawn depth only into a
+// small CPU buffer, bands of rows spread over the WorkerPool and four pixels at a time with
+// SSE. The buffer is then reduced into a pyramid holding the farthest depth of each texel's
+// children. Each object still visible has its box projected to the screen and compared
+// against the level where that rectangle spans at most 2x2 texels: if the box's nearest
+// point is behind the farthest occluder depth there, nothing of it can show.
+//
+// Coverage is only counted strictly inside triangle edges, so a pixel an occluder merely
+// touches stays open and the test errs towards drawing.
+class OcclusionCulling {
+public:
+	static OcclusionCulling& get();
+
+	bool enabled = true;
+
+	// Depth buffer resolution, independent of the window
+	ivec2 resolution = ivec2(256, 128);
+
+	// Boxes, quads and triangles whose world bounds are at least this big on some axis occlude
+	float minOccluderSize = 4.f;
+	// Meshes with more triangles are only used if marked as occluders
+	int maxOccluderTriangles = 256;
+
+	struct Stats {
+		size_t occluders = 0;
+		size_t triangles = 0;
+		size_t tested = 0;
+		size_t occluded = 0;
+		double rasterTime = 0.0, pyramidTime = 0.0, testTime = 0.0;
+	} stats;
+
+	// Draws this frame's occluders as seen through viewproj, then hides the objects they cover
+	// from the culling's camera pass. Call after SceneCulling::cull.
+	void cull(const mat4& viewproj, const std::vector<AnimationObject>& objects, SceneCulling& culling);
+
+	// Forgets the last cull, so nothing counts as occluded until the next one
+	void reset() { valid = false; stats = Stats(); }
+
+	// Whether a world space box is hidden behind the occluders from the last cull
+	bool isOccluded(const Bounds& bounds) const;
+
+	void renderUI();
+
+protected:
+	// Screen space triangle: x and y in pixels, z window depth
+	struct Triangle {
+		vec3 v[3];
+		int minY, maxY;
+	};
+
+	mat4 viewproj = mat4(1.f);
+	bool valid = false;
+
+	std::vector<vec4> clipVertices;
+	std::vector<Triangle> triangles;
+
+	// Level 0 is the depth buffer, rows padded to a multiple of four pixels
+	std::vector<std::vector<float>> levels;
+	std::vector<ivec2> levelSizes;
+	int stride = 0;
+
+	std::vector<size_t> candidates;
+	std::vector<uint8_t> hidden;
+
+	// Grayscale copy of the depth buffer for the UI
+	unsigned int debugTexture = 0;
+	bool showDepth = false;
+
+	bool isOccluder(const AnimationObject& shape, const Bounds& bounds, size_t triangleCount) const;
+	void addOccluder(const AnimationObject& shape);
+	void clipAndAdd(const vec4 v[3]);
+	void rasterize();
+	void rasterizeBand(int y0, int y1);
+	void buildPyramid();
+	void updateDebugTexture();
+
+	OcclusionCulling() { }
+};
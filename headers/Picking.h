@@ -0,0 +1,118 @@
+#pragma once
+
+#include "globals.h"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+class Framebuffer;
+
+// Readback copies a few gbuffer pixels into a pixel pack buffer and collects them a frame
+// or two later. RayCast answers on the CPU against Application::objects without touching
+// the GPU; it doesn't see glTF scenes or objects drawn by assignments.
+MAKE_ENUM(PickMethod, int, Readback, RayCast);
+
+struct PickResult {
+	bool valid = false;
+	// AnimationObject::index under the pixel, -1 for nothing
+	int objectIndex = -1;
+	// gbuffer attachments 0 (color) and 1 (object, primitive ids) at the pixel.
+	// Ray casts fill in the object and triangle.
+	vec4 color = vec4(0.f);
+	ivec4 primitive = ivec4(0);
+	// Window pixel the pick was for, origin bottom left
+	ivec2 pixel = ivec2(0);
+	// Frames between the request and the answer
+	int latency = 0;
+	// What Picker::request returned for this pick, and whether it was a click
+	uint64_t id = 0;
+	bool click = false;
+};
+
+// Finds what's under a window pixel without stalling the pipeline.
+//
+// A readback request is copied out of the gbuffer right after the main pass into one of
+// SlotCount pixel pack buffers, with a fence behind it. poll() checks the fences without
+// waiting and hands back the newest finished pick. Only a small square around the pixel
+// is read, so if the pixel itself hit nothing the closest covered pixel in the square is
+// used, which makes thin objects easier to hover.
+class Picker {
+public:
+	static Picker& get();
+
+	static const int SlotCount = 3;
+
+	PickMethod method = PickMethod::Readback;
+
+	// Pixels read on each side of the requested one
+	int radius = 2;
+
+	struct Stats {
+		size_t requests = 0;
+		size_t readbacks = 0;
+		size_t resolved = 0;
+		// Requests replaced by a newer one of the same kind while waiting for a slot
+		size_t superseded = 0;
+		size_t rayCasts = 0;
+		double rayCastTime = 0.0;
+	} stats;
+
+	// Asks what's under a window pixel, origin bottom left, and returns an id for the pick.
+	// Ray casts are answered immediately; readbacks once the renderer has drawn a frame and
+	// the copy has landed. Hover requests replace each other while waiting for a slot;
+	// a click waits in its own place, is read back first and only a newer click replaces it.
+	uint64_t request(ivec2 pixel, ivec2 windowSize, bool click = false);
+
+	// Copies the region for the pending request, called by OpenGLRenderer after the main pass
+	void readback(const Framebuffer& gbuffer);
+
+	// Collects finished readbacks without waiting. Returns true if result() changed.
+	bool poll();
+
+	const PickResult& result() const { return latest; }
+
+	// The newest finished click, kept even when a later hover pick lands first
+	const PickResult& clickResult() const { return latestClick; }
+
+	// Nearest Application::objects triangle through the pixel
+	PickResult rayCast(ivec2 pixel, ivec2 windowSize);
+
+	void renderUI();
+
+protected:
+	struct Request {
+		ivec2 pixel = ivec2(0);
+		ivec2 windowSize = ivec2(1);
+		uint64_t frame = 0;
+		uint64_t id = 0;
+		bool click = false;
+	};
+
+	struct Slot {
+		GLuint pbo = 0;
+		GLsync fence = nullptr;
+		Request request;
+		// Region read, in gbuffer pixels
+		ivec2 origin = ivec2(0);
+		ivec2 size = ivec2(0);
+		// The requested pixel within the region
+		ivec2 center = ivec2(0);
+		uint64_t sequence = 0;
+	};
+
+	Slot slots[SlotCount];
+	bool hasRequest = false, hasClick = false;
+	Request pending, pendingClick;
+	uint64_t requestId = 0;
+	uint64_t frame = 0;
+	uint64_t sequence = 0;
+	uint64_t latestSequence = 0;
+	bool changed = false;
+
+	PickResult latest, latestClick;
+
+	void startReadback(const Framebuffer& gbuffer, Slot& slot, const Request& request);
+	void resolve(Slot& slot);
+
+	Picker() { }
+};
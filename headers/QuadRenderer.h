@@ -6,6 +6,8 @@
 #include "Shader.h"
 #include "Uniform.h"
 
+class StreamBuffer;
+
 
 
 struct QuadRenderData {
@@ -22,9 +24,52 @@ struct QuadRenderData {
 };
 
 
+MAKE_ENUM(QuadBillboard, int, None, Spherical, Cylindrical);
+
+// One quad as queued with QuadRenderer::add. Corners sit at (+-1, +-1, 1) before scaling, as in
+// the quad shaders, so a z scale of 0 centers the quad on its position.
+struct Quad {
+	vec3 position = vec3(0.f);
+	quaternion rotation = glm::identity<quaternion>();
+	vec3 scale = vec3(1.f);
+	vec4 color = vec4(1.f);
+	// xy: origin, zw: size, in texture coordinates
+	vec4 uvRect = vec4(0.f, 0.f, 1.f, 1.f);
+	// Layer of a GL_TEXTURE_2D_ARRAY texture
+	int layer = 0;
+	// Spherical quads face the camera, cylindrical ones turn about world up towards it.
+	// Either way the rotation then applies in the facing plane.
+	QuadBillboard billboard = QuadBillboard::None;
+};
+
+// One quad as the vertex shader reads it
+struct QuadInstance {
+	// xyz: position, w: QuadBillboard
+	vec4 position;
+	// Quaternion, xyzw
+	vec4 rotation;
+	// xyz: scale, w: texture layer
+	vec4 scale;
+	vec4 color;
+	vec4 uvRect;
+};
+
+// Batches textured, tinted and billboarded quads. Everything added between beginBatch() and
+// endBatch() is queued, sorted by texture, streamed into one buffer and drawn with one
+// instanced call per texture.
 class QuadRenderer
 {
 	s_ptr<QuadRenderData> renderData;
+	u_ptr<StreamBuffer> stream;
+
+	struct Queued {
+		QuadInstance instance;
+		GLuint texture;
+		GLenum target;
+	};
+	std::vector<Queued> queue;
+	std::vector<QuadInstance> sorted;
+
 public:
 	bool readyToRender = false;
 
@@ -37,18 +82,42 @@ public:
 	vec4 globalColor = vec4(1.f);
 	float globalWidth = 0.1f;
 
+	// Where the instance attributes read from, moved to each run's range before it draws
+	GLintptr currentOffset = 0;
+
+	struct Stats {
+		size_t quads = 0;
+		size_t draws = 0;
+	};
+
+	// Counts for the current frame so far, and the whole of the frame before it
+	Stats frameStats, lastFrameStats;
+
 	bool init();
 
+	// textureID is what render() draws with; add() can name its own
 	void beginBatch(bool showBackface = true, unsigned int textureID = 0, bool allowBlend = true);
+	// Queues a quad with the batch's texture. Rotation is in degrees.
 	void render(const vec3& position, const vec3& rotation, const vec3& scale, const vec4& color = vec4(1.0f));
+	// Queues a quad. A texture of 0 draws untextured.
+	void add(const Quad& quad, unsigned int textureID = 0, GLenum target = GL_TEXTURE_2D);
+	// Draws everything queued since beginBatch
 	void endBatch();
 
+	StreamBuffer& getStream();
+
 	void renderUI();
 
 private:
 	int wireframeMode = 0;
-	QuadRenderer() { }
-	virtual ~QuadRenderer() { }
+	GLuint batchTexture = 0;
+	bool batchBlend = true;
+	unsigned long statsFrame = 0;
+
+	void flush();
+
+	QuadRenderer();
+	virtual ~QuadRenderer();
 };
 
 struct InstanceQuadRenderData {
@@ -73,7 +142,9 @@ class InstanceQuadRenderer
 public:
 	bool readyToRender = false;
 
-	spVectorBuffer<ParticleRenderData> currentParticles;
+	// The stream range of the system being drawn
+	GLuint currentBuffer = 0;
+	GLintptr currentOffset = 0;
 	size_t currentParticleCount = 0;
 
 	static InstanceQuadRenderer& get();
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "globals.h"
+
+#include "RenderTargetPool.h"
+
+#include <GL/glew.h>
+
+// A frame declared as passes that read and write textures, then compiled and run.
+//
+// Each frame the renderer calls reset(), imports the targets it owns (shadow map, gbuffer,
+// backbuffer), creates transient textures for everything in between, and adds passes with
+// the resources they read and write. compile() orders the passes so every writer of a
+// resource runs before its readers, culls passes nothing needed reads from (working back
+// from outputs and side effect passes), and places transients in RenderTargetPool textures,
+// acquiring each at its first use in the compiled order and releasing it after its last, so
+// transients whose lifetimes don't overlap share a texture. execute() then runs what's left.
+//
+// The pool keeps textures and their framebuffers between frames, so declaring the same
+// graph again allocates nothing, and a pass switched off just isn't added.
+class RenderGraph {
+public:
+	using Resource = int;
+	static const Resource None = -1;
+
+	using TextureDesc = RenderTargetPool::Desc;
+
+	using ExecuteFunc = std::function<void(RenderGraph&)>;
+
+	// Returned by addPass to declare what the pass touches
+	class PassBuilder {
+	public:
+		PassBuilder& read(Resource resource);
+		PassBuilder& write(Resource resource);
+		// Runs even when nothing reads what it writes, e.g. a readback
+		PassBuilder& sideEffect();
+
+	protected:
+		friend class RenderGraph;
+		PassBuilder(RenderGraph& _graph, size_t _pass) : graph(_graph), pass(_pass) { }
+
+		RenderGraph& graph;
+		size_t pass;
+	};
+
+	struct Stats {
+		size_t passes = 0;
+		size_t culled = 0;
+		size_t transients = 0;
+		// Pool textures the transients were placed in
+		size_t texturesUsed = 0;
+		// Transient memory with aliasing, and what it would be with a texture each
+		size_t bytes = 0;
+		size_t unaliasedBytes = 0;
+		// Seconds spent in compile()
+		double compileTime = 0.0;
+	} stats;
+
+	// Starts declaring a new frame
+	void reset();
+
+	// A texture the graph doesn't own. 0 is the default framebuffer. Outputs keep the passes
+	// writing them alive.
+	Resource importTexture(const std::string& name, GLuint texture, const ivec2& size, bool output = false);
+
+	// A texture that only lives for this frame
+	Resource createTexture(const std::string& name, const TextureDesc& desc);
+
+	// Keeps the passes writing a resource alive
+	void markOutput(Resource resource);
+
+	PassBuilder addPass(const std::string& name, ExecuteFunc execute);
+
+	// Orders and culls the passes and places the transients. Returns false on a cycle.
+	bool compile();
+
+	// Runs the passes compile() kept, in order
+	void execute();
+
+	// For use in a pass
+	GLuint getTexture(Resource resource) const;
+	ivec2 getSize(Resource resource) const;
+	const std::string& getName(Resource resource) const;
+
+	// Framebuffer with these transients attached, color in order then any depth
+	GLuint getFramebuffer(const std::vector<Resource>& attachments);
+
+	// Binds the running pass's written textures as the draw framebuffer and sets the viewport
+	void bindTargets();
+
+	void renderUI();
+
+protected:
+	struct ResourceNode {
+		std::string name;
+		TextureDesc desc;
+		bool imported = false;
+		bool output = false;
+		// Pooled texture for transients, placed by compile()
+		GLuint texture = 0;
+		std::vector<size_t> writers, readers;
+		// Compiled order of first and last use
+		int first = -1, last = -1;
+	};
+
+	struct PassNode {
+		std::string name;
+		ExecuteFunc execute;
+		std::vector<Resource> reads, writes;
+		bool sideEffect = false;
+		bool culled = false;
+	};
+
+	std::vector<ResourceNode> resources;
+	std::vector<PassNode> passes;
+	std::vector<size_t> order;
+
+	int currentPass = -1;
+	bool compiled = false;
+
+	bool sortPasses();
+	void cullPasses();
+	void placeTransients();
+};
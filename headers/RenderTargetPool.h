@@ -0,0 +1,100 @@
+#pragma once
+
+#include "globals.h"
+
+#include <GL/glew.h>
+
+// Render target textures and framebuffers shared by everything that needs a target for a
+// while, keyed by size, format and sample count.
+//
+// acquire() hands out a free texture with a matching description or makes one, and
+// release() puts it back for the next acquire, this frame or a later one. Framebuffers over
+// pooled textures are cached by their attachments. A texture nobody has acquired for
+// keepFrames frames is evicted: it and its framebuffers go behind a fence and are only
+// deleted once the GPU has passed it, so work still queued on them isn't waited on.
+class RenderTargetPool {
+public:
+	static RenderTargetPool& get();
+
+	struct Desc {
+		ivec2 size = ivec2(0);
+		GLenum internalFormat = GL_RGBA8;
+		GLenum format = GL_RGBA;
+		GLenum type = GL_UNSIGNED_BYTE;
+		int samples = 1;
+
+		// Same format a Framebuffer uses for this mode
+		static Desc fromMode(GBufferMode mode, const ivec2& size, int samples = 1);
+
+		bool operator==(const Desc& other) const {
+			return size == other.size && internalFormat == other.internalFormat && format == other.format
+				&& type == other.type && samples == other.samples;
+		}
+
+		bool isDepth() const { return format == GL_DEPTH_COMPONENT || format == GL_DEPTH_STENCIL; }
+		GLenum target() const { return samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D; }
+		size_t bytes() const;
+	};
+
+	struct Stats {
+		size_t textures = 0;
+		size_t inUse = 0;
+		size_t framebuffers = 0;
+		size_t bytes = 0;
+		size_t bytesInUse = 0;
+		// Waiting on their fence
+		size_t pendingDeletes = 0;
+		// Totals since startup
+		size_t created = 0;
+		size_t reused = 0;
+		size_t evicted = 0;
+	} stats;
+
+	// Frames a texture is kept without being acquired
+	int keepFrames = 120;
+
+	// A texture matching desc, until release
+	GLuint acquire(const Desc& desc);
+
+	// Hands a texture from acquire back
+	void release(GLuint texture);
+
+	// Framebuffer with these pooled textures attached, colors in order then depth if not 0
+	GLuint getFramebuffer(const std::vector<GLuint>& colors, GLuint depth = 0);
+
+	const Desc* describe(GLuint texture) const;
+
+	// Evicts stale textures and deletes the ones the GPU is done with. Once per frame.
+	void endFrame();
+
+	void renderUI();
+
+protected:
+	struct Entry {
+		Desc desc;
+		GLuint texture = 0;
+		bool inUse = false;
+		int lastUsedFrame = 0;
+		uint64_t memoryHandle = 0;
+	};
+
+	struct PendingDelete {
+		GLsync fence = 0;
+		std::vector<GLuint> textures;
+		std::vector<GLuint> framebuffers;
+		// Counted until actually deleted
+		std::vector<uint64_t> memoryHandles;
+	};
+
+	std::vector<Entry> entries;
+	std::map<std::vector<GLuint>, GLuint> framebuffers;
+	std::vector<PendingDelete> pending;
+
+	int frame = 0;
+
+	Entry* find(GLuint texture);
+	void deletePending();
+	void updateStats();
+
+	RenderTargetPool() { }
+};
@@ -1,9 +1,13 @@
 #pragma once
 
 #include "Camera.h"
+#include "SoftwareRasterizer.h"
 
 class Application;
+class FullscreenFilter;
+class RenderGraph;
 class Texture;
+struct GLTFData;
 
 class Renderer
 {
@@ -46,56 +50,98 @@ class Renderer
 		static std::string shaderVersion;
 };
 
-//class SoftwareRenderer : public Renderer {
-//	public:
-//		struct Settings;
-//		s_ptr<Settings> settings;
-//
-//		s_ptr<Framebuffer> gbuffer;
-//
-//		bool refresh = true;
-//
-//		virtual void initImGui();
-//
-//		virtual void init();
-//
-//		virtual void ImGuiNewFrame();
-//
-//		virtual double Render(Application&);
-//
-//		virtual void endRender();
-//
-//		virtual void renderUI();
-//
-//		virtual void presentUI();
-//
-//		virtual ~SoftwareRenderer();
-//
-//		static bool readyToRock;
-//		static SoftwareRenderer* instance;
-//		
-//};
+// Draws the scene's shapes, meshes and glTF primitives with SoftwareRasterizer and
+// uploads the result into the gbuffer for display. Started with --software.
+class SoftwareRenderer : public Renderer {
+	public:
+		struct Settings;
+		s_ptr<Settings> settings;
+
+		// Color in attachment 0 and (object, 0, primitive, 1) in attachment 1, like OpenGLRenderer's
+		s_ptr<Framebuffer> gbuffer;
+
+		SoftwareRasterizer rasterizer;
+
+		bool refresh = true;
+
+		virtual void initImGui();
+
+		virtual void init();
+
+		virtual void ImGuiNewFrame();
+
+		virtual double Render(Application&);
+
+		virtual void endRender();
+
+		virtual void renderUI();
+
+		virtual void presentUI();
+
+		virtual ~SoftwareRenderer();
+
+		static bool readyToRock;
+		static SoftwareRenderer* instance;
+
+	protected:
+		// Triangles of one glTF primitive, converted once per file
+		struct MeshCopy {
+			std::vector<PlainOldVertex> vertices;
+			std::vector<uint32_t> indices;
+			int material = -1;
+		};
+
+		s_ptr<GLTFData> copiedGLTF;
+		// Key: mesh index
+		std::map<uint32_t, std::vector<MeshCopy>> gltfMeshes;
+
+		std::vector<vec4> idPixels;
+
+		void submitScene(Application& application);
+		void upload();
+};
 
 class OpenGLRenderer : public Renderer {
 public:
 	struct Settings;
 	s_ptr<Settings> settings;
 
-	s_ptr<Framebuffer> gbuffer, input, output;
+	s_ptr<Framebuffer> gbuffer;
 
 	s_ptr<Framebuffer> shadowMap;
 	bool useShadow = true;
 
+	// Static casters only, kept between frames and copied into shadowMap under the dynamic ones.
+	// Made the first time ShadowCascades::cacheStatic is on and dropped when it's turned off.
+	s_ptr<Framebuffer> staticShadowMap;
+
 	s_ptr<Framebuffer> dummyInput;
 
+	// Rebuilt each frame: shadow, main pass, enabled filters, present
+	s_ptr<RenderGraph> renderGraph;
+
+	// Post-processing run in order on the main pass color, through transient targets
+	std::vector<s_ptr<FullscreenFilter>> filters;
+
+	// Adds a filter from shaders/, e.g. "filters/postprocessingtest1.frag", at position or the end
+	s_ptr<FullscreenFilter> addFilter(const std::string& fragPath, bool enabled = true, int position = -1);
+
 	std::map<unsigned int, s_ptr<Texture>> textures;
 
 	bool refresh = true;
 
+	// Window size as of the last size event, and rendered frames since it changed
+	ivec2 settlingResolution = ivec2(0);
+	int framesSinceResize = 0;
+
 	virtual void initImGui();
 
 	virtual void init();
 
+	// Builds the programs the renderers use up front, overlapping their compiles, so the
+	// first frame doesn't build them one at a time
+	void prewarmShaders();
+
 	virtual void ImGuiNewFrame();
 
 	virtual double Render(Application&);
@@ -104,6 +150,10 @@ public:
 
 	double renderScene(const mat4& projection, const mat4& view, s_ptr<Framebuffer> framebuffer = nullptr);
 
+	// Draws the ShadowCascades views into shadowMap, redrawing static casters only where
+	// their cached copy went stale
+	void renderShadows();
+
 	virtual void renderUI();
 
 	virtual void presentUI();
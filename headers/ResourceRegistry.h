@@ -0,0 +1,77 @@
+#pragma once
+
+#include "globals.h"
+
+#include <GL/glew.h>
+
+MAKE_ENUM(ResourceCategory, int, Buffer, StreamBuffer, Texture, Framebuffer, RenderTarget, GLTF);
+
+// GPU and CPU memory held by the renderer's resources, by category.
+//
+// Resource classes add() themselves when they allocate, with their GPU bytes (size times
+// texel or element size; drivers pad, so real use is a little higher) and any CPU copy they
+// keep, update() when that changes and remove() when freed. Each add records the file and
+// line it was called from. Buffers pass on their own caller's, so the UI shows which call
+// sites hold the memory. Totals are sampled once a frame into a timeline, with a high-water
+// mark per category. Going over budgetMB of GPU memory logs a warning once and shows the
+// total in red until it drops back under.
+class ResourceRegistry {
+public:
+	static ResourceRegistry& get();
+
+	using Handle = uint64_t;
+
+	static const size_t HistoryLength = 240;
+
+	// GPU budget in MB, 0 for none. Set with --memory-budget.
+	int budgetMB = 0;
+
+	struct Totals {
+		size_t count = 0;
+		size_t gpu = 0, cpu = 0;
+		size_t peakGPU = 0, peakCPU = 0;
+	};
+
+	Handle add(ResourceCategory category, const std::string& name, size_t gpuBytes, size_t cpuBytes = 0,
+		const char* file = __builtin_FILE(), int line = __builtin_LINE());
+
+	void update(Handle handle, size_t gpuBytes, size_t cpuBytes);
+
+	// 0 is ignored, so owners can remove unconditionally
+	void remove(Handle handle);
+
+	const Totals& totals(ResourceCategory category) const { return categories[category._to_index()]; }
+	const Totals& total() const { return all; }
+
+	// Bytes per texel of a sized or unsized internal format
+	static size_t texelSize(GLenum internalFormat);
+
+	// Samples the timeline and checks the budget. Once per frame.
+	void endFrame();
+
+	void renderUI();
+
+protected:
+	struct Entry {
+		ResourceCategory category = ResourceCategory::Buffer;
+		std::string name;
+		std::string site;
+		size_t gpu = 0, cpu = 0;
+	};
+
+	std::unordered_map<Handle, Entry> entries;
+	Handle next = 1;
+
+	Totals categories[ResourceCategory::_size()];
+	Totals all;
+
+	// MB per frame, per category and in total
+	std::vector<float> history[ResourceCategory::_size()];
+	std::vector<float> totalHistory;
+
+	bool overBudget = false;
+
+	void adjust(const Entry& entry, int64_t gpu, int64_t cpu);
+
+	ResourceRegistry() { }
+};
@@ -0,0 +1,196 @@
+#pragma once
+
+#include "globals.h"
+#include "AnimationObject.h"
+
+// Versioned binary scene format used by the labs for fast save/load. JSON stays
+// available as the interchange format; this is the one to use for large scenes.
+//
+// Layout (little-endian):
+//		Header: magic "4480SCN\0", uint32 version, uint32 chunk count
+//		Chunks: uint32 fourcc, uint32 chunk version, uint64 payload size, payload
+//
+// Chunks are read one at a time straight into preallocated record arrays, so loading
+// never builds a document tree. Unknown chunks are skipped, which lets newer files
+// carry extra data without breaking older readers.
+namespace SceneFile
+{
+	constexpr uint32_t Version = 1;
+
+	constexpr uint32_t makeFourCC(char a, char b, char c, char d) {
+		return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+	}
+
+	constexpr uint32_t ConfigChunk = makeFourCC('C', 'O', 'N', 'F');
+	constexpr uint32_t AssetChunk = makeFourCC('A', 'S', 'S', 'T');
+	constexpr uint32_t ObjectChunk = makeFourCC('O', 'B', 'J', 'S');
+	constexpr uint32_t HierarchyChunk = makeFourCC('H', 'I', 'E', 'R');
+	constexpr uint32_t TrackChunk = makeFourCC('T', 'R', 'A', 'K');
+
+	struct Config {
+		std::string name;
+		int32_t numFrames = 0;
+		int32_t fps = 24;
+	};
+
+	// One interpolation track. Objects are referenced by their slot in the object array,
+	// so nothing has to be searched for when the file is loaded.
+	struct Track {
+		int32_t objectSlot = -1;
+		int32_t target = 0;
+		int32_t easing = 0;
+		int32_t startFrame = 0;
+		float startValue = 0.f;
+		int32_t endFrame = 0;
+		float endValue = 0.f;
+	};
+
+	struct Stats {
+		size_t bytes = 0;
+		size_t objects = 0;
+		size_t tracks = 0;
+		double seconds = 0.0;
+	};
+
+	// Returns true if the filename should go through the binary path rather than JSON
+	bool isSceneFile(const std::string& filename);
+
+	bool save(const std::string& filename, const Config& config, const std::vector<AnimationObject>& objects,
+		const std::vector<Track>& tracks, Stats* stats = nullptr);
+
+	// Replaces the contents of objects and tracks. Parent pointers are resolved by slot, so
+	// the caller must not reallocate objects before they are used. Fails without touching
+	// objects if a record has a shape type or axis this build doesn't know.
+	bool load(const std::string& filename, Config& config, std::vector<AnimationObject>& objects,
+		std::vector<Track>& tracks, Stats* stats = nullptr);
+
+	// The JSON document the labs export: config, objects, and interpolations as the lab writes them
+	bool saveJSON(const std::string& filename, const Config& config, const std::vector<AnimationObject>& objects,
+		const json& interpolations);
+
+	// Replaces objects and links their parents. Config fields missing from the file keep
+	// the values passed in.
+	bool loadJSON(const std::string& filename, Config& config, std::vector<AnimationObject>& objects,
+		json& interpolations);
+
+	// Save and load for the keyframe labs, which keep their interpolation commands per object
+	// index. A Command has start and end keyframes (frame, value), easing and target enums,
+	// and objectId, with to_json and from_json next to it.
+	template <typename Command>
+	bool saveLabJSON(const std::string& filename, const Config& config, const std::vector<AnimationObject>& objects,
+		const std::map<int, std::vector<Command>>& commands) {
+		json interpolations = json::array();
+		for (const auto& objectCommands : commands) {
+			for (const auto& command : objectCommands.second) {
+				interpolations.push_back(command);
+			}
+		}
+		return saveJSON(filename, config, objects, interpolations);
+	}
+
+	// Filenames with .json go through the JSON path, everything else through the binary one
+	template <typename Command>
+	bool saveLab(const std::string& filename, const Config& config, const std::vector<AnimationObject>& objects,
+		const std::map<int, std::vector<Command>>& commands) {
+		if (!isSceneFile(filename)) {
+			return saveLabJSON(filename, config, objects, commands);
+		}
+
+		// Tracks reference objects by slot rather than by index
+		std::unordered_map<int, int> slots;
+		for (int i = 0; i < (int)objects.size(); i++) {
+			slots[objects[i].index] = i;
+		}
+
+		std::vector<Track> tracks;
+		for (const auto& objectCommands : commands) {
+			auto slot = slots.find(objectCommands.first);
+			if (slot == slots.end()) continue;
+
+			for (const auto& command : objectCommands.second) {
+				Track track;
+				track.objectSlot = slot->second;
+				track.target = command.target._to_integral();
+				track.easing = command.easing._to_integral();
+				track.startFrame = command.start.frame;
+				track.startValue = command.start.value;
+				track.endFrame = command.end.frame;
+				track.endValue = command.end.value;
+				tracks.push_back(track);
+			}
+		}
+
+		Stats stats;
+		if (!save(filename, config, objects, tracks, &stats)) return false;
+
+		log("Saved {0} objects, {1} tracks ({2} bytes) in {3:.3f} ms\n", stats.objects, stats.tracks, stats.bytes, stats.seconds * 1000.0);
+		return true;
+	}
+
+	// Replaces objects and commands. add hands a loaded command to its object, so the lab
+	// can point it at the value it drives. Commands the lab can't represent are logged and
+	// skipped.
+	template <typename Command>
+	bool loadLab(const std::string& filename, Config& config, std::vector<AnimationObject>& objects,
+		std::map<int, std::vector<Command>>& commands, const std::function<void(AnimationObject&, Command)>& add) {
+		using Easing = decltype(Command::easing);
+		using Target = decltype(Command::target);
+
+		if (!isSceneFile(filename)) {
+			json interpolations;
+			if (!loadJSON(filename, config, objects, interpolations)) return false;
+
+			std::unordered_map<int, int> slots;
+			for (int i = 0; i < (int)objects.size(); i++) {
+				slots[objects[i].index] = i;
+			}
+
+			commands.clear();
+			for (auto& interp : interpolations) {
+				Command command;
+				try {
+					command = interp;
+				}
+				catch (const std::exception& e) {
+					log("{0}: skipping interpolation in {1}: {2}\n", __FUNCTION__, filename, e.what());
+					continue;
+				}
+
+				auto slot = slots.find(command.objectId);
+				if (slot != slots.end()) {
+					add(objects[slot->second], command);
+				}
+			}
+			return true;
+		}
+
+		std::vector<Track> tracks;
+		Stats stats;
+		if (!load(filename, config, objects, tracks, &stats)) return false;
+
+		commands.clear();
+		for (const auto& track : tracks) {
+			auto easing = Easing::_from_integral_nothrow(track.easing);
+			auto target = Target::_from_integral_nothrow(track.target);
+			if (!easing || !target) {
+				log("{0}: skipping track with unknown easing {1} or target {2} in {3}\n", __FUNCTION__, track.easing, track.target, filename);
+				continue;
+			}
+
+			Command command;
+			command.start.frame = track.startFrame;
+			command.start.value = track.startValue;
+			command.end.frame = track.endFrame;
+			command.end.value = track.endValue;
+			command.easing = *easing;
+			command.target = *target;
+
+			auto& object = objects[track.objectSlot];
+			command.objectId = object.index;
+			add(object, command);
+		}
+
+		log("Loaded {0} objects, {1} tracks ({2} bytes) in {3:.3f} ms\n", stats.objects, stats.tracks, stats.bytes, stats.seconds * 1000.0);
+		return true;
+	}
+}
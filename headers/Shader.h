@@ -2,6 +2,7 @@
 
 #include "globals.h"
 
+#include "GLStateCache.h"
 #include "StringUtil.h"
 
 #include <GL/glew.h>
@@ -46,7 +47,12 @@ public:
 		GLshader(ShaderType _type, const std::string& _text)
 			: type(_type), text(_text) { }
 
-		bool compile();
+		// Hands the source to the driver without waiting for the result
+		void beginCompile();
+		// Waits for the compile and logs any errors
+		bool finishCompile();
+
+		bool compile() { beginCompile(); return finishCompile(); }
 	};
 
 	// Parameter is the uniform/attribute location for the shader program.
@@ -205,9 +211,46 @@ public:
 		}
 	};
 
+	// FNV-1a, usable at compile time so literal uniform names are hashed by the compiler
+	static constexpr uint32_t HashName(const char* name, uint32_t hash = 2166136261u)
+	{
+		return *name == 0 ? hash : HashName(name + 1, (hash ^ (uint32_t)(uint8_t)*name) * 16777619u);
+	}
+
+	// A uniform name with its hash, made implicitly from a string
+	struct UniformName
+	{
+		const char* name;
+		uint32_t hash;
+
+		constexpr UniformName(const char* _name) : name(_name), hash(HashName(_name)) { }
+		UniformName(const std::string& _name) : name(_name.c_str()), hash(HashName(_name.c_str())) { }
+	};
+
+	// An active uniform as reported by glGetActiveUniform after linking
+	struct UniformInfo
+	{
+		std::string name;
+		GLint location = -1;
+		GLenum type = 0;
+		GLint size = 0;
+	};
+
+	// Uniform block names and the binding points every program gets them on, so shared
+	// buffers are bound once rather than per program
+	static const std::map<std::string, GLuint> UniformBlockBindings;
+
+	// Sampler uniforms set to a fixed texture unit when a program links, for textures bound
+	// once per pass rather than per draw
+	static const std::map<std::string, GLint> SamplerBindings;
+
 	// Shader program
 	GLuint program = 0;
 
+	// Active uniforms by hashed name, filled in after linking. Array uniforms are listed
+	// under both "name" and "name[0]".
+	std::unordered_map<uint32_t, UniformInfo> uniformTable;
+
 	// Link log
 	std::string linkLog;
 
@@ -218,6 +261,9 @@ public:
 	// List of transform feedback parameters
 	glsl_list xfbParams;
 
+	// Vertex attributes bound to locations 0, 1, 2... in this order before linking
+	string_vector attributeLocations;
+
 	// Conveniences flags for checking presence
 	struct
 	{
@@ -257,7 +303,21 @@ public:
 	}
 
 	// Initializes the shader by creating the program, compiling and attaching source, and linking
-	bool init(bool recompile = false, std::vector<ShaderFragOutputBindings> fragBindings = {});
+	bool init(bool recompile = false, std::vector<ShaderFragOutputBindings> fragBindings = {})
+	{
+		return beginInit(recompile, fragBindings) && finishInit();
+	}
+
+	// init() in two halves. beginInit loads the program from ShaderCache, or starts its
+	// compile and link without waiting on them; finishInit waits, checks and reflects. Other
+	// programs can be started in between so their compiles overlap.
+	bool beginInit(bool recompile = false, const std::vector<ShaderFragOutputBindings>& fragBindings = {});
+	bool finishInit();
+
+	// Whether the last init loaded a cached binary
+	bool fromCache = false;
+	// ShaderCache key of the last init
+	uint64_t cacheKey = 0;
 
 	// Binds the shader given the provided uniform and attribute binding details
 	void bind(const Binding& _binding, bool purgeBad = true);
@@ -266,17 +326,40 @@ public:
 	{
 		if (program != 0)
 		{
-			glUseProgram(program);
+			GLState::useProgram(program);
 		}
 	}
 
 	void stop()
 	{
-		glUseProgram(0);
+		GLState::useProgram(0);
 	}
 
 	bool link();
 
+	// Checks the link status and reflects the program, logging the link log if it failed
+	bool checkLink();
+
+	// Location of a uniform from the reflected table, -1 if it isn't active. Same result as
+	// glGetUniformLocation without the driver call and string compare. Array elements past
+	// the first aren't listed, so those still go to the driver.
+	GLint uniform(UniformName name) const
+	{
+		auto it = uniformTable.find(name.hash);
+		if (it != uniformTable.end() && it->second.name == name.name) return it->second.location;
+		if (std::strchr(name.name, '[') != nullptr) return glGetUniformLocation(program, name.name);
+		return -1;
+	}
+
+	// Fills uniformTable from the linked program
+	void reflectUniforms();
+
+	// Assigns the program's uniform blocks to their UniformBlockBindings binding points
+	void bindUniformBlocks();
+
+	// Points the program's SamplerBindings samplers at their units
+	void bindSamplers();
+
 	void destroy(bool clearGLshaders = true);
 
 	static std::string LoadText(const std::string& src);
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "globals.h"
+
+#include "Shader.h"
+
+// Keeps linked shader programs between runs so startup doesn't recompile them.
+//
+// A program is keyed by a 64 bit FNV-1a hash of its preprocessed stage sources, transform
+// feedback varyings, attribute and fragment output bindings, plus the GL vendor, renderer
+// and version strings, so a driver update or an edited include misses rather than loading
+// a stale binary. Binaries come from glGetProgramBinary after a successful link and are written to
+// shadercache/ under the asset root, one file per key. A binary the driver refuses is
+// deleted and the program compiled from source again.
+//
+// Where KHR_parallel_shader_compile (or the ARB version) is supported the driver is told to
+// use as many compiler threads as it likes. Shader::init then only waits on a program once
+// every stage has been handed over, and prewarm() starts every program the renderers need
+// at startup before waiting on any of them.
+class ShaderCache {
+public:
+	static ShaderCache& get();
+
+	// Off with --no-shader-cache, to time a cold start
+	bool enabled = true;
+
+	// A program prewarm() builds: stage files and how its inputs and outputs are bound
+	struct Program {
+		std::string vertPath, fragPath;
+		std::vector<ShaderFragOutputBindings> fragBindings;
+		string_vector attributeLocations;
+	};
+
+	struct Stats {
+		size_t hits = 0;
+		size_t misses = 0;
+		// Binaries the driver wouldn't take back
+		size_t rejected = 0;
+		size_t stored = 0;
+		// Seconds spent in glProgramBinary, and compiling and linking misses
+		double loadTime = 0.0, compileTime = 0.0;
+	} stats;
+
+	// Reads the driver strings and starts the parallel compiler. Call once the context is current.
+	void init();
+
+	bool parallelCompile() const { return parallel; }
+
+	// Key for a program with these stages and bindings
+	uint64_t key(const Shader& shader, const std::vector<ShaderFragOutputBindings>& fragBindings) const;
+
+	// Loads the binary for key into program. False if there's none or the driver rejects it.
+	bool load(GLuint program, uint64_t key);
+
+	// Saves a linked program's binary under key
+	void store(GLuint program, uint64_t key);
+
+	// Compiles the programs not in the cache all at once, so their compiles overlap, and
+	// stores them. Shader::init on the same sources then hits the cache.
+	void prewarm(const std::vector<Program>& programs);
+
+	// Deletes every cached binary, in memory and on disk
+	void clear();
+
+	void renderUI();
+
+protected:
+	struct Binary {
+		GLenum format = 0;
+		std::vector<uint8_t> data;
+	};
+
+	bool initialized = false;
+	bool supported = false;
+	bool parallel = false;
+	std::string driver;
+	std::string directory;
+
+	// Binaries loaded or stored this run
+	std::unordered_map<uint64_t, Binary> binaries;
+
+	std::string filename(uint64_t key) const;
+	bool read(uint64_t key, Binary& binary) const;
+
+	ShaderCache() { }
+};
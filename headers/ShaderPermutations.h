@@ -0,0 +1,62 @@
+#pragma once
+
+#include "globals.h"
+
+#include "Shader.h"
+
+// Builds variants of one vertex/fragment shader pair with features fixed at compile time.
+//
+// Each feature is a name and a bit. A variant for a set of feature bits gets
+// "#define PERMUTATION" after the #version line, then "#define NAME true" or
+// "#define NAME false" for every feature. Shaders declare a feature as a const bool under
+// PERMUTATION and as the old uniform otherwise, so branches on it fold away in a variant
+// and the unspecialized shader still works as before:
+//
+//   #ifdef PERMUTATION
+//   const bool useTexture = USE_TEXTURE;
+//   #else
+//   uniform bool useTexture = false;
+//   #endif
+//
+// Setting a uniform a variant doesn't have is a no-op (its location is -1), so draw code
+// can keep setting them. Sources are preprocessed once. Variants are built on first use
+// or all together by warmUp(), kept for the life of the set, and go through ShaderCache
+// like any other program. Every variant binds the listed attributes to the same
+// locations, so one VAO works with all of them.
+class ShaderPermutations {
+public:
+	ShaderPermutations(const std::string& vertText, const std::string& fragText, const string_vector& features,
+		const std::vector<ShaderFragOutputBindings>& fragBindings = {}, const string_vector& attributes = {});
+
+	// Bit for a feature name, 0 if there's no such feature
+	uint32_t feature(const std::string& name) const;
+
+	// The variant with exactly these features on, built on first use. Null if it won't build.
+	s_ptr<Shader> get(uint32_t features);
+
+	// Builds the variants in the list that aren't built yet, starting them all before
+	// waiting on any so their compiles overlap
+	void warmUp(const std::vector<uint32_t>& featureSets);
+
+	// Run on each variant once it's built, before it's handed out
+	std::function<void(Shader&)> onBuild;
+
+	size_t size() const { return variants.size(); }
+
+	// Names of the features on in a set, for logs and UI
+	std::string describe(uint32_t features) const;
+
+protected:
+	// Preprocessed once, specialized per variant
+	std::string vertText, fragText;
+	string_vector features;
+	std::vector<ShaderFragOutputBindings> fragBindings;
+	string_vector attributes;
+
+	// Failed variants are kept as null so they aren't retried every draw
+	std::map<uint32_t, s_ptr<Shader>> variants;
+
+	std::string specialize(const std::string& text, uint32_t featureSet) const;
+	s_ptr<Shader> create(uint32_t featureSet) const;
+	void finish(uint32_t featureSet, s_ptr<Shader> shader);
+};
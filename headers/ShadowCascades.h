@@ -0,0 +1,82 @@
+#pragma once
+
+#include "globals.h"
+#include "Lighting.h"
+
+class Camera;
+
+// The views the shadow pass draws, and which of them still have their static casters cached.
+//
+// With an orthographic shadow light the camera's view depth, up to shadowDistance, is split
+// into cascades, closer ones shorter (splitLambda blends even and logarithmic splits). Each
+// cascade gets a light box around the bounding sphere of its slice of the view frustum, so its
+// size doesn't change as the camera turns, drawn into one quadrant of the shadow map. The box
+// reaches casterDistance further back toward the light, and culling casters against it is
+// what keeps objects that can't shade the slice out of the pass. A perspective shadow light,
+// or cascades turned off, draws the whole map from the light camera as before.
+//
+// Static casters (see SceneCulling::isStatic) are drawn into a separate persistent map, once,
+// and copied under the dynamic ones every frame. A view's cached copy goes stale when its
+// matrix changes or SceneCulling::getStaticVersion does. Box centers snap to steps of
+// 1 / cacheSteps of the box's width, with the box padded by a step, so a moving camera only
+// redraws a cascade's static casters when it crosses a step, and in whole texels otherwise.
+class ShadowCascades {
+public:
+	static ShadowCascades& get();
+
+	struct View {
+		mat4 projection = mat4(1.f);
+		mat4 view = mat4(1.f);
+		mat4 viewproj = mat4(1.f);
+		// Shadow map pixels drawn to
+		ivec4 viewport = ivec4(0);
+		// View depth covered, for cascades
+		float splitFar = 0.f;
+		// The static map holds this view's casters
+		bool cached = false;
+	};
+
+	struct Stats {
+		// Views whose static casters were drawn this frame
+		size_t staticRedraws = 0;
+		// Frames the static map was reused without drawing anything into it, in a row
+		size_t cachedFrames = 0;
+		double fitTime = 0.0;
+	} stats;
+
+	bool useCascades = true;
+	int cascadeCount = GPU_SHADOW_MAX_CASCADES;
+	float shadowDistance = 150.0f;
+	float splitLambda = 0.75f;
+	float casterDistance = 50.0f;
+
+	bool cacheStatic = true;
+	int cacheSteps = 16;
+
+	std::vector<View> views;
+
+	// Lays out the views for this frame. lightCamera is the single map's camera, used when
+	// not cascading.
+	void update(const Camera& camera, const Camera& lightCamera, const vec3& lightPosition,
+		const vec3& lightCenter, const vec3& lightUp, ProjectionType lightProjection, const ivec2& mapSize);
+
+	// Whether update() split the map into cascades
+	bool cascading() const { return cascaded; }
+
+	// Drops every cached view, e.g. after the shadow map is reallocated
+	void invalidate();
+
+	// Marks the views just drawn into the static map
+	void markCached();
+
+	// Writes the cascade matrices and splits for the main pass
+	void apply(GPU::FrameData& frame) const;
+
+	void renderUI();
+
+protected:
+	bool cascaded = false;
+	uint64_t staticVersion = (uint64_t)-1;
+
+	ShadowCascades() { }
+};
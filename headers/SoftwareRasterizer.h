@@ -0,0 +1,149 @@
+#pragma once
+
+#include "globals.h"
+#include "Meshing.h"
+
+// Draws triangle meshes on the CPU, without touching GL.
+//
+// Draws are queued with submit() and drawn together by render(), which runs in three
+// stages spread over the WorkerPool threads:
+//
+//  1. Vertices are transformed to clip space, then each triangle is clipped against the near
+//     plane and a guard band, snapped to a 1/16 pixel grid and set up for rasterization.
+//  2. Triangles are binned into TileSize square screen tiles by their bounding boxes.
+//  3. Tiles are rasterized in parallel, each by one thread, so no two threads share a pixel.
+//     A tile walks its triangles in submission order, 8x8 pixel blocks at a time. Blocks
+//     are classified against each edge exactly in 64 bit integers: blocks outside any edge
+//     are skipped, blocks inside all of them need no coverage test, and the rest test
+//     coverage four pixels at a time with SSE2 integer edge functions. Each block keeps the
+//     farthest depth it holds, so a triangle entirely behind a block skips it, and each
+//     tile keeps the farthest of its blocks.
+//
+// Attributes are interpolated perspective correct, depth linearly in screen space. Edges
+// follow the top-left rule, so triangles sharing an edge never both cover a pixel.
+// Rows start at the bottom like GL textures.
+class SoftwareRasterizer {
+public:
+	static const int TileSize = 64;
+	static const int BlockSize = 8;
+
+	struct Draw {
+		// Must stay alive until render() returns
+		const PlainOldVertex* vertices = nullptr;
+		size_t vertexCount = 0;
+		const uint32_t* indices = nullptr;
+		size_t indexCount = 0;
+
+		mat4 model = mat4(1.f);
+		vec4 color = vec4(1.f);
+		// Written to the id buffer, -1 is left for uncovered pixels
+		int objectIndex = 0;
+		// Counter-clockwise faces are front faces, as in GL
+		bool cullBack = true;
+		bool lit = true;
+	};
+
+	struct Stats {
+		size_t draws = 0;
+		size_t triangles = 0;
+		// Dropped by face culling or outside the view
+		size_t culled = 0;
+		// Extra triangles made by clipping
+		size_t clipped = 0;
+		size_t binned = 0;
+		size_t blocksFull = 0, blocksPartial = 0;
+		// Triangle-block pairs skipped because the block was already nearer
+		size_t blocksOccluded = 0;
+		size_t tilesOccluded = 0;
+		double setupTime = 0.0, binTime = 0.0, rasterTime = 0.0;
+		int threads = 1;
+	} stats;
+
+	vec4 clearColor = vec4(0.f, 0.f, 0.f, 1.f);
+	// Direction the light travels, world space
+	vec3 lightDirection = vec3(0.f, -1.f, 0.f);
+	float ambient = 0.2f;
+
+	// Resizes the buffers. Contents are undefined until the next render().
+	void resize(ivec2 size);
+	ivec2 getSize() const { return size; }
+
+	void submit(const Draw& draw);
+
+	// Clears and draws everything submitted since the last call
+	void render(const mat4& viewproj);
+
+	// RGBA8, one uint32_t per pixel
+	const std::vector<uint32_t>& getColor() const { return color; }
+	const std::vector<float>& getDepth() const { return depth; }
+	// Object and primitive index per pixel, (-1, -1) where nothing was drawn
+	const std::vector<ivec2>& getIds() const { return ids; }
+
+	// PNGs, top row first. The id images hold index + 1 across their RGB bytes.
+	bool writeColor(const std::string& filename) const;
+	bool writeIds(const std::string& objectFilename, const std::string& primitiveFilename) const;
+
+	void renderUI();
+
+protected:
+	static const int AttributeCount = 7;
+
+	struct ClipVertex {
+		vec4 position;
+		// World space normal, then color
+		float attributes[AttributeCount];
+	};
+
+	struct Triangle {
+		// Screen position in 1/16 pixels
+		int x[3], y[3];
+		// Window depth, 0 near and 1 far
+		float z[3];
+		float minZ, maxZ;
+		float invW[3];
+		// Attributes over w
+		float attributes[3][AttributeCount];
+		// Pixel bounds, inclusive
+		ivec4 bounds;
+		int objectIndex;
+		int primitive;
+		bool lit;
+	};
+
+	struct Tile {
+		// Farthest depth in each block
+		float blockMaxZ[(TileSize / BlockSize) * (TileSize / BlockSize)];
+		float maxZ;
+	};
+
+	ivec2 size = ivec2(0);
+	ivec2 tileCount = ivec2(0);
+
+	std::vector<uint32_t> color;
+	std::vector<float> depth;
+	std::vector<ivec2> ids;
+	std::vector<Tile> tiles;
+
+	std::vector<Draw> draws;
+	std::vector<ClipVertex> transformed;
+	// First transformed vertex and first triangle of each draw
+	std::vector<size_t> vertexOffsets, triangleOffsets;
+
+	// Triangles are set up and binned in one contiguous chunk per thread, so nothing is
+	// shared. Tiles read the chunks in order, which is submission order.
+	std::vector<std::vector<Triangle>> threadTriangles;
+	// Per chunk, per tile: indices into that chunk's triangles
+	std::vector<std::vector<std::vector<uint32_t>>> threadBins;
+
+	void transformVertices(const mat4& viewproj);
+	void setupTriangles();
+	void binTriangles();
+	void rasterizeTile(int tileIndex, size_t& full, size_t& partial, size_t& occluded, size_t& tilesOccluded);
+
+	void clipAndSetup(ClipVertex v[3], int objectIndex, int primitive, bool cullBack, bool lit, std::vector<Triangle>& out, size_t& culled, size_t& clipped);
+	bool setup(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, int objectIndex, int primitive, bool cullBack, bool lit, Triangle& out);
+
+	// Depth tests and shades the covered pixels of a block. Returns true if any were written.
+	bool shadeBlock(const Triangle& t, ivec2 blockMin, uint64_t coverage, Tile& tile, int blockIndex,
+		const float baryBase[3], const float baryDx[3], const float baryDy[3]);
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "globals.h"
+
+MAKE_ENUM(SplineType, int, CatmullRom, Centripetal, Bezier);
+
+// A piecewise cubic path through (or, for Bezier, controlled by) a list of points, with an
+// arc-length table for constant-speed evaluation.
+//
+// Catmull-Rom and centripetal Catmull-Rom pass through every point. Bezier expects
+// 3n + 1 points: an anchor, two handles, an anchor, and so on.
+//
+// Each segment is stored as polynomial coefficients, and the arc-length table holds the
+// cumulative length at evenly spaced parameter steps. Looking up a distance is a binary
+// search in that table followed by one cubic evaluation. Batch evaluation walks the
+// table instead when distances are given in increasing order.
+class SplinePath {
+public:
+	SplineType type = SplineType::Centripetal;
+	bool closed = false;
+	// Arc-length table resolution. Higher is more accurate for tightly curved segments.
+	int samplesPerSegment = 16;
+
+	SplinePath() { }
+	SplinePath(const std::vector<vec3>& points, SplineType type = SplineType::Centripetal, bool closed = false);
+
+	// Simplifies recorded samples with reduce_RDP before fitting the path through what's left
+	static SplinePath fromSamples(const std::vector<vec3>& samples, float epsilon, SplineType type = SplineType::Centripetal);
+
+	void setPoints(const std::vector<vec3>& points);
+	const std::vector<vec3>& getPoints() const { return points; }
+
+	// Recomputes segment coefficients and the arc-length table. Call after changing type,
+	// closed or samplesPerSegment.
+	void rebuild();
+
+	bool empty() const { return cubics.empty(); }
+	size_t numSegments() const { return cubics.size(); }
+	float length() const { return lengths.empty() ? 0.f : lengths.back(); }
+
+	// Position and derivative by raw parameter, where u is in [0, numSegments()]
+	vec3 positionAtParameter(float u) const;
+	vec3 tangentAtParameter(float u) const;
+
+	// Converts a distance along the path (clamped, or wrapped if closed) to a raw parameter
+	float parameterAtDistance(float distance) const;
+
+	vec3 positionAtDistance(float distance) const;
+	vec3 tangentAtDistance(float distance) const;
+
+	// Position at a fraction of the total length, so t in [0, 1] moves at constant speed
+	vec3 positionAt(float t) const { return positionAtDistance(t * length()); }
+
+	// Evaluates many distances at once. Increasing runs of distances reuse the previous
+	// table position rather than searching again.
+	void evaluate(const float* distances, vec3* positions, size_t count, vec3* tangents = nullptr) const;
+
+	// Evenly spaced points along the path, for drawing it
+	std::vector<vec3> sample(size_t count) const;
+
+protected:
+	// p(t) = a + t * (b + t * (c + t * d)) for t in [0, 1]
+	struct Cubic {
+		vec3 a, b, c, d;
+	};
+
+	std::vector<vec3> points;
+	std::vector<Cubic> cubics;
+	// Cumulative length at parameter i / samplesPerSegment
+	std::vector<float> lengths;
+
+	float wrapDistance(float distance) const;
+	float parameterInStep(size_t step, float distance) const;
+	size_t findStep(float distance) const;
+};
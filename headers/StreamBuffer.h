@@ -0,0 +1,106 @@
+#pragma once
+
+#include "globals.h"
+
+#include "ResourceRegistry.h"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+// A buffer the CPU fills every frame and the GPU reads without either side waiting on the
+// other. The store is split into RegionCount regions, one per frame in flight. Each frame
+// allocates from the next region, and endFrame() puts a fence after the frame's commands
+// so the region isn't written again until the GPU is done reading it.
+//
+// With ARB_buffer_storage the store is mapped once, persistently and coherently, and
+// allocations point straight into it. Without it each allocation maps its own range
+// unsynchronized and commit() unmaps it; the fences still keep regions apart.
+//
+// A frame that outgrows its region gets a store twice the size. The old store is unmapped
+// and replaced as soon as it's outgrown, so a range is only good until the next allocate()
+// from the same stream: write it, commit it and issue the draws that read it first. Draws
+// already issued keep reading the old buffer, which is deleted at endFrame().
+class StreamBuffer {
+public:
+	static const int RegionCount = 3;
+
+	struct Range {
+		// Null if the store couldn't be mapped; there's nothing to write or draw then
+		uint8_t* data = nullptr;
+		GLintptr offset = 0;
+		GLsizeiptr size = 0;
+
+		template <typename T>
+		T* as() const { return reinterpret_cast<T*>(data); }
+	};
+
+	struct Stats {
+		size_t allocations = 0;
+		size_t bytes = 0;
+		// Times a region was still in use by the GPU when the CPU came back to it
+		size_t stalls = 0;
+		double stallTime = 0.0;
+		size_t grows = 0;
+	};
+
+	// alignment is raised to the target's offset alignment for uniform and storage buffers
+	StreamBuffer(const std::string& name, GLenum target, GLsizeiptr regionSize, GLsizeiptr alignment = 16);
+	~StreamBuffer();
+
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	// Space for size bytes in this frame's region. Write it, commit it, then draw from it.
+	Range allocate(GLsizeiptr size);
+
+	template <typename T>
+	Range allocate(size_t count) { return allocate((GLsizeiptr)(sizeof(T) * count)); }
+
+	// Makes the range's writes visible to the GPU
+	void commit(const Range& range);
+
+	GLuint getBuffer() const { return buffer; }
+	GLenum getTarget() const { return target; }
+	const std::string& getName() const { return name; }
+	GLsizeiptr getRegionSize() const { return regionSize; }
+	const Stats& getStats() const { return stats; }
+
+	void bind() const { glBindBuffer(target, buffer); }
+	// glBindBufferRange for uniform and storage buffers
+	void bindRange(GLuint index, const Range& range) const { glBindBufferRange(target, index, buffer, range.offset, range.size); }
+
+	// Fences the regions written this frame and moves every stream buffer to its next region.
+	// Call once per frame after the frame's draws are submitted.
+	static void endFrame();
+
+	// Whether allocations write into a persistently mapped store
+	static bool isPersistent();
+
+	static void renderUI();
+
+protected:
+	std::string name;
+	GLenum target;
+	GLsizeiptr regionSize;
+	GLsizeiptr alignment;
+
+	GLuint buffer = 0;
+	uint8_t* mapped = nullptr;
+	ResourceRegistry::Handle memoryHandle = 0;
+	GLsync fences[RegionCount] = {};
+	int region = 0;
+	GLsizeiptr cursor = 0;
+	bool regionReady = false;
+
+	// Stores replaced this frame, deleted at endFrame
+	std::vector<GLuint> retired;
+
+	Stats stats;
+
+	void createStore();
+	void destroyStore(bool retire);
+	void waitForRegion();
+	void nextRegion();
+
+	static std::vector<StreamBuffer*>& all();
+};
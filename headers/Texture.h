@@ -136,6 +136,9 @@ class Texture {
 		// Memory allocation for this texture (if needed for copying to CPU memory, etc.)
 		s_ptr<TextureMemory> memory;
 
+		// ResourceRegistry entry
+		uint64_t memoryHandle = 0;
+
 		//static s_ptr<Texture> createTexture(const std::string& filename);
 
         Texture(const std::string & fname);
@@ -147,6 +150,12 @@ class Texture {
 
 		void copyToMemory();
 
+		// Sampler object with this texture's filter and wrap modes
+		GLuint getSampler() const;
+
+		// Adds this texture to ResourceRegistry, sized by a format with a known texel size
+		void trackMemory(GLenum sizedFormat);
+
 		vec4 getColor(ivec2 pos);
 
 		vec4 getColorUV(vec2 uv);
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "globals.h"
+
+// Checkpoint cache for scrubbing a simulated timeline.
+//
+// The owner supplies three callbacks: capture the evaluated scene state into bytes,
+// restore it from bytes, and simulate exactly one frame forward. Every `interval` frames
+// the state is captured. Seeking restores the nearest checkpoint at or before the
+// target frame and simulates forward from there, so a seek never replays more than
+// `interval - 1` frames once the timeline has been visited.
+//
+// Checkpoints are delta-compressed. Every `keyInterval`th checkpoint is stored in full,
+// and the ones in between are stored as the XOR against that key, run-length encoded.
+// Consecutive frames of a simulation differ in few bytes, so the deltas are mostly zero
+// runs. When the total size exceeds `budgetBytes`, the least recently used checkpoints
+// are evicted. Evicting a key also evicts the deltas that depend on it, and frame 0 is
+// never evicted.
+class TimelineCache {
+public:
+	using Capture = std::function<void(std::vector<uint8_t>&)>;
+	using Restore = std::function<void(const std::vector<uint8_t>&)>;
+	using Step = std::function<void()>;
+
+	int interval = 10;
+	int keyInterval = 8;
+	size_t budgetBytes = 64 * 1024 * 1024;
+
+	struct Stats {
+		size_t checkpoints = 0;
+		size_t bytes = 0;
+		size_t rawBytes = 0;
+		size_t evictions = 0;
+		size_t hits = 0;
+		size_t misses = 0;
+		int lastSeekSteps = 0;
+		double lastSeekTime = 0.0;
+	} stats;
+
+	TimelineCache() { }
+	TimelineCache(Capture c, Restore r, Step s) : capture(c), restore(r), step(s) { }
+
+	void setCallbacks(Capture c, Restore r, Step s);
+
+	// Drops every checkpoint and records the current state as the given frame
+	void reset(int frame = 0);
+
+	// Simulates one frame forward from the current frame, checkpointing when due
+	void advance();
+
+	// Brings the simulation to the given frame. Returns false if no checkpoint precedes it.
+	bool seek(int frame);
+
+	// Drops checkpoints after the given frame, e.g. when a parameter that affects the
+	// simulation changes
+	void invalidateAfter(int frame);
+
+	int getFrame() const { return currentFrame; }
+	bool hasCheckpoint(int frame) const { return checkpoints.count(frame) > 0; }
+
+	// Frames that currently have a checkpoint, for drawing on a timeline
+	std::vector<int> getCheckpointFrames() const;
+
+	void renderUI();
+
+protected:
+	struct Checkpoint {
+		int keyFrame = -1;				// frame of the key this is a delta of, -1 if this is a key
+		size_t rawSize = 0;
+		std::vector<uint8_t> data;
+		uint64_t lastUsed = 0;
+	};
+
+	Capture capture;
+	Restore restore;
+	Step step;
+
+	std::map<int, Checkpoint> checkpoints;
+	int currentFrame = 0;
+	uint64_t useCounter = 0;
+
+	std::vector<uint8_t> scratch;
+	std::vector<uint8_t> keyScratch;
+
+	void store(int frame);
+	bool load(int frame, std::vector<uint8_t>& state);
+	void evict();
+	void erase(int frame);
+
+	static void encode(const std::vector<uint8_t>& state, const std::vector<uint8_t>* key, std::vector<uint8_t>& out);
+	static void decode(const std::vector<uint8_t>& in, const std::vector<uint8_t>* key, size_t rawSize, std::vector<uint8_t>& state);
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "globals.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// A fixed set of std::threads for CPU loops that split into independent pieces.
+//
+// parallelFor hands indices out one at a time to the workers and the calling thread and
+// returns once every index has run, so the caller sees all results. Threads are made once,
+// one fewer than the hardware has since the caller works too, and sleep between loops.
+// A loop started while another is running (from a task, or a second thread) just runs on
+// its caller, as worker threadCount() - 1, a slot none of the pool's loops hand out. Only
+// one such loop should run at a time outside of nesting, since they all share that slot.
+class WorkerPool {
+public:
+	static WorkerPool& get();
+
+	// Calls task(index, worker) for each index in [0, count). worker is in [0, threadCount())
+	// and no two running tasks share one, for per-thread results.
+	using Task = std::function<void(int index, int worker)>;
+
+	void parallelFor(int count, const Task& task);
+
+	// Worker slots: the pool's threads, the caller, and one for loops run inline
+	int threadCount() const { return (int)threads.size() + 2; }
+
+	// Threads a loop is shared between, the caller included, for splitting work into chunks
+	int loopThreads() const { return (int)threads.size() + 1; }
+
+	~WorkerPool();
+
+protected:
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable wake, finished;
+
+	const Task* task = nullptr;
+	int count = 0;
+	std::atomic<int> next{ 0 };
+	// Workers still in the current loop
+	int busy = 0;
+	uint64_t generation = 0;
+	bool quit = false;
+
+	std::atomic<bool> running{ false };
+
+	void workerLoop(int worker);
+	void runTasks(int worker);
+
+	WorkerPool();
+};
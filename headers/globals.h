@@ -383,8 +383,12 @@ inline std::time_t current_time_t()
 }
 
 // Returns the seconds elapsed since the program was initialized (wrapper for glfwGetTime())
+// Headless runs step this by a fixed amount each frame instead.
 double getTime();
 
+// Seconds from the real clock, for timing code even when getTime() is being stepped
+double getWallTime();
+
 using Command = std::function<void()>;
 using TimedCommand = std::function<bool()>;
 
@@ -2,6 +2,15 @@
 
 #define GPU_LIGHT_BINDING_SPOT 3
 #define GPU_LIGHT_MAX_COUNT 3
+#define GPU_FRAME_BINDING_SPOT 4
+#define GPU_DRAW_BINDING_SPOT 5
+#define GPU_JOINT_BINDING_SPOT 6
+#define GPU_MAX_JOINTS 100
+#define GPU_SHADOW_MAX_CASCADES 4
+// Texture units of the clustered light buffers, see GPU::LightClusters
+#define GPU_CLUSTER_GRID_UNIT 13
+#define GPU_CLUSTER_INDEX_UNIT 14
+#define GPU_CLUSTER_LIGHT_UNIT 15
 
 struct Ray
 {
@@ -41,7 +50,8 @@ struct Light
 	vec4 direction;
 	vec4 diffuse;
 	vec4 specular;
-	// x is constant, y is linear, z is quadratic
+	// x is constant, y is linear, z is quadratic, w is the range past which the light is
+	// cut off (0 for none)
 	vec4 attenuation;
 	// x is cutoff, y is exponent
 	vec4 spot;
@@ -107,4 +117,43 @@ struct RuntimeParams
 	float accumulateBlend;
 	int clearAccumulate;
 	float time;
-};
\ No newline at end of file
+};
+
+// Per-pass values shared by every program through the FrameBlock uniform block
+struct FrameData
+{
+	mat4 viewproj;
+	mat4 view;
+	mat4 projection;
+	// View projection of the shadow light
+	mat4 lightViewProj;
+	// xyz: camera position
+	vec4 cameraPosition;
+	// xyz: normalized direction the camera looks
+	vec4 viewDirection;
+	// Clustered lights. xyz: froxels across, down and deep, w: lights (0 when off)
+	ivec4 clusterDims;
+	// x: view depth the first slice ends at, y: slices per unit of log depth after it
+	vec4 clusterDepth;
+	// xy: pixel size of the target the froxels cover
+	vec4 clusterViewport;
+	// Light view projection of each shadow cascade. Cascade i is drawn to the quadrant
+	// (i % 2, i / 2) of the shadow map.
+	mat4 cascadeViewProj[GPU_SHADOW_MAX_CASCADES];
+	// View depth each cascade reaches to
+	vec4 cascadeSplits;
+	// x: cascades in use, 0 for the single shadow map lightViewProj covers
+	ivec4 cascadeInfo;
+};
+
+// Per-draw values for multi-draw indirect, read from the DrawBlock storage buffer by
+// the draw id each command carries in its baseInstance
+struct DrawData
+{
+	mat4 model;
+	vec4 color;
+	// x: mesh id, y: InstanceFlag bits, z: the slice's baseVertex
+	ivec4 data;
+	// x: scale applied to positions before model
+	vec4 params;
+};
@@ -0,0 +1,4 @@
+// Include after datatypes.glsl. Filled once per pass by GPU::FrameUniforms.
+layout(std140) uniform FrameBlock {
+	FrameData frame;
+};
@@ -1,6 +1,5 @@
 #include "datatypes.glsl"
-
-uniform vec3 viewDirection;
+#include "frame.glsl"
 
 layout(std140) uniform LightData {
 	SceneLight sceneLight;
@@ -15,71 +14,136 @@ Material frontMaterial = Material(
 	200.0
 );
 
+// Clustered lights, bound by GPU::LightClusters on the GPU_CLUSTER_*_UNIT units
+// Per froxel: x offset into clusterIndices, y count
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterIndices;
+// Six texels per light, in Light's member order
+uniform samplerBuffer clusterLights;
+
+Light clusterLight(int index)
+{
+	int base = index * 6;
+	return Light(
+		texelFetch(clusterLights, base),
+		texelFetch(clusterLights, base + 1),
+		texelFetch(clusterLights, base + 2),
+		texelFetch(clusterLights, base + 3),
+		texelFetch(clusterLights, base + 4),
+		texelFetch(clusterLights, base + 5));
+}
+
+vec3 lightContribution(Light light, vec3 normalDirection, vec4 position)
+{
+	vec3 lightDirection;
+	float attenuation;
+
+	if (0.0 == light.position.w) // directional light?
+	{
+		attenuation = 1.0; // no attenuation
+		//lightDirection = normalize(vec3(light.position.xyz));
+		lightDirection = normalize(-vec3(light.direction.xyz));
+	} 
+	else // point light or spotlight (or other kind of light) 
+	{
+		vec3 positionToLightSource = light.position.xyz - position.xyz;
+		float distance = length(positionToLightSource);
+		if (light.attenuation.w > 0.0 && distance > light.attenuation.w) return vec3(0.0);
+
+		lightDirection = normalize(positionToLightSource);
+		attenuation = 1.0 / (light.attenuation.x
+					+ light.attenuation.y * distance
+					+ light.attenuation.z * distance * distance);
+ 
+		if (light.spot.x <= 90.0) // spotlight?
+			{
+				float clampedCosine = max(0.0, dot(-lightDirection, normalize(light.direction.xyz)));
+				if (clampedCosine < cos(radians(light.spot.x))) // outside of spotlight cone?
+				{
+					attenuation = 0.0;
+				}
+				else
+				{
+					attenuation = attenuation * pow(clampedCosine, light.spot.y);   
+				}
+			}
+	}
+ 
+	vec3 diffuseReflection = attenuation 
+		* light.diffuse.rgb * frontMaterial.diffuse.rgb
+		* max(0.0, dot(normalDirection, lightDirection));
+ 
+	vec3 specularReflection;
+	if (dot(normalDirection, lightDirection) < 0.0) // light source on the wrong side?
+	{
+		specularReflection = vec3(0.0, 0.0, 0.0); // no specular reflection
+	}
+	else // light source on the right side
+	{
+		specularReflection = attenuation * light.specular.rgb * frontMaterial.specular.rgb
+		* pow(max(0.0, dot(reflect(lightDirection, normalDirection), frame.viewDirection.xyz)), frontMaterial.shininess);
+	}
+
+	return diffuseReflection + specularReflection;
+}
+
+// Shadow map coordinates of a world position in [0, 1], z past 1 when nothing covers it.
+// With cascades the map is a 2x2 atlas and the view depth picks the quadrant; without,
+// lightPosition (lightViewProj times position) is used as is.
+vec3 shadowCoords(vec4 position, vec4 lightPosition)
+{
+	int count = frame.cascadeInfo.x;
+	if (count == 0)
+	{
+		return (lightPosition.xyz / lightPosition.w) * 0.5 + 0.5;
+	}
+
+	float depth = -(frame.view * position).z;
+	if (depth > frame.cascadeSplits[count - 1]) return vec3(0.0, 0.0, 2.0);
+
+	int cascade = 0;
+	while (cascade < count - 1 && depth > frame.cascadeSplits[cascade]) cascade++;
+
+	vec4 p = frame.cascadeViewProj[cascade] * position;
+	vec3 coords = (p.xyz / p.w) * 0.5 + 0.5;
+	if (any(lessThan(coords.xy, vec2(0.0))) || any(greaterThan(coords.xy, vec2(1.0)))) return vec3(0.0, 0.0, 2.0);
+
+	coords.xy = (coords.xy + vec2(cascade % 2, cascade / 2)) * 0.5;
+	return coords;
+}
+
 vec4 lighting(vec3 normal, vec4 position)
 {
 	vec3 normalDirection = normalize(normal);
 
 	//vec3 viewDirection = normalize(vec3(v_inv * vec4(0.0, 0.0, 0.0, 1.0) - position.xyz));
 
-	vec3 lightDirection;
-	float attenuation;
- 
 	// initialize total lighting with ambient lighting
 	vec3 totalLighting = vec3(sceneLight.scene_ambient) * vec3(frontMaterial.ambient);
  
 	int numLights = lights.length();
 	for (int index = 0; index < numLights; index++) // for all light sources
 	{
-		if (0.0 == lights[index].position.w) // directional light?
-		{
-			attenuation = 1.0; // no attenuation
-			//lightDirection = normalize(vec3(lights[index].position.xyz));
-			lightDirection = normalize(-vec3(lights[index].direction.xyz));
-		} 
-		else // point light or spotlight (or other kind of light) 
-		{
-			vec3 positionToLightSource = lights[index].position.xyz - position.xyz;
-			float distance = length(positionToLightSource);
-			lightDirection = normalize(positionToLightSource);
-			attenuation = 1.0 / (lights[index].attenuation.x
-						+ lights[index].attenuation.y * distance
-						+ lights[index].attenuation.z * distance * distance);
- 
-			if (lights[index].spot.x <= 90.0) // spotlight?
-				{
-					float clampedCosine = max(0.0, dot(-lightDirection, normalize(lights[index].direction.xyz)));
-					if (clampedCosine < cos(radians(lights[index].spot.x))) // outside of spotlight cone?
-					{
-						attenuation = 0.0;
-					}
-					else
-					{
-						attenuation = attenuation * pow(clampedCosine, lights[index].spot.y);   
-					}
-				}
-		}
- 
-		vec3 diffuseReflection = attenuation 
-			* lights[index].diffuse.rgb * frontMaterial.diffuse.rgb
-			* max(0.0, dot(normalDirection, lightDirection));
- 
-		vec3 specularReflection;
-		if (dot(normalDirection, lightDirection) < 0.0) // light source on the wrong side?
-		{
-			specularReflection = vec3(0.0, 0.0, 0.0); // no specular reflection
-		}
+		totalLighting += lightContribution(lights[index], normalDirection, position);
+	}
+
+	// Only the lights listed for this fragment's froxel
+	if (frame.clusterDims.w > 0)
+	{
+		ivec3 dims = frame.clusterDims.xyz;
+		float depth = -(frame.view * position).z;
+
+		ivec3 cell;
+		cell.xy = ivec2(gl_FragCoord.xy / frame.clusterViewport.xy * vec2(dims.xy));
+		cell.z = depth < frame.clusterDepth.x ? 0 : 1 + int(log(depth / frame.clusterDepth.x) * frame.clusterDepth.y);
+		cell = clamp(cell, ivec3(0), dims - 1);
 
-		
-		else // light source on the right side
+		uvec2 range = texelFetch(clusterGrid, cell.x + dims.x * (cell.y + dims.y * cell.z)).xy;
+		for (uint i = 0u; i < range.y; i++)
 		{
-			specularReflection = attenuation * lights[index].specular.rgb * frontMaterial.specular.rgb
-			* pow(max(0.0, dot(reflect(lightDirection, normalDirection), viewDirection)), frontMaterial.shininess);
+			int index = int(texelFetch(clusterIndices, int(range.x + i)).x);
+			totalLighting += lightContribution(clusterLight(index), normalDirection, position);
 		}
-		
-		
-		
- 
-		totalLighting = totalLighting + diffuseReflection + specularReflection;
 	}
  
 	return vec4(totalLighting, 1.0);
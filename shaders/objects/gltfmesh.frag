@@ -8,6 +8,11 @@ in vec3 v_wnormal;
 in vec2 v_uv;
 //in vec4 v_color;
 flat in ivec4 v_data;
+// Built with INDIRECT by IndirectRenderer, behind staticmesh_indirect.vert. The base color
+// and unlit flag come per draw instead of from uniforms.
+#ifdef INDIRECT
+in vec4 v_color;
+#endif
 in vec4 v_lightposition;
 
 // First fragment out: color
@@ -18,10 +23,19 @@ out vec4 frag_prim;
 
 uniform vec4 baseColorFactor = vec4(1.0);
 
+// Fixed per variant by ShaderPermutations, so branches on these compile away
+#ifdef PERMUTATION
+const bool useTexture = USE_TEXTURE;
+const bool useShadow = USE_SHADOW;
+const bool useLighting = USE_LIGHTING;
+#else
 uniform bool useTexture = false;
+uniform bool useShadow = false;
+uniform bool useLighting = true;
+#endif
+
 uniform sampler2D inputTexture;
 
-uniform bool useShadow = false;
 uniform sampler2DShadow shadowTexture;
 
 // Min and max for shadow bias
@@ -34,8 +48,6 @@ uniform vec4 selectedColor = vec4(1., 1., 0., 1.);
 
 uniform bool isLight = false;
 
-uniform bool useLighting = true;
-
 uniform bool showDepth = false;
 
 uniform float c = 80.0;
@@ -105,8 +117,7 @@ float shadowCalc() {
 	
 
 
-	vec3 projCoords = projCoordsW.xyz / projCoordsW.w;
-	projCoords = projCoords * 0.5 + 0.5;
+	vec3 projCoords = shadowCoords(v_position, projCoordsW);
 
 	if (projCoords.z > 1.0) {
         return 0.0;
@@ -158,10 +169,15 @@ float linearize_depth2(float d,float zNear,float zFar)
 
 void main()
 {
-	//vec4 result = v_color;
+#ifdef INDIRECT
+	vec4 result = v_color;
+	bool lit = useLighting && (v_data.z & 4) == 0;
+#else
 	vec4 result = baseColorFactor;
+	bool lit = useLighting;
+#endif
 
-	if (useLighting) {
+	if (lit) {
 		result *= lighting(v_normal, v_position);
 	}
 
@@ -187,7 +203,7 @@ void main()
 		result *= texResult;
 	}
 
-	if (useLighting && useShadow && !isLight) {
+	if (lit && useShadow && !isLight) {
 		result *= (1.0 - shadowCalc());
 	}
 
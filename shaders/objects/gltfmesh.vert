@@ -1,8 +1,10 @@
 __VERSION__
 
+#include "datatypes.glsl"
+#include "frame.glsl"
+
 uniform mat4 mvp;
 uniform mat4 model;
-uniform mat4 lightmvp;
 uniform mat3 normalMatrix;
 uniform vec4 globalColor;
 uniform int meshID;
@@ -38,5 +40,5 @@ void main()
 	v_wnormal = normal;
 	v_uv = uv;
 	//v_color = color * globalColor;
-	v_lightposition = lightmvp * v_position;
+	v_lightposition = frame.lightViewProj * v_position;
 }
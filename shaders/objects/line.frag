@@ -1,10 +1,11 @@
 __VERSION__
 
-uniform vec4 color;
+uniform vec4 globalColor = vec4(1.0);
 
+in vec4 vertexColor;
 out vec4 fragColor;
 
 void main() 
 {
-	fragColor = color;
+	fragColor = vertexColor * globalColor;
 }
@@ -2,16 +2,38 @@ __VERSION__
 
 in uint index;
 
-vec4 position[4] = vec4[](
-	vec4(0.0, 1.0, 0.0, 1.0),
-	vec4(0.0, -1.0, 0.0, 1.0),
-	vec4(1.0, -1.0, 0.0, 1.0),
-	vec4(1.0, 1.0, 0.0, 1.0)
+// Per segment: endpoints with the width in start.w, and color
+in vec4 start;
+in vec4 end;
+in vec4 color;
+
+// x: position along the segment, y: side of the line
+vec2 corner[4] = vec2[](
+	vec2(0.0, 1.0),
+	vec2(0.0, -1.0),
+	vec2(1.0, -1.0),
+	vec2(1.0, 1.0)
 );
 
-uniform mat4 mvp;
+uniform mat4 vp;
+// From the camera's look-at point towards its position
+uniform vec3 toCamera;
+uniform float globalWidth = 1.0;
+
+out vec4 vertexColor;
 
 void main()
 {
-	gl_Position = mvp * position[index];
+	vec3 along = end.xyz - start.xyz;
+
+	// Widen the segment sideways to the camera, or along any perpendicular when it points at it
+	vec3 side = cross(toCamera, along);
+	if (dot(side, side) < 1e-12) side = cross(abs(along.y) < 0.99 * length(along) ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0), along);
+	side = dot(side, side) > 0.0 ? normalize(side) : vec3(0.0);
+
+	vec2 c = corner[index];
+	vec3 position = start.xyz + along * c.x + side * (c.y * start.w * globalWidth);
+
+	gl_Position = vp * vec4(position, 1.0);
+	vertexColor = color;
 }
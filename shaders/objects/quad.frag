@@ -1,20 +1,24 @@
 __VERSION__
 
-uniform vec4 color;
+uniform vec4 globalColor = vec4(1.0);
 
 uniform bool useTexture = false;
+uniform bool useTextureArray = false;
 
 uniform sampler2D quadTexture;
+uniform sampler2DArray quadTextureArray;
 
 in vec2 fragUV;
+in vec4 vertexColor;
+flat in float fragLayer;
 out vec4 fragColor;
 
 void main() 
 {
-	vec4 result = color;
+	vec4 result = vertexColor * globalColor;
 
-	if (useTexture) {
-		vec4 tc = texture(quadTexture, fragUV);
+	if (useTexture || useTextureArray) {
+		vec4 tc = useTextureArray ? texture(quadTextureArray, vec3(fragUV, fragLayer)) : texture(quadTexture, fragUV);
 
 		if (tc.a < 0.05) discard;
 
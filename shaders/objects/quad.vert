@@ -2,26 +2,68 @@ __VERSION__
 
 in uint index;
 
-vec4 position[4] = {
-	{-1.0, -1.0, 1.0, 1.0},
-	{1.0, -1.0, 1.0, 1.0},
-	{1.0, 1.0, 1.0, 1.0},
-	{-1.0, 1.0, 1.0, 1.0}
-};
-
-vec2 uv[4] = {
-	{0.0, 0.0},
-	{1.0, 0.0},
-	{1.0, 1.0},
-	{0.0, 1.0}
-};
-
-uniform mat4 mvp;
+// Per quad: position with the billboard mode in w, rotation quaternion, scale with the
+// texture layer in w, color, and uv rectangle (origin, size)
+in vec4 instancePosition;
+in vec4 instanceRotation;
+in vec4 instanceScale;
+in vec4 instanceColor;
+in vec4 instanceUV;
+
+vec3 position[4] = vec3[](
+	vec3(-1.0, -1.0, 1.0),
+	vec3(1.0, -1.0, 1.0),
+	vec3(1.0, 1.0, 1.0),
+	vec3(-1.0, 1.0, 1.0)
+);
+
+vec2 uv[4] = vec2[](
+	vec2(0.0, 0.0),
+	vec2(1.0, 0.0),
+	vec2(1.0, 1.0),
+	vec2(0.0, 1.0)
+);
+
+uniform mat4 vp;
+uniform vec3 cameraRight;
+uniform vec3 cameraUp;
+uniform vec3 cameraPosition;
 
 out vec2 fragUV;
+out vec4 vertexColor;
+flat out float fragLayer;
+
+vec3 rotate(vec4 q, vec3 v)
+{
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
 
 void main()
 {
-	gl_Position = mvp * position[index];
-	fragUV = uv[index];
+	vec3 local = rotate(instanceRotation, position[index] * instanceScale.xyz);
+	vec3 center = instancePosition.xyz;
+	int billboard = int(instancePosition.w + 0.5);
+
+	vec3 world;
+	if (billboard == 1) {
+		// Spherical: local x, y and z map to the camera's right, up and back
+		vec3 back = cross(cameraRight, cameraUp);
+		world = center + cameraRight * local.x + cameraUp * local.y + back * local.z;
+	}
+	else if (billboard == 2) {
+		// Cylindrical: stays upright, turning about world y towards the camera
+		vec3 toCamera = cameraPosition - center;
+		toCamera.y = 0.0;
+		vec3 back = dot(toCamera, toCamera) > 1e-8 ? normalize(toCamera) : vec3(0.0, 0.0, 1.0);
+		vec3 right = cross(vec3(0.0, 1.0, 0.0), back);
+		world = center + right * local.x + vec3(0.0, 1.0, 0.0) * local.y + back * local.z;
+	}
+	else {
+		world = center + local;
+	}
+
+	gl_Position = vp * vec4(world, 1.0);
+	fragUV = instanceUV.xy + uv[index] * instanceUV.zw;
+	vertexColor = instanceColor;
+	fragLayer = instanceScale.w;
 }
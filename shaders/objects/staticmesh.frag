@@ -16,7 +16,21 @@ out vec4 frag_color;
 // Second fragment out: xyzw: mesh id, vertex id, prim id, unused
 out vec4 frag_prim;
 
+// Fixed per variant by ShaderPermutations, so branches on these compile away
+#ifdef PERMUTATION
+const bool useTexture = USE_TEXTURE;
+const bool useShadow = USE_SHADOW;
+const bool useLighting = USE_LIGHTING;
+const bool isLight = IS_LIGHT;
+const bool useFragmentTransform = USE_FRAGMENT_TRANSFORM;
+#else
 uniform bool useTexture = false;
+uniform bool useShadow = false;
+uniform bool useLighting = true;
+uniform bool isLight = false;
+uniform bool useFragmentTransform = false;
+#endif
+
 uniform sampler2D inputTexture;
 
 // Offsets for texture sprite sheets
@@ -24,7 +38,6 @@ uniform sampler2D inputTexture;
 // zw: scale of offset coordinates
 uniform vec4 uvOffset = vec4(0, 0, 1, 1);
 
-uniform bool useShadow = false;
 uniform sampler2DShadow shadowTexture;
 
 // Min and max for shadow bias
@@ -33,18 +46,14 @@ uniform vec3 lightPosition;
 uniform vec3 lightDirection;
 
 uniform bool isSelected = false;
+uniform bool isHovered = false;
 uniform vec4 selectedColor = vec4(1., 1., 0., 1.);
 
-uniform bool isLight = false;
-
-uniform bool useLighting = true;
-
 uniform bool showDepth = false;
 
 uniform float c = 80.0;
 
 uniform float iTime = 0.;
-uniform bool useFragmentTransform = false;
 
 float shadowCalcPCF() {
 	if (!useShadow) return 0.0;
@@ -108,8 +117,7 @@ float shadowCalc() {
 	
 
 
-	vec3 projCoords = projCoordsW.xyz / projCoordsW.w;
-	projCoords = projCoords * 0.5 + 0.5;
+	vec3 projCoords = shadowCoords(v_position, projCoordsW);
 
 	if (projCoords.z > 1.0) {
         return 0.0;
@@ -161,9 +169,15 @@ float linearize_depth2(float d,float zNear,float zFar)
 
 void main()
 {
+	// Instanced draws carry these per instance in v_data.z, see staticmesh_instanced.vert
+	bool selected = isSelected || (v_data.z & 1) != 0;
+	bool hovered = isHovered || (v_data.z & 32) != 0;
+	bool light = isLight || (v_data.z & 2) != 0;
+	bool lit = useLighting && (v_data.z & 4) == 0;
+
 	vec4 result = v_color;
 
-	if (useLighting) {
+	if (lit) {
 		result *= lighting(v_normal, v_position);
 	}
 
@@ -195,20 +209,24 @@ void main()
 
 		}
 		vec4 texResult = texture(inputTexture, uv);
-		if (length(texResult.rgb) < 0.25) discard;
+		// Near black texels are a color key unless the draw opts out
+		if (length(texResult.rgb) < 0.25 && (v_data.z & 16) == 0) discard;
 		if (texResult.a < 0.1) discard;
 		result *= texResult;
 	}
 
-	if (useLighting && useShadow && !isLight) {
+	if (lit && useShadow && !light) {
 		result *= (1.0 - shadowCalc());
 	}
 
-	if (isSelected) {
+	if (selected) {
 		result += selectedColor * 0.4;
 	}
+	else if (hovered) {
+		result += selectedColor * 0.2;
+	}
 
-	if (isLight) {
+	if (light) {
 		frag_color = v_color;
 	}
 	else {
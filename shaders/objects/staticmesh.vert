@@ -1,8 +1,9 @@
 __VERSION__
 
-uniform mat4 mvp;
+#include "datatypes.glsl"
+#include "frame.glsl"
+
 uniform mat4 model;
-uniform mat4 lightmvp;
 uniform mat3 normalMatrix;
 uniform vec4 globalColor;
 uniform int meshID;
@@ -36,10 +37,10 @@ void main()
 	}
 	v_position =  model * vec4(p, 1.0);
 	v_data = ivec4(meshID, gl_VertexID, 0, 0);
-	gl_Position = mvp * vec4(p, 1.0);
+	gl_Position = frame.viewproj * v_position;
 	v_normal =  transpose(inverse(mat3(model))) * normal;
 	v_wnormal = normal;
 	v_uv = uv;
 	v_color = color * globalColor;
-	v_lightposition = lightmvp * v_position;
+	v_lightposition = frame.lightViewProj * v_position;
 }
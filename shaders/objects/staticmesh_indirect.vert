@@ -0,0 +1,49 @@
+__VERSION__
+
+#include "datatypes.glsl"
+#include "frame.glsl"
+
+layout(std430, binding = GPU_DRAW_BINDING_SPOT) readonly buffer DrawBlock {
+	DrawData draws[];
+};
+
+uniform float iTime = 0.;
+
+// GeometryPool's vertex format
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 uv;
+layout(location = 3) in vec4 color;
+// Index into draws, taken from the command's baseInstance
+layout(location = 4) in uint drawID;
+
+out vec4 v_position;
+out vec3 v_normal;
+out vec3 v_wnormal;
+out vec2 v_uv;
+out vec4 v_color;
+// xyzw: mesh id, vertex id, instance flags, unused
+flat out ivec4 v_data;
+out vec4 v_lightposition;
+
+// Matches InstanceFlag in AnimationObjectRenderer.h
+const int VertexTransform = 8;
+
+void main()
+{
+	DrawData draw = draws[drawID];
+
+	vec3 p = position * draw.params.x;
+	if ((draw.data.y & VertexTransform) != 0) {
+		p = p + sin(iTime * p.x + p.y + p.z) * 0.1;
+	}
+	v_position = draw.model * vec4(p, 1.0);
+	// gl_VertexID includes the slice's offset into the pool
+	v_data = ivec4(draw.data.x, gl_VertexID - draw.data.z, draw.data.y, 0);
+	gl_Position = frame.viewproj * v_position;
+	v_normal = transpose(inverse(mat3(draw.model))) * normal;
+	v_wnormal = normal;
+	v_uv = uv;
+	v_color = color * draw.color;
+	v_lightposition = frame.lightViewProj * v_position;
+}
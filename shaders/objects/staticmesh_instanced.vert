@@ -0,0 +1,51 @@
+__VERSION__
+
+#include "datatypes.glsl"
+#include "frame.glsl"
+
+uniform float iTime = 0.;
+
+// Static attributes
+in vec3 position;
+in vec2 uv;
+in vec3 normal;
+in vec4 color;
+
+// Instance attributes: model matrix columns, color, (mesh id, flags) and size
+in vec4 m0;
+in vec4 m1;
+in vec4 m2;
+in vec4 m3;
+in vec4 instanceColor;
+in ivec2 instanceData;
+in float instanceSize;
+
+out vec4 v_position;
+out vec3 v_normal;
+out vec3 v_wnormal;
+out vec2 v_uv;
+out vec4 v_color;
+// xyzw: mesh id, vertex id, instance flags, unused
+flat out ivec4 v_data;
+out vec4 v_lightposition;
+
+// Matches InstanceFlag in AnimationObjectRenderer.h
+const int VertexTransform = 8;
+
+void main()
+{
+	mat4 model = mat4(m0, m1, m2, m3);
+
+	vec3 p = position * instanceSize;
+	if ((instanceData.y & VertexTransform) != 0) {
+		p = p + sin(iTime * p.x + p.y + p.z) * 0.1;
+	}
+	v_position = model * vec4(p, 1.0);
+	v_data = ivec4(instanceData.x, gl_VertexID, instanceData.y, 0);
+	gl_Position = frame.viewproj * v_position;
+	v_normal = transpose(inverse(mat3(model))) * normal;
+	v_wnormal = normal;
+	v_uv = uv;
+	v_color = color * instanceColor;
+	v_lightposition = frame.lightViewProj * v_position;
+}
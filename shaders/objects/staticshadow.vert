@@ -1,6 +1,9 @@
 __VERSION__
 
-uniform mat4 mvp;
+#include "datatypes.glsl"
+#include "frame.glsl"
+
+uniform mat4 model;
 
 uniform bool useVertexTransform = false;
 uniform float iTime = 0.;
@@ -16,5 +19,5 @@ void main()
 		//p = p + (p * sin(float(gl_VertexID) + iTime) * 0.1);
 		p = p + sin(iTime * p.x + p.y + p.z) * 0.1;
 	}
-	gl_Position = mvp * vec4(p, 1.0);
+	gl_Position = frame.viewproj * model * vec4(p, 1.0);
 }
@@ -0,0 +1,28 @@
+__VERSION__
+
+#include "datatypes.glsl"
+#include "frame.glsl"
+
+layout(std430, binding = GPU_DRAW_BINDING_SPOT) readonly buffer DrawBlock {
+	DrawData draws[];
+};
+
+uniform float iTime = 0.;
+
+// GeometryPool's vertex format, only position is needed
+layout(location = 0) in vec3 position;
+layout(location = 4) in uint drawID;
+
+// Matches InstanceFlag in AnimationObjectRenderer.h
+const int VertexTransform = 8;
+
+void main()
+{
+	DrawData draw = draws[drawID];
+
+	vec3 p = position * draw.params.x;
+	if ((draw.data.y & VertexTransform) != 0) {
+		p = p + sin(iTime * p.x + p.y + p.z) * 0.1;
+	}
+	gl_Position = frame.viewproj * draw.model * vec4(p, 1.0);
+}
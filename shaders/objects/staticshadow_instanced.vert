@@ -0,0 +1,29 @@
+__VERSION__
+
+#include "datatypes.glsl"
+#include "frame.glsl"
+
+uniform float iTime = 0.;
+
+// Static attributes
+in vec3 position;
+
+// Instance attributes
+in vec4 m0;
+in vec4 m1;
+in vec4 m2;
+in vec4 m3;
+in ivec2 instanceData;
+in float instanceSize;
+
+// Matches InstanceFlag in AnimationObjectRenderer.h
+const int VertexTransform = 8;
+
+void main()
+{
+	vec3 p = position * instanceSize;
+	if ((instanceData.y & VertexTransform) != 0) {
+		p = p + sin(iTime * p.x + p.y + p.z) * 0.1;
+	}
+	gl_Position = frame.viewproj * mat4(m0, m1, m2, m3) * vec4(p, 1.0);
+}
@@ -47,62 +47,15 @@ void AnimationObject::setParent(AnimationObject* p, bool adjustTf) {
 	}
 }
 
+// Orbit, constant rotation and billboarding are solved by ConstraintSolver after animation
 void AnimationObject::update() {
 	transformUpdatedThisFrame = false;
-
-	if (glm::length(constantRotation) > 0.f) {
-		localRotation += constantRotation;
-	}
-
-	if (glm::length(orbitRotation) > 0.f) {
-		float dt = Application::get().deltaTime;
-		mat4 orbitRot = glm::toMat4(quaternion(glm::radians(orbitRotation * dt)));
-
-		localPosition = orbitRot * vec4(localPosition, 1.f);
-	}
 }
 
 void AnimationObject::updateMatrix(bool force) {
 	if (transformUpdatedThisFrame && !force) return;
 	if (overrideUpdate && !force) return;
 
-	if (billboard) {
-		auto& cam = Application::get().getRenderer<OpenGLRenderer>()->camera;
-
-		vec3 modelFwd = glm::normalize(cam.Position - position);
-		vec3 modelUp = cam.currentUp;
-		vec3 modelSide = glm::cross(modelUp, modelFwd);
-
-		mat3 oldRot = transform;
-		mat3 newRot;
-		if (forwardDirection == +Axis::X) {
-			newRot[0] = modelFwd;
-			newRot[1] = modelUp;
-			newRot[2] = modelSide;
-		}
-		else if (forwardDirection == +Axis::Y) {
-			newRot[0] = modelSide;
-			newRot[1] = modelFwd;
-			newRot[2] = modelUp;
-		}
-		else if (forwardDirection == +Axis::Z) {
-			newRot[0] = modelUp;
-			newRot[1] = modelSide;
-			newRot[2] = modelFwd;
-		}
-
-		mat4 newRot4 = newRot;
-
-		if (parent) {
-			auto dc = glm::decompose(newRot4);
-			localRotation = glm::degrees(glm::eulerAngles(dc.rotation));
-		}
-		else {
-			auto dc = glm::decompose(newRot4);
-			localRotation = glm::degrees(glm::eulerAngles(dc.rotation));
-		}
-	}
-
 	mat4 T = glm::translate(localPosition);
 	mat4 R = glm::translate(-localPivot) * glm::toMat4(quaternion(glm::radians(localRotation))) * glm::translate(localPivot);
 	mat4 S = glm::scale(localScale);
@@ -111,17 +64,16 @@ void AnimationObject::updateMatrix(bool force) {
 	if (parent && parent != this) {
 		if (!parent->transformUpdatedThisFrame) parent->updateMatrix();
 
-		mat4 cr = mat4(1.f);
-		if (glm::length(constantRotation) > 0.f) {
-			cr = glm::toMat4(quaternion(glm::radians(constantRotation)));
-		}
-
 		transform = parent->transform * localTransform;
 
-		auto decomp = glm::decompose(transform);
-		position = decomp.position;
-		rotation = glm::degrees(glm::eulerAngles(decomp.rotation));
-		scale = decomp.scale;
+		// Cheaper than decompose; a zero scaled axis keeps the last rotation
+		mat3 basis = transform;
+		position = vec3(transform[3]);
+		scale = vec3(glm::length(basis[0]), glm::length(basis[1]), glm::length(basis[2]));
+		quaternion worldRotation;
+		if (extractRotation(transform, worldRotation)) {
+			rotation = glm::degrees(glm::eulerAngles(worldRotation));
+		}
 	}
 	else {
 		transform = localTransform;
@@ -133,6 +85,32 @@ void AnimationObject::updateMatrix(bool force) {
 	transformUpdatedThisFrame = true;
 }
 
+bool AnimationObject::extractRotation(const mat4& m, quaternion& rotation) {
+	const float epsilon = 1e-8f;
+
+	// Gram-Schmidt, like decompose, so shear doesn't leak into the rotation
+	vec3 x = vec3(m[0]);
+	float lx = glm::length(x);
+	if (lx < epsilon) return false;
+	x /= lx;
+
+	vec3 y = vec3(m[1]) - glm::dot(vec3(m[1]), x) * x;
+	float ly = glm::length(y);
+	if (ly < epsilon) return false;
+	y /= ly;
+
+	vec3 z = vec3(m[2]) - glm::dot(vec3(m[2]), x) * x - glm::dot(vec3(m[2]), y) * y;
+	float lz = glm::length(z);
+	if (lz < epsilon) return false;
+	z /= lz;
+
+	// A mirrored basis is a negative scale, not part of the rotation
+	if (glm::dot(glm::cross(x, y), z) < 0.f) z = -z;
+
+	rotation = glm::quat_cast(mat3(x, y, z));
+	return true;
+}
+
 bool AnimationObject::renderUI() {
 	ImGui::PushID((const void*)this);
 	renderEnumDropDown<AnimationObjectType>("Shape type", shapeType);
@@ -169,6 +147,7 @@ bool AnimationObject::renderUI() {
 	anyChange |= ImGui::InputInt("Light index", &lightIndex);
 	anyChange |= ImGui::Checkbox("Use lighting", &useLighting);
 	anyChange |= ImGui::Checkbox("Cull backface", &cullFace);
+	anyChange |= ImGui::Checkbox("Occluder", &occluder);
 	anyChange |= ImGui::Checkbox("Billboard to camera", &billboard);
 	if (billboard) {
 		ImGui::Text("Forward direction");
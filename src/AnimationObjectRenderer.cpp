@@ -1,5 +1,6 @@
 #include "AnimationObjectRenderer.h"
 
+#include "GLStateCache.h"
 #include "Textures.h"
 
 #include "Application.h"
@@ -8,6 +9,7 @@
 #include "Lighting.h"
 
 #include "Framebuffer.h"
+#include "IndirectRenderer.h"
 #include "StringUtil.h"
 #include "InputOutput.h"
 
@@ -449,6 +451,7 @@ AnimationObjectRenderData::AnimationObjectRenderData(AnimationObjectType st) {
 		break;
 	}
 
+	computeBounds();
 	initShader();
 }
 
@@ -474,9 +477,19 @@ AnimationObjectRenderData::AnimationObjectRenderData(std::string filename) {
 
 	initModel(*this, filename);
 
+	computeBounds();
 	initShader();
 }
 
+void AnimationObjectRenderData::computeBounds() {
+	bounds = Bounds();
+	if (!vertexVBO) return;
+
+	for (const auto& v : vertexVBO->data) {
+		bounds.expand(v.position);
+	}
+}
+
 
 bool AnimationObjectRenderData::initShader() {
 	auto vertText = Shader::LoadText("objects/staticmesh.vert");
@@ -520,15 +533,10 @@ bool AnimationObjectRenderData::initShader() {
 		glEnableVertexAttribArray(loc);
 		});
 
-	binding.addUniform("vec3", "viewDirection", [this](GLint loc) {
-		auto& cam = Application::get().getRenderer<OpenGLRenderer>()->camera;
-		auto axis = glm::normalize(cam.Lookat - cam.Position);
-		glUniform3fv(loc, 1, glm::value_ptr(axis));
-		});
-	glBindVertexArray(vao);
+	GLState::bindVertexArray(vao);
 	shader->bind(binding);
 	indexVBO->bind();
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 
 	// Shadow shader
 	auto shadowVertText = Shader::LoadText("objects/staticshadow.vert");
@@ -550,10 +558,114 @@ bool AnimationObjectRenderData::initShader() {
 		glEnableVertexAttribArray(loc);
 		});
 
-	glBindVertexArray(shadowVAO);
+	GLState::bindVertexArray(shadowVAO);
 	shadowShader->bind(shadowBinding);
 	indexVBO->bind();
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
+
+	return initInstancedShader();
+}
+
+namespace {
+	const char* InstanceAttributes[] = { "m0", "m1", "m2", "m3", "instanceColor", "instanceData", "instanceSize" };
+
+	// Re-points just the instance attributes. The vertex attribute functions capture the
+	// render data they were made by, which may since have been copied into a catalog.
+	void refreshInstanceAttributes(const ShaderBinding& binding) {
+		for (auto name : InstanceAttributes) {
+			auto attribute = binding.vertexAttributes.find(name);
+			if (attribute != binding.vertexAttributes.end()) {
+				attribute->second.refresh();
+			}
+		}
+	}
+
+	// The instance attributes read from AnimationObjectRenderer's shared instance buffer
+	void addInstanceAttributes(ShaderBinding& binding, bool isShadow) {
+		for (int i = 0; i < 4; i++) {
+			binding.addVertexAttribute("vec4", fmt::format("m{0}", i), [i](GLint loc) {
+				AnimationObjectRenderer::get().getInstanceStream().bind();
+				glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(AnimationObjectInstance), (const GLvoid*)(AnimationObjectRenderer::get().instanceOffset + offsetof(AnimationObjectInstance, model) + sizeof(vec4) * i));
+				glEnableVertexAttribArray(loc);
+				glVertexAttribDivisor(loc, 1);
+				});
+		}
+
+		if (!isShadow) {
+			binding.addVertexAttribute("vec4", "instanceColor", [](GLint loc) {
+				AnimationObjectRenderer::get().getInstanceStream().bind();
+				glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(AnimationObjectInstance), (const GLvoid*)(AnimationObjectRenderer::get().instanceOffset + offsetof(AnimationObjectInstance, color)));
+				glEnableVertexAttribArray(loc);
+				glVertexAttribDivisor(loc, 1);
+				});
+		}
+
+		binding.addVertexAttribute("ivec2", "instanceData", [](GLint loc) {
+			AnimationObjectRenderer::get().getInstanceStream().bind();
+			glVertexAttribIPointer(loc, 2, GL_INT, sizeof(AnimationObjectInstance), (const GLvoid*)(AnimationObjectRenderer::get().instanceOffset + offsetof(AnimationObjectInstance, data)));
+			glEnableVertexAttribArray(loc);
+			glVertexAttribDivisor(loc, 1);
+			});
+
+		binding.addVertexAttribute("float", "instanceSize", [](GLint loc) {
+			AnimationObjectRenderer::get().getInstanceStream().bind();
+			glVertexAttribPointer(loc, 1, GL_FLOAT, GL_FALSE, sizeof(AnimationObjectInstance), (const GLvoid*)(AnimationObjectRenderer::get().instanceOffset + offsetof(AnimationObjectInstance, size)));
+			glEnableVertexAttribArray(loc);
+			glVertexAttribDivisor(loc, 1);
+			});
+	}
+}
+
+bool AnimationObjectRenderData::initInstancedShader() {
+	if (instancedVAO == 0) glGenVertexArrays(1, &instancedVAO);
+	if (instancedShadowVAO == 0) glGenVertexArrays(1, &instancedShadowVAO);
+
+	auto vertText = Shader::LoadText("objects/staticmesh_instanced.vert");
+	auto fragText = Shader::LoadText("objects/staticmesh.frag");
+
+	instancedShader = s_ptr<Shader>(new Shader(vertText, fragText));
+	instancedShader->attributeLocations = AnimationObjectRenderer::InstancedAttributes;
+
+	std::vector<ShaderFragOutputBindings> fragBindings = {
+		{0, "frag_color"},
+		{1, "frag_prim"}
+	};
+
+	if (!instancedShader->init(false, fragBindings))
+	{
+		log("Unable to load {0} instanced shader!\n", objectName);
+		instancedShader = nullptr;
+		return false;
+	}
+
+	ShaderBinding binding = shader->binding;
+	addInstanceAttributes(binding, false);
+
+	GLState::bindVertexArray(instancedVAO);
+	instancedShader->bind(binding);
+	indexVBO->bind();
+	GLState::bindVertexArray(0);
+
+	auto shadowVertText = Shader::LoadText("objects/staticshadow_instanced.vert");
+	auto shadowFragText = Shader::LoadText("objects/staticshadow.frag");
+
+	instancedShadowShader = s_ptr<Shader>(new Shader(shadowVertText, shadowFragText));
+
+	if (!instancedShadowShader->init())
+	{
+		log("Unable to load {0} instanced shadow shader!\n", objectName);
+		instancedShader = nullptr;
+		instancedShadowShader = nullptr;
+		return false;
+	}
+
+	ShaderBinding shadowBinding = shadowShader->binding;
+	addInstanceAttributes(shadowBinding, true);
+
+	GLState::bindVertexArray(instancedShadowVAO);
+	instancedShadowShader->bind(shadowBinding);
+	indexVBO->bind();
+	GLState::bindVertexArray(0);
 
 	return true;
 }
@@ -564,6 +676,29 @@ AnimationObjectRenderer& AnimationObjectRenderer::get()
 	return instance;
 }
 
+const string_vector AnimationObjectRenderer::InstancedAttributes = {
+	"position", "normal", "uv", "color", "m0", "m1", "m2", "m3", "instanceColor", "instanceData", "instanceSize"
+};
+
+ShaderPermutations& AnimationObjectRenderer::getInstancedVariants() {
+	if (!instancedVariants) {
+		instancedVariants = std::make_unique<ShaderPermutations>(
+			Shader::LoadText("objects/staticmesh_instanced.vert"), Shader::LoadText("objects/staticmesh.frag"),
+			string_vector{ "USE_TEXTURE", "USE_SHADOW", "USE_LIGHTING", "IS_LIGHT", "USE_FRAGMENT_TRANSFORM" },
+			std::vector<ShaderFragOutputBindings>{ {0, "frag_color"}, {1, "frag_prim"} },
+			InstancedAttributes);
+
+		// Lighting and light tinting stay per instance in the instance flags, so every
+		// variant has USE_LIGHTING on and IS_LIGHT off. Build the common ones up front.
+		auto& v = *instancedVariants;
+		uint32_t lit = v.feature("USE_LIGHTING");
+		uint32_t texture = v.feature("USE_TEXTURE");
+		uint32_t shadow = v.feature("USE_SHADOW");
+		v.warmUp({ lit, lit | shadow, lit | texture, lit | texture | shadow });
+	}
+	return *instancedVariants;
+}
+
 bool AnimationObjectRenderer::init()
 {
 	for (const auto m : AnimationObjectType::_values()) {
@@ -573,6 +708,68 @@ bool AnimationObjectRenderer::init()
 	return true;
 }
 
+const Bounds& AnimationObjectRenderer::getLocalBounds(const AnimationObject& shape) {
+	if (!initialized)
+	{
+		initialized = init();
+	}
+
+	return getRenderData(shape).bounds;
+}
+
+AnimationObjectRenderData& AnimationObjectRenderer::getRenderData(const AnimationObject& shape) {
+	if (shape.shapeType == +AnimationObjectType::model) {
+		return getMeshData(shape);
+	}
+
+	auto meshToRender = shapeCatalog.find(shape.shapeType);
+	if (meshToRender == shapeCatalog.end()) {
+		shapeCatalog[shape.shapeType] = AnimationObjectRenderData(shape.shapeType);
+	}
+	return shapeCatalog[shape.shapeType];
+}
+
+int AnimationObjectRenderer::getInstanceFlags(const AnimationObject& shape) {
+	int flags = 0;
+	if (shape.selected) flags |= InstanceSelected;
+	if (shape.lightIndex != -1) flags |= InstanceLight;
+	if (!shape.useLighting) flags |= InstanceUnlit;
+	if (shape.useVertexTransform) flags |= InstanceVertexTransform;
+	if (shape.index == get().hoveredIndex) flags |= InstanceHovered;
+	return flags;
+}
+
+StreamBuffer& AnimationObjectRenderer::getInstanceStream() {
+	if (!instanceStream) {
+		instanceStream = u_ptr<StreamBuffer>(new StreamBuffer("Object instances", GL_ARRAY_BUFFER,
+			sizeof(AnimationObjectInstance) * 4096, sizeof(AnimationObjectInstance)));
+	}
+	return *instanceStream;
+}
+
+AnimationObjectRenderData& AnimationObjectRenderer::getMeshData(const AnimationObject& shape) {
+	auto meshToRender = meshCatalog.find(shape.meshName);
+	if (meshToRender == meshCatalog.end()) {
+		meshCatalog[shape.meshName] = AnimationObjectRenderData(shape.meshName);
+
+		// Check for materials file
+
+		auto mtlFile = StringUtil::replaceAll(shape.meshName, ".obj", ".mtl");
+		if (IO::pathExists(mtlFile)) {
+			meshCatalog[shape.meshName].mesh->materials = MaterialData::LoadFromFile(mtlFile);
+			if (!meshCatalog[shape.meshName].mesh->materials.empty()) {
+				AnimationObject* s = (AnimationObject*)&shape;
+				if (meshCatalog[shape.meshName].mesh->materials.front().diffuseTexture) {
+					s->texture = reinterpret_cast<void*>(meshCatalog[shape.meshName].mesh->materials.front().diffuseTexture->id);
+				}
+
+			}
+		}
+	}
+
+	return meshCatalog[shape.meshName];
+}
+
 
 void AnimationObjectRenderer::beginBatchRender(AnimationObjectType shapeType, bool overrideColor, const vec4& batchColor, bool isShadow)
 {
@@ -593,16 +790,16 @@ void AnimationObjectRenderer::beginBatchRender(AnimationObjectType shapeType, bo
 
 	//glPushAttrib(GL_ENABLE_BIT);
 	if (!isShadow) {
-		glBindVertexArray(currentMesh->vao);
-		//glEnable(GL_DEPTH_TEST);
-		//glDepthFunc(GL_GREATER);
+		GLState::bindVertexArray(currentMesh->vao);
+		//GLState::enable(GL_DEPTH_TEST);
+		//GLState::depthFunc(GL_GREATER);
 		currentMesh->shader->start();
 
-		GLint nmLoc = glGetUniformLocation(currentMesh->shader->program, "normalMatrix");
+		GLint nmLoc = currentMesh->shader->uniform("normalMatrix");
 		mat4 normalMatrix = glm::transpose(glm::inverse(Application::get().renderer->camera.view));
 		glUniformMatrix3fv(nmLoc, 1, GL_FALSE, (const GLfloat*)glm::value_ptr(normalMatrix));
 
-		GLint gcLoc = glGetUniformLocation(currentMesh->shader->program, "globalColor");
+		GLint gcLoc = currentMesh->shader->uniform("globalColor");
 		if (overrideColor) {
 			glUniform4fv(gcLoc, 1, glm::value_ptr(batchColor));
 		}
@@ -613,7 +810,7 @@ void AnimationObjectRenderer::beginBatchRender(AnimationObjectType shapeType, bo
 		GPU::Lighting::get().bind(currentMesh->shader);
 	}
 	else {
-		glBindVertexArray(currentMesh->shadowVAO);
+		GLState::bindVertexArray(currentMesh->shadowVAO);
 		currentMesh->shadowShader->start();
 	}
 }
@@ -625,41 +822,22 @@ void AnimationObjectRenderer::beginBatchRender(const AnimationObject& shape, boo
 		if (!initialized) return;
 	}
 
-	auto meshToRender = meshCatalog.find(shape.meshName);
-	if (meshToRender == meshCatalog.end()) {
-		meshCatalog[shape.meshName] = AnimationObjectRenderData(shape.meshName);
-
-		// Check for materials file
-
-		auto mtlFile = StringUtil::replaceAll(shape.meshName, ".obj", ".mtl");
-		if (IO::pathExists(mtlFile)) {
-			meshCatalog[shape.meshName].mesh->materials = MaterialData::LoadFromFile(mtlFile);
-			if (!meshCatalog[shape.meshName].mesh->materials.empty()) {
-				AnimationObject* s = (AnimationObject*)&shape;
-				if (meshCatalog[shape.meshName].mesh->materials.front().diffuseTexture) {
-					s->texture = reinterpret_cast<void*>(meshCatalog[shape.meshName].mesh->materials.front().diffuseTexture->id);
-				}
-
-			}
-		}
-	}
-
-	currentMesh = &meshCatalog[shape.meshName];
+	currentMesh = &getMeshData(shape);
 
 	//mesh->beginRender(ShadingMode::Shaded, true);
 
 	//glPushAttrib(GL_ENABLE_BIT);
 	if (!isShadow) {
-		glBindVertexArray(currentMesh->vao);
-		//glEnable(GL_DEPTH_TEST);
-		//glDepthFunc(GL_GREATER);
+		GLState::bindVertexArray(currentMesh->vao);
+		//GLState::enable(GL_DEPTH_TEST);
+		//GLState::depthFunc(GL_GREATER);
 		currentMesh->shader->start();
 
-		GLint nmLoc = glGetUniformLocation(currentMesh->shader->program, "normalMatrix");
+		GLint nmLoc = currentMesh->shader->uniform("normalMatrix");
 		mat4 normalMatrix = glm::transpose(glm::inverse(Application::get().renderer->camera.view));
 		glUniformMatrix3fv(nmLoc, 1, GL_FALSE, (const GLfloat*)glm::value_ptr(normalMatrix));
 
-		GLint gcLoc = glGetUniformLocation(currentMesh->shader->program, "globalColor");
+		GLint gcLoc = currentMesh->shader->uniform("globalColor");
 		if (overrideColor) {
 			glUniform4fv(gcLoc, 1, glm::value_ptr(batchColor));
 		}
@@ -670,7 +848,7 @@ void AnimationObjectRenderer::beginBatchRender(const AnimationObject& shape, boo
 		GPU::Lighting::get().bind(currentMesh->shader);
 	}
 	else {
-		glBindVertexArray(currentMesh->shadowVAO);
+		GLState::bindVertexArray(currentMesh->shadowVAO);
 		currentMesh->shadowShader->start();
 	}
 }
@@ -684,7 +862,16 @@ void AnimationObjectRenderer::endBatchRender(bool isShadow)
 		currentMesh->shadowShader->stop();
 	}
 
-	glBindVertexArray(0);
+	// Textures are left bound between objects so repeats are filtered out; put them back here
+	if (!isShadow) {
+		GLState::activeTexture(GL_TEXTURE1);
+		GLState::bindTexture(GL_TEXTURE_2D, 0);
+		GLState::activeTexture(GL_TEXTURE0);
+		GLState::bindTexture(GL_TEXTURE_2D, 0);
+		GLState::unbindSamplers();
+	}
+
+	GLState::bindVertexArray(0);
 
 	//glPopAttrib();
 }
@@ -708,25 +895,20 @@ void AnimationObjectRenderer::render(AnimationObjectType shapeType, const mat4&
 void AnimationObjectRenderer::renderLight(const mat4& mat) {
 	beginBatchRender(AnimationObjectType::joint, false, vec4(1.f), false);
 
-	GLint lLoc = glGetUniformLocation(currentMesh->shader->program, "isLight");
+	GLint lLoc = currentMesh->shader->uniform("isLight");
 	glUniform1i(lLoc, 1);
 
 
 	auto ogl = std::dynamic_pointer_cast<OpenGLRenderer>(Application::get().renderer);
 	if (ogl && ogl->dummyInput) {
-		glEnable(GL_DEPTH_TEST);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, ogl->dummyInput->textures[0]->id);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, ogl->dummyInput->textures[1]->id);
-		GLint stLoc = glGetUniformLocation(currentMesh->shader->program, "shadowTexture");
+		GLState::enable(GL_DEPTH_TEST);
+		GLState::activeTexture(GL_TEXTURE0);
+		GLState::bindTexture(GL_TEXTURE_2D, ogl->dummyInput->textures[0]->id);
+		GLState::activeTexture(GL_TEXTURE1);
+		GLState::bindTexture(GL_TEXTURE_2D, ogl->dummyInput->textures[1]->id);
+		GLint stLoc = currentMesh->shader->uniform("shadowTexture");
 		glUniform1i(stLoc, 1);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_ALWAYS);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		GLState::bindSampler(1, getShadowSampler(GL_ALWAYS));
 	}
 
 	renderBatch(mat, false);
@@ -735,72 +917,52 @@ void AnimationObjectRenderer::renderLight(const mat4& mat) {
 }
 
 void AnimationObjectRenderer::renderBatch(const mat4& mat, bool isShadow) {
-	static mat4 lightmvp;
-
 	auto shaderToUse = isShadow ? currentMesh->shadowShader : currentMesh->shader;
 
-	if (isShadow) {
-		lightmvp = Application::get().renderer->camera.viewproj;
-	}
-	else {
-		GLint lightmvpLoc = glGetUniformLocation(shaderToUse->program, "lightmvp");
-		glUniformMatrix4fv(lightmvpLoc, 1, GL_FALSE, glm::value_ptr(lightmvp));
-	}
-
-	GLint mLoc = glGetUniformLocation(shaderToUse->program, "model");
+	// The view projection and light matrices come from the FrameBlock uniform block
+	GLint mLoc = shaderToUse->uniform("model");
 	if (mLoc != -1) {
 		glUniformMatrix4fv(mLoc, 1, GL_FALSE, glm::value_ptr(mat));
 	}
 
-	GLint mvpLoc = glGetUniformLocation(shaderToUse->program, "mvp");
-	if (mvpLoc != -1) {
-		mat4 mvp = Application::get().renderer->camera.viewproj * mat;
-		glUniformMatrix4fv(mvpLoc, 1, GL_FALSE, glm::value_ptr(mvp));
-	}
-
 	glDrawElements(GL_TRIANGLES, currentMesh->indexVBO->data.size(), GL_UNSIGNED_INT, 0);
 }
 
 void AnimationObjectRenderer::renderBatchWithOwnColor(const mat4& mat, const vec4& color, const GLuint texture, bool isShadow) {
 
 	if (!isShadow) {
-		GLint gcLoc = glGetUniformLocation(currentMesh->shader->program, "globalColor");
+		GLint gcLoc = currentMesh->shader->uniform("globalColor");
 		glUniform4fv(gcLoc, 1, glm::value_ptr(color));
 
-		glActiveTexture(GL_TEXTURE0);
-		GLint utLoc = glGetUniformLocation(currentMesh->shader->program, "useTexture");
+		GLState::activeTexture(GL_TEXTURE0);
+		GLint utLoc = currentMesh->shader->uniform("useTexture");
 		if (texture != 0) {
 			glUniform1i(utLoc, 1);
-			glBindTexture(GL_TEXTURE_2D, texture);
+			GLState::bindTexture(GL_TEXTURE_2D, texture);
+			// A bare name, so it samples with its own parameters
+			GLState::bindSampler(0, 0);
 		}
 		else {
 			glUniform1i(utLoc, 0);
-			glBindTexture(GL_TEXTURE_2D, 0);
+			GLState::bindTexture(GL_TEXTURE_2D, 0);
 		}
 
-		GLint smLoc = glGetUniformLocation(currentMesh->shader->program, "useShadow");
-		glActiveTexture(GL_TEXTURE1);
+		GLint smLoc = currentMesh->shader->uniform("useShadow");
+		GLState::activeTexture(GL_TEXTURE1);
 		auto ogl = std::dynamic_pointer_cast<OpenGLRenderer>(Application::get().renderer);
 		if (ogl && ogl->shadowMap) {
 			glUniform1i(smLoc, 1);
-			GLint stLoc = glGetUniformLocation(currentMesh->shader->program, "shadowTexture");
+			GLint stLoc = currentMesh->shader->uniform("shadowTexture");
 			glUniform1i(stLoc, 1);
-			glBindTexture(GL_TEXTURE_2D, ogl->shadowMap->textures.front()->id);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-			float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-			glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-			GLint sbLoc = glGetUniformLocation(currentMesh->shader->program, "shadowBias");
+			GLState::bindTexture(GL_TEXTURE_2D, ogl->shadowMap->textures.front()->id);
+			GLState::bindSampler(1, getShadowSampler());
+
+			GLint sbLoc = currentMesh->shader->uniform("shadowBias");
 			glUniform2fv(sbLoc, 1, glm::value_ptr(shadowBias));
 
 			auto& l = GPU::Lighting::get();
-			GLint lpLoc = glGetUniformLocation(currentMesh->shader->program, "lightPosition");
-			GLint ldLoc = glGetUniformLocation(currentMesh->shader->program, "lightDirection");
+			GLint lpLoc = currentMesh->shader->uniform("lightPosition");
+			GLint ldLoc = currentMesh->shader->uniform("lightDirection");
 
 			glUniform3fv(lpLoc, 1, glm::value_ptr(l.position));
 			auto lightDir = glm::normalize(l.center - l.position);
@@ -810,37 +972,40 @@ void AnimationObjectRenderer::renderBatchWithOwnColor(const mat4& mat, const vec
 		}
 		else {
 			glUniform1i(smLoc, 0);
-			glBindTexture(GL_TEXTURE_2D, 0);
+			GLState::bindTexture(GL_TEXTURE_2D, 0);
 		}
 	}
 
 	renderBatch(mat, isShadow);
-
-	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 void AnimationObjectRenderer::renderBatchWithOwnColor(const AnimationObject& shape, bool isShadow, bool useShapeColor) {
 
 	if (!isShadow) {
-		GLint lLoc = glGetUniformLocation(currentMesh->shader->program, "isLight");
+		GLint lLoc = currentMesh->shader->uniform("isLight");
 		glUniform1i(lLoc, (shape.lightIndex != -1));
 
 		if (useShapeColor) {
-			GLint gcLoc = glGetUniformLocation(currentMesh->shader->program, "globalColor");
+			GLint gcLoc = currentMesh->shader->uniform("globalColor");
 			glUniform4fv(gcLoc, 1, glm::value_ptr(shape.color));
 		}
 
-		GLint midLoc = glGetUniformLocation(currentMesh->shader->program, "meshID");
+		GLint midLoc = currentMesh->shader->uniform("meshID");
 		if (midLoc != -1) {
 			glUniform1i(midLoc, shape.index);
 		}
 
-		GLint sLoc = glGetUniformLocation(currentMesh->shader->program, "isSelected");
+		GLint sLoc = currentMesh->shader->uniform("isSelected");
 		if (sLoc != -1) {
 			glUniform1i(sLoc, (int)shape.selected);
 		}
 
-		GLint uLoc = glGetUniformLocation(currentMesh->shader->program, "useLighting");
+		GLint hLoc = currentMesh->shader->uniform("isHovered");
+		if (hLoc != -1) {
+			glUniform1i(hLoc, (int)(shape.index == hoveredIndex));
+		}
+
+		GLint uLoc = currentMesh->shader->uniform("useLighting");
 		if (uLoc != -1) {
 			glUniform1i(uLoc, (int)shape.useLighting);
 		}
@@ -848,27 +1013,21 @@ void AnimationObjectRenderer::renderBatchWithOwnColor(const AnimationObject& sha
 
 		bool foundATexture = true;
 
-		glActiveTexture(GL_TEXTURE0);
-		GLint utLoc = glGetUniformLocation(currentMesh->shader->program, "useTexture");
+		GLState::activeTexture(GL_TEXTURE0);
+		GLint utLoc = currentMesh->shader->uniform("useTexture");
 		GLuint tex = static_cast<GLuint>(reinterpret_cast<intptr_t>(shape.texture));
 		if (auto texptr = TextureRegistry::getTexture(tex)) {
 			glUniform1i(utLoc, 1);
-			glBindTexture(GL_TEXTURE_2D, tex);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, texptr->magFilter._to_integral());
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texptr->minFilter._to_integral());
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, texptr->wrapS._to_integral());
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, texptr->wrapT._to_integral());
+			GLState::bindTexture(GL_TEXTURE_2D, tex);
+			GLState::bindSampler(0, texptr->getSampler());
 		}
 		else if (shape.meshName != "") {
 			auto& shapeMesh = meshCatalog[shape.meshName];
 			if (!shapeMesh.mesh->materials.empty()) {
 				if (auto texptr = shapeMesh.mesh->materials.front().diffuseTexture) {
 					glUniform1i(utLoc, 1);
-					glBindTexture(GL_TEXTURE_2D, texptr->id);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, texptr->magFilter._to_integral());
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texptr->minFilter._to_integral());
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, texptr->wrapS._to_integral());
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, texptr->wrapT._to_integral());
+					GLState::bindTexture(GL_TEXTURE_2D, texptr->id);
+					GLState::bindSampler(0, texptr->getSampler());
 				}
 				else {
 					foundATexture = false;
@@ -884,32 +1043,25 @@ void AnimationObjectRenderer::renderBatchWithOwnColor(const AnimationObject& sha
 
 		if (!foundATexture) {
 			glUniform1i(utLoc, 0);
-			glBindTexture(GL_TEXTURE_2D, 0);
+			GLState::bindTexture(GL_TEXTURE_2D, 0);
 		}
 
-		GLint smLoc = glGetUniformLocation(currentMesh->shader->program, "useShadow");
-		glActiveTexture(GL_TEXTURE1);
+		GLint smLoc = currentMesh->shader->uniform("useShadow");
+		GLState::activeTexture(GL_TEXTURE1);
 		auto ogl = std::dynamic_pointer_cast<OpenGLRenderer>(Application::get().renderer);
 		if (ogl && ogl->shadowMap) {
 			glUniform1i(smLoc, 1);
-			GLint stLoc = glGetUniformLocation(currentMesh->shader->program, "shadowTexture");
+			GLint stLoc = currentMesh->shader->uniform("shadowTexture");
 			glUniform1i(stLoc, 1);
-			glBindTexture(GL_TEXTURE_2D, ogl->shadowMap->textures.front()->id);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-			float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-			glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-			GLint sbLoc = glGetUniformLocation(currentMesh->shader->program, "shadowBias");
+			GLState::bindTexture(GL_TEXTURE_2D, ogl->shadowMap->textures.front()->id);
+			GLState::bindSampler(1, getShadowSampler());
+
+			GLint sbLoc = currentMesh->shader->uniform("shadowBias");
 			glUniform2fv(sbLoc, 1, glm::value_ptr(shadowBias));
 
 			auto& l = GPU::Lighting::get();
-			GLint lpLoc = glGetUniformLocation(currentMesh->shader->program, "lightPosition");
-			GLint ldLoc = glGetUniformLocation(currentMesh->shader->program, "lightDirection");
+			GLint lpLoc = currentMesh->shader->uniform("lightPosition");
+			GLint ldLoc = currentMesh->shader->uniform("lightDirection");
 
 			glUniform3fv(lpLoc, 1, glm::value_ptr(l.position));
 			auto lightDir = glm::normalize(l.center - l.position);
@@ -917,42 +1069,292 @@ void AnimationObjectRenderer::renderBatchWithOwnColor(const AnimationObject& sha
 		}
 		else {
 			glUniform1i(smLoc, 0);
-			glBindTexture(GL_TEXTURE_2D, 0);
+			GLState::bindTexture(GL_TEXTURE_2D, 0);
 		}
 	}
 
 	auto shaderToUse = isShadow ? currentMesh->shadowShader : currentMesh->shader;
 
-	GLint vtLoc = glGetUniformLocation(shaderToUse->program, "useVertexTransform");
+	GLint vtLoc = shaderToUse->uniform("useVertexTransform");
 	glUniform1i(vtLoc, shape.useVertexTransform ? 1 : 0);
 
-	GLint ftLoc = glGetUniformLocation(shaderToUse->program, "useFragmentTransform");
+	GLint ftLoc = shaderToUse->uniform("useFragmentTransform");
 	glUniform1i(ftLoc, shape.useFragmentTransform ? 1 : 0);
 
-	GLint itLoc = glGetUniformLocation(shaderToUse->program, "iTime");
+	GLint itLoc = shaderToUse->uniform("iTime");
 	glUniform1f(itLoc, (float)Application::get().timeSinceStart);
 
-	GLint sizLoc = glGetUniformLocation(shaderToUse->program, "size");
+	GLint sizLoc = shaderToUse->uniform("size");
 	if (sizLoc != -1) {
 		glUniform1f(sizLoc, shape.size);
 	}
 
 
 	if (!shape.cullFace) {
-		glDisable(GL_CULL_FACE);
+		GLState::disable(GL_CULL_FACE);
 	}
 	renderBatch(shape.transform, isShadow);
 
 	if (!shape.cullFace) {
-		glEnable(GL_CULL_FACE);
+		GLState::enable(GL_CULL_FACE);
+	}
+}
+
+GLuint AnimationObjectRenderer::getShadowSampler(GLint compareFunc) {
+	GLState::SamplerState state;
+	state.wrapS = state.wrapT = GL_CLAMP_TO_BORDER;
+	state.compareMode = GL_COMPARE_REF_TO_TEXTURE;
+	state.compareFunc = compareFunc;
+	// Outside the light's view counts as lit
+	state.borderColor = vec4(1.f);
+	return GLState::getSampler(state);
+}
+
+s_ptr<Texture> AnimationObjectRenderer::getObjectTexture(const AnimationObject& shape, const AnimationObjectRenderData& renderData) const {
+	GLuint tex = static_cast<GLuint>(reinterpret_cast<intptr_t>(shape.texture));
+	if (auto texptr = TextureRegistry::getTexture(tex)) {
+		return texptr;
+	}
+
+	if (shape.meshName != "" && renderData.mesh && !renderData.mesh->materials.empty()) {
+		return renderData.mesh->materials.front().diffuseTexture;
+	}
+
+	return nullptr;
+}
+
+void AnimationObjectRenderer::bindShadowMap(const s_ptr<Shader>& shader) {
+	GLint smLoc = shader->uniform("useShadow");
+	GLState::activeTexture(GL_TEXTURE1);
+	auto ogl = std::dynamic_pointer_cast<OpenGLRenderer>(Application::get().renderer);
+	if (ogl && ogl->shadowMap) {
+		glUniform1i(smLoc, 1);
+		GLint stLoc = shader->uniform("shadowTexture");
+		glUniform1i(stLoc, 1);
+		GLState::bindTexture(GL_TEXTURE_2D, ogl->shadowMap->textures.front()->id);
+		GLState::bindSampler(1, getShadowSampler());
+
+		GLint sbLoc = shader->uniform("shadowBias");
+		glUniform2fv(sbLoc, 1, glm::value_ptr(shadowBias));
+
+		auto& l = GPU::Lighting::get();
+		GLint lpLoc = shader->uniform("lightPosition");
+		GLint ldLoc = shader->uniform("lightDirection");
+
+		glUniform3fv(lpLoc, 1, glm::value_ptr(l.position));
+		auto lightDir = glm::normalize(l.center - l.position);
+		glUniform3fv(ldLoc, 1, glm::value_ptr(lightDir));
+	}
+	else {
+		glUniform1i(smLoc, 0);
+		GLState::bindTexture(GL_TEXTURE_2D, 0);
+	}
+}
+
+void AnimationObjectRenderer::renderInstanced(AnimationObjectType shapeType, const std::vector<const AnimationObject*>& shapes, bool isShadow) {
+	if (!initialized)
+	{
+		initialized = init();
+		if (!initialized) return;
+	}
+
+	auto meshToRender = shapeCatalog.find(shapeType);
+	if (meshToRender == shapeCatalog.end()) {
+		shapeCatalog[shapeType] = AnimationObjectRenderData(shapeType);
+	}
+
+	renderInstanced(shapeCatalog[shapeType], shapes, isShadow);
+}
+
+void AnimationObjectRenderer::renderInstanced(AnimationObjectRenderData& renderData, const std::vector<const AnimationObject*>& shapes, bool isShadow) {
+	if (shapes.empty()) return;
+
+	// Shaders that failed to build fall back to a draw per object
+	if (!renderData.instancedShader) {
+		for (auto shape : shapes) {
+			if (shape->shapeType == +AnimationObjectType::model) beginBatchRender(*shape, false, shape->color, isShadow);
+			else beginBatchRender(shape->shapeType, false, vec4(1.f), isShadow);
+			renderBatchWithOwnColor(*shape, isShadow);
+			endBatchRender(isShadow);
+		}
+		return;
 	}
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	currentMesh = &renderData;
+
+	auto& cam = Application::get().renderer->camera;
+	auto shader = isShadow ? renderData.instancedShadowShader : renderData.instancedShader;
+
+	// Sort into runs that share the state a single draw can't vary per instance: the
+	// texture (not needed for shadows), face culling and the fragment transform
+	instanceBatches.clear();
+	instanceBatches.reserve(shapes.size());
+	for (auto shape : shapes) {
+		uint64_t key = (uint64_t)(!shape->cullFace) | ((uint64_t)shape->useFragmentTransform << 1);
+		if (!isShadow) {
+			if (auto texptr = getObjectTexture(*shape, renderData)) {
+				key |= (uint64_t)texptr->id << 2;
+			}
+		}
+		instanceBatches.push_back({ key, shape });
+	}
+	std::sort(instanceBatches.begin(), instanceBatches.end(), [](const auto& a, const auto& b) {
+		return a.first < b.first;
+	});
+
+	GLState::bindVertexArray(isShadow ? renderData.instancedShadowVAO : renderData.instancedVAO);
+
+	// The program runs are drawn with, switched per run when using variants. Uniforms are
+	// per program, so a newly started one gets the per frame ones again.
+	s_ptr<Shader> program;
+	auto useProgram = [&](const s_ptr<Shader>& next) {
+		if (next == program) return;
+		program = next;
+		program->start();
+
+		GLint itLoc = program->uniform("iTime");
+		glUniform1f(itLoc, (float)Application::get().timeSinceStart);
+
+		if (!isShadow) {
+			GLint nmLoc = program->uniform("normalMatrix");
+			mat4 normalMatrix = glm::transpose(glm::inverse(cam.view));
+			glUniformMatrix3fv(nmLoc, 1, GL_FALSE, (const GLfloat*)glm::value_ptr(normalMatrix));
+
+			bindShadowMap(program);
+		}
+	};
+
+	useProgram(shader);
+	if (!isShadow) {
+		GPU::Lighting::get().bind(shader);
+	}
+
+	ShaderPermutations* variants = !isShadow && useShaderVariants ? &getInstancedVariants() : nullptr;
+	uint32_t baseFeatures = 0, textureFeature = 0, transformFeature = 0;
+	if (variants) {
+		auto ogl = std::dynamic_pointer_cast<OpenGLRenderer>(Application::get().renderer);
+		baseFeatures = variants->feature("USE_LIGHTING") | (ogl && ogl->shadowMap ? variants->feature("USE_SHADOW") : 0);
+		textureFeature = variants->feature("USE_TEXTURE");
+		transformFeature = variants->feature("USE_FRAGMENT_TRANSFORM");
+	}
+
+	auto& instances = getInstanceStream();
+	GLsizei indexCount = (GLsizei)renderData.indexVBO->data.size();
+
+	size_t begin = 0;
+	while (begin < instanceBatches.size()) {
+		uint64_t key = instanceBatches[begin].first;
+		size_t end = begin;
+		while (end < instanceBatches.size() && instanceBatches[end].first == key) end++;
+
+		size_t count = end - begin;
+		auto range = instances.allocate<AnimationObjectInstance>(count);
+		auto mapped = range.as<AnimationObjectInstance>();
+		if (!mapped) {
+			begin = end;
+			continue;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			const auto& shape = *instanceBatches[begin + i].second;
+			auto& instance = mapped[i];
+
+			instance.model = shape.transform;
+			instance.color = shape.color;
+			instance.data = ivec2(shape.index, getInstanceFlags(shape));
+			instance.size = shape.size;
+		}
+
+		instances.commit(range);
+
+		// Point the instance attributes at this run's range
+		instanceOffset = range.offset;
+		refreshInstanceAttributes(shader->binding);
+
+		const auto& first = *instanceBatches[begin].second;
+
+		if (!isShadow) {
+			auto texptr = getObjectTexture(first, renderData);
+
+			if (variants) {
+				uint32_t features = baseFeatures | (texptr ? textureFeature : 0) | (first.useFragmentTransform ? transformFeature : 0);
+				auto variant = variants->get(features);
+				if (variant && variant != program) {
+					useProgram(variant);
+					instancingStats.variantSwitches++;
+				}
+			}
+
+			GLint ftLoc = program->uniform("useFragmentTransform");
+			glUniform1i(ftLoc, first.useFragmentTransform ? 1 : 0);
+
+			GLState::activeTexture(GL_TEXTURE0);
+			GLint utLoc = program->uniform("useTexture");
+			if (texptr) {
+				glUniform1i(utLoc, 1);
+				GLState::bindTexture(GL_TEXTURE_2D, texptr->id);
+				GLState::bindSampler(0, texptr->getSampler());
+			}
+			else {
+				glUniform1i(utLoc, 0);
+				GLState::bindTexture(GL_TEXTURE_2D, 0);
+			}
+		}
+
+		if (!first.cullFace) {
+			GLState::disable(GL_CULL_FACE);
+		}
+
+		glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, (GLsizei)count);
+
+		if (!first.cullFace) {
+			GLState::enable(GL_CULL_FACE);
+		}
+
+		instancingStats.draws++;
+		instancingStats.instances += count;
+
+		begin = end;
+	}
+
+	GLState::activeTexture(GL_TEXTURE1);
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+	GLState::activeTexture(GL_TEXTURE0);
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+	GLState::unbindSamplers();
+	program->stop();
+	GLState::bindVertexArray(0);
 }
 
 void AnimationObjectRenderer::renderUI() {
 	if (ImGui::CollapsingHeader("StaticMeshRenderer")) {
 		ImGui::ColorEdit4("Global color", glm::value_ptr(globalColor));
 		ImGui::InputFloat2("Shadow bias", glm::value_ptr(shadowBias));
+
+		IndirectRenderer::get().renderUI();
+
+		ImGui::Checkbox("Instanced rendering", &useInstancing);
+		if (useInstancing) {
+			ImGui::Text("%d instances in %d draws", (int)instancingStats.instances, (int)instancingStats.draws);
+			ImGui::Checkbox("Shader variants", &useShaderVariants);
+			if (useShaderVariants && instancedVariants) {
+				ImGui::Text("%d variants built, %d switches", (int)instancedVariants->size(), (int)instancingStats.variantSwitches);
+			}
+		}
+
+		// Fills the scene with a grid of spheres and boxes to measure the instanced path against
+		static int stressCount = 50000;
+		ImGui::InputInt("Stress objects", &stressCount);
+		if (ImGui::Button("Add stress grid")) {
+			auto& objects = Application::get().objects;
+			int side = (int)glm::ceil(glm::sqrt((float)std::max(stressCount, 1)));
+			objects.reserve(objects.size() + stressCount);
+			for (int i = 0; i < stressCount; i++) {
+				vec3 pos = vec3(i % side - side / 2, 0.5f, i / side - side / 2) * 0.5f;
+				auto st = i % 2 == 0 ? AnimationObjectType::sphere : AnimationObjectType::box;
+				vec4 col = vec4(glm::fract(pos.x * 0.13f), glm::fract(pos.z * 0.17f), 0.6f, 1.f);
+				objects.push_back(AnimationObject(st, pos, vec3(0.f), vec3(0.2f), nullptr, col));
+			}
+		}
 	}
 }
\ No newline at end of file
@@ -10,7 +10,15 @@
 #include "Prompts.h"
 #include "Renderer.h"
 //#include "Shader.h"
+#include "ShaderCache.h"
 #include "AnimationObjectRenderer.h"
+#include "Constraints.h"
+#include "Culling.h"
+#include "OcclusionCulling.h"
+#include "GLStateCache.h"
+#include "GPUProfiler.h"
+#include "Picking.h"
+#include "StreamBuffer.h"
 #include "Tools.h"
 #include "UIHelpers.h"
 
@@ -37,8 +45,12 @@ void Application::init(GLFWwindow* w)
 
 	window = w;
 
-	//renderer = std::make_shared<SoftwareRenderer>();
-	renderer = std::make_shared<OpenGLRenderer>();
+	if (useSoftwareRenderer) {
+		renderer = std::make_shared<SoftwareRenderer>();
+	}
+	else {
+		renderer = std::make_shared<OpenGLRenderer>();
+	}
 	//OGLRenderer = std::make_shared<OpenGLRenderer>();
 
 	if (!renderer) {
@@ -93,6 +105,7 @@ void Application::update()
 {
 	// Gets the time (in seconds) since GLFW was initialized
 	double nowish = getTime();
+	double wallStart = getWallTime();
 
 	// Gets the time since the application began updating
 	timeSinceStart = nowish - startedAt;
@@ -147,9 +160,11 @@ void Application::update()
 		s.updateMatrix();
 	}
 
+	ConstraintSolver::get().solve(deltaTime);
+
 	input.setEvents(events);
 		
-	updateTime = getTime() - nowish;
+	updateTime = getWallTime() - wallStart;
 	lastFrameAt = nowish;
 	frameCounter++;
 }
@@ -158,7 +173,7 @@ void Application::render()
 {
 	if (!renderer) return; 
 
-	auto t = getTime();
+	auto t = getWallTime();
 
 	renderer->ImGuiNewFrame();
 
@@ -169,9 +184,20 @@ void Application::render()
 	
 	renderTime = renderer->Render(*this);
 
+	// Fence this frame's streamed data before the swap
+	StreamBuffer::endFrame();
+
 	renderer->endRender();
 
-	renderTime = getTime() - t;
+	renderTime = getWallTime() - t;
+
+	// The wall clock starts at glfwInit, so this covers window creation and every shader built before the first swap
+	if (timeToFirstFrame == 0.) {
+		timeToFirstFrame = getWallTime();
+		auto& cache = ShaderCache::get();
+		log("Time to first frame: {0:.1f} ms (shader programs: {1} from cache, {2} compiled, {3:.1f} ms compiling)\n",
+			timeToFirstFrame * 1000.0, cache.stats.hits, cache.stats.misses, cache.stats.compileTime * 1000.0);
+	}
 
 	//Profiler::get().add(rendererType._to_string(), Profiled{ renderTime, frameCounter });
 
@@ -209,6 +235,7 @@ void Application::renderUI()
 		ImGui::Text("Frame counter: %lu, time since start: %.4f s", frameCounter, timeSinceStart);
 		ImGui::Text("Update time: %.2f ms", updateTime * 1000);
 		ImGui::Text("Render time: %.2f ms", renderTime * 1000);
+		ImGui::Text("Time to first frame: %.1f ms", timeToFirstFrame * 1000);
 		ImGui::Text("Delta time: %.2f ms", deltaTime * 1000);
 		ImGui::Text("FPS (from delta time): %.2f", 1.0 / deltaTime);
 
@@ -255,10 +282,13 @@ void Application::renderUI()
 
 		if (toDelete >= 0 && toDelete < objects.size()) {
 			auto d = objects.begin() + toDelete;
+			ConstraintSolver::get().remove(d->index);
 			objects.erase(d);
 		}
 	}
 
+	ConstraintSolver::get().renderUI();
+
 	Input::get().renderUI();
 
 	if (ImGui::CollapsingHeader("Tools")) {
@@ -279,6 +309,13 @@ void Application::renderUI()
 	if (renderer) renderer->renderUI();
 
 	AnimationObjectRenderer::get().renderUI();
+	SceneCulling::get().renderUI();
+	OcclusionCulling::get().renderUI();
+	ShaderCache::get().renderUI();
+	StreamBuffer::renderUI();
+	GPUProfiler::get().renderUI();
+	GLState::renderUI();
+	Picker::get().renderUI();
 	/*SimpleShapeRenderer::get().renderUI();
 	LineRenderer::get().renderUI();*/
 
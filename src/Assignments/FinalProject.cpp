@@ -4,6 +4,7 @@
 #include "FinalProject.h"
 #include "Application.h"
 #include "AnimationObjectRenderer.h"
+#include "GLStateCache.h"
 #include "GLTFImporter.h"
 #include "InputOutput.h"
 #include "Lighting.h"
@@ -64,17 +65,17 @@ void FinalProject::render(const mat4& projection, const mat4& view, s_ptr<Frameb
 		GPU::Lighting::get().bind(jr.currentMesh->shader);
 		if (ground.cullFace)
 		{
-			glEnable(GL_CULL_FACE);
-			glCullFace(GL_BACK);
+			GLState::enable(GL_CULL_FACE);
+			GLState::cullFace(GL_BACK);
 		}
 		else {
-			glDisable(GL_CULL_FACE);
+			GLState::disable(GL_CULL_FACE);
 		}
 	}
 
 	if (isShadow) {
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_FRONT);
+		GLState::enable(GL_CULL_FACE);
+		GLState::cullFace(GL_FRONT);
 	}
 
 	ground.updateMatrix(true);
@@ -4,8 +4,11 @@
 #include "Lab02.h"
 #include "Application.h"
 #include "AnimationObjectRenderer.h"
+#include "GLStateCache.h"
 #include "InputOutput.h"
 #include "Lighting.h"
+#include "LineRenderer.h"
+#include "SplinePath.h"
 #include "UIHelpers.h"
 
 namespace cmps_4480_lab_02 {
@@ -17,10 +20,20 @@ namespace cmps_4480_lab_02 {
 	std::vector<vec3> framePositions(1024);
 	// Current frame of playback. Value should be in [0, framePositions.size() - 1]
 	size_t currentFrame = 0;
+	// Number of frames that hold recorded positions
+	size_t recordedFrames = 0;
 	// Boolean states: recording and playing
 	bool isRecording = false;
 	bool isPlaying = false;
 
+	// Smooth path fit through the recording. Playing along it moves at constant speed
+	// instead of replaying the raw per-frame positions.
+	SplinePath path;
+	SplineType pathType = SplineType::Centripetal;
+	float pathEpsilon = 0.05f;
+	bool playAlongPath = false;
+	bool showPath = true;
+
 	// Variables for giving the ball a motion trail
 	bool showTrail = true;
 	std::vector<AnimationObject> trail;
@@ -48,6 +61,18 @@ namespace cmps_4480_lab_02 {
 		}
 	}
 
+	void buildPath() {
+		std::vector<vec3> samples(framePositions.begin(), framePositions.begin() + std::min(recordedFrames, framePositions.size()));
+		path = SplinePath::fromSamples(samples, pathEpsilon, pathType);
+		log("Path: {0} recorded frames reduced to {1} points, {2:.2f} units long\n", samples.size(), path.getPoints().size(), path.length());
+	}
+
+	// Distance along the path for the current frame, so the whole recording plays at constant speed
+	float pathDistance() {
+		if (recordedFrames < 2) return 0.f;
+		return path.length() * (float)std::min(currentFrame, recordedFrames - 1) / (float)(recordedFrames - 1);
+	}
+
 	// Where the motion data file will be saved. This should be the root
 	// of the project directory.
 	std::string labDataFilepath() {
@@ -86,6 +111,7 @@ void Lab02::update() {
 			if (isRecording && nextFrame >= framePositions.size()) {
 				log("Done recording!");
 				isRecording = false;
+				buildPath();
 			}
 
 			// Advance the frame. For playback, loop it back around to the beginning.
@@ -98,6 +124,7 @@ void Lab02::update() {
 	// When recording: save ball's current position to the current frame
 	if (isRecording) {
 		framePositions[currentFrame] = ball.localPosition;
+		recordedFrames = std::max(recordedFrames, currentFrame + 1);
 
 		// Need to interpolate between these frames and last frames 
 		if (framesToAdvance > 1) {
@@ -113,6 +140,9 @@ void Lab02::update() {
 		}
 	}
 	// When playing: load ball's current position from the current frame
+	else if (isPlaying && playAlongPath && !path.empty()) {
+		ball.localPosition = path.positionAtDistance(pathDistance());
+	}
 	else if (isPlaying && !framePositions.empty()) {
 		ball.localPosition = framePositions[currentFrame];
 	}
@@ -134,10 +164,27 @@ void Lab02::update() {
 			lastBallPosition = ball.localPosition;
 		}
 
-		for (size_t i = trail.size() - 1; i > 0; i--) {
-			auto& ti = trail[i];
-			auto& tj = trail[i - 1];
-			ti.localPosition = tj.localPosition;
+		if (isPlaying && playAlongPath && !path.empty()) {
+			// Followers sit at fixed gaps behind the ball along the path, evaluated in one batch
+			// from the farthest back to the nearest
+			size_t n = trail.size();
+			float ballDistance = pathDistance();
+			std::vector<float> distances(n);
+			std::vector<vec3> positions(n);
+			for (size_t k = 0; k < n; k++) {
+				distances[k] = glm::max(0.f, ballDistance - (n - k) * minTrailGap);
+			}
+			path.evaluate(distances.data(), positions.data(), n);
+			for (size_t k = 0; k < n; k++) {
+				trail[n - 1 - k].localPosition = positions[k];
+			}
+		}
+		else {
+			for (size_t i = trail.size() - 1; i > 0; i--) {
+				auto& ti = trail[i];
+				auto& tj = trail[i - 1];
+				ti.localPosition = tj.localPosition;
+			}
 		}
 	}
 }
@@ -153,8 +200,8 @@ void Lab02::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 	}
 
 	if (isShadow) {
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_FRONT);
+		GLState::enable(GL_CULL_FACE);
+		GLState::cullFace(GL_FRONT);
 	}
 
 	// Render ball
@@ -172,6 +219,17 @@ void Lab02::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 	}
 	
 	jr.endBatchRender(isShadow);
+
+	if (!isShadow && showPath && !path.empty()) {
+		auto points = path.sample(256);
+
+		LineRenderer& lr = LineRenderer::get();
+		lr.begin();
+		for (size_t i = 1; i < points.size(); i++) {
+			lr.renderSingle(points[i - 1], points[i], vec4(0.2f, 0.8f, 1.0f, 1.0f), 0.05f);
+		}
+		lr.end();
+	}
 }
 
 // Renders the UI controls for the lab.
@@ -185,6 +243,7 @@ void Lab02::renderUI() {
 	}
 	else if (ImGui::Button("Stop record")) {
 		isRecording = false;
+		buildPath();
 	}
 
 	ImGui::SameLine();
@@ -225,6 +284,8 @@ void Lab02::renderUI() {
 				vec3* location = framePositions.data() + i;
 				fin.read((char*)location, sizeof(float) * 3);
 			}
+			recordedFrames = framePositions.size();
+			buildPath();
 		}
 	}
 
@@ -232,13 +293,15 @@ void Lab02::renderUI() {
 	if (ImGui::Button("Reset")) {
 		framePositions.assign(framePositions.size(), vec3(0));
 		currentFrame = 0;
+		recordedFrames = 0;
+		path = SplinePath();
 	}
 
 	// Slider for playback
 	int pf = (int)currentFrame;
 	if (ImGui::SliderInt("Frame position", &pf, 0, (int)framePositions.size() - 1)) {
 		currentFrame = (size_t)pf;
-		ball.localPosition = framePositions[currentFrame];
+		ball.localPosition = playAlongPath && !path.empty() ? path.positionAtDistance(pathDistance()) : framePositions[currentFrame];
 	}
 
 	int fps = FPS;
@@ -252,6 +315,22 @@ void Lab02::renderUI() {
 
 	ImGui::Text("SPF: %.2f", SPF);
 
+	if (ImGui::CollapsingHeader("Path")) {
+		IMDENT;
+		ImGui::Checkbox("Play along path", &playAlongPath);
+		ImGui::SameLine();
+		ImGui::Checkbox("Show path", &showPath);
+
+		bool rebuild = renderEnumDropDown<SplineType>("Path type", pathType);
+		rebuild |= ImGui::InputFloat("Simplify epsilon", &pathEpsilon);
+		if (rebuild || ImGui::Button("Rebuild path")) {
+			buildPath();
+		}
+
+		ImGui::Text("%d points, %d segments, length %.2f", (int)path.getPoints().size(), (int)path.numSegments(), path.length());
+		IMDONT;
+	}
+
 	ImGui::Checkbox("Show trail", &showTrail);
 
 	if (showTrail) {
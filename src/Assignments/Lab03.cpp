@@ -4,6 +4,7 @@
 #include "Lab03.h"
 #include "Application.h"
 #include "AnimationObjectRenderer.h"
+#include "GLStateCache.h"
 #include "InputOutput.h"
 #include "Lighting.h"
 #include "UIHelpers.h"
@@ -158,8 +159,8 @@ void Lab03::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 		GPU::Lighting::get().bind(jr.currentMesh->shader);
 	}
 	else {
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_FRONT);
+		GLState::enable(GL_CULL_FACE);
+		GLState::cullFace(GL_FRONT);
 	}
 
 	// Render the table and its legs
@@ -4,9 +4,11 @@
 #include "Lab04.h"
 #include "Application.h"
 #include "AnimationObjectRenderer.h"
+#include "GLStateCache.h"
 #include "InputOutput.h"
 #include "Lighting.h"
 #include "Prompts.h"
+#include "SceneFile.h"
 #include "UIHelpers.h"
 
 #include <cassert>
@@ -226,7 +228,16 @@ namespace cmps_4480_lab_04 {
 	}
 
 	std::string defaultName() {
-		return fmt::format("cmps-4480-lab04-{0}.json", yourName);
+		return fmt::format("cmps-4480-lab04-{0}.scene", yourName);
+	}
+
+	// What a saved scene records, and the defaults for fields a loaded one doesn't have
+	SceneFile::Config sceneConfig() {
+		SceneFile::Config config;
+		config.name = yourName;
+		config.numFrames = numFrames;
+		config.fps = FPS;
+		return config;
 	}
 }
 
@@ -316,12 +327,12 @@ void Lab04::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 		}
 
 		if (isShadow) {
-			glEnable(GL_CULL_FACE);
+			GLState::enable(GL_CULL_FACE);
 			if (st == +AnimationObjectType::quad || st == +AnimationObjectType::tri) {
-				glCullFace(GL_BACK);
+				GLState::cullFace(GL_BACK);
 			}
 			else {
-				glCullFace(GL_FRONT);
+				GLState::cullFace(GL_FRONT);
 			}
 		}
 
@@ -384,6 +395,13 @@ void Lab04::renderUI() {
 		loadScene();
 	}
 	ImGui::SameLine();
+	if (ImGui::Button("Export JSON")) {
+		std::string exportFilename = Util::SaveFile({ "json file (.json)", "*.json", "All files (*)", "*" }, IO::getAssetRoot(), StringUtil::replaceAll(defaultName(), ".scene", ".json"));
+		if (exportFilename != "") {
+			SceneFile::saveLabJSON(exportFilename, sceneConfig(), objects, interpCommands);
+		}
+	}
+	ImGui::SameLine();
 	if (ImGui::Button("Clear scene")) {
 		objects.clear();
 	}
@@ -511,91 +529,24 @@ ptr_vector<AnimationObject> Lab04::getObjects() {
 }
 
 
-void Lab04::saveScene() {
-	std::string saveFilename = Util::SaveFile({ "json file (.json)", "*.json", "All files (*)", "*" }, IO::getAssetRoot(), defaultName());
-	if (saveFilename != "") {
-		json saveData;
-		auto& configData = saveData["config"];
-		configData["name"] = yourName;
-		configData["numFrames"] = numFrames;
-		configData["FPS"] = FPS;
-
-		auto& objectData = saveData["objects"];
-		for (auto& obj : objects) {
-			objectData.push_back(obj);
-		}
-
-		auto& interpData = saveData["interpolations"];
-		for (auto& objectCommands : interpCommands) {
-			for (const auto& command : objectCommands.second) {
-				interpData.push_back(command);
-			}
-		}
-		/*configData["maxAnimationFrames"] = maxAnimationFrames;
-		configData["animationFPS"] = animationFPS;
-		auto& shapesData = saveData["shapes"];
-		for (auto& s : shapes) {
-			shapesData.push_back(s);
-		}*/
-
-		/*auto& animData = saveData["animations"];
-		for (auto& a : animations) {
-			animData.push_back(a);
-		}*/
+// Scene files use the binary format unless a .json filename is chosen
+const string_vector sceneFilters = { "scene file (.scene)", "*.scene", "json file (.json)", "*.json", "All files (*)", "*" };
 
-		std::ofstream fout(saveFilename);
+void Lab04::saveScene() {
+	std::string saveFilename = Util::SaveFile(sceneFilters, IO::getAssetRoot(), defaultName());
+	if (saveFilename == "") return;
 
-		fout << saveData.dump(4) << std::endl;
-	}
+	SceneFile::saveLab(saveFilename, sceneConfig(), objects, interpCommands);
 }
 
 void Lab04::loadScene() {
-	std::string loadFilename = Util::LoadFile({ "json file (.json)", "*.json", "All files (*)", "*" }, IO::getAssetRoot());
-	if (loadFilename != "") {
-		std::ifstream fin(loadFilename);
-		json loadData;
-		fin >> loadData;
-
-		try {
-			auto& configData = loadData["config"];
-			configData.at("numFrames").get_to(numFrames);
-			configData.at("FPS").get_to(FPS);
-			SPF = 1.0 / FPS;
-		}
-		catch (json::type_error te) {
-			log("{0}\n", te.what());
-		}
-		catch (json::out_of_range oor) {
-			log("{0}\n", oor.what());
-		}
-
-		objects.clear();
-
-		for (auto& js : loadData["objects"]) {
-			objects.push_back(js);
-			objects.back().updateMatrix();
-		}
-
-		for (auto& object: objects) {
-			if (object.parentIndex >= 0 && object.parentIndex < objects.size() && object.parent == nullptr) {
-				object.setParent(&objects[object.parentIndex], false);
-			}
-		}
+	std::string loadFilename = Util::LoadFile(sceneFilters, IO::getAssetRoot());
+	if (loadFilename == "") return;
 
-		for (auto& interp : loadData["interpolations"]) {
-			InterpCommand fileCmd = interp;
-			// Find object by this id
-			for (auto& obj : objects) {
-				if (obj.index == fileCmd.objectId) {
-					addInterpCommandToObject(obj, fileCmd);
-					break;
-				}
-			}
-		}
+	SceneFile::Config config = sceneConfig();
+	if (!SceneFile::loadLab<InterpCommand>(loadFilename, config, objects, interpCommands, addInterpCommandToObject)) return;
 
-		//for (auto& ja : loadData["animations"]) {
-		//	animations.push_back(ja);
-		//	animations.back().updatePointers();
-		//}
-	}
-}
\ No newline at end of file
+	numFrames = config.numFrames;
+	FPS = std::max(1, (int)config.fps);
+	SPF = 1.0 / FPS;
+}
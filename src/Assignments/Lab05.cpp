@@ -4,9 +4,11 @@
 #include "Lab05.h"
 #include "Application.h"
 #include "AnimationObjectRenderer.h"
+#include "GLStateCache.h"
 #include "InputOutput.h"
 #include "Lighting.h"
 #include "Prompts.h"
+#include "SceneFile.h"
 #include "UIHelpers.h"
 
 #include <cassert>
@@ -235,7 +237,16 @@ namespace cmps_4480_lab_05 {
 	}
 
 	std::string defaultName() {
-		return fmt::format("cmps-4480-Lab05-{0}.json", yourName);
+		return fmt::format("cmps-4480-Lab05-{0}.scene", yourName);
+	}
+
+	// What a saved scene records, and the defaults for fields a loaded one doesn't have
+	SceneFile::Config sceneConfig() {
+		SceneFile::Config config;
+		config.name = yourName;
+		config.numFrames = numFrames;
+		config.fps = FPS;
+		return config;
 	}
 }
 
@@ -298,12 +309,12 @@ void Lab05::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 		}
 
 		if (isShadow) {
-			glEnable(GL_CULL_FACE);
+			GLState::enable(GL_CULL_FACE);
 			if (st == +AnimationObjectType::quad || st == +AnimationObjectType::tri) {
-				glCullFace(GL_BACK);
+				GLState::cullFace(GL_BACK);
 			}
 			else {
-				glCullFace(GL_FRONT);
+				GLState::cullFace(GL_FRONT);
 			}
 		}
 
@@ -376,6 +387,13 @@ void Lab05::renderUI() {
 		loadScene();
 	}
 	ImGui::SameLine();
+	if (ImGui::Button("Export JSON")) {
+		std::string exportFilename = Util::SaveFile({ "json file (.json)", "*.json", "All files (*)", "*" }, IO::getAssetRoot(), StringUtil::replaceAll(defaultName(), ".scene", ".json"));
+		if (exportFilename != "") {
+			SceneFile::saveLabJSON(exportFilename, sceneConfig(), objects, interpCommands);
+		}
+	}
+	ImGui::SameLine();
 	if (ImGui::Button("Clear scene")) {
 		objects.clear();
 	}
@@ -506,99 +524,24 @@ ptr_vector<AnimationObject> Lab05::getObjects() {
 }
 
 
-void Lab05::saveScene() {
-	std::string saveFilename = Util::SaveFile({ "json file (.json)", "*.json", "All files (*)", "*" }, IO::getAssetRoot(), defaultName());
-	if (saveFilename != "") {
-		json saveData;
-		auto& configData = saveData["config"];
-		configData["name"] = yourName;
-		configData["numFrames"] = numFrames;
-		configData["FPS"] = FPS;
-
-		auto& objectData = saveData["objects"];
-		for (auto& obj : objects) {
-			objectData.push_back(obj);
-		}
-
-		auto& interpData = saveData["interpolations"];
-		for (auto& objectCommands : interpCommands) {
-			for (const auto& command : objectCommands.second) {
-				interpData.push_back(command);
-			}
-		}
-		/*configData["maxAnimationFrames"] = maxAnimationFrames;
-		configData["animationFPS"] = animationFPS;
-		auto& shapesData = saveData["shapes"];
-		for (auto& s : shapes) {
-			shapesData.push_back(s);
-		}*/
-
-		/*auto& animData = saveData["animations"];
-		for (auto& a : animations) {
-			animData.push_back(a);
-		}*/
+// Scene files use the binary format unless a .json filename is chosen
+const string_vector sceneFilters = { "scene file (.scene)", "*.scene", "json file (.json)", "*.json", "All files (*)", "*" };
 
-		std::ofstream fout(saveFilename);
+void Lab05::saveScene() {
+	std::string saveFilename = Util::SaveFile(sceneFilters, IO::getAssetRoot(), defaultName());
+	if (saveFilename == "") return;
 
-		fout << saveData.dump(4) << std::endl;
-	}
+	SceneFile::saveLab(saveFilename, sceneConfig(), objects, interpCommands);
 }
 
 void Lab05::loadScene() {
-	std::string loadFilename = Util::LoadFile({ "json file (.json)", "*.json", "All files (*)", "*" }, IO::getAssetRoot());
-	if (loadFilename != "") {
-		std::ifstream fin(loadFilename);
-		json loadData;
-		fin >> loadData;
-
-		try {
-			auto& configData = loadData["config"];
-			configData.at("numFrames").get_to(numFrames);
-			configData.at("FPS").get_to(FPS);
-			SPF = 1.0 / FPS;
-		}
-		catch (json::type_error te) {
-			log("{0}\n", te.what());
-		}
-		catch (json::out_of_range oor) {
-			log("{0}\n", oor.what());
-		}
+	std::string loadFilename = Util::LoadFile(sceneFilters, IO::getAssetRoot());
+	if (loadFilename == "") return;
 
-		objects.clear();
-
-		for (auto& js : loadData["objects"]) {
-			objects.push_back(js);
-			objects.back().updateMatrix();
-		}
-
-		for (auto& object: objects) {
-			if (object.parentIndex >= 0) {
-				for (auto& other : objects) {
-					if (&other == &object) continue;
-					if (other.index == object.parentIndex) {
-						object.setParent(&other, false);
-						break;
-					}
-				}
-			}
-		}
+	SceneFile::Config config = sceneConfig();
+	if (!SceneFile::loadLab<InterpCommand>(loadFilename, config, objects, interpCommands, addInterpCommandToObject)) return;
 
-		interpCommands.clear();
-
-		for (auto& interp : loadData["interpolations"]) {
-			InterpCommand fileCmd = interp;
-			// Find object by this id
-			for (auto& obj : objects) {
-				if (obj.index == fileCmd.objectId) {
-					addInterpCommandToObject(obj, fileCmd);
-					break;
-				}
-			}
-		}
-
-		//for (auto& ja : loadData["animations"]) {
-		//	animations.push_back(ja);
-		//	animations.back().updatePointers();
-		//}
-	}
-}
\ No newline at end of file
+	numFrames = config.numFrames;
+	FPS = std::max(1, (int)config.fps);
+	SPF = 1.0 / FPS;
+}
@@ -4,6 +4,8 @@
 #include "Lab07.h"
 #include "Application.h"
 #include "AnimationObjectRenderer.h"
+#include "DependencyGraph.h"
+#include "GLStateCache.h"
 #include "GLTFImporter.h"
 #include "InputOutput.h"
 #include "Lighting.h"
@@ -49,6 +51,39 @@ namespace cmps_4480_lab_07 {
 	float timeOfDay = 0.0f;
 
 	bool autoChangeTimeOfDay = false;
+
+	// Everything driven by timeOfDay, so it's only recomputed on frames where timeOfDay changes
+	DependencyGraph timeOfDayGraph("Time of day");
+	float sunAngle = 0.0f;
+	float sunDistance = 90.0f;
+
+	void buildTimeOfDayGraph() {
+		auto& graph = timeOfDayGraph;
+		graph.clear();
+
+		auto tod = graph.addInput("Time of day", &timeOfDay);
+
+		// Noon is straight overhead, midnight is straight below
+		auto angle = graph.addDriven("Sun angle", { tod }, []() {
+			sunAngle = timeOfDay * glm::pi<float>();
+		});
+
+		graph.addDriven("Sun position", { angle }, []() {
+			sun.localPosition = sunDistance * vec3(glm::sin(sunAngle), glm::cos(sunAngle), 0.f);
+		});
+
+		// Yellow overhead, orange at the horizon, dim below it
+		graph.addDriven("Sun color", { angle }, []() {
+			float height = glm::cos(sunAngle);
+			vec3 color = glm::mix(vec3(1.f, 0.45f, 0.1f), vec3(1.f, 1.f, 0.f), glm::clamp(height, 0.f, 1.f));
+			sun.color = vec4(color * glm::clamp(height + 1.f, 0.2f, 1.f), 1.f);
+		});
+
+		graph.addDriven("Sky ambient", { tod }, []() {
+			float daylight = glm::clamp(glm::cos(timeOfDay * glm::pi<float>()) * 0.5f + 0.5f, 0.f, 1.f);
+			GPU::Lighting::get().sceneLight.scene_ambient = vec4(glm::mix(vec3(0.02f, 0.02f, 0.05f), vec3(0.1f), daylight), 1.f);
+		});
+	}
 }
 
 using namespace cmps_4480_lab_07;
@@ -165,7 +200,7 @@ void main()
 				GLTFGPUData primGPU;
 				glGenVertexArrays(1, &primGPU.VAO);
 
-				glBindVertexArray(primGPU.VAO);
+				GLState::bindVertexArray(primGPU.VAO);
 
 				for (auto& attribute : prim.attributes.items()) {
 					const auto& attribName = attribute.key();
@@ -222,7 +257,7 @@ void main()
 					}
 				}
 
-				glBindVertexArray(0);
+				GLState::bindVertexArray(0);
 
 				gpu.push_back(primGPU);
 			}
@@ -245,7 +280,8 @@ void main()
 	}
 
 	sky->context = context;
-	
+
+	buildTimeOfDayGraph();
 
 	initialized = true;
 }
@@ -278,7 +314,8 @@ void Lab07::update() {
 		// previous labs, functions, etc.
 	}
 
-	// TODO 2: change the sun position with respect to the timeOfDay variable
+	// Sun position, sun colour and ambient follow timeOfDay, recomputed only when it changes
+	timeOfDayGraph.evaluate();
 
 
 
@@ -505,9 +542,9 @@ void Lab07::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 
 				mat4 mvp = projection * view * node->matrix;
 
-				auto mvpLoc = glGetUniformLocation(sky->context->shader->program, "mvp");
+				auto mvpLoc = sky->context->shader->uniform("mvp");
 				glUniformMatrix4fv(mvpLoc, 1, GL_FALSE, glm::value_ptr(mvp));
-				auto modelLoc = glGetUniformLocation(sky->context->shader->program, "model");
+				auto modelLoc = sky->context->shader->uniform("model");
 				glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(node->matrix));
 
 				for (uint32_t i = 0; i < mesh->primitives.size(); i++) {
@@ -520,27 +557,27 @@ void Lab07::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 						primMaterial = &sky->materials[prim.material];
 
 						if (primMaterial->doubleSided) {
-							glDisable(GL_CULL_FACE);
+							GLState::disable(GL_CULL_FACE);
 						}
 						else {
-							glEnable(GL_CULL_FACE);
+							GLState::enable(GL_CULL_FACE);
 						}
 
-						auto itfLoc = glGetUniformLocation(sky->context->shader->program, "timeOfDay");
+						auto itfLoc = sky->context->shader->uniform("timeOfDay");
 						glUniform1f(itfLoc, timeOfDay);
 
-						auto bcfLoc = glGetUniformLocation(sky->context->shader->program, "baseColorFactor");
+						auto bcfLoc = sky->context->shader->uniform("baseColorFactor");
 						glUniform4fv(bcfLoc, 1, glm::value_ptr(primMaterial->pbr.baseColorFactor));
 
-						auto acLoc = glGetUniformLocation(sky->context->shader->program, "alphaCutoff");
+						auto acLoc = sky->context->shader->uniform("alphaCutoff");
 						glUniform1f(acLoc, primMaterial->alphaCutoff);
 
 
-						glActiveTexture(GL_TEXTURE0);
-						GLint itLoc = glGetUniformLocation(sky->context->shader->program, "inputTexture");
+						GLState::activeTexture(GL_TEXTURE0);
+						GLint itLoc = sky->context->shader->uniform("inputTexture");
 						glUniform1i(itLoc, 0);
 
-						GLint utLoc = glGetUniformLocation(sky->context->shader->program, "useTexture");
+						GLint utLoc = sky->context->shader->uniform("useTexture");
 						if (primMaterial->pbr.baseColorTexture.index >= 0) {
 
 							const GLTFTexture& tex = sky->textures[primMaterial->pbr.baseColorTexture.index];
@@ -548,7 +585,7 @@ void Lab07::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 							if (tex.source >= 0) {
 								GLuint texture = sky->context->imageTextures[tex.source]->id;
 								glUniform1i(utLoc, 1);
-								glBindTexture(GL_TEXTURE_2D, texture);
+								GLState::bindTexture(GL_TEXTURE_2D, texture);
 								// Set sampler
 								if (tex.sampler >= 0) {
 									const GLTFSampler& sampler = sky->samplers[tex.sampler];
@@ -562,26 +599,26 @@ void Lab07::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 							}
 							else {
 								glUniform1i(utLoc, 0);
-								glBindTexture(GL_TEXTURE_2D, 0);
+								GLState::bindTexture(GL_TEXTURE_2D, 0);
 							}
 
 						}
 						else {
 							glUniform1i(utLoc, 0);
-							glBindTexture(GL_TEXTURE_2D, 0);
+							GLState::bindTexture(GL_TEXTURE_2D, 0);
 						}
 					}
 
 					
-					glActiveTexture(GL_TEXTURE1);
-					glBindTexture(GL_TEXTURE_2D, 0);
+					GLState::activeTexture(GL_TEXTURE1);
+					GLState::bindTexture(GL_TEXTURE_2D, 0);
 					
-					//glActiveTexture(GL_TEXTURE1);
-					//glBindTexture(GL_TEXTURE_2D, 0);
-					//GLint stLoc = glGetUniformLocation(gltf->context->shader->program, "shadowTexture");
+					//GLState::activeTexture(GL_TEXTURE1);
+					//GLState::bindTexture(GL_TEXTURE_2D, 0);
+					//GLint stLoc = gltf->context->shader->uniform("shadowTexture");
 					//glUniform1i(stLoc, 1);
 
-					glBindVertexArray(primGPU.VAO);
+					GLState::bindVertexArray(primGPU.VAO);
 
 					// If we have an index buffer, draw this primitive with glDrawElements
 					if (prim.indices >= 0) {
@@ -602,15 +639,15 @@ void Lab07::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 						}
 					}
 
-					glBindVertexArray(0);
+					GLState::bindVertexArray(0);
 				}
 			}
 		}
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, 0);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		GLState::activeTexture(GL_TEXTURE0);
+		GLState::bindTexture(GL_TEXTURE_2D, 0);
+		GLState::activeTexture(GL_TEXTURE1);
+		GLState::bindTexture(GL_TEXTURE_2D, 0);
 
 		sky->context->shader->stop();
 	}
@@ -625,12 +662,12 @@ void Lab07::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 	}
 
 	if (isShadow) {
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_FRONT);
+		GLState::enable(GL_CULL_FACE);
+		GLState::cullFace(GL_FRONT);
 	}
 	else {
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_BACK);
+		GLState::enable(GL_CULL_FACE);
+		GLState::cullFace(GL_BACK);
 	}
 
 	sun.updateMatrix(true);
@@ -644,17 +681,17 @@ void Lab07::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 		GPU::Lighting::get().bind(jr.currentMesh->shader);
 		if (ground.cullFace)
 		{
-			glEnable(GL_CULL_FACE);
-			glCullFace(GL_BACK);
+			GLState::enable(GL_CULL_FACE);
+			GLState::cullFace(GL_BACK);
 		}
 		else {
-			glDisable(GL_CULL_FACE);
+			GLState::disable(GL_CULL_FACE);
 		}
 	}
 
 	if (isShadow) {
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_FRONT);
+		GLState::enable(GL_CULL_FACE);
+		GLState::cullFace(GL_FRONT);
 	}
 
 	ground.updateMatrix(true);
@@ -726,6 +763,12 @@ void Lab07::renderUI() {
 	ImGui::SliderFloat("Time of day", &timeOfDay, 0.0f, 1.0f);
 	ImGui::Checkbox("Auto-update time of day", &autoChangeTimeOfDay);
 
+	if (ImGui::CollapsingHeader("Time of day graph")) {
+		IMDENT;
+		timeOfDayGraph.renderUI();
+		IMDONT;
+	}
+
 	if (ImGui::CollapsingHeader("Sun")) {
 		sun.renderUI();
 	}
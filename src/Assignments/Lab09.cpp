@@ -4,6 +4,7 @@
 #include "Lab09.h"
 #include "Application.h"
 #include "AnimationObjectRenderer.h"
+#include "GLStateCache.h"
 #include "GLTFImporter.h"
 #include "InputOutput.h"
 #include "Lighting.h"
@@ -87,7 +88,7 @@ namespace cmps_4480_lab_09 {
 					GLTFGPUData primGPU;
 					glGenVertexArrays(1, &primGPU.VAO);
 
-					glBindVertexArray(primGPU.VAO);
+					GLState::bindVertexArray(primGPU.VAO);
 
 					for (auto& attribute : prim.attributes.items()) {
 						const auto& attribName = attribute.key();
@@ -158,7 +159,7 @@ namespace cmps_4480_lab_09 {
 						}
 					}
 
-					glBindVertexArray(0);
+					GLState::bindVertexArray(0);
 
 					gpu.push_back(primGPU);
 				}
@@ -494,26 +495,22 @@ void Lab09::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 
 				GPU::Lighting::get().bind(meshWithSkin->context->shader);
 
-				auto joLoc = glGetUniformLocation(meshWithSkin->context->shader->program, "joints");
-				if (joLoc >= 0) {
-
-					int i = 0; 
-					for (auto j : skin.joints) {
-						auto& jNode = meshWithSkin->nodes[j];
-						skin.jointMatrices[i] = //invNode * 
-							jNode->matrix * skin.inverseBindMatrices[j];
-						i++;
-					}
-
-					glUniformMatrix4fv(joLoc, skin.jointMatrices.size(), GL_FALSE, (const GLfloat*)skin.jointMatrices.data());
+				int i = 0; 
+				for (auto j : skin.joints) {
+					auto& jNode = meshWithSkin->nodes[j];
+					skin.jointMatrices[i] = //invNode * 
+						jNode->matrix * skin.inverseBindMatrices[j];
+					i++;
 				}
 
-				auto jcLoc = glGetUniformLocation(meshWithSkin->context->shader->program, "jointColors");
+				GLTFRenderer::get().bindJointPalette(skin.jointMatrices);
+
+				auto jcLoc = meshWithSkin->context->shader->uniform("jointColors");
 				if (jcLoc >= 0) {
 					glUniform4fv(jcLoc, jointColors.size(), (const GLfloat*)jointColors.data());
 				}
 
-				auto vpLoc = glGetUniformLocation(meshWithSkin->context->shader->program, "viewproj");
+				auto vpLoc = meshWithSkin->context->shader->uniform("viewproj");
 				if (vpLoc >= 0) {
 					auto viewproj = projection * view;
 					glUniformMatrix4fv(vpLoc, 1, GL_FALSE, glm::value_ptr(viewproj));
@@ -529,24 +526,24 @@ void Lab09::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 						primMaterial = &meshWithSkin->materials[prim.material];
 
 						if (primMaterial->doubleSided) {
-							glDisable(GL_CULL_FACE);
+							GLState::disable(GL_CULL_FACE);
 						}
 						else {
-							glEnable(GL_CULL_FACE);
+							GLState::enable(GL_CULL_FACE);
 						}
 
-						auto bcfLoc = glGetUniformLocation(meshWithSkin->context->shader->program, "baseColorFactor");
+						auto bcfLoc = meshWithSkin->context->shader->uniform("baseColorFactor");
 						glUniform4fv(bcfLoc, 1, glm::value_ptr(primMaterial->pbr.baseColorFactor));
 
-						auto acLoc = glGetUniformLocation(meshWithSkin->context->shader->program, "alphaCutoff");
+						auto acLoc = meshWithSkin->context->shader->uniform("alphaCutoff");
 						glUniform1f(acLoc, primMaterial->alphaCutoff);
 
 
-						glActiveTexture(GL_TEXTURE0);
-						GLint itLoc = glGetUniformLocation(meshWithSkin->context->shader->program, "inputTexture");
+						GLState::activeTexture(GL_TEXTURE0);
+						GLint itLoc = meshWithSkin->context->shader->uniform("inputTexture");
 						glUniform1i(itLoc, 0);
 
-						GLint utLoc = glGetUniformLocation(meshWithSkin->context->shader->program, "useTexture");
+						GLint utLoc = meshWithSkin->context->shader->uniform("useTexture");
 						if (primMaterial->pbr.baseColorTexture.index >= 0) {
 
 							const GLTFTexture& tex = meshWithSkin->textures[primMaterial->pbr.baseColorTexture.index];
@@ -554,7 +551,7 @@ void Lab09::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 							if (tex.source >= 0) {
 								GLuint texture = meshWithSkin->context->imageTextures[tex.source]->id;
 								glUniform1i(utLoc, 1);
-								glBindTexture(GL_TEXTURE_2D, texture);
+								GLState::bindTexture(GL_TEXTURE_2D, texture);
 								// Set sampler
 								if (tex.sampler >= 0) {
 									const GLTFSampler& sampler = meshWithSkin->samplers[tex.sampler];
@@ -568,26 +565,26 @@ void Lab09::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 							}
 							else {
 								glUniform1i(utLoc, 0);
-								glBindTexture(GL_TEXTURE_2D, 0);
+								GLState::bindTexture(GL_TEXTURE_2D, 0);
 							}
 
 						}
 						else {
 							glUniform1i(utLoc, 0);
-							glBindTexture(GL_TEXTURE_2D, 0);
+							GLState::bindTexture(GL_TEXTURE_2D, 0);
 						}
 					}
 
 
-					glActiveTexture(GL_TEXTURE1);
-					glBindTexture(GL_TEXTURE_2D, 0);
+					GLState::activeTexture(GL_TEXTURE1);
+					GLState::bindTexture(GL_TEXTURE_2D, 0);
 
-					//glActiveTexture(GL_TEXTURE1);
-					//glBindTexture(GL_TEXTURE_2D, 0);
-					//GLint stLoc = glGetUniformLocation(meshWithSkin->context->shader->program, "shadowTexture");
+					//GLState::activeTexture(GL_TEXTURE1);
+					//GLState::bindTexture(GL_TEXTURE_2D, 0);
+					//GLint stLoc = meshWithSkin->context->shader->uniform("shadowTexture");
 					//glUniform1i(stLoc, 1);
 
-					glBindVertexArray(primGPU.VAO);
+					GLState::bindVertexArray(primGPU.VAO);
 
 					// If we have an index buffer, draw this primitive with glDrawElements
 					if (prim.indices >= 0) {
@@ -608,15 +605,15 @@ void Lab09::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 						}
 					}
 
-					glBindVertexArray(0);
+					GLState::bindVertexArray(0);
 				}
 			}
 		}
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, 0);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		GLState::activeTexture(GL_TEXTURE0);
+		GLState::bindTexture(GL_TEXTURE_2D, 0);
+		GLState::activeTexture(GL_TEXTURE1);
+		GLState::bindTexture(GL_TEXTURE_2D, 0);
 
 		meshWithSkin->context->shader->stop();
 	}
@@ -629,17 +626,17 @@ void Lab09::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 		GPU::Lighting::get().bind(jr.currentMesh->shader);
 		if (ground.cullFace)
 		{
-			glEnable(GL_CULL_FACE);
-			glCullFace(GL_BACK);
+			GLState::enable(GL_CULL_FACE);
+			GLState::cullFace(GL_BACK);
 		}
 		else {
-			glDisable(GL_CULL_FACE);
+			GLState::disable(GL_CULL_FACE);
 		}
 	}
 
 	if (isShadow) {
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_FRONT);
+		GLState::enable(GL_CULL_FACE);
+		GLState::cullFace(GL_FRONT);
 	}
 
 	ground.updateMatrix(true);
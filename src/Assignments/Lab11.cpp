@@ -4,10 +4,12 @@
 #include "Lab11.h"
 #include "Application.h"
 #include "AnimationObjectRenderer.h"
+#include "GLStateCache.h"
 #include "GLTFImporter.h"
 #include "InputOutput.h"
 #include "Lighting.h"
 #include "Prompts.h"
+#include "ShaderPermutations.h"
 #include "UIHelpers.h"
 #include "Textures.h"
 
@@ -37,6 +39,8 @@ namespace cmps_4480_lab_11 {
 	std::string skinnedMeshPath = IO::getAssetRoot() + "/" + "cylinder2.gltf";
 	std::string shaderPath = IO::getAssetRoot() + "/src/Assignments/skinnedMesh";
 	s_ptr<GLTFData> meshWithSkin;
+	// skinnedMesh with and without USE_SKINNING, picked per primitive
+	s_ptr<ShaderPermutations> skinningVariants;
 
 	AnimationObject ground;
 	AnimationObject joint = AnimationObject(AnimationObjectType::sphere);
@@ -94,14 +98,20 @@ namespace cmps_4480_lab_11 {
 		std::string vertText = IO::readText(shaderPath + ".vert");
 		std::string fragText = IO::readText(shaderPath + ".frag");
 
-		context->shader = s_ptr<Shader>(new Shader(vertText, fragText));
-
 		std::vector<ShaderFragOutputBindings> fragBindings = {
 			{0, "frag_color"},
 			{1, "frag_prim"}
 		};
 
-		if (!context->shader->init(false, fragBindings))
+		// Both variants bind the attributes to the same locations, so the VAOs below work with either
+		skinningVariants = std::make_shared<ShaderPermutations>(vertText, fragText, string_vector{ "USE_SKINNING" },
+			fragBindings, string_vector{ "position", "uv", "normal", "indices", "weights" });
+		uint32_t skinned = skinningVariants->feature("USE_SKINNING");
+		skinningVariants->warmUp({ 0, skinned });
+
+		context->shader = skinningVariants->get(skinned);
+
+		if (!context->shader)
 		{
 			log("Unable to load GLTF shader!\n");
 			return;
@@ -124,7 +134,7 @@ namespace cmps_4480_lab_11 {
 					GLTFGPUData primGPU;
 					glGenVertexArrays(1, &primGPU.VAO);
 
-					glBindVertexArray(primGPU.VAO);
+					GLState::bindVertexArray(primGPU.VAO);
 
 					for (auto& attribute : prim.attributes.items()) {
 						const auto& attribName = attribute.key();
@@ -195,7 +205,7 @@ namespace cmps_4480_lab_11 {
 						}
 					}
 
-					glBindVertexArray(0);
+					GLState::bindVertexArray(0);
 
 					gpu.push_back(primGPU);
 				}
@@ -579,7 +589,8 @@ void Lab11::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 	if (meshWithSkin) {
 		if (isShadow) return;
 
-		meshWithSkin->context->shader->start();
+		auto program = meshWithSkin->context->shader;
+		program->start();
 
 		for (auto& node : meshWithSkin->nodes) {
 			if (node->type == +GLTFNodeType::skin || node->type == +GLTFNodeType::mesh) {
@@ -596,37 +607,36 @@ void Lab11::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 
 				GPU::Lighting::get().bind(meshWithSkin->context->shader);
 
-				auto joLoc = glGetUniformLocation(meshWithSkin->context->shader->program, "joints");
-				if (joLoc >= 0) {
-
-					int i = 0;
-					for (auto j : skin.joints) {
-						auto& jNode = meshWithSkin->nodes[j];
-						skin.jointMatrices[i] = //invNode * 
-							jNode->matrix * skin.inverseBindMatrices[j];
-						i++;
-					}
-
-					glUniformMatrix4fv(joLoc, skin.jointMatrices.size(), GL_FALSE, (const GLfloat*)skin.jointMatrices.data());
+				int i = 0;
+				for (auto j : skin.joints) {
+					auto& jNode = meshWithSkin->nodes[j];
+					skin.jointMatrices[i] = //invNode * 
+						jNode->matrix * skin.inverseBindMatrices[j];
+					i++;
 				}
 
-				auto vpLoc = glGetUniformLocation(meshWithSkin->context->shader->program, "viewproj");
-				if (vpLoc >= 0) {
-					auto viewproj = projection * view;
-					glUniformMatrix4fv(vpLoc, 1, GL_FALSE, glm::value_ptr(viewproj));
-				}
+				GLTFRenderer::get().bindJointPalette(skin.jointMatrices);
+
+				auto viewproj = projection * view;
 
 				for (uint32_t i = 0; i < mesh->primitives.size(); i++) {
 					auto& prim = mesh->primitives[i];
 
-					auto usLoc = glGetUniformLocation(meshWithSkin->context->shader->program, "useSkinning");
-					if (prim.attributes.contains("WEIGHTS_0")) {
-						glUniform1i(usLoc, 1);
+					bool skinned = prim.attributes.contains("WEIGHTS_0");
+					auto variant = skinningVariants->get(skinned ? skinningVariants->feature("USE_SKINNING") : 0);
+					if (variant && variant != program) {
+						program = variant;
+						program->start();
 					}
-					else {
-						glUniform1i(usLoc, 0);
+
+					auto vpLoc = program->uniform("viewproj");
+					if (vpLoc >= 0) {
+						glUniformMatrix4fv(vpLoc, 1, GL_FALSE, glm::value_ptr(viewproj));
+					}
+
+					if (!skinned) {
 						// Get rigid parent index for this mesh primitive. 
-						auto rpLoc = glGetUniformLocation(meshWithSkin->context->shader->program, "rigidParent");
+						auto rpLoc = program->uniform("rigidParent");
 						glUniformMatrix4fv(rpLoc, 1, GL_FALSE, glm::value_ptr(node->matrix));
 					}
 
@@ -639,24 +649,24 @@ void Lab11::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 						primMaterial = &meshWithSkin->materials[prim.material];
 
 						if (primMaterial->doubleSided) {
-							glDisable(GL_CULL_FACE);
+							GLState::disable(GL_CULL_FACE);
 						}
 						else {
-							glEnable(GL_CULL_FACE);
+							GLState::enable(GL_CULL_FACE);
 						}
 
-						auto bcfLoc = glGetUniformLocation(meshWithSkin->context->shader->program, "baseColorFactor");
+						auto bcfLoc = program->uniform("baseColorFactor");
 						glUniform4fv(bcfLoc, 1, glm::value_ptr(primMaterial->pbr.baseColorFactor));
 
-						auto acLoc = glGetUniformLocation(meshWithSkin->context->shader->program, "alphaCutoff");
+						auto acLoc = program->uniform("alphaCutoff");
 						glUniform1f(acLoc, primMaterial->alphaCutoff);
 
 
-						glActiveTexture(GL_TEXTURE0);
-						GLint itLoc = glGetUniformLocation(meshWithSkin->context->shader->program, "inputTexture");
+						GLState::activeTexture(GL_TEXTURE0);
+						GLint itLoc = program->uniform("inputTexture");
 						glUniform1i(itLoc, 0);
 
-						GLint utLoc = glGetUniformLocation(meshWithSkin->context->shader->program, "useTexture");
+						GLint utLoc = program->uniform("useTexture");
 						if (primMaterial->pbr.baseColorTexture.index >= 0) {
 
 							const GLTFTexture& tex = meshWithSkin->textures[primMaterial->pbr.baseColorTexture.index];
@@ -664,7 +674,7 @@ void Lab11::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 							if (tex.source >= 0) {
 								GLuint texture = meshWithSkin->context->imageTextures[tex.source]->id;
 								glUniform1i(utLoc, 1);
-								glBindTexture(GL_TEXTURE_2D, texture);
+								GLState::bindTexture(GL_TEXTURE_2D, texture);
 								// Set sampler
 								if (tex.sampler >= 0) {
 									const GLTFSampler& sampler = meshWithSkin->samplers[tex.sampler];
@@ -678,26 +688,26 @@ void Lab11::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 							}
 							else {
 								glUniform1i(utLoc, 0);
-								glBindTexture(GL_TEXTURE_2D, 0);
+								GLState::bindTexture(GL_TEXTURE_2D, 0);
 							}
 
 						}
 						else {
 							glUniform1i(utLoc, 0);
-							glBindTexture(GL_TEXTURE_2D, 0);
+							GLState::bindTexture(GL_TEXTURE_2D, 0);
 						}
 					}
 
 
-					glActiveTexture(GL_TEXTURE1);
-					glBindTexture(GL_TEXTURE_2D, 0);
+					GLState::activeTexture(GL_TEXTURE1);
+					GLState::bindTexture(GL_TEXTURE_2D, 0);
 
-					//glActiveTexture(GL_TEXTURE1);
-					//glBindTexture(GL_TEXTURE_2D, 0);
-					//GLint stLoc = glGetUniformLocation(meshWithSkin->context->shader->program, "shadowTexture");
+					//GLState::activeTexture(GL_TEXTURE1);
+					//GLState::bindTexture(GL_TEXTURE_2D, 0);
+					//GLint stLoc = program->uniform("shadowTexture");
 					//glUniform1i(stLoc, 1);
 
-					glBindVertexArray(primGPU.VAO);
+					GLState::bindVertexArray(primGPU.VAO);
 
 					// If we have an index buffer, draw this primitive with glDrawElements
 					if (prim.indices >= 0) {
@@ -718,17 +728,17 @@ void Lab11::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 						}
 					}
 
-					glBindVertexArray(0);
+					GLState::bindVertexArray(0);
 				}
 			}
 		}
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, 0);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		GLState::activeTexture(GL_TEXTURE0);
+		GLState::bindTexture(GL_TEXTURE_2D, 0);
+		GLState::activeTexture(GL_TEXTURE1);
+		GLState::bindTexture(GL_TEXTURE_2D, 0);
 
-		meshWithSkin->context->shader->stop();
+		program->stop();
 	}
 
 	auto& jr = AnimationObjectRenderer::get();
@@ -739,17 +749,17 @@ void Lab11::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 		GPU::Lighting::get().bind(jr.currentMesh->shader);
 		if (ground.cullFace)
 		{
-			glEnable(GL_CULL_FACE);
-			glCullFace(GL_BACK);
+			GLState::enable(GL_CULL_FACE);
+			GLState::cullFace(GL_BACK);
 		}
 		else {
-			glDisable(GL_CULL_FACE);
+			GLState::disable(GL_CULL_FACE);
 		}
 	}
 
 	if (isShadow) {
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_FRONT);
+		GLState::enable(GL_CULL_FACE);
+		GLState::cullFace(GL_FRONT);
 	}
 
 	ground.updateMatrix(true);
@@ -763,17 +773,17 @@ void Lab11::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer>
 		GPU::Lighting::get().bind(jr.currentMesh->shader);
 		if (target.cullFace)
 		{
-			glEnable(GL_CULL_FACE);
-			glCullFace(GL_BACK);
+			GLState::enable(GL_CULL_FACE);
+			GLState::cullFace(GL_BACK);
 		}
 		else {
-			glDisable(GL_CULL_FACE);
+			GLState::disable(GL_CULL_FACE);
 		}
 	}
 
 	if (isShadow) {
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_FRONT);
+		GLState::enable(GL_CULL_FACE);
+		GLState::cullFace(GL_FRONT);
 	}
 
 	target.updateMatrix(true);
@@ -4,7 +4,9 @@
 #include "ParticleSystemDemo.h"
 #include "Application.h"
 #include "AnimationObjectRenderer.h"
+#include "GLStateCache.h"
 #include "GLTFImporter.h"
+#include "GPUProfiler.h"
 #include "InputOutput.h"
 #include "Input.h"
 #include "Lighting.h"
@@ -62,16 +64,15 @@ void ParticleSystemDemo::init() {
 #define REDUCE_REUSE_RECYCLE
 void updateParticleSystem(ParticleSystem& ps, float dt) {
 
-	if (!ps.renderData) {
-		std::vector<ParticleRenderData> prd(ps.maxParticles, { mat4(1.f), vec4(1.f), vec4(0.f) });
-		ps.renderData = spVectorBuffer<ParticleRenderData>(new VectorBuffer<ParticleRenderData>(GL_ARRAY_BUFFER, prd, GL_DYNAMIC_DRAW));
+	if (!ps.renderStream) {
+		ps.renderStream = std::make_shared<StreamBuffer>("Particles", GL_ARRAY_BUFFER,
+			(GLsizeiptr)(sizeof(ParticleRenderData) * std::max(ps.maxParticles, 1000u)), sizeof(ParticleRenderData));
 	}
-	else if (ps.renderData->data.size() < ps.particles.size()) {
-		std::vector<ParticleRenderData> prd(ps.particles.size(), { mat4(1.f), vec4(1.f), vec4(0.f) });
-		ps.renderData = spVectorBuffer<ParticleRenderData>(new VectorBuffer<ParticleRenderData>(GL_ARRAY_BUFFER, prd, GL_DYNAMIC_DRAW));
+	if (ps.renderData.size() < ps.particles.size()) {
+		ps.renderData.resize(ps.particles.size(), { mat4(1.f), vec4(1.f), vec4(0.f) });
 	}
 
-	auto& cam = Application::get().getRenderer<OpenGLRenderer>()->camera;
+	auto& cam = Application::get().getRenderer<Renderer>()->camera;
 	vec3 reverseLookDir = glm::normalize(cam.Position - cam.Lookat);
 
 	//while (it != ps.particles.end()) {
@@ -82,11 +83,11 @@ void updateParticleSystem(ParticleSystem& ps, float dt) {
 
 		auto aliveFor = getTime() - p.createdAt;
 		if (!p.alive) {
-			ps.renderData->data[i].data.x = p.alive ? 1 : 0;
+			ps.renderData[i].data.x = p.alive ? 1 : 0;
 		}
 		else if (aliveFor > p.lifeSpan) {
 			p.alive = false;
-			ps.renderData->data[i].data.x = p.alive ? 1 : 0;
+			ps.renderData[i].data.x = p.alive ? 1 : 0;
 			ps.numAlive--;
 		}
 
@@ -128,13 +129,23 @@ void updateParticleSystem(ParticleSystem& ps, float dt) {
 			mat4 quadRot = glm::toMat4(quaternion(glm::radians(physics.rotation)));
 			mat4 quadScale = glm::scale(p.size);
 
-			ps.renderData->data[i].transform = quadPos * quadRot * quadScale;
-			ps.renderData->data[i].color = p.color * ps.mainColor;
-			ps.renderData->data[i].data.x = p.alive ? 1 : 0;
+			ps.renderData[i].transform = quadPos * quadRot * quadScale;
+			ps.renderData[i].color = p.color * ps.mainColor;
+			ps.renderData[i].data.x = p.alive ? 1 : 0;
 		}
 	}
 
-	ps.renderData->update(0, ps.renderData->data.size());
+	// Only the live particles go to the GPU, packed into this frame's stream region
+	ps.renderCount = 0;
+	ps.renderRange = ps.renderStream->allocate<ParticleRenderData>(ps.particles.size());
+	if (auto out = ps.renderRange.as<ParticleRenderData>()) {
+		for (size_t i = 0; i < ps.particles.size(); i++) {
+			if (ps.renderData[i].data.x >= 1.f) {
+				out[ps.renderCount++] = ps.renderData[i];
+			}
+		}
+		ps.renderStream->commit(ps.renderRange);
+	}
 
 	// See if we need to create any new particles
 	int numSpawned = 0;
@@ -299,17 +310,17 @@ void ParticleSystemDemo::render(const mat4& projection, const mat4& view, s_ptr<
 		GPU::Lighting::get().bind(jr.currentMesh->shader);
 		if (ground.cullFace)
 		{
-			glEnable(GL_CULL_FACE);
-			glCullFace(GL_BACK);
+			GLState::enable(GL_CULL_FACE);
+			GLState::cullFace(GL_BACK);
 		}
 		else {
-			glDisable(GL_CULL_FACE);
+			GLState::disable(GL_CULL_FACE);
 		}
 	}
 
 	if (isShadow) {
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_FRONT);
+		GLState::enable(GL_CULL_FACE);
+		GLState::cullFace(GL_FRONT);
 	}
 
 	ground.updateMatrix(true);
@@ -328,7 +339,7 @@ void ParticleSystemDemo::render(const mat4& projection, const mat4& view, s_ptr<
 	uvOffset.z = (1.0f / 25.0f);
 
 	if (!isShadow) {
-		glUniform4fv(glGetUniformLocation(jr.currentMesh->shader->program, "uvOffset"),
+		glUniform4fv(jr.currentMesh->shader->uniform("uvOffset"),
 			1, glm::value_ptr(uvOffset));
 	}
 	
@@ -344,17 +355,17 @@ void ParticleSystemDemo::render(const mat4& projection, const mat4& view, s_ptr<
 			GPU::Lighting::get().bind(jr.currentMesh->shader);
 			if (objects[0].cullFace)
 			{
-				glEnable(GL_CULL_FACE);
-				glCullFace(GL_BACK);
+				GLState::enable(GL_CULL_FACE);
+				GLState::cullFace(GL_BACK);
 			}
 			else {
-				glDisable(GL_CULL_FACE);
+				GLState::disable(GL_CULL_FACE);
 			}
 		}
 
 		if (isShadow) {
-			glEnable(GL_CULL_FACE);
-			glCullFace(GL_FRONT);
+			GLState::enable(GL_CULL_FACE);
+			GLState::cullFace(GL_FRONT);
 		}
 
 		for (auto& o : objects) {
@@ -365,9 +376,10 @@ void ParticleSystemDemo::render(const mat4& projection, const mat4& view, s_ptr<
 		jr.endBatchRender(isShadow);
 	}
 
+	GPUScope scope("Particles");
 	auto& iqr = InstanceQuadRenderer::get();
 	for (auto& ps : particleSystems) {
-		if (ps.renderData == nullptr) continue;
+		if (!ps.renderStream || ps.renderCount == 0) continue;
 		iqr.beginBatch(&ps, true, ps.textureID);
 		iqr.render(vec4(1), uvOffset);
 		iqr.endBatch();
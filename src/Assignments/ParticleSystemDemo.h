@@ -2,6 +2,7 @@
 
 #include "Assignment.h"
 #include "Buffer.h"
+#include "StreamBuffer.h"
 
 struct ParticlePhysics {
 	vec3 position = vec3(0);
@@ -68,8 +69,13 @@ struct ParticleSystem {
 	// CPU-side particles
 	std::vector<Particle> particles;
 
-	// GPU-side particles
-	spVectorBuffer<ParticleRenderData> renderData;
+	// Per particle render data, written in parallel
+	std::vector<ParticleRenderData> renderData;
+
+	// The live particles streamed to the GPU this frame
+	s_ptr<StreamBuffer> renderStream;
+	StreamBuffer::Range renderRange;
+	unsigned int renderCount = 0;
 
 	void renderUI() {
 
@@ -4,6 +4,7 @@
 #include "ProceduralDemos.h"
 #include "Application.h"
 #include "AnimationObjectRenderer.h"
+#include "GLStateCache.h"
 #include "GLTFImporter.h"
 #include "InputOutput.h"
 #include "Input.h"
@@ -12,6 +13,7 @@
 #include "Prompts.h"
 #include "UIHelpers.h"
 #include "Textures.h"
+#include "TimelineCache.h"
 
 #include <cassert>
 
@@ -103,10 +105,50 @@ namespace cmps_4480_procedural_demos {
 	float physicsDt = 1.0f / 60.0f;
 
 	bool simulating = true;
+
+	// Checkpoints of the physics state so the simulation can be scrubbed
+	TimelineCache timeline;
+
+	// Per object: physics position, velocity, kinematic flag and the object's local position.
+	// Forces and acceleration are recomputed every step, so they don't need saving.
+	constexpr size_t StateFloats = 10;
+
+	void captureState(std::vector<uint8_t>& state) {
+		state.resize(physics.size() * StateFloats * sizeof(float));
+		float* f = reinterpret_cast<float*>(state.data());
+
+		for (size_t i = 0; i < physics.size(); i++, f += StateFloats) {
+			const auto& p = physics[i];
+			const vec3& lp = objects[i].localPosition;
+			float values[StateFloats] = {
+				p.position.x, p.position.y, p.position.z,
+				p.velocity.x, p.velocity.y, p.velocity.z,
+				p.kinematic ? 1.f : 0.f,
+				lp.x, lp.y, lp.z
+			};
+			memcpy(f, values, sizeof(values));
+		}
+	}
+
+	void restoreState(const std::vector<uint8_t>& state) {
+		if (state.size() != physics.size() * StateFloats * sizeof(float)) return;
+		const float* f = reinterpret_cast<const float*>(state.data());
+
+		for (size_t i = 0; i < physics.size(); i++, f += StateFloats) {
+			auto& p = physics[i];
+			p.position = vec3(f[0], f[1], f[2]);
+			p.velocity = vec3(f[3], f[4], f[5]);
+			p.kinematic = f[6] != 0.f;
+			objects[i].localPosition = vec3(f[7], f[8], f[9]);
+			objects[i].updateMatrix(true);
+		}
+	}
 }
 
 using namespace cmps_4480_procedural_demos;
 
+void stepPhysics();
+
 void initWheel() {
 
 	AnimationObject target = AnimationObject(AnimationObjectType::sphere);
@@ -513,6 +555,9 @@ void ProceduralDemos::init() {
 	//initSolidCube(10);
 	initTwoSpheres();
 	//initPablosphere();
+
+	timeline.setCallbacks(captureState, restoreState, stepPhysics);
+	timeline.reset(0);
 	
 	initialized = true;
 }
@@ -549,12 +594,22 @@ void ProceduralDemos::update() {
 		for (int i = 0; i < objects.size(); i++) {
 			if (objects[i].selected) {
 				physics[i].kinematic = !physics[i].kinematic;
+				timeline.invalidateAfter(currentFrame);
 			}
 		}
 	}
 
 	if (!simulating) return;
 
+	timeline.advance();
+	currentFrame = timeline.getFrame();
+	numFrames = std::max(numFrames, currentFrame);
+}
+
+// Advances the simulation by one physics timestep
+void stepPhysics() {
+	float dt = physicsDt;
+
 	// Reset and recompute all forces each frame
 	for (auto& po : physics) {
 
@@ -715,7 +770,6 @@ void ProceduralDemos::update() {
 			}
 		}
 	}
-
 }
 
 void ProceduralDemos::render(const mat4& projection, const mat4& view, s_ptr<Framebuffer> framebuffer, bool isShadow) {
@@ -728,17 +782,17 @@ void ProceduralDemos::render(const mat4& projection, const mat4& view, s_ptr<Fra
 		GPU::Lighting::get().bind(jr.currentMesh->shader);
 		if (ground.cullFace)
 		{
-			glEnable(GL_CULL_FACE);
-			glCullFace(GL_BACK);
+			GLState::enable(GL_CULL_FACE);
+			GLState::cullFace(GL_BACK);
 		}
 		else {
-			glDisable(GL_CULL_FACE);
+			GLState::disable(GL_CULL_FACE);
 		}
 	}
 
 	if (isShadow) {
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_FRONT);
+		GLState::enable(GL_CULL_FACE);
+		GLState::cullFace(GL_FRONT);
 	}
 
 	ground.updateMatrix(true);
@@ -752,17 +806,17 @@ void ProceduralDemos::render(const mat4& projection, const mat4& view, s_ptr<Fra
 		GPU::Lighting::get().bind(jr.currentMesh->shader);
 		if (objects[0].cullFace)
 		{
-			glEnable(GL_CULL_FACE);
-			glCullFace(GL_BACK);
+			GLState::enable(GL_CULL_FACE);
+			GLState::cullFace(GL_BACK);
 		}
 		else {
-			glDisable(GL_CULL_FACE);
+			GLState::disable(GL_CULL_FACE);
 		}
 	}
 
 	if (isShadow) {
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_FRONT);
+		GLState::enable(GL_CULL_FACE);
+		GLState::cullFace(GL_FRONT);
 	}
 
 	for (auto& o : objects) {
@@ -816,24 +870,48 @@ void ProceduralDemos::renderUI() {
 		if (findex >= 0 && findex < objects.size()) {
 			ImGui::Text("Object %d", findex);
 
-			objects[findex].renderUI();
+			if (objects[findex].renderUI()) {
+				timeline.invalidateAfter(currentFrame);
+			}
 			ImGui::Separator();
 			physics[findex].renderUI();
 		}
 	}
 
 	ImGui::Checkbox("Simulating physics", &simulating);
-	ImGui::InputFloat("Max speed", &maxSpeed);
-	ImGui::InputFloat("Global stiffness", &globalStiffness);
-	ImGui::InputFloat("Global dampening", &globalDampening);
+
+	// Scrubbing pauses the simulation; playing resumes from wherever the slider was left
+	int frame = currentFrame;
+	if (ImGui::SliderInt("Frame", &frame, 0, numFrames)) {
+		simulating = false;
+		if (timeline.seek(frame)) {
+			currentFrame = timeline.getFrame();
+		}
+	}
+
+	if (ImGui::CollapsingHeader("Timeline cache")) {
+		IMDENT;
+		timeline.renderUI();
+		IMDONT;
+	}
+
+	// Anything that changes the simulation makes the checkpoints after this frame stale
+	bool changed = false;
+	changed |= ImGui::InputFloat("Max speed", &maxSpeed);
+	changed |= ImGui::InputFloat("Global stiffness", &globalStiffness);
+	changed |= ImGui::InputFloat("Global dampening", &globalDampening);
 	ImGui::Checkbox("Show spring lines", &showLines);
-	ImGui::Checkbox("Keep on ground", &keepOnGround);
-	ImGui::Checkbox("No negative y", &limitY);
-	ImGui::InputFloat("Timestep (physics)", &physicsDt);
+	changed |= ImGui::Checkbox("Keep on ground", &keepOnGround);
+	changed |= ImGui::Checkbox("No negative y", &limitY);
+	changed |= ImGui::InputFloat("Timestep (physics)", &physicsDt);
 
-	ImGui::Checkbox("Gravity", &gravity);
+	changed |= ImGui::Checkbox("Gravity", &gravity);
 	if (gravity) {
-		ImGui::InputFloat("Gravity force", &gravityForce);
+		changed |= ImGui::InputFloat("Gravity force", &gravityForce);
+	}
+
+	if (changed) {
+		timeline.invalidateAfter(currentFrame);
 	}
 }
 
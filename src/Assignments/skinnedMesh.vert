@@ -1,9 +1,19 @@
 __VERSION__
 
+#include "datatypes.glsl"
+
 uniform mat4 viewproj;
 
-uniform mat4 joints[100];
+// Bound from a stream buffer by GLTFRenderer::bindJointPalette
+layout(std140) uniform JointBlock {
+	mat4 joints[GPU_MAX_JOINTS];
+};
+#ifdef PERMUTATION
+// Fixed per variant by ShaderPermutations
+const bool useSkinning = USE_SKINNING;
+#else
 uniform bool useSkinning;
+#endif
 uniform mat4 rigidParent;
 
 // Static attributes
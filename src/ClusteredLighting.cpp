@@ -0,0 +1,354 @@
+#include "ClusteredLighting.h"
+
+#include "Camera.h"
+#include "FrameUniforms.h"
+#include "GLStateCache.h"
+#include "ResourceRegistry.h"
+#include "UIHelpers.h"
+
+#include "imgui.h"
+
+#include <random>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define CLUSTERS_SSE 1
+#include <xmmintrin.h>
+#endif
+
+using namespace GPU;
+
+bool LightClusters::init()
+{
+	createTextureBuffer(grid, GL_RG32UI);
+	createTextureBuffer(indices, GL_R32UI);
+	createTextureBuffer(lightData, GL_RGBA32F);
+
+	return true;
+}
+
+LightClusters& LightClusters::get()
+{
+	// Never destroyed: the context is gone by the time statics are
+	static LightClusters* instance = new LightClusters();
+	static bool initialized = ([&]() {
+		return instance->init();
+		})();
+
+	return *instance;
+}
+
+void LightClusters::createTextureBuffer(TextureBuffer& tb, GLenum format)
+{
+	// Never empty, a texture buffer over no storage reads as incomplete
+	static const vec4 zero(0.f);
+	tb.buffer = spBuffer(new Buffer(GL_TEXTURE_BUFFER, sizeof(zero), (GLvoid*)&zero, GL_STREAM_DRAW));
+
+	glGenTextures(1, &tb.texture);
+	GLState::bindTexture(GL_TEXTURE_BUFFER, tb.texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, format, tb.buffer->buffer);
+	GLState::bindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::upload(TextureBuffer& tb, const void* data, size_t bytes)
+{
+	if (bytes == 0) return;
+
+	// Respecifying the store each frame lets the driver orphan the one still being read
+	auto& b = *tb.buffer;
+	b.bufferSize = (GLsizeiptr)bytes;
+	b.bufferData = (GLvoid*)data;
+	b.update(true, true);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	ResourceRegistry::get().update(b.memoryHandle, bytes, 0);
+}
+
+float LightClusters::range(const Light& light) const
+{
+	float intensity = std::max(std::max(light.diffuse.r, light.diffuse.g), light.diffuse.b);
+	intensity = std::max(intensity, std::max(std::max(light.specular.r, light.specular.g), light.specular.b));
+
+	// Solve c + l * d + q * d^2 = intensity / cutoff for d
+	float target = intensity / std::max(cutoff, 1e-6f);
+	float c = light.attenuation.x - target, l = light.attenuation.y, q = light.attenuation.z;
+
+	if (c >= 0.f) return 0.f;
+	if (q > 0.f) return (-l + std::sqrt(l * l - 4.f * q * c)) / (2.f * q);
+	if (l > 0.f) return -c / l;
+
+	// No falloff, it reaches every slice
+	return farDistance * 2.f;
+}
+
+int LightClusters::sliceOf(float depth) const
+{
+	if (depth < nearDistance) return 0;
+
+	float scale = (dims.z - 2) / std::log(farDistance / nearDistance);
+	int slice = 1 + (int)(std::log(depth / nearDistance) * scale);
+	return std::min(slice, dims.z - 1);
+}
+
+void LightClusters::buildFroxels(const mat4& projection, float cameraNear, float cameraFar)
+{
+	mat4 inverseProjection = glm::inverse(projection);
+
+	auto unproject = [&inverseProjection](float x, float y, float z) {
+		vec4 p = inverseProjection * vec4(x, y, z, 1.f);
+		return vec3(p) / (std::abs(p.w) > 1e-8f ? p.w : 1e-8f);
+	};
+
+	// A line through each tile corner, from two points along it. Works for both projections:
+	// perspective lines spread out from the eye, orthographic ones run straight down -z.
+	int cornersX = dims.x + 1, cornersY = dims.y + 1;
+	std::vector<vec3> lineA(cornersX * cornersY), lineB(cornersX * cornersY);
+	for (int y = 0; y < cornersY; y++) {
+		for (int x = 0; x < cornersX; x++) {
+			float nx = -1.f + 2.f * x / dims.x;
+			float ny = -1.f + 2.f * y / dims.y;
+			lineA[y * cornersX + x] = unproject(nx, ny, -1.f);
+			lineB[y * cornersX + x] = unproject(nx, ny, 0.f);
+		}
+	}
+
+	auto atDepth = [&](int corner, float depth) {
+		const vec3& a = lineA[corner];
+		const vec3& b = lineB[corner];
+		float dz = b.z - a.z;
+		float t = std::abs(dz) > 1e-8f ? (-depth - a.z) / dz : 0.f;
+		return a + t * (b - a);
+	};
+
+	float scale = (dims.z - 2) / std::log(farDistance / nearDistance);
+	auto sliceStart = [&](int slice) {
+		if (slice == 0) return cameraNear;
+		if (slice == dims.z - 1) return farDistance;
+		return nearDistance * std::exp((slice - 1) / scale);
+	};
+
+	size_t cells = (size_t)dims.x * dims.y * dims.z;
+	froxelMin.resize(cells);
+	froxelMax.resize(cells);
+
+	for (int z = 0; z < dims.z; z++) {
+		float d0 = sliceStart(z);
+		float d1 = z == dims.z - 1 ? std::max(cameraFar, farDistance) : sliceStart(z + 1);
+
+		for (int y = 0; y < dims.y; y++) {
+			for (int x = 0; x < dims.x; x++) {
+				vec3 mn(FLT_MAX), mx(-FLT_MAX);
+
+				int corners[4] = { y * cornersX + x, y * cornersX + x + 1, (y + 1) * cornersX + x, (y + 1) * cornersX + x + 1 };
+				for (int corner : corners) {
+					for (float d : { d0, d1 }) {
+						vec3 p = atDepth(corner, d);
+						mn = glm::min(mn, p);
+						mx = glm::max(mx, p);
+					}
+				}
+
+				size_t cell = ((size_t)z * dims.y + y) * dims.x + x;
+				froxelMin[cell] = mn;
+				froxelMax[cell] = mx;
+			}
+		}
+	}
+}
+
+void LightClusters::assign(const mat4& view)
+{
+	size_t cells = (size_t)dims.x * dims.y * dims.z;
+	gridData.assign(cells, uvec2(0));
+	indexData.clear();
+	uploadData.clear();
+
+	slices.resize(dims.z);
+	for (auto& s : slices) s.clear();
+
+	for (const auto& light : lights) {
+		Light l = light;
+		l.position.w = 1.f;
+		if (l.attenuation.w <= 0.f) l.attenuation.w = range(l);
+
+		float r = l.attenuation.w;
+		if (r <= 0.f) continue;
+
+		vec3 center = vec3(view * vec4(vec3(l.position), 1.f));
+		float zmin = -center.z - r, zmax = -center.z + r;
+		if (zmax <= 0.f) continue;
+
+		GLuint index = (GLuint)uploadData.size();
+		uploadData.push_back(l);
+
+		int s1 = sliceOf(zmax);
+		for (int s = sliceOf(std::max(zmin, 0.f)); s <= s1; s++) {
+			slices[s].push(center, r * r, index);
+		}
+	}
+
+	stats.visible = uploadData.size();
+	stats.maxPerCluster = 0;
+	stats.overflow = 0;
+
+	std::vector<GLuint> hits;
+
+	for (int z = 0; z < dims.z; z++) {
+		auto& candidates = slices[z];
+		candidates.pad();
+		size_t count = candidates.x.size();
+
+		for (int y = 0; y < dims.y; y++) {
+			for (int x = 0; x < dims.x; x++) {
+				size_t cell = ((size_t)z * dims.y + y) * dims.x + x;
+				const vec3& mn = froxelMin[cell];
+				const vec3& mx = froxelMax[cell];
+
+				hits.clear();
+
+				// Squared distance from each sphere's center to the box against its squared radius
+#ifdef CLUSTERS_SSE
+				__m128 zero = _mm_setzero_ps();
+				__m128 minX = _mm_set1_ps(mn.x), minY = _mm_set1_ps(mn.y), minZ = _mm_set1_ps(mn.z);
+				__m128 maxX = _mm_set1_ps(mx.x), maxY = _mm_set1_ps(mx.y), maxZ = _mm_set1_ps(mx.z);
+
+				for (size_t i = 0; i < count; i += 4) {
+					__m128 cx = _mm_loadu_ps(&candidates.x[i]);
+					__m128 cy = _mm_loadu_ps(&candidates.y[i]);
+					__m128 cz = _mm_loadu_ps(&candidates.z[i]);
+
+					__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minX, cx), _mm_sub_ps(cx, maxX)), zero);
+					__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minY, cy), _mm_sub_ps(cy, maxY)), zero);
+					__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minZ, cz), _mm_sub_ps(cz, maxZ)), zero);
+
+					__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+					int mask = _mm_movemask_ps(_mm_cmple_ps(d2, _mm_loadu_ps(&candidates.radius2[i])));
+
+					for (int lane = 0; mask != 0; lane++, mask >>= 1) {
+						if (mask & 1) hits.push_back(candidates.index[i + lane]);
+					}
+				}
+#else
+				for (size_t i = 0; i < count; i++) {
+					vec3 c(candidates.x[i], candidates.y[i], candidates.z[i]);
+					vec3 d = glm::max(glm::max(mn - c, c - mx), vec3(0.f));
+					if (glm::dot(d, d) <= candidates.radius2[i]) hits.push_back(candidates.index[i]);
+				}
+#endif
+
+				stats.maxPerCluster = std::max(stats.maxPerCluster, hits.size());
+				if (hits.size() > (size_t)maxPerCluster) {
+					stats.overflow += hits.size() - maxPerCluster;
+					hits.resize(maxPerCluster);
+				}
+
+				gridData[cell] = uvec2((GLuint)indexData.size(), (GLuint)hits.size());
+				indexData.insert(indexData.end(), hits.begin(), hits.end());
+			}
+		}
+	}
+
+	stats.indices = indexData.size();
+}
+
+void LightClusters::begin(const Camera& camera, const ivec2& resolution)
+{
+	auto& frame = FrameUniforms::get().data;
+
+	stats.lights = lights.size();
+	if (!enabled || lights.empty()) {
+		frame.clusterDims = ivec4(0);
+		stats.visible = stats.indices = stats.maxPerCluster = stats.overflow = 0;
+		return;
+	}
+
+	double start = getWallTime();
+
+	dims = glm::max(dims, ivec3(1, 1, 3));
+	nearDistance = std::max(nearDistance, 1e-3f);
+	farDistance = std::max(farDistance, nearDistance * 2.f);
+
+	float cameraNear = std::max(std::min(camera.nearFar.x, camera.nearFar.y), 0.f);
+	float cameraFar = std::max(camera.nearFar.x, camera.nearFar.y);
+
+	buildFroxels(camera.projection, cameraNear, cameraFar);
+	assign(camera.view);
+
+	upload(grid, gridData.data(), gridData.size() * sizeof(uvec2));
+	upload(indices, indexData.data(), indexData.size() * sizeof(GLuint));
+	upload(lightData, uploadData.data(), uploadData.size() * sizeof(Light));
+
+	GLState::activeTexture(GL_TEXTURE0 + GPU_CLUSTER_GRID_UNIT);
+	GLState::bindTexture(GL_TEXTURE_BUFFER, grid.texture);
+	GLState::activeTexture(GL_TEXTURE0 + GPU_CLUSTER_INDEX_UNIT);
+	GLState::bindTexture(GL_TEXTURE_BUFFER, indices.texture);
+	GLState::activeTexture(GL_TEXTURE0 + GPU_CLUSTER_LIGHT_UNIT);
+	GLState::bindTexture(GL_TEXTURE_BUFFER, lightData.texture);
+	GLState::activeTexture(GL_TEXTURE0);
+
+	frame.clusterDims = ivec4(dims, (int)uploadData.size());
+	frame.clusterDepth = vec4(nearDistance, (dims.z - 2) / std::log(farDistance / nearDistance), 0.f, 0.f);
+	frame.clusterViewport = vec4(resolution, 0.f, 0.f);
+
+	stats.buildTime = getWallTime() - start;
+}
+
+void LightClusters::end()
+{
+	FrameUniforms::get().data.clusterDims = ivec4(0);
+}
+
+void LightClusters::addTestLights(int count, const vec3& center, const vec3& extent)
+{
+	std::mt19937 rng((unsigned)lights.size() + 1);
+	std::uniform_real_distribution<float> unit(-1.f, 1.f);
+	std::uniform_real_distribution<float> channel(0.2f, 1.f);
+
+	for (int i = 0; i < count; i++) {
+		Light l;
+		l.position = vec4(center + extent * vec3(unit(rng), unit(rng), unit(rng)), 1.f);
+		l.direction = vec4(0.f, -1.f, 0.f, 0.f);
+		l.diffuse = vec4(channel(rng), channel(rng), channel(rng), 1.f);
+		l.specular = l.diffuse * 0.5f;
+		l.attenuation = vec4(1.f, 0.f, 4.f, 0.f);
+
+		// Every third one a spot pointing down
+		l.spot = i % 3 == 0 ? vec4(30.f, 8.f, 0.f, 0.f) : vec4(180.f, 0.f, 0.f, 0.f);
+		if (i % 3 == 0) l.attenuation.z = 1.f;
+
+		lights.push_back(l);
+	}
+}
+
+void LightClusters::renderUI()
+{
+	if (ImGui::CollapsingHeader("Clustered lights")) {
+		IMDENT;
+
+		ImGui::Checkbox("Enabled", &enabled);
+		ImGui::InputInt3("Froxels", glm::value_ptr(dims));
+		ImGui::DragFloatRange2("Slice depths", &nearDistance, &farDistance, 0.1f, 0.01f, 1000.f);
+		ImGui::SliderInt("Max lights per froxel", &maxPerCluster, 1, 512);
+		ImGui::InputFloat("Range cutoff", &cutoff, 0.f, 0.f, "%.5f");
+
+		ImGui::Text("Lights: %zu (%zu in front of the camera)", stats.lights, stats.visible);
+		ImGui::Text("Indices: %zu, most in one froxel: %zu, dropped: %zu", stats.indices, stats.maxPerCluster, stats.overflow);
+		ImGui::Text("Build: %.3f ms", stats.buildTime * 1000.0);
+
+		static int testCount = 256;
+		static vec3 testCenter = vec3(0.f, 1.f, 0.f);
+		static vec3 testExtent = vec3(10.f, 1.f, 10.f);
+		ImGui::InputInt("Test lights", &testCount);
+		ImGui::InputFloat3("Test center", glm::value_ptr(testCenter));
+		ImGui::InputFloat3("Test extent", glm::value_ptr(testExtent));
+		if (ImGui::Button("Add test lights")) {
+			addTestLights(std::max(testCount, 0), testCenter, testExtent);
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Clear lights")) {
+			lights.clear();
+		}
+
+		IMDONT;
+	}
+}
@@ -0,0 +1,467 @@
+#include "Constraints.h"
+
+#include "Application.h"
+#include "Renderer.h"
+#include "UIHelpers.h"
+
+#include "imgui.h"
+
+namespace {
+	// World rotation without a full decompose. Identity for a matrix with a zero scaled
+	// axis, as decompose gave.
+	quaternion worldRotation(const mat4& m) {
+		quaternion rotation = quaternion(1.f, 0.f, 0.f, 0.f);
+		AnimationObject::extractRotation(m, rotation);
+		return rotation;
+	}
+
+	vec3 worldScale(const mat4& m) {
+		return vec3(glm::length(vec3(m[0])), glm::length(vec3(m[1])), glm::length(vec3(m[2])));
+	}
+
+	void setWorld(AnimationObject& o, const vec3& position, const quaternion& rotation, const vec3& scale) {
+		o.transform = glm::translate(position) * glm::toMat4(rotation) * glm::scale(scale);
+		o.position = position;
+		o.rotation = glm::degrees(glm::eulerAngles(rotation));
+		o.scale = scale;
+
+		// Write the local channels back too, so a later updateMatrix(true) rebuilds the solved
+		// pose instead of the one from before the solve. A parent scaled to zero has no inverse
+		// to solve through, so the channels are left as they were.
+		bool parented = o.parent && o.parent != &o;
+		if (parented && std::abs(glm::determinant(o.parent->transform)) < 1e-12f) return;
+
+		mat4 local = parented ? glm::inverse(o.parent->transform) * o.transform : o.transform;
+		quaternion localRotation = worldRotation(local);
+		o.localTransform = local;
+		o.localScale = worldScale(local);
+		o.localRotation = glm::degrees(glm::eulerAngles(localRotation));
+		// updateMatrix rotates about localPivot, which shifts the translation column
+		o.localPosition = vec3(local[3]) - (glm::toMat3(localRotation) * o.localPivot - o.localPivot);
+	}
+
+	// Rotation whose forward axis points along fwd, keeping the other axes as close to up as possible
+	mat3 lookBasis(const vec3& fwd, const vec3& up, Axis forward) {
+		vec3 side = glm::cross(fwd, up);
+		if (glm::length(side) < 1e-6f) {
+			side = glm::cross(fwd, glm::abs(fwd.y) < 0.99f ? vec3(0.f, 1.f, 0.f) : vec3(1.f, 0.f, 0.f));
+		}
+		side = glm::normalize(side);
+		vec3 trueUp = glm::cross(side, fwd);
+
+		mat3 basis;
+		switch (forward) {
+		case Axis::X:
+			basis[0] = fwd; basis[1] = trueUp; basis[2] = side;
+			break;
+		case Axis::Y:
+			basis[0] = side; basis[1] = fwd; basis[2] = trueUp;
+			break;
+		case Axis::Z:
+			basis[0] = trueUp; basis[1] = side; basis[2] = fwd;
+			break;
+		}
+		return basis;
+	}
+}
+
+ConstraintSolver& ConstraintSolver::get() {
+	static ConstraintSolver solver;
+	return solver;
+}
+
+void ConstraintSolver::addParent(const AnimationObject& object, const AnimationObject& target, float weight) {
+	ParentConstraint c;
+	c.object = object.index;
+	c.target = target.index;
+	c.weight = weight;
+	c.offset = glm::inverse(target.transform) * object.transform;
+	parents.push_back(c);
+}
+
+void ConstraintSolver::addPoint(const AnimationObject& object, const AnimationObject& target, const vec3& offset, float weight) {
+	PointConstraint c;
+	c.object = object.index;
+	c.target = target.index;
+	c.weight = weight;
+	c.offset = offset;
+	points.push_back(c);
+}
+
+void ConstraintSolver::addOrient(const AnimationObject& object, const AnimationObject& target, const vec3& offset, float weight) {
+	OrientConstraint c;
+	c.object = object.index;
+	c.target = target.index;
+	c.weight = weight;
+	c.offset = offset;
+	orients.push_back(c);
+}
+
+void ConstraintSolver::addAim(const AnimationObject& object, const AnimationObject& target, Axis forward, float weight) {
+	AimConstraint c;
+	c.object = object.index;
+	c.target = target.index;
+	c.weight = weight;
+	c.forward = forward;
+	aims.push_back(c);
+}
+
+void ConstraintSolver::remove(int objectIndex) {
+	auto matches = [objectIndex](const Constraint& c) { return c.object == objectIndex || c.target == objectIndex; };
+	parents.erase(std::remove_if(parents.begin(), parents.end(), matches), parents.end());
+	points.erase(std::remove_if(points.begin(), points.end(), matches), points.end());
+	orients.erase(std::remove_if(orients.begin(), orients.end(), matches), orients.end());
+	aims.erase(std::remove_if(aims.begin(), aims.end(), matches), aims.end());
+}
+
+void ConstraintSolver::clear() {
+	parents.clear();
+	points.clear();
+	orients.clear();
+	aims.clear();
+}
+
+int ConstraintSolver::levelOf(AnimationObject* object, int depth) {
+	auto found = levels.find(object->index);
+	if (found != levels.end()) return found->second;
+
+	// Cycles (a aims at b, b aims at a) just stop climbing; one side sees last frame's result
+	if (depth > 32) return 0;
+
+	int level = 0;
+	auto foundTargets = targets.find(object);
+	if (foundTargets != targets.end()) {
+		for (auto target : foundTargets->second) {
+			level = std::max(level, levelOf(target, depth + 1) + 1);
+		}
+	}
+
+	levels[object->index] = level;
+	return level;
+}
+
+void ConstraintSolver::gather() {
+	auto& app = Application::get();
+
+	scene.clear();
+	scene.reserve(app.objects.size());
+	for (auto& o : app.objects) {
+		scene.push_back(&o);
+	}
+	auto assignmentObjects = app.getObjects();
+	scene.insert(scene.end(), assignmentObjects.begin(), assignmentObjects.end());
+
+	for (auto& r : resolved) {
+		r.clear();
+	}
+
+	bool anyExplicit = !parents.empty() || !points.empty() || !orients.empty() || !aims.empty();
+	byIndex.clear();
+	targets.clear();
+
+	for (auto o : scene) {
+		if (anyExplicit) byIndex[o->index] = o;
+
+		if (o->billboard) resolved[ConstraintType::Billboard].push_back({ o });
+		if (glm::length(o->orbitRotation) > 0.f) resolved[ConstraintType::Orbit].push_back({ o });
+		if (glm::length(o->constantRotation) > 0.f) resolved[ConstraintType::Spin].push_back({ o });
+	}
+
+	if (!anyExplicit) return;
+
+	auto resolve = [this](const auto& list, ConstraintType type) {
+		for (size_t i = 0; i < list.size(); i++) {
+			const auto& c = list[i];
+			if (!c.enabled) continue;
+
+			auto object = byIndex.find(c.object);
+			auto target = byIndex.find(c.target);
+			if (object == byIndex.end() || target == byIndex.end() || object->second == target->second) continue;
+
+			resolved[type].push_back({ object->second, target->second, i });
+			targets[object->second].push_back(target->second);
+		}
+	};
+	resolve(parents, ConstraintType::Parent);
+	resolve(points, ConstraintType::Point);
+	resolve(orients, ConstraintType::Orient);
+	resolve(aims, ConstraintType::Aim);
+}
+
+void ConstraintSolver::refreshChildren() {
+	// Pull children of anything solved so far along with their parents. Repeats until
+	// nothing changes so grandchildren are handled too.
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (auto o : scene) {
+			if (!o->parent || solved.count(o) || !solved.count(o->parent)) continue;
+
+			o->transform = o->parent->transform * o->localTransform;
+			setWorld(*o, vec3(o->transform[3]), worldRotation(o->transform), worldScale(o->transform));
+			solved.insert(o);
+			stats.refreshed++;
+			changed = true;
+		}
+	}
+}
+
+void ConstraintSolver::restoreAuthored(AnimationObject& o) {
+	LocalPose current = { o.localPosition, o.localRotation, o.localScale };
+
+	auto found = poses.find(o.index);
+	if (found == poses.end() || !(found->second.written == current)) {
+		// New to the solver, or animated or edited since the last solve
+		poses[o.index].authored = current;
+		return;
+	}
+
+	const auto& authored = found->second.authored;
+	o.localPosition = authored.position;
+	o.localRotation = authored.rotation;
+	o.localScale = authored.scale;
+	o.updateMatrix(true);
+}
+
+void ConstraintSolver::prunePoses() {
+	for (auto it = poses.begin(); it != poses.end();) {
+		if (byIndex.count(it->first) && targets.count(byIndex[it->first])) ++it;
+		else it = poses.erase(it);
+	}
+}
+
+void ConstraintSolver::solveOrbits(double dt) {
+	for (auto& r : resolved[ConstraintType::Orbit]) {
+		auto o = r.object;
+		quaternion orbit = quaternion(glm::radians(o->orbitRotation * (float)dt));
+		o->localPosition = orbit * o->localPosition;
+	}
+}
+
+void ConstraintSolver::solveSpins() {
+	for (auto& r : resolved[ConstraintType::Spin]) {
+		r.object->localRotation += r.object->constantRotation;
+	}
+}
+
+void ConstraintSolver::solveParents(size_t begin, size_t end) {
+	auto& list = resolved[ConstraintType::Parent];
+	for (size_t i = begin; i < end; i++) {
+		auto& r = list[i];
+		const auto& c = parents[r.source];
+		mat4 goal = r.target->transform * c.offset;
+
+		vec3 position = glm::mix(vec3(r.object->transform[3]), vec3(goal[3]), c.weight);
+		quaternion rotation = glm::slerp(worldRotation(r.object->transform), worldRotation(goal), c.weight);
+		vec3 scale = glm::mix(worldScale(r.object->transform), worldScale(goal), c.weight);
+		setWorld(*r.object, position, rotation, scale);
+	}
+}
+
+void ConstraintSolver::solvePoints(size_t begin, size_t end) {
+	auto& list = resolved[ConstraintType::Point];
+	for (size_t i = begin; i < end; i++) {
+		auto& r = list[i];
+		const auto& c = points[r.source];
+		vec3 position = glm::mix(vec3(r.object->transform[3]), vec3(r.target->transform[3]) + c.offset, c.weight);
+		setWorld(*r.object, position, worldRotation(r.object->transform), worldScale(r.object->transform));
+	}
+}
+
+void ConstraintSolver::solveOrients(size_t begin, size_t end) {
+	auto& list = resolved[ConstraintType::Orient];
+	for (size_t i = begin; i < end; i++) {
+		auto& r = list[i];
+		const auto& c = orients[r.source];
+		quaternion goal = worldRotation(r.target->transform) * quaternion(glm::radians(c.offset));
+		quaternion rotation = glm::slerp(worldRotation(r.object->transform), goal, c.weight);
+		setWorld(*r.object, vec3(r.object->transform[3]), rotation, worldScale(r.object->transform));
+	}
+}
+
+void ConstraintSolver::solveAims(size_t begin, size_t end) {
+	auto& list = resolved[ConstraintType::Aim];
+	for (size_t i = begin; i < end; i++) {
+		auto& r = list[i];
+		const auto& c = aims[r.source];
+		vec3 position = vec3(r.object->transform[3]);
+		vec3 toTarget = vec3(r.target->transform[3]) - position;
+		if (glm::length(toTarget) < 1e-6f) continue;
+
+		quaternion goal = glm::quat_cast(lookBasis(glm::normalize(toTarget), c.up, c.forward));
+		quaternion rotation = glm::slerp(worldRotation(r.object->transform), goal, c.weight);
+		setWorld(*r.object, position, rotation, worldScale(r.object->transform));
+	}
+}
+
+void ConstraintSolver::solveBillboards(size_t begin, size_t end) {
+	auto renderer = Application::get().getRenderer<Renderer>();
+	if (!renderer) return;
+
+	const auto& cam = renderer->camera;
+
+	auto& list = resolved[ConstraintType::Billboard];
+	for (size_t i = begin; i < end; i++) {
+		auto o = list[i].object;
+		vec3 position = vec3(o->transform[3]);
+		vec3 toCamera = cam.Position - position;
+		if (glm::length(toCamera) < 1e-6f) continue;
+
+		mat3 basis = lookBasis(glm::normalize(toCamera), cam.currentUp, o->forwardDirection);
+		setWorld(*o, position, glm::quat_cast(basis), worldScale(o->transform));
+	}
+}
+
+void ConstraintSolver::solve(double dt) {
+	if (!enabled) return;
+
+	double start = getWallTime();
+
+	gather();
+
+	stats.refreshed = 0;
+	for (int t = 0; t < ConstraintType::_size(); t++) {
+		stats.counts[t] = resolved[t].size();
+	}
+
+	// Local-space drivers first, then rebuild the matrices they touched
+	if (!resolved[ConstraintType::Orbit].empty() || !resolved[ConstraintType::Spin].empty()) {
+		solveOrbits(dt);
+		solveSpins();
+
+		for (auto type : { ConstraintType::Orbit, ConstraintType::Spin }) {
+			for (auto& r : resolved[type]) {
+				r.object->updateMatrix(true);
+			}
+		}
+
+		solved.clear();
+		for (auto type : { ConstraintType::Orbit, ConstraintType::Spin }) {
+			for (auto& r : resolved[type]) {
+				solved.insert(r.object);
+			}
+		}
+		refreshChildren();
+	}
+
+	const ConstraintType worldTypes[] = { ConstraintType::Parent, ConstraintType::Point, ConstraintType::Orient,
+		ConstraintType::Aim, ConstraintType::Billboard };
+
+	// Sort each world-space array by level so a level is a contiguous range per type
+	levels.clear();
+	int maxLevel = -1;
+	for (auto type : worldTypes) {
+		for (auto& r : resolved[type]) {
+			r.level = levelOf(r.object);
+			maxLevel = std::max(maxLevel, r.level);
+		}
+		std::stable_sort(resolved[type].begin(), resolved[type].end(),
+			[](const Resolved& a, const Resolved& b) { return a.level < b.level; });
+	}
+
+	prunePoses();
+
+	size_t cursor[ConstraintType::_size()] = {};
+	size_t ends[ConstraintType::_size()] = {};
+
+	for (int level = 0; level <= maxLevel; level++) {
+		solved.clear();
+
+		for (auto type : worldTypes) {
+			auto& list = resolved[type];
+			size_t end = cursor[type];
+			while (end < list.size() && list[end].level == level) {
+				solved.insert(list[end].object);
+				end++;
+			}
+			ends[type] = end;
+		}
+
+		// Every weighted constraint on an object blends from the same authored pose, so it's
+		// restored once for all of them
+		for (auto o : solved) {
+			if (targets.count(o)) restoreAuthored(*o);
+		}
+
+		for (auto type : worldTypes) {
+			size_t begin = cursor[type], end = ends[type];
+			cursor[type] = end;
+			if (begin == end) continue;
+
+			switch (type) {
+			case ConstraintType::Parent: solveParents(begin, end); break;
+			case ConstraintType::Point: solvePoints(begin, end); break;
+			case ConstraintType::Orient: solveOrients(begin, end); break;
+			case ConstraintType::Aim: solveAims(begin, end); break;
+			case ConstraintType::Billboard: solveBillboards(begin, end); break;
+			default: break;
+			}
+		}
+
+		for (auto o : solved) {
+			auto found = poses.find(o->index);
+			if (found != poses.end()) found->second.written = { o->localPosition, o->localRotation, o->localScale };
+		}
+
+		refreshChildren();
+	}
+
+	stats.levels = maxLevel + 1;
+	stats.time = getWallTime() - start;
+}
+
+void ConstraintSolver::renderUI() {
+	if (!ImGui::CollapsingHeader("Constraints")) return;
+
+	IMDENT;
+	ImGui::PushID((void*)this);
+
+	ImGui::Checkbox("Enabled", &enabled);
+	ImGui::Text("Solved in %.3f ms, %d levels, %d children refreshed", stats.time * 1000.0, stats.levels, (int)stats.refreshed);
+	for (int t = 0; t < ConstraintType::_size(); t++) {
+		ImGui::Text("%s: %d", ConstraintType::_from_index(t)._to_string(), (int)stats.counts[t]);
+	}
+
+	auto selection = Application::get().getSelectedObjects();
+	if (selection.size() >= 2) {
+		// Last selected object is constrained to the one selected before it
+		auto& target = *selection[selection.size() - 2];
+		auto& object = *selection.back();
+		ImGui::Text("Constrain shape %d to shape %d", object.index, target.index);
+		if (ImGui::Button("Parent")) addParent(object, target);
+		ImGui::SameLine();
+		if (ImGui::Button("Point")) addPoint(object, target);
+		ImGui::SameLine();
+		if (ImGui::Button("Orient")) addOrient(object, target);
+		ImGui::SameLine();
+		if (ImGui::Button("Aim")) addAim(object, target, object.forwardDirection);
+	}
+	else {
+		ImGui::TextDisabled("Select two objects to add a constraint");
+	}
+
+	auto renderList = [](const char* label, auto& list) {
+		int toDelete = -1;
+		for (int i = 0; i < (int)list.size(); i++) {
+			auto& c = list[i];
+			ImGui::PushID(&c);
+			ImGui::Checkbox("##enabled", &c.enabled);
+			ImGui::SameLine();
+			ImGui::Text("%s: %d -> %d", label, c.object, c.target);
+			ImGui::SameLine();
+			ImGui::SetNextItemWidth(100.f);
+			ImGui::SliderFloat("Weight", &c.weight, 0.f, 1.f);
+			ImGui::SameLine();
+			if (ImGui::Button("Delete")) toDelete = i;
+			ImGui::PopID();
+		}
+		if (toDelete >= 0) list.erase(list.begin() + toDelete);
+	};
+	renderList("Parent", parents);
+	renderList("Point", points);
+	renderList("Orient", orients);
+	renderList("Aim", aims);
+
+	ImGui::PopID();
+	IMDONT;
+}
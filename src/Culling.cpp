@@ -0,0 +1,466 @@
+#include "Culling.h"
+
+#include "AnimationObject.h"
+#include "AnimationObjectRenderer.h"
+
+#include "imgui.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define CULLING_SSE 1
+#include <xmmintrin.h>
+#endif
+
+Bounds Bounds::transformed(const mat4& m) const {
+	if (!valid()) return *this;
+
+	// Arvo's method: each output axis picks the smaller and larger product per input axis
+	vec3 tmin = vec3(m[3]);
+	vec3 tmax = tmin;
+	for (int col = 0; col < 3; col++) {
+		for (int row = 0; row < 3; row++) {
+			float a = m[col][row] * min[col];
+			float b = m[col][row] * max[col];
+			tmin[row] += std::min(a, b);
+			tmax[row] += std::max(a, b);
+		}
+	}
+	return Bounds(tmin, tmax);
+}
+
+Frustum::Frustum(const mat4& viewproj) {
+	vec4 row0 = glm::row(viewproj, 0);
+	vec4 row1 = glm::row(viewproj, 1);
+	vec4 row2 = glm::row(viewproj, 2);
+	vec4 row3 = glm::row(viewproj, 3);
+
+	vec4 planes[6] = { row3 + row0, row3 - row0, row3 + row1, row3 - row1, row3 + row2, row3 - row2 };
+	*this = Frustum(planes);
+}
+
+Frustum::Frustum(const vec4 planes[6]) {
+	for (int i = 0; i < 8; i++) {
+		vec4 p = vec4(0.f, 0.f, 0.f, 1.f);
+		if (i < 6) {
+			float l = glm::length(vec3(planes[i]));
+			p = l > 0.f ? planes[i] / l : vec4(0.f, 0.f, 0.f, 1.f);
+		}
+		nx[i] = p.x;
+		ny[i] = p.y;
+		nz[i] = p.z;
+		d[i] = p.w;
+	}
+}
+
+CullResult Frustum::test(const Bounds& b) const {
+	vec3 c = b.center();
+	vec3 e = b.extents();
+
+	bool inside = true;
+
+#ifdef CULLING_SSE
+	const __m128 signMask = _mm_set1_ps(-0.f);
+	__m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+	__m128 ex = _mm_set1_ps(e.x), ey = _mm_set1_ps(e.y), ez = _mm_set1_ps(e.z);
+
+	for (int i = 0; i < 8; i += 4) {
+		__m128 px = _mm_load_ps(nx + i), py = _mm_load_ps(ny + i), pz = _mm_load_ps(nz + i);
+
+		// Distance from the plane to the box center, and the box's projected half size
+		__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)),
+			_mm_add_ps(_mm_mul_ps(pz, cz), _mm_load_ps(d + i)));
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, px), ex),
+			_mm_mul_ps(_mm_andnot_ps(signMask, py), ey)), _mm_mul_ps(_mm_andnot_ps(signMask, pz), ez));
+
+		if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, r), _mm_setzero_ps()))) {
+			return CullResult::Outside;
+		}
+		if (_mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(dist, r), _mm_setzero_ps()))) {
+			inside = false;
+		}
+	}
+#else
+	for (int i = 0; i < 6; i++) {
+		float dist = nx[i] * c.x + ny[i] * c.y + nz[i] * c.z + d[i];
+		float r = fabsf(nx[i]) * e.x + fabsf(ny[i]) * e.y + fabsf(nz[i]) * e.z;
+
+		if (dist + r < 0.f) return CullResult::Outside;
+		if (dist - r < 0.f) inside = false;
+	}
+#endif
+
+	return inside ? CullResult::Inside : CullResult::Intersecting;
+}
+
+bool Frustum::isVisible(const vec3& center, float radius) const {
+	for (int i = 0; i < 6; i++) {
+		if (nx[i] * center.x + ny[i] * center.y + nz[i] * center.z + d[i] < -radius) return false;
+	}
+	return true;
+}
+
+int DynamicBVH::allocate() {
+	if (freeList == -1) {
+		nodes.emplace_back();
+		nodes.back().height = 0;
+		return (int)nodes.size() - 1;
+	}
+
+	int node = freeList;
+	freeList = nodes[node].parent;
+	freeCount--;
+
+	nodes[node] = Node();
+	nodes[node].height = 0;
+	return node;
+}
+
+void DynamicBVH::release(int node) {
+	nodes[node].parent = freeList;
+	nodes[node].height = -1;
+	freeList = node;
+	freeCount++;
+}
+
+int DynamicBVH::insert(const Bounds& bounds, int userData) {
+	int leaf = allocate();
+	nodes[leaf].bounds = bounds.padded(margin);
+	nodes[leaf].userData = userData;
+
+	insertLeaf(leaf);
+	leafCount++;
+	return leaf;
+}
+
+void DynamicBVH::remove(int proxy) {
+	removeLeaf(proxy);
+	release(proxy);
+	leafCount--;
+}
+
+bool DynamicBVH::update(int proxy, const Bounds& bounds) {
+	if (nodes[proxy].bounds.contains(bounds)) return false;
+
+	removeLeaf(proxy);
+	nodes[proxy].bounds = bounds.padded(margin);
+	insertLeaf(proxy);
+	return true;
+}
+
+void DynamicBVH::clear() {
+	nodes.clear();
+	root = -1;
+	freeList = -1;
+	freeCount = 0;
+	leafCount = 0;
+}
+
+void DynamicBVH::insertLeaf(int leaf) {
+	if (root == -1) {
+		root = leaf;
+		nodes[root].parent = -1;
+		return;
+	}
+
+	// Walk down towards whichever child costs less to grow, stopping when making a new
+	// parent here is cheaper than descending
+	Bounds leafBounds = nodes[leaf].bounds;
+	int index = root;
+	while (!nodes[index].isLeaf()) {
+		const Node& node = nodes[index];
+		float area = node.bounds.area();
+		float combined = Bounds::merge(node.bounds, leafBounds).area();
+
+		float cost = 2.f * combined;
+		float inheritance = 2.f * (combined - area);
+
+		auto childCost = [&](int child) {
+			float grown = Bounds::merge(nodes[child].bounds, leafBounds).area();
+			return nodes[child].isLeaf() ? grown + inheritance : grown - nodes[child].bounds.area() + inheritance;
+		};
+
+		float leftCost = childCost(node.left);
+		float rightCost = childCost(node.right);
+
+		if (cost < leftCost && cost < rightCost) break;
+
+		index = leftCost < rightCost ? node.left : node.right;
+	}
+
+	int sibling = index;
+	int oldParent = nodes[sibling].parent;
+	int newParent = allocate();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].bounds = Bounds::merge(leafBounds, nodes[sibling].bounds);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].left = sibling;
+	nodes[newParent].right = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent == -1) {
+		root = newParent;
+	}
+	else if (nodes[oldParent].left == sibling) {
+		nodes[oldParent].left = newParent;
+	}
+	else {
+		nodes[oldParent].right = newParent;
+	}
+
+	refit(nodes[leaf].parent);
+}
+
+void DynamicBVH::removeLeaf(int leaf) {
+	if (leaf == root) {
+		root = -1;
+		return;
+	}
+
+	int parent = nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+	if (grandParent == -1) {
+		root = sibling;
+		nodes[sibling].parent = -1;
+		release(parent);
+		return;
+	}
+
+	if (nodes[grandParent].left == parent) nodes[grandParent].left = sibling;
+	else nodes[grandParent].right = sibling;
+	nodes[sibling].parent = grandParent;
+	release(parent);
+
+	refit(grandParent);
+}
+
+void DynamicBVH::refit(int node) {
+	while (node != -1) {
+		node = balance(node);
+
+		int left = nodes[node].left;
+		int right = nodes[node].right;
+		nodes[node].height = 1 + std::max(nodes[left].height, nodes[right].height);
+		nodes[node].bounds = Bounds::merge(nodes[left].bounds, nodes[right].bounds);
+
+		node = nodes[node].parent;
+	}
+}
+
+int DynamicBVH::balance(int a) {
+	Node& A = nodes[a];
+	if (A.isLeaf()) return a;
+
+	int b = A.left;
+	int c = A.right;
+	int diff = nodes[c].height - nodes[b].height;
+
+	if (diff > 1) {
+		std::swap(b, c);
+	}
+	else if (diff >= -1) {
+		return a;
+	}
+
+	// b is the taller child: rotate it up, giving a its shorter grandchild
+	int f = nodes[b].left;
+	int g = nodes[b].right;
+
+	nodes[b].left = a;
+	nodes[b].parent = nodes[a].parent;
+	nodes[a].parent = b;
+
+	int bParent = nodes[b].parent;
+	if (bParent == -1) root = b;
+	else if (nodes[bParent].left == a) nodes[bParent].left = b;
+	else nodes[bParent].right = b;
+
+	int keep = nodes[f].height > nodes[g].height ? f : g;
+	int give = keep == f ? g : f;
+
+	nodes[b].right = keep;
+	if (nodes[a].left == b) nodes[a].left = give;
+	else nodes[a].right = give;
+	nodes[give].parent = a;
+
+	nodes[a].bounds = Bounds::merge(nodes[nodes[a].left].bounds, nodes[nodes[a].right].bounds);
+	nodes[a].height = 1 + std::max(nodes[nodes[a].left].height, nodes[nodes[a].right].height);
+
+	return b;
+}
+
+void DynamicBVH::collect(int node, std::vector<int>& out) const {
+	std::vector<int> stack = { node };
+	while (!stack.empty()) {
+		int n = stack.back();
+		stack.pop_back();
+
+		if (nodes[n].isLeaf()) {
+			out.push_back(nodes[n].userData);
+		}
+		else {
+			stack.push_back(nodes[n].left);
+			stack.push_back(nodes[n].right);
+		}
+	}
+}
+
+void DynamicBVH::query(const Frustum& frustum, std::vector<int>& out, size_t* tests) const {
+	if (root == -1) return;
+
+	std::vector<int> stack = { root };
+	while (!stack.empty()) {
+		int n = stack.back();
+		stack.pop_back();
+
+		if (tests) (*tests)++;
+
+		auto result = frustum.test(nodes[n].bounds);
+		if (result == +CullResult::Outside) continue;
+
+		if (result == +CullResult::Inside) {
+			collect(n, out);
+		}
+		else if (nodes[n].isLeaf()) {
+			out.push_back(nodes[n].userData);
+		}
+		else {
+			stack.push_back(nodes[n].left);
+			stack.push_back(nodes[n].right);
+		}
+	}
+}
+
+SceneCulling& SceneCulling::get() {
+	static SceneCulling culling;
+	return culling;
+}
+
+void SceneCulling::sync(const std::vector<AnimationObject>& objects) {
+	double start = getWallTime();
+	syncCount++;
+	objectCount = objects.size();
+
+	auto& renderer = AnimationObjectRenderer::get();
+
+	staticFlags.assign(objects.size(), 0);
+
+	for (size_t i = 0; i < objects.size(); i++) {
+		const auto& shape = objects[i];
+		auto& proxy = proxies[shape.index];
+		bool wasStatic = proxy.node != -1 && syncCount - proxy.lastMoved > (uint64_t)staticFrames;
+
+		// Reordering objects moves nothing in the world, but positions index staticFlags
+		proxy.position = i;
+		proxy.lastSeen = syncCount;
+
+		bool moved = proxy.node == -1 || proxy.size != shape.size ||
+			memcmp(&proxy.transform, &shape.transform, sizeof(mat4)) != 0;
+		if (moved) proxy.lastMoved = syncCount;
+
+		bool isStatic = syncCount - proxy.lastMoved > (uint64_t)staticFrames;
+		staticFlags[i] = isStatic ? 1 : 0;
+		if (isStatic != wasStatic) staticVersion++;
+
+		if (!moved) continue;
+
+		Bounds local = renderer.getLocalBounds(shape);
+		Bounds sized = Bounds(local.min * shape.size, local.max * shape.size);
+		// The vertex transform wobbles positions by up to 0.1
+		if (shape.useVertexTransform) sized = sized.padded(0.1f);
+
+		proxy.transform = shape.transform;
+		proxy.size = shape.size;
+		proxy.bounds = sized.transformed(shape.transform);
+
+		if (proxy.node == -1) {
+			proxy.node = tree.insert(proxy.bounds, shape.index);
+		}
+		else if (tree.update(proxy.node, proxy.bounds)) {
+			reinserts++;
+		}
+	}
+
+	// Deleted objects weren't seen this time around
+	for (auto it = proxies.begin(); it != proxies.end(); ) {
+		if (it->second.lastSeen != syncCount) {
+			if (it->second.lastSeen - it->second.lastMoved > (uint64_t)staticFrames) staticVersion++;
+			if (it->second.node != -1) tree.remove(it->second.node);
+			it = proxies.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	syncTime = getWallTime() - start;
+}
+
+void SceneCulling::cull(const Frustum& frustum, bool isShadow) {
+	auto& stats = isShadow ? shadowStats : cameraStats;
+	stats = Stats();
+
+	if (!enabled) return;
+
+	double start = getWallTime();
+
+	visibility.assign(objectCount, 0);
+	queryResults.clear();
+	tree.query(frustum, queryResults, &stats.tested);
+
+	for (int index : queryResults) {
+		auto it = proxies.find(index);
+		if (it == proxies.end()) continue;
+
+		// Fat boxes are generous, so check the object's own box before counting it
+		if (frustum.isVisible(it->second.bounds) && it->second.position < visibility.size()) {
+			visibility[it->second.position] = 1;
+			stats.visible++;
+		}
+	}
+
+	stats.culled = proxies.size() - stats.visible;
+	stats.time = getWallTime() - start;
+}
+
+void SceneCulling::record(bool visible, bool isShadow) {
+	auto& stats = isShadow ? shadowStats : cameraStats;
+	stats.tested++;
+	if (visible) stats.visible++;
+	else stats.culled++;
+}
+
+void SceneCulling::hide(size_t objectPosition) {
+	if (objectPosition >= visibility.size() || !visibility[objectPosition]) return;
+
+	visibility[objectPosition] = 0;
+	cameraStats.visible--;
+	cameraStats.culled++;
+	cameraStats.occluded++;
+}
+
+const Bounds* SceneCulling::getBounds(int objectIndex) const {
+	auto it = proxies.find(objectIndex);
+	return it == proxies.end() ? nullptr : &it->second.bounds;
+}
+
+void SceneCulling::renderUI() {
+	if (ImGui::CollapsingHeader("Culling")) {
+		ImGui::Checkbox("Frustum culling", &enabled);
+		ImGui::SliderFloat("BVH margin", &tree.margin, 0.f, 2.f);
+
+		ImGui::Text("BVH: %d objects, %d nodes, height %d", (int)tree.getLeafCount(), (int)tree.getNodeCount(), tree.getHeight());
+		ImGui::Text("Sync: %.3f ms, %d reinserts total", syncTime * 1000.0, (int)reinserts);
+
+		ImGui::SliderInt("Frames until static", &staticFrames, 1, 240);
+		ImGui::Text("Static objects: %d of %d", (int)std::count(staticFlags.begin(), staticFlags.end(), 1), (int)staticFlags.size());
+
+		auto statsText = [](const char* label, const Stats& s) {
+			ImGui::Text("%s: %d visible, %d culled (%d occluded), %d box tests in %.3f ms",
+				label, (int)s.visible, (int)s.culled, (int)s.occluded, (int)s.tested, s.time * 1000.0);
+		};
+		statsText("Camera", cameraStats);
+		statsText("Shadow", shadowStats);
+	}
+}
@@ -0,0 +1,184 @@
+#include "DependencyGraph.h"
+
+#include "WorkerPool.h"
+
+#include "imgui.h"
+
+DependencyGraph::NodeId DependencyGraph::addInput(const std::string& nodeName, Changed changed) {
+	NodeId id = addDriven(nodeName, {}, nullptr);
+	nodes[id].changed = changed;
+	return id;
+}
+
+DependencyGraph::NodeId DependencyGraph::addDriven(const std::string& nodeName, const std::vector<NodeId>& inputs, Evaluate evaluate, bool threadSafe) {
+	NodeId id = (NodeId)nodes.size();
+
+	Node node;
+	node.name = nodeName;
+	node.evaluate = evaluate;
+	node.threadSafe = threadSafe;
+
+	for (NodeId input : inputs) {
+		if (input < 0 || input >= id) {
+			log("{0}: input {1} of {2} is not in the graph\n", __FUNCTION__, input, nodeName);
+			return -1;
+		}
+		node.inputs.push_back(input);
+		node.level = std::max(node.level, nodes[input].level + 1);
+	}
+
+	nodes.push_back(node);
+	for (NodeId input : inputs) {
+		nodes[input].outputs.push_back(id);
+	}
+
+	if (node.level >= (int)levels.size()) {
+		levels.resize(node.level + 1);
+	}
+	levels[node.level].push_back(id);
+
+	return id;
+}
+
+void DependencyGraph::markDirty(NodeId id) {
+	if (id < 0 || id >= (NodeId)nodes.size()) return;
+
+	// A dirty node's outputs are already dirty, so there's nothing further to push
+	auto& node = nodes[id];
+	if (node.dirty) return;
+
+	node.dirty = true;
+	for (NodeId output : node.outputs) {
+		markDirty(output);
+	}
+}
+
+void DependencyGraph::evaluateNode(Node& node) {
+	double start = getWallTime();
+	if (node.evaluate) {
+		node.evaluate();
+	}
+	node.lastEvaluationTime = getWallTime() - start;
+	node.lastEvaluatedFrame = frame;
+	node.evaluationCount++;
+	node.dirty = false;
+}
+
+size_t DependencyGraph::evaluate() {
+	double start = getWallTime();
+	frame++;
+
+	// Only level 0 nodes have no inputs, so only they can be sources
+	if (!levels.empty()) {
+		for (NodeId id : levels[0]) {
+			auto& node = nodes[id];
+			if (node.changed && node.changed()) {
+				markDirty(id);
+			}
+		}
+	}
+
+	size_t count = 0;
+	std::vector<NodeId> dirty;
+	std::vector<NodeId> threadSafe;
+
+	for (const auto& level : levels) {
+		dirty.clear();
+		for (NodeId id : level) {
+			if (nodes[id].dirty) dirty.push_back(id);
+		}
+		count += dirty.size();
+
+		if (!parallel || (int)dirty.size() < std::max(2, minParallelNodes)) {
+			for (NodeId id : dirty) {
+				evaluateNode(nodes[id]);
+			}
+			continue;
+		}
+
+		// Same-level nodes don't read each other's outputs, so they can run side by side.
+		// The calling thread takes whatever isn't thread safe first.
+		threadSafe.clear();
+		for (NodeId id : dirty) {
+			if (nodes[id].threadSafe) {
+				threadSafe.push_back(id);
+			}
+			else {
+				evaluateNode(nodes[id]);
+			}
+		}
+
+		WorkerPool::get().parallelFor((int)threadSafe.size(), [this, &threadSafe](int i, int) {
+			evaluateNode(nodes[threadSafe[i]]);
+		});
+	}
+
+	lastEvaluatedCount = count;
+	lastEvaluationTime = getWallTime() - start;
+
+	return count;
+}
+
+bool DependencyGraph::evaluatedThisFrame(NodeId id) const {
+	return id >= 0 && id < (NodeId)nodes.size() && nodes[id].lastEvaluatedFrame == frame;
+}
+
+void DependencyGraph::clear() {
+	nodes.clear();
+	levels.clear();
+}
+
+void DependencyGraph::renderUI() {
+	ImGui::PushID((void*)this);
+
+	ImGui::Checkbox("Evaluate levels in parallel", &parallel);
+	if (parallel) {
+		ImGui::SliderInt("Min nodes per parallel level", &minParallelNodes, 2, 64);
+	}
+
+	ImGui::Text("%d / %d nodes evaluated in %.3f ms", (int)lastEvaluatedCount, (int)nodes.size(), lastEvaluationTime * 1000.0);
+
+	if (ImGui::BeginTable("Nodes", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+		ImGui::TableSetupColumn("Node");
+		ImGui::TableSetupColumn("Level");
+		ImGui::TableSetupColumn("Inputs");
+		ImGui::TableSetupColumn("Evaluations");
+		ImGui::TableSetupColumn("Last (ms)");
+		ImGui::TableHeadersRow();
+
+		for (NodeId id = 0; id < (NodeId)nodes.size(); id++) {
+			const auto& node = nodes[id];
+			bool evaluated = evaluatedThisFrame(id);
+
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			if (evaluated) {
+				ImGui::TextColored(ImVec4(0.3f, 1.f, 0.3f, 1.f), "%s", node.name.c_str());
+			}
+			else {
+				ImGui::TextDisabled("%s", node.name.c_str());
+			}
+
+			ImGui::TableNextColumn();
+			ImGui::Text("%d", node.level);
+
+			ImGui::TableNextColumn();
+			std::string inputNames;
+			for (NodeId input : node.inputs) {
+				if (!inputNames.empty()) inputNames += ", ";
+				inputNames += nodes[input].name;
+			}
+			ImGui::TextUnformatted(inputNames.empty() ? "-" : inputNames.c_str());
+
+			ImGui::TableNextColumn();
+			ImGui::Text("%d", (int)node.evaluationCount);
+
+			ImGui::TableNextColumn();
+			ImGui::Text("%.4f", node.lastEvaluationTime * 1000.0);
+		}
+
+		ImGui::EndTable();
+	}
+
+	ImGui::PopID();
+}
@@ -0,0 +1,46 @@
+#include "FrameUniforms.h"
+
+#include "Camera.h"
+
+using namespace GPU;
+
+bool FrameUniforms::init()
+{
+	data.viewproj = mat4(1.f);
+	data.view = mat4(1.f);
+	data.projection = mat4(1.f);
+	data.lightViewProj = mat4(1.f);
+	data.cameraPosition = vec4(0.f, 0.f, 0.f, 1.f);
+	data.viewDirection = vec4(0.f, 0.f, -1.f, 0.f);
+
+	gpu = spBuffer(new Buffer(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr, GL_DYNAMIC_DRAW));
+
+	return true;
+}
+
+void FrameUniforms::update(const Camera& camera)
+{
+	data.viewproj = camera.viewproj;
+	data.view = camera.view;
+	data.projection = camera.projection;
+	data.cameraPosition = vec4(camera.Position, 1.f);
+
+	vec3 lookDir = camera.Lookat - camera.Position;
+	data.viewDirection = vec4(glm::length(lookDir) > 0.f ? glm::normalize(lookDir) : vec3(0.f, 0.f, -1.f), 0.f);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, gpu->buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), &data, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, GPU_FRAME_BINDING_SPOT, gpu->buffer);
+}
+
+FrameUniforms& FrameUniforms::get()
+{
+	static FrameUniforms instance;
+	static bool initialized = ([&]() {
+		return instance.init();
+		})();
+
+	return instance;
+}
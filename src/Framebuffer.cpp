@@ -1,4 +1,5 @@
 #include "Framebuffer.h"
+#include "GLStateCache.h"
 #include "GraphicsUtils.h"
 #include "Texture.h"
 
@@ -125,7 +126,7 @@ void Framebuffer::initTextures() {
 
 	GraphicsUtils::checkGLError(__FUNCTION__);
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	
 }
@@ -146,7 +147,7 @@ void Framebuffer::initTexture(int index, GBufferMode indexMode)
 
 		//GBufferMode indexMode = GBufferMode::_from_integral(index);
 
-		glBindTexture(GL_TEXTURE_2D, tex->id);
+		GLState::bindTexture(GL_TEXTURE_2D, tex->id);
 		// Set texture parameters
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -168,7 +169,7 @@ void Framebuffer::initTexture(int index, GBufferMode indexMode)
 /*
 void Framebuffer::initTexture(int index, GBufferMode indexMode)
 {
-	glBindTexture(GL_TEXTURE_2D, textures[index]);
+	GLState::bindTexture(GL_TEXTURE_2D, textures[index]);
 	// Set texture parameters
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -352,7 +353,7 @@ void Framebuffer::clearTexture(GBufferMode mode, const vec4 & clearColor)
 		return;
 	}
 
-	auto colorLoc = glGetUniformLocation(blankerShader->program, "clearColor");
+	auto colorLoc = blankerShader->uniform("clearColor");
 
 	blankerShader->start();
 
@@ -0,0 +1,99 @@
+#include "FullscreenFilter.h"
+
+#include "GLStateCache.h"
+#include "StringUtil.h"
+#include "UIHelpers.h"
+
+#include "imgui.h"
+
+FullscreenFilter::FullscreenFilter(const std::string& _fragPath, bool _enabled)
+	: fragPath(_fragPath), enabled(_enabled)
+{
+	name = StringUtil::replaceAll(fragPath, "filters/", "");
+	name = StringUtil::replaceAll(name, ".frag", "");
+}
+
+bool FullscreenFilter::init()
+{
+	initialized = true;
+
+	if (!vao) {
+		glGenVertexArrays(1, &vao);
+
+		vertexVBO = spVectorBuffer<GLuint>(
+			new VectorBuffer<GLuint>(GL_ARRAY_BUFFER, { 0, 1, 2, 3 }, GL_STATIC_DRAW));
+
+		indexVBO = spVectorBuffer<GLuint>(
+			new VectorBuffer<GLuint>(GL_ELEMENT_ARRAY_BUFFER, { 0, 1, 2, 0, 2, 3 }, GL_STATIC_DRAW));
+	}
+
+	auto vertText = Shader::LoadText("filters/fullscreenfilter.vert");
+	auto fragText = Shader::ProcessShaderText(Shader::LoadText(fragPath), {
+		{ "__UNIFORMS__", "uniform float iTime;\nuniform vec2 resolution;\n" }
+	});
+
+	shader = s_ptr<Shader>(new Shader(vertText, fragText));
+
+	if (!shader->init()) {
+		log("Unable to load filter {0}\n", fragPath);
+		shader = nullptr;
+		return false;
+	}
+
+	ShaderBinding binding;
+	binding.addVertexAttribute("uint", "index", [this](GLint loc) {
+		vertexVBO->bind();
+		glVertexAttribIPointer(loc, 1, GL_UNSIGNED_INT, sizeof(GLuint), (const GLvoid*)0);
+		glEnableVertexAttribArray(loc);
+		});
+
+	GLState::bindVertexArray(vao);
+	shader->bind(binding);
+	indexVBO->bind();
+	GLState::bindVertexArray(0);
+
+	return true;
+}
+
+void FullscreenFilter::render(GLuint input, GLuint depth, const ivec2& resolution)
+{
+	if (!initialized) init();
+	if (!shader) return;
+
+	shader->start();
+
+	GLState::activeTexture(GL_TEXTURE0);
+	GLState::bindTexture(GL_TEXTURE_2D, input);
+	GLState::bindSampler(0, 0);
+	glUniform1i(shader->uniform("filterInput"), 0);
+
+	GLState::activeTexture(GL_TEXTURE1);
+	GLState::bindTexture(GL_TEXTURE_2D, depth);
+	GLState::bindSampler(1, 0);
+	glUniform1i(shader->uniform("depthInput"), 1);
+	GLState::activeTexture(GL_TEXTURE0);
+
+	glUniform1f(shader->uniform("iTime"), (float)getTime());
+	glUniform2f(shader->uniform("resolution"), (float)resolution.x, (float)resolution.y);
+
+	GLState::disable(GL_DEPTH_TEST);
+	GLState::disable(GL_BLEND);
+	GLState::disable(GL_CULL_FACE);
+
+	GLState::bindVertexArray(vao);
+	glDrawElements(GL_TRIANGLES, (GLsizei)indexVBO->data.size(), GL_UNSIGNED_INT, (const GLvoid*)0);
+	GLState::bindVertexArray(0);
+}
+
+void FullscreenFilter::renderUI()
+{
+	ImGui::PushID(this);
+
+	ImGui::Checkbox(name.c_str(), &enabled);
+	ImGui::SameLine();
+	if (ImGui::Button("Reload")) {
+		init();
+	}
+
+	ImGui::PopID();
+}
@@ -0,0 +1,276 @@
+#include "GLStateCache.h"
+
+#include "imgui.h"
+
+namespace GLState
+{
+	namespace {
+		// Not a name GL hands out, so the first call after an invalidate always goes through
+		const GLuint Unknown = ~0u;
+		const int MaxUnits = 32;
+
+		const GLenum TrackedTargets[] = { GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BUFFER };
+		const int TargetCount = 4;
+
+		const GLenum TrackedCaps[] = { GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST, GL_SCISSOR_TEST, GL_STENCIL_TEST };
+		const int CapCount = 5;
+
+		struct Cache {
+			GLuint program = Unknown;
+			GLuint vao = Unknown;
+			GLuint activeUnit = Unknown;
+			GLuint textures[MaxUnits][TargetCount];
+			// Nothing else binds samplers, so these are kept across invalidates
+			GLuint samplers[MaxUnits] = {};
+			// 0 off, 1 on, -1 unknown
+			int caps[CapCount];
+			GLenum cullFace = Unknown;
+			GLenum frontFace = Unknown;
+			GLenum blendSrc = Unknown, blendDst = Unknown;
+			GLenum blendEquation = Unknown;
+			GLenum depthFunc = Unknown;
+			int depthMask = -1;
+
+			std::map<SamplerState, GLuint> samplerObjects;
+
+			Stats frame, last;
+
+			Cache() { reset(); }
+
+			void reset() {
+				program = vao = activeUnit = Unknown;
+				for (auto& unit : textures) {
+					for (auto& t : unit) t = Unknown;
+				}
+				for (auto& c : caps) c = -1;
+				cullFace = frontFace = blendSrc = blendDst = blendEquation = depthFunc = Unknown;
+				depthMask = -1;
+			}
+		};
+
+		Cache& cache() {
+			static Cache instance;
+			return instance;
+		}
+
+		// Counts the call and returns true if it has to reach GL
+		template <typename T>
+		bool changes(T& current, const T& next) {
+			auto& c = cache();
+			c.frame.calls++;
+			if (current == next) {
+				c.frame.filtered++;
+				return false;
+			}
+			current = next;
+			return true;
+		}
+
+		int targetIndex(GLenum target) {
+			for (int i = 0; i < TargetCount; i++) {
+				if (TrackedTargets[i] == target) return i;
+			}
+			return -1;
+		}
+
+		int capIndex(GLenum cap) {
+			for (int i = 0; i < CapCount; i++) {
+				if (TrackedCaps[i] == cap) return i;
+			}
+			return -1;
+		}
+	}
+
+	void useProgram(GLuint program)
+	{
+		if (changes(cache().program, program)) glUseProgram(program);
+	}
+
+	void bindVertexArray(GLuint vao)
+	{
+		if (changes(cache().vao, vao)) glBindVertexArray(vao);
+	}
+
+	void activeTexture(GLenum unit)
+	{
+		if (changes(cache().activeUnit, (GLuint)unit)) glActiveTexture(unit);
+	}
+
+	void bindTexture(GLenum target, GLuint texture)
+	{
+		auto& c = cache();
+		int t = targetIndex(target);
+		int unit = c.activeUnit == Unknown ? -1 : (int)(c.activeUnit - GL_TEXTURE0);
+
+		if (t == -1 || unit < 0 || unit >= MaxUnits) {
+			c.frame.calls++;
+			glBindTexture(target, texture);
+			return;
+		}
+
+		if (changes(c.textures[unit][t], texture)) glBindTexture(target, texture);
+	}
+
+	void bindSampler(GLuint unit, GLuint sampler)
+	{
+		auto& c = cache();
+		if (unit >= MaxUnits) {
+			c.frame.calls++;
+			glBindSampler(unit, sampler);
+			return;
+		}
+
+		if (changes(c.samplers[unit], sampler)) glBindSampler(unit, sampler);
+	}
+
+	void unbindSamplers()
+	{
+		auto& c = cache();
+		for (GLuint unit = 0; unit < MaxUnits; unit++) {
+			if (c.samplers[unit] != 0) bindSampler(unit, 0);
+		}
+	}
+
+	GLuint getSampler(const SamplerState& state)
+	{
+		auto& objects = cache().samplerObjects;
+		auto found = objects.find(state);
+		if (found != objects.end()) return found->second;
+
+		GLuint sampler = 0;
+		glGenSamplers(1, &sampler);
+		glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, state.magFilter);
+		glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, state.minFilter);
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, state.wrapS);
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, state.wrapT);
+		glSamplerParameteri(sampler, GL_TEXTURE_COMPARE_MODE, state.compareMode);
+		glSamplerParameteri(sampler, GL_TEXTURE_COMPARE_FUNC, state.compareFunc);
+		glSamplerParameterfv(sampler, GL_TEXTURE_BORDER_COLOR, glm::value_ptr(state.borderColor));
+
+		objects[state] = sampler;
+		return sampler;
+	}
+
+	void setEnabled(GLenum cap, bool enabled)
+	{
+		auto& c = cache();
+		int i = capIndex(cap);
+
+		if (i == -1) {
+			c.frame.calls++;
+			if (enabled) glEnable(cap);
+			else glDisable(cap);
+			return;
+		}
+
+		if (changes(c.caps[i], enabled ? 1 : 0)) {
+			if (enabled) glEnable(cap);
+			else glDisable(cap);
+		}
+	}
+
+	void enable(GLenum cap) { setEnabled(cap, true); }
+	void disable(GLenum cap) { setEnabled(cap, false); }
+
+	bool isEnabled(GLenum cap)
+	{
+		auto& c = cache();
+		int i = capIndex(cap);
+		if (i == -1) return glIsEnabled(cap) == GL_TRUE;
+
+		if (c.caps[i] == -1) c.caps[i] = glIsEnabled(cap) == GL_TRUE ? 1 : 0;
+		return c.caps[i] == 1;
+	}
+
+	void cullFace(GLenum mode)
+	{
+		if (changes(cache().cullFace, mode)) glCullFace(mode);
+	}
+
+	GLenum getCullFace()
+	{
+		auto& c = cache();
+		if (c.cullFace == Unknown) {
+			GLint mode = GL_BACK;
+			glGetIntegerv(GL_CULL_FACE_MODE, &mode);
+			c.cullFace = (GLenum)mode;
+		}
+		return c.cullFace;
+	}
+
+	void frontFace(GLenum mode)
+	{
+		if (changes(cache().frontFace, mode)) glFrontFace(mode);
+	}
+
+	void blendFunc(GLenum src, GLenum dst)
+	{
+		auto& c = cache();
+		c.frame.calls++;
+		if (c.blendSrc == src && c.blendDst == dst) {
+			c.frame.filtered++;
+			return;
+		}
+		c.blendSrc = src;
+		c.blendDst = dst;
+		glBlendFunc(src, dst);
+	}
+
+	void blendEquation(GLenum mode)
+	{
+		if (changes(cache().blendEquation, mode)) glBlendEquation(mode);
+	}
+
+	void depthFunc(GLenum func)
+	{
+		if (changes(cache().depthFunc, func)) glDepthFunc(func);
+	}
+
+	void depthMask(GLboolean flag)
+	{
+		if (changes(cache().depthMask, (int)flag)) glDepthMask(flag);
+	}
+
+	void forgetTexture(GLuint texture)
+	{
+		for (auto& unit : cache().textures) {
+			for (auto& t : unit) {
+				if (t == texture) t = Unknown;
+			}
+		}
+	}
+
+	void forgetProgram(GLuint program)
+	{
+		auto& c = cache();
+		if (c.program == program) c.program = Unknown;
+	}
+
+	void invalidate()
+	{
+		cache().reset();
+	}
+
+	void beginFrame()
+	{
+		auto& c = cache();
+		c.reset();
+		c.last = c.frame;
+		c.frame = Stats();
+	}
+
+	const Stats& lastFrame()
+	{
+		return cache().last;
+	}
+
+	void renderUI()
+	{
+		if (ImGui::CollapsingHeader("GL state cache")) {
+			const auto& s = lastFrame();
+			ImGui::Text("%d state calls, %d filtered (%.0f%%)", (int)s.calls, (int)s.filtered,
+				s.calls ? 100.0 * s.filtered / s.calls : 0.0);
+			ImGui::Text("%d sampler objects", (int)cache().samplerObjects.size());
+		}
+	}
+}
@@ -3,10 +3,16 @@
 #include "AnimationObjectRenderer.h"
 #include "Application.h"
 #include "Buffer.h"
+#include "Culling.h"
 #include "Framebuffer.h"
+#include "GLStateCache.h"
+#include "IndirectRenderer.h"
 #include "Lighting.h"
+#include "OcclusionCulling.h"
 #include "Renderer.h"
+#include "ResourceRegistry.h"
 #include "Shader.h"
+#include "ShaderPermutations.h"
 #include "StringUtil.h"
 
 #include <glm/gtx/string_cast.hpp>
@@ -528,6 +534,137 @@ s_ptr<GLTFData> GLTFImporter::import(std::string file) {
 
 
 
+namespace {
+	// Start of element i of an accessor
+	const uint8_t* accessorElement(const GLTFData& gltf, const GLTFAccessor& accessor, size_t elementSize, uint32_t i) {
+		const auto& bufferView = gltf.bufferViews[accessor.bufferView];
+		size_t stride = bufferView.byteStride ? bufferView.byteStride : elementSize;
+		return gltf.buffers[bufferView.bufferIndex].data() + bufferView.byteOffset + accessor.byteOffset + stride * i;
+	}
+
+	// Converts a triangle primitive to GeometryPool's vertex format. Returns false for what the
+	// pool can't hold, like other primitive modes or attributes that aren't floats.
+	bool readPrimitive(const GLTFData& gltf, const GLTFPrimitive& prim, std::vector<PlainOldVertex>& vertices, std::vector<GLuint>& indices) {
+		if (prim.mode != +GLTFPrimitiveMode::TRIANGLES || !prim.attributes.contains("POSITION")) return false;
+
+		const auto& positionAccessor = gltf.accessors[prim.attributes["POSITION"].get<uint32_t>()];
+		vertices.assign(positionAccessor.count, PlainOldVertex());
+
+		auto readAttribute = [&](const char* name, size_t components, size_t offset) {
+			if (!prim.attributes.contains(name)) return true;
+
+			const auto& accessor = gltf.accessors[prim.attributes[name].get<uint32_t>()];
+			if (accessor.bufferView < 0 || accessor.componentType != +GLTFAccessorComponentType::FLOAT || accessor.count < vertices.size()) {
+				return false;
+			}
+
+			for (uint32_t i = 0; i < (uint32_t)vertices.size(); i++) {
+				const uint8_t* element = accessorElement(gltf, accessor, sizeof(float) * components, i);
+				std::memcpy((uint8_t*)&vertices[i] + offset, element, sizeof(float) * components);
+			}
+			return true;
+		};
+
+		if (!readAttribute("POSITION", 3, offsetof(PlainOldVertex, position))) return false;
+		if (!readAttribute("NORMAL", 3, offsetof(PlainOldVertex, normal))) return false;
+		if (!readAttribute("TEXCOORD_0", 2, offsetof(PlainOldVertex, uv))) return false;
+
+		indices.clear();
+
+		// Without an index buffer, every three vertices are a triangle
+		if (prim.indices < 0) {
+			for (GLuint i = 0; i < (GLuint)vertices.size(); i++) {
+				indices.push_back(i);
+			}
+			return true;
+		}
+
+		const auto& indexAccessor = gltf.accessors[prim.indices];
+		if (indexAccessor.bufferView < 0) return false;
+
+		size_t indexSize = 0;
+		switch (indexAccessor.componentType) {
+		case GLTFAccessorComponentType::UNSIGNED_BYTE: indexSize = 1; break;
+		case GLTFAccessorComponentType::UNSIGNED_SHORT: indexSize = 2; break;
+		case GLTFAccessorComponentType::UNSIGNED_INT: indexSize = 4; break;
+		default: return false;
+		}
+
+		indices.reserve(indexAccessor.count);
+		for (uint32_t i = 0; i < indexAccessor.count; i++) {
+			const uint8_t* element = accessorElement(gltf, indexAccessor, indexSize, i);
+			GLuint index = 0;
+			if (indexSize == 1) index = *element;
+			else if (indexSize == 2) index = *(const uint16_t*)element;
+			else index = *(const uint32_t*)element;
+
+			if (index >= vertices.size()) return false;
+			indices.push_back(index);
+		}
+
+		return true;
+	}
+
+	// Updates a mesh node's matrix from its parent's and tests its bounds against the frustum.
+	// Returns false if it was culled.
+	bool updateMeshNode(GLTFData& gltf, GLTFNode& node, const Frustum& frustum, bool isShadow) {
+		node.matrix = glm::translate(node.translation) * glm::toMat4(node.rotation) * glm::scale(node.scale);
+
+		if (node.parent) {
+			node.matrix = node.parent->matrix * node.matrix;
+		}
+
+		auto& culling = SceneCulling::get();
+		if (!culling.enabled) return true;
+
+		auto bounds = gltf.context->meshBounds.find(node.meshIndex);
+		if (bounds == gltf.context->meshBounds.end()) {
+			Bounds meshBounds;
+			for (const auto& prim : gltf.meshes[node.meshIndex]->primitives) {
+				if (!prim.attributes.contains("POSITION")) continue;
+				const auto& accessor = gltf.accessors[prim.attributes["POSITION"].get<uint32_t>()];
+				if (accessor.min.size() >= 3 && accessor.max.size() >= 3) {
+					meshBounds.expand(Bounds(vec3(accessor.min[0], accessor.min[1], accessor.min[2]),
+						vec3(accessor.max[0], accessor.max[1], accessor.max[2])));
+				}
+			}
+			bounds = gltf.context->meshBounds.emplace(node.meshIndex, meshBounds).first;
+		}
+
+		// Meshes without min/max can't be culled, so they're always drawn
+		if (!bounds->second.valid()) return true;
+
+		Bounds world = bounds->second.transformed(node.matrix);
+		bool visible = frustum.isVisible(world) && (isShadow || !OcclusionCulling::get().isOccluded(world));
+		culling.record(visible, isShadow);
+		return visible;
+	}
+}
+
+bool GLTFImporter::readTriangles(const GLTFData& gltf, const GLTFPrimitive& prim, std::vector<PlainOldVertex>& vertices, std::vector<GLuint>& indices) {
+	return readPrimitive(gltf, prim, vertices, indices);
+}
+
+GLTFRenderContext::~GLTFRenderContext() {
+	ResourceRegistry::get().remove(memoryHandle);
+}
+
+const string_vector GLTFRenderer::Attributes = { "position", "normal", "uv" };
+
+ShaderPermutations& GLTFRenderer::getVariants() {
+	if (!variants) {
+		variants = std::make_shared<ShaderPermutations>(
+			Shader::LoadText("objects/gltfmesh.vert"), Shader::LoadText("objects/gltfmesh.frag"),
+			string_vector{ "USE_TEXTURE", "USE_SHADOW", "USE_LIGHTING" },
+			std::vector<ShaderFragOutputBindings>{ {0, "frag_color"}, {1, "frag_prim"} },
+			Attributes);
+
+		// Every combination, there are only eight
+		variants->warmUp({ 0, 1, 2, 3, 4, 5, 6, 7 });
+	}
+	return *variants;
+}
+
 void GLTFRenderer::init(s_ptr<GLTFData> gltf) {
 	if (gltf->context) return;
 
@@ -538,6 +675,7 @@ void GLTFRenderer::init(s_ptr<GLTFData> gltf) {
 	auto fragText = Shader::LoadText("objects/gltfmesh.frag");
 
 	context->shader = s_ptr<Shader>(new Shader(vertText, fragText));
+	context->shader->attributeLocations = Attributes;
 
 	std::vector<ShaderFragOutputBindings> fragBindings = {
 		{0, "frag_color"},
@@ -552,6 +690,9 @@ void GLTFRenderer::init(s_ptr<GLTFData> gltf) {
 
 	context->shader->start();
 
+	// Vertex and index data uploaded below, for ResourceRegistry
+	size_t gpuBytes = 0;
+
 	for (auto& node : gltf->nodes) {
 		if (node->type == +GLTFNodeType::mesh) {
 			auto& mesh = gltf->meshes[node->meshIndex];
@@ -565,7 +706,7 @@ void GLTFRenderer::init(s_ptr<GLTFData> gltf) {
 				GLTFGPUData primGPU;
 				glGenVertexArrays(1, &primGPU.VAO);
 
-				glBindVertexArray(primGPU.VAO);
+				GLState::bindVertexArray(primGPU.VAO);
 
 				for (auto& attribute : prim.attributes.items()) {
 					const auto& attribName = attribute.key();
@@ -583,6 +724,7 @@ void GLTFRenderer::init(s_ptr<GLTFData> gltf) {
 						glBindBuffer(GL_ARRAY_BUFFER, attribBuffer);
 
 						glBufferData(GL_ARRAY_BUFFER, bufferView.byteLength, buffer.data() + bufferView.byteOffset, GL_STATIC_DRAW);
+						gpuBytes += bufferView.byteLength;
 
 						if (attribName == "POSITION") {
 							auto loc = glGetAttribLocation(context->shader->program, "position");
@@ -611,10 +753,11 @@ void GLTFRenderer::init(s_ptr<GLTFData> gltf) {
 						glGenBuffers(1, &primGPU.IBO);
 						glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, primGPU.IBO);
 						glBufferData(GL_ELEMENT_ARRAY_BUFFER, primIndicesBufferView.byteLength, primIndicesBuffer.data() + primIndicesBufferView.byteOffset, GL_STATIC_DRAW);
+						gpuBytes += primIndicesBufferView.byteLength;
 					}
 				}
 
-				glBindVertexArray(0);
+				GLState::bindVertexArray(0);
 
 				gpu.push_back(primGPU);
 			}
@@ -637,6 +780,41 @@ void GLTFRenderer::init(s_ptr<GLTFData> gltf) {
 		}
 	}
 
+	// The file's buffers stay loaded on the CPU; its images are counted as textures
+	size_t cpuBytes = 0;
+	for (const auto& buffer : gltf->buffers) {
+		cpuBytes += buffer.size();
+	}
+	context->memoryHandle = ResourceRegistry::get().add(ResourceCategory::GLTF, gltf->filename, gpuBytes, cpuBytes);
+
+	// Copy every primitive into the geometry pool too, so the file can be drawn indirectly.
+	// Everything is read before allocating, so a file that can't be pooled takes no space.
+	if (IndirectRenderer::isSupported()) {
+		std::map<uint32_t, std::vector<std::pair<std::vector<PlainOldVertex>, std::vector<GLuint>>>> pooled;
+		bool poolable = true;
+
+		for (const auto& meshPrims : context->meshPrimitives) {
+			auto& prims = pooled[meshPrims.first];
+			for (const auto& prim : gltf->meshes[meshPrims.first]->primitives) {
+				prims.emplace_back();
+				if (!readPrimitive(*gltf, prim, prims.back().first, prims.back().second)) {
+					poolable = false;
+					break;
+				}
+			}
+			if (!poolable) break;
+		}
+
+		if (poolable) {
+			for (const auto& mesh : pooled) {
+				auto& slices = context->meshSlices[mesh.first];
+				for (const auto& prim : mesh.second) {
+					slices.push_back(GeometryPool::get().allocate(prim.first, prim.second));
+				}
+			}
+		}
+	}
+
 	gltf->context = context;
 }
 
@@ -645,28 +823,41 @@ void GLTFRenderer::render(const mat4& projection, const mat4& view, s_ptr<GLTFDa
 		init(gltf);
 	}
 
-	static mat4 lightmvp;
-
 	if (isShadow) {
-		lightmvp = Application::get().renderer->camera.viewproj;
 		return;
 
 		// No shadow rendering support yet...
 	}
 
-	gltf->context->shader->start();
+	auto ogl = std::dynamic_pointer_cast<OpenGLRenderer>(Application::get().renderer);
+	bool hasShadowMap = ogl && ogl->shadowMap;
+
+	ShaderPermutations* shaderVariants = useShaderVariants ? &getVariants() : nullptr;
+	uint32_t textureFeature = 0, shadowFeature = 0, lightingFeature = 0;
+	if (shaderVariants) {
+		textureFeature = shaderVariants->feature("USE_TEXTURE");
+		shadowFeature = hasShadowMap ? shaderVariants->feature("USE_SHADOW") : 0;
+		lightingFeature = shaderVariants->feature("USE_LIGHTING");
+	}
 
-	GLint nmLoc = glGetUniformLocation(gltf->context->shader->program, "normalMatrix");
 	mat4 normalMatrix = glm::transpose(glm::inverse(Application::get().renderer->camera.view));
-	glUniformMatrix3fv(nmLoc, 1, GL_FALSE, (const GLfloat*)glm::value_ptr(normalMatrix));
 
-	GPU::Lighting::get().bind(gltf->context->shader);
+	// Switched per primitive when using variants. A newly started program gets the per frame uniforms again.
+	s_ptr<Shader> program;
+	auto useProgram = [&](const s_ptr<Shader>& next) {
+		if (next == program) return;
+		program = next;
+		program->start();
 
+		GLint nmLoc = program->uniform("normalMatrix");
+		glUniformMatrix3fv(nmLoc, 1, GL_FALSE, (const GLfloat*)glm::value_ptr(normalMatrix));
+	};
 
-	if (!isShadow) {
-		GLint lightmvpLoc = glGetUniformLocation(gltf->context->shader->program, "lightmvp");
-		glUniformMatrix4fv(lightmvpLoc, 1, GL_FALSE, glm::value_ptr(lightmvp));
-	}
+	useProgram(gltf->context->shader);
+
+	GPU::Lighting::get().bind(gltf->context->shader);
+
+	Frustum frustum(projection * view);
 
 	for (auto& node : gltf->nodes) {
 		if (node->type == +GLTFNodeType::mesh) {
@@ -676,53 +867,63 @@ void GLTFRenderer::render(const mat4& projection, const mat4& view, s_ptr<GLTFDa
 
 			const auto& gpu = gltf->context->meshPrimitives[node->meshIndex];
 
-			node->matrix = glm::translate(node->translation) * glm::toMat4(node->rotation) * glm::scale(node->scale);
-
-			if (node->parent) {
-				node->matrix = node->parent->matrix * node->matrix;
-			}
+			if (!updateMeshNode(*gltf, *node, frustum, isShadow)) continue;
 
 			mat4 mvp = projection * view * node->matrix;
 
-			auto mvpLoc = glGetUniformLocation(gltf->context->shader->program, "mvp");
-			glUniformMatrix4fv(mvpLoc, 1, GL_FALSE, glm::value_ptr(mvp));
-			auto modelLoc = glGetUniformLocation(gltf->context->shader->program, "model");
-			glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(node->matrix));
-
 			for (uint32_t i = 0; i < mesh->primitives.size(); i++) {
 				auto& prim = mesh->primitives[i];
 				const auto& primGPU = gpu[i];
 
 				static GLTFMaterial defaultMaterial;
 				const GLTFMaterial* primMaterial = &defaultMaterial;
+
+				if (shaderVariants) {
+					const GLTFMaterial& material = prim.material >= 0 ? gltf->materials[prim.material] : defaultMaterial;
+					bool textured = false;
+					if (material.pbr.baseColorTexture.index >= 0) {
+						textured = gltf->textures[material.pbr.baseColorTexture.index].source >= 0;
+					}
+
+					uint32_t features = shadowFeature | (textured ? textureFeature : 0) | (material.useLighting ? lightingFeature : 0);
+					if (auto variant = shaderVariants->get(features)) {
+						useProgram(variant);
+					}
+				}
+
+				auto mvpLoc = program->uniform("mvp");
+				glUniformMatrix4fv(mvpLoc, 1, GL_FALSE, glm::value_ptr(mvp));
+				auto modelLoc = program->uniform("model");
+				glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(node->matrix));
+
 				if (prim.material >= 0) {
 					primMaterial = &gltf->materials[prim.material];
 
 					if (primMaterial->doubleSided) {
-						glDisable(GL_CULL_FACE);
+						GLState::disable(GL_CULL_FACE);
 					}
 					else {
-						glEnable(GL_CULL_FACE);
+						GLState::enable(GL_CULL_FACE);
 					}
 
-					GLint ulLoc = glGetUniformLocation(gltf->context->shader->program, "useLighting");
+					GLint ulLoc = program->uniform("useLighting");
 					glUniform1i(ulLoc, primMaterial->useLighting);
 
-					auto bcfLoc = glGetUniformLocation(gltf->context->shader->program, "baseColorFactor");
+					auto bcfLoc = program->uniform("baseColorFactor");
 					glUniform4fv(bcfLoc, 1, glm::value_ptr(primMaterial->pbr.baseColorFactor));
 
-					auto acLoc = glGetUniformLocation(gltf->context->shader->program, "alphaCutoff");
+					auto acLoc = program->uniform("alphaCutoff");
 					glUniform1f(acLoc, primMaterial->alphaCutoff);
 
-					GLint usLoc = glGetUniformLocation(gltf->context->shader->program, "useShadow");
+					GLint usLoc = program->uniform("useShadow");
 					glUniform1i(usLoc, 0);
 
 
-					glActiveTexture(GL_TEXTURE0);
-					GLint itLoc = glGetUniformLocation(gltf->context->shader->program, "inputTexture");
+					GLState::activeTexture(GL_TEXTURE0);
+					GLint itLoc = program->uniform("inputTexture");
 					glUniform1i(itLoc, 0);
 
-					GLint utLoc = glGetUniformLocation(gltf->context->shader->program, "useTexture");
+					GLint utLoc = program->uniform("useTexture");
 					if (primMaterial->pbr.baseColorTexture.index >= 0) {
 
 						const GLTFTexture& tex = gltf->textures[primMaterial->pbr.baseColorTexture.index];
@@ -730,55 +931,50 @@ void GLTFRenderer::render(const mat4& projection, const mat4& view, s_ptr<GLTFDa
 						if (tex.source >= 0) {
 							GLuint texture = gltf->context->imageTextures[tex.source]->id;
 							glUniform1i(utLoc, 1);
-							glBindTexture(GL_TEXTURE_2D, texture);
+							GLState::bindTexture(GL_TEXTURE_2D, texture);
 							// Set sampler
 							if (tex.sampler >= 0) {
 								const GLTFSampler& sampler = gltf->samplers[tex.sampler];
-								glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrapS._to_integral());
-								glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrapT._to_integral());
-								glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler.minFilter._to_integral());
-								glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.magFilter._to_integral());
-
-
+								GLState::SamplerState state;
+								state.wrapS = sampler.wrapS._to_integral();
+								state.wrapT = sampler.wrapT._to_integral();
+								state.minFilter = sampler.minFilter._to_integral();
+								state.magFilter = sampler.magFilter._to_integral();
+								GLState::bindSampler(0, GLState::getSampler(state));
+							}
+							else {
+								GLState::bindSampler(0, 0);
 							}
 						}
 						else {
 							glUniform1i(utLoc, 0);
-							glBindTexture(GL_TEXTURE_2D, 0);
+							GLState::bindTexture(GL_TEXTURE_2D, 0);
 						}
 
 					}
 					else {
 						glUniform1i(utLoc, 0);
-						glBindTexture(GL_TEXTURE_2D, 0);
+						GLState::bindTexture(GL_TEXTURE_2D, 0);
 					}
 				}
 
 				// Render with shadows
-				GLint smLoc = glGetUniformLocation(gltf->context->shader->program, "useShadow");
-				glActiveTexture(GL_TEXTURE1);
-				auto ogl = std::dynamic_pointer_cast<OpenGLRenderer>(Application::get().renderer);
-				if (ogl && ogl->shadowMap) {
+				GLint smLoc = program->uniform("useShadow");
+				GLState::activeTexture(GL_TEXTURE1);
+				if (hasShadowMap) {
 					glUniform1i(smLoc, 1);
-					GLint stLoc = glGetUniformLocation(gltf->context->shader->program, "shadowTexture");
+					GLint stLoc = program->uniform("shadowTexture");
 					glUniform1i(stLoc, 1);
-					glBindTexture(GL_TEXTURE_2D, ogl->shadowMap->textures.front()->id);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-					float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-					glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-					GLint sbLoc = glGetUniformLocation(gltf->context->shader->program, "shadowBias");
+					GLState::bindTexture(GL_TEXTURE_2D, ogl->shadowMap->textures.front()->id);
+					GLState::bindSampler(1, AnimationObjectRenderer::getShadowSampler());
+
+					GLint sbLoc = program->uniform("shadowBias");
 					auto shadowBias = AnimationObjectRenderer::get().shadowBias;
 					glUniform2fv(sbLoc, 1, glm::value_ptr(shadowBias));
 
 					auto& l = GPU::Lighting::get();
-					GLint lpLoc = glGetUniformLocation(gltf->context->shader->program, "lightPosition");
-					GLint ldLoc = glGetUniformLocation(gltf->context->shader->program, "lightDirection");
+					GLint lpLoc = program->uniform("lightPosition");
+					GLint ldLoc = program->uniform("lightDirection");
 
 					glUniform3fv(lpLoc, 1, glm::value_ptr(l.position));
 					auto lightDir = glm::normalize(l.center - l.position);
@@ -786,15 +982,15 @@ void GLTFRenderer::render(const mat4& projection, const mat4& view, s_ptr<GLTFDa
 				}
 				else {
 					glUniform1i(smLoc, 0);
-					glBindTexture(GL_TEXTURE_2D, 0);
+					GLState::bindTexture(GL_TEXTURE_2D, 0);
 				}
 
-				//glActiveTexture(GL_TEXTURE1);
-				//glBindTexture(GL_TEXTURE_2D, 0);
-				//GLint stLoc = glGetUniformLocation(gltf->context->shader->program, "shadowTexture");
+				//GLState::activeTexture(GL_TEXTURE1);
+				//GLState::bindTexture(GL_TEXTURE_2D, 0);
+				//GLint stLoc = program->uniform("shadowTexture");
 				//glUniform1i(stLoc, 1);
 
-				glBindVertexArray(primGPU.VAO);
+				GLState::bindVertexArray(primGPU.VAO);
 
 				// If we have an index buffer, draw this primitive with glDrawElements
 				if (prim.indices >= 0) {
@@ -815,17 +1011,83 @@ void GLTFRenderer::render(const mat4& projection, const mat4& view, s_ptr<GLTFDa
 					}
 				}
 
-				glBindVertexArray(0);
+				GLState::bindVertexArray(0);
 			}
 		}
 	}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::activeTexture(GL_TEXTURE0);
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+	GLState::activeTexture(GL_TEXTURE1);
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+	GLState::unbindSamplers();
 
-	gltf->context->shader->stop();
+	program->stop();
+}
+
+bool GLTFRenderer::renderIndirect(const mat4& projection, const mat4& view, s_ptr<GLTFData> gltf, bool isShadow) {
+	if (gltf->context == nullptr) {
+		init(gltf);
+	}
+
+	// Nothing to queue, render doesn't draw shadows either
+	if (isShadow) return true;
+
+	if (!gltf->context || gltf->context->meshSlices.empty()) return false;
+
+	auto& indirect = IndirectRenderer::get();
+	Frustum frustum(projection * view);
+
+	static GLTFMaterial defaultMaterial;
+
+	for (auto& node : gltf->nodes) {
+		if (node->type != +GLTFNodeType::mesh) continue;
+
+		auto slices = gltf->context->meshSlices.find(node->meshIndex);
+		if (slices == gltf->context->meshSlices.end()) continue;
+
+		if (!updateMeshNode(*gltf, *node, frustum, isShadow)) continue;
+
+		auto& mesh = gltf->meshes[node->meshIndex];
+		for (uint32_t i = 0; i < mesh->primitives.size(); i++) {
+			const auto& prim = mesh->primitives[i];
+			const auto& slice = slices->second[i];
+
+			const GLTFMaterial* primMaterial = prim.material >= 0 ? &gltf->materials[prim.material] : &defaultMaterial;
+
+			int flags = InstanceNoColorKey;
+			if (!primMaterial->useLighting) flags |= InstanceUnlit;
+
+			GPU::DrawData data;
+			data.model = node->matrix;
+			data.color = primMaterial->pbr.baseColorFactor;
+			// Mesh id 0, as gltfmesh.vert gets without a meshID uniform
+			data.data = ivec4(0, flags, slice.baseVertex, 0);
+			data.params = vec4(1.f, 0.f, 0.f, 0.f);
+
+			IndirectTexture texture;
+			if (primMaterial->pbr.baseColorTexture.index >= 0) {
+				const GLTFTexture& tex = gltf->textures[primMaterial->pbr.baseColorTexture.index];
+				auto image = gltf->context->imageTextures.find(tex.source);
+				if (image != gltf->context->imageTextures.end() && image->second) {
+					texture.id = image->second->id;
+					if (tex.sampler >= 0) {
+						const GLTFSampler& sampler = gltf->samplers[tex.sampler];
+						texture.setParameters = true;
+						texture.magFilter = sampler.magFilter._to_integral();
+						texture.minFilter = sampler.minFilter._to_integral();
+						texture.wrapS = sampler.wrapS._to_integral();
+						texture.wrapT = sampler.wrapT._to_integral();
+					}
+				}
+			}
+
+			indirect.add(slice, data, texture, primMaterial->doubleSided ? IndirectCull::None : IndirectCull::Default,
+				false, IndirectShading::GLTF);
+		}
+	}
+
+	return true;
 }
 
 void GLTFSampler::renderUI() {
@@ -967,8 +1229,33 @@ void renderUIGLTFNode(s_ptr<GLTFNode> node, s_ptr<GLTFData> gltf) {
 	ImGui::PopID();
 }
 
+void GLTFRenderer::bindJointPalette(const std::vector<mat4>& jointMatrices) {
+	const GLsizeiptr paletteSize = sizeof(mat4) * GPU_MAX_JOINTS;
+
+	if (!jointStream) {
+		// A few dozen skinned draws a frame before the regions grow
+		jointStream = u_ptr<StreamBuffer>(new StreamBuffer("Joint palettes", GL_UNIFORM_BUFFER, paletteSize * 32));
+	}
+
+	// Always the whole block so the bound range covers everything the shader declares
+	auto range = jointStream->allocate(paletteSize);
+	if (!range.data) return;
+
+	size_t count = std::min<size_t>(jointMatrices.size(), GPU_MAX_JOINTS);
+	memcpy(range.data, jointMatrices.data(), sizeof(mat4) * count);
+
+	jointStream->commit(range);
+	jointStream->bindRange(GPU_JOINT_BINDING_SPOT, range);
+}
+
 void GLTFRenderer::renderUI(s_ptr<GLTFData> gltf) {
 	IMDENT;
+	auto& renderer = get();
+	ImGui::Checkbox("Shader variants", &renderer.useShaderVariants);
+	if (renderer.variants) {
+		ImGui::SameLine();
+		ImGui::Text("(%d built)", (int)renderer.variants->size());
+	}
 	if (ImGui::CollapsingHeader("Nodes")) {
 		for (s_ptr<GLTFNode> node : gltf->nodes) {
 			IMDENT;
@@ -0,0 +1,205 @@
+#include "GPUProfiler.h"
+
+#include "imgui.h"
+#include "implot.h"
+
+GPUProfiler& GPUProfiler::get()
+{
+	static GPUProfiler instance;
+	return instance;
+}
+
+bool GPUProfiler::isSupported()
+{
+	return GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+}
+
+GLuint GPUProfiler::nextQuery(QuerySet& set)
+{
+	if (set.used == set.queries.size()) {
+		GLuint query = 0;
+		glGenQueries(1, &query);
+		set.queries.push_back(query);
+	}
+
+	return set.queries[set.used++];
+}
+
+void GPUProfiler::beginFrame()
+{
+	current = (current + 1) % FrameLatency;
+
+	auto& set = sets[current];
+	if (set.pending) {
+		resolve(set);
+	}
+
+	set.markers.clear();
+	set.used = 0;
+	set.pending = false;
+	set.frame = frame++;
+	stack.clear();
+
+	frameActive = enabled && isSupported();
+	if (frameActive) {
+		push("Frame");
+	}
+}
+
+void GPUProfiler::endFrame()
+{
+	if (!frameActive) return;
+
+	while (!stack.empty()) {
+		pop();
+	}
+
+	sets[current].pending = true;
+	frameActive = false;
+}
+
+void GPUProfiler::push(const std::string& name)
+{
+	if (!frameActive) return;
+
+	auto& set = sets[current];
+
+	Marker marker;
+	marker.name = name;
+	marker.depth = (int)stack.size();
+	marker.path = stack.empty() ? name : set.markers[stack.back()].path + "/" + name;
+	marker.cpuBegin = getWallTime();
+	marker.begin = nextQuery(set);
+	glQueryCounter(marker.begin, GL_TIMESTAMP);
+
+	stack.push_back(set.markers.size());
+	set.markers.push_back(marker);
+}
+
+void GPUProfiler::pop()
+{
+	if (!frameActive || stack.empty()) return;
+
+	auto& set = sets[current];
+	auto& marker = set.markers[stack.back()];
+	stack.pop_back();
+
+	marker.end = nextQuery(set);
+	glQueryCounter(marker.end, GL_TIMESTAMP);
+	marker.cpuEnd = getWallTime();
+}
+
+GPUProfiler::Timing& GPUProfiler::getTiming(const Marker& marker)
+{
+	for (auto& timing : timings) {
+		if (timing.path == marker.path) return timing;
+	}
+
+	Timing timing;
+	timing.path = marker.path;
+	timing.name = marker.name;
+	timing.depth = marker.depth;
+	timings.push_back(timing);
+	return timings.back();
+}
+
+void GPUProfiler::resolve(QuerySet& set)
+{
+	if (set.markers.empty() || set.used == 0) return;
+
+	// The last query issued finishes last, so the rest are ready once it is
+	GLint available = 0;
+	glGetQueryObjectiv(set.queries[set.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) {
+		droppedFrames++;
+		return;
+	}
+
+	for (auto& timing : timings) {
+		timing.frameGPU = timing.frameCPU = 0.f;
+		timing.seen = false;
+	}
+
+	for (const auto& marker : set.markers) {
+		if (marker.end == 0) continue;
+
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(marker.begin, GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(marker.end, GL_QUERY_RESULT, &end);
+
+		auto& timing = getTiming(marker);
+		timing.frameGPU += (float)((end - begin) / 1.0e6);
+		timing.frameCPU += (float)((marker.cpuEnd - marker.cpuBegin) * 1000.0);
+		timing.seen = true;
+	}
+
+	if (keepResolved) {
+		std::vector<StageTime> stages;
+		for (const auto& timing : timings) {
+			if (timing.seen) stages.push_back({ timing.path, timing.frameGPU, timing.frameCPU });
+		}
+		resolved.push_back({ set.frame, stages });
+	}
+
+	for (auto& timing : timings) {
+		if (!timing.seen) continue;
+
+		if (timing.gpu.size() == HistoryLength) {
+			timing.gpu.erase(timing.gpu.begin());
+			timing.cpu.erase(timing.cpu.begin());
+		}
+		timing.gpu.push_back(timing.frameGPU);
+		timing.cpu.push_back(timing.frameCPU);
+	}
+}
+
+std::vector<std::pair<uint64_t, std::vector<GPUProfiler::StageTime>>> GPUProfiler::takeResolved()
+{
+	std::vector<std::pair<uint64_t, std::vector<StageTime>>> frames;
+	frames.swap(resolved);
+	return frames;
+}
+
+void GPUProfiler::flush()
+{
+	glFinish();
+
+	// Oldest first, so frames come out in order
+	for (int i = 1; i <= FrameLatency; i++) {
+		auto& set = sets[(current + i) % FrameLatency];
+		if (!set.pending) continue;
+		resolve(set);
+		set.pending = false;
+	}
+}
+
+void GPUProfiler::renderUI()
+{
+	if (ImGui::CollapsingHeader("GPU profiler")) {
+		if (!isSupported()) {
+			ImGui::Text("Timer queries need OpenGL 3.3");
+			return;
+		}
+
+		ImGui::Checkbox("Profile GPU", &enabled);
+		ImGui::Text("Read back %d frames late, %d frames dropped", FrameLatency, (int)droppedFrames);
+
+		for (const auto& timing : timings) {
+			if (timing.gpu.empty()) continue;
+			ImGui::Text("%*s%s: GPU %.3f ms, CPU %.3f ms", timing.depth * 2, "", timing.name.c_str(),
+				timing.gpu.back(), timing.cpu.back());
+		}
+
+		if (ImPlot::BeginPlot("GPU time (ms)", ImVec2(-1, 200))) {
+			ImPlot::SetupAxes("Frame", "ms", ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
+
+			// The frame and the stages directly under it; deeper stages would bury the plot
+			for (const auto& timing : timings) {
+				if (timing.depth > 1 || timing.gpu.empty()) continue;
+				ImPlot::PlotLine(timing.path.c_str(), timing.gpu.data(), (int)timing.gpu.size());
+			}
+
+			ImPlot::EndPlot();
+		}
+	}
+}
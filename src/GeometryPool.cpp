@@ -0,0 +1,120 @@
+#include "GeometryPool.h"
+
+#include "GLStateCache.h"
+
+#include "imgui.h"
+
+GeometryPool& GeometryPool::get()
+{
+	static GeometryPool instance;
+	return instance;
+}
+
+GeometrySlice GeometryPool::allocate(const PlainOldVertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount)
+{
+	GeometrySlice slice;
+	if (vertexCount == 0 || indexCount == 0) return slice;
+
+	int pageIndex = -1;
+	for (size_t i = 0; i < pages.size(); i++) {
+		const auto& page = pages[i];
+		if (page.vertexCount + vertexCount <= page.vertexCapacity && page.indexCount + indexCount <= page.indexCapacity) {
+			pageIndex = (int)i;
+			break;
+		}
+	}
+
+	if (pageIndex == -1) {
+		pageIndex = createPage(std::max(pageVertices, (GLuint)vertexCount), std::max(pageIndices, (GLuint)indexCount));
+	}
+
+	auto& page = pages[pageIndex];
+
+	slice.page = pageIndex;
+	slice.baseVertex = (GLint)page.vertexCount;
+	slice.vertexCount = (GLuint)vertexCount;
+	slice.firstIndex = page.indexCount;
+	slice.indexCount = (GLuint)indexCount;
+
+	// The copy target keeps this from touching whatever vertex array is bound
+	glBindBuffer(GL_COPY_WRITE_BUFFER, page.vertices->buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(PlainOldVertex) * page.vertexCount, sizeof(PlainOldVertex) * vertexCount, vertices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, page.indices->buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * page.indexCount, sizeof(GLuint) * indexCount, indices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	page.vertexCount += (GLuint)vertexCount;
+	page.indexCount += (GLuint)indexCount;
+
+	return slice;
+}
+
+int GeometryPool::createPage(GLuint vertexCapacity, GLuint indexCapacity)
+{
+	Page page;
+	page.vertexCapacity = vertexCapacity;
+	page.indexCapacity = indexCapacity;
+
+	GLState::bindVertexArray(0);
+
+	page.vertices = spBuffer(new Buffer(GL_ARRAY_BUFFER, sizeof(PlainOldVertex) * vertexCapacity, nullptr, GL_STATIC_DRAW));
+	page.indices = spBuffer(new Buffer(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * indexCapacity, nullptr, GL_STATIC_DRAW));
+
+	glGenVertexArrays(1, &page.vao);
+	GLState::bindVertexArray(page.vao);
+
+	page.vertices->bind();
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PlainOldVertex), (const GLvoid*)offsetof(PlainOldVertex, position));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(PlainOldVertex), (const GLvoid*)offsetof(PlainOldVertex, normal));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(PlainOldVertex), (const GLvoid*)offsetof(PlainOldVertex, uv));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(PlainOldVertex), (const GLvoid*)offsetof(PlainOldVertex, color));
+	glEnableVertexAttribArray(3);
+
+	page.indices->bind(GL_ELEMENT_ARRAY_BUFFER);
+
+	GLState::bindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (drawIDBuffer != 0) {
+		bindDrawIDs(page);
+	}
+
+	log("GeometryPool: new page {0} ({1} vertices, {2} indices)\n", pages.size(), vertexCapacity, indexCapacity);
+
+	pages.push_back(page);
+	return (int)pages.size() - 1;
+}
+
+void GeometryPool::setDrawIDBuffer(GLuint buffer)
+{
+	drawIDBuffer = buffer;
+	for (const auto& page : pages) {
+		bindDrawIDs(page);
+	}
+}
+
+void GeometryPool::bindDrawIDs(const Page& page)
+{
+	GLState::bindVertexArray(page.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, drawIDBuffer);
+	glVertexAttribIPointer(4, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+	glEnableVertexAttribArray(4);
+	// Instanced attributes start at the command's baseInstance, which is the draw's index
+	glVertexAttribDivisor(4, 1);
+	GLState::bindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GeometryPool::renderUI()
+{
+	ImGui::Text("Geometry pool: %d pages", (int)pages.size());
+	for (size_t i = 0; i < pages.size(); i++) {
+		const auto& page = pages[i];
+		ImGui::Text("  %d: %d / %d vertices, %d / %d indices", (int)i,
+			(int)page.vertexCount, (int)page.vertexCapacity, (int)page.indexCount, (int)page.indexCapacity);
+	}
+}
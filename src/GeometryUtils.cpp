@@ -0,0 +1,49 @@
+#include "GeometryUtils.h"
+
+namespace {
+	// Ramer-Douglas-Peucker with an explicit stack so long recordings don't copy the point
+	// list at every level of recursion
+	template<typename V>
+	std::vector<V> reduce(const std::vector<V>& points, float epsilon) {
+		if (points.size() < 3) return points;
+
+		std::vector<bool> keep(points.size(), false);
+		keep.front() = keep.back() = true;
+
+		std::vector<std::pair<size_t, size_t>> ranges = { { 0, points.size() - 1 } };
+		while (!ranges.empty()) {
+			auto range = ranges.back();
+			ranges.pop_back();
+
+			float dmax = 0.f;
+			size_t imax = range.first;
+			for (size_t i = range.first + 1; i < range.second; i++) {
+				float d = lineSegmentDistance(points[range.first], points[range.second], points[i]);
+				if (d > dmax) {
+					dmax = d;
+					imax = i;
+				}
+			}
+
+			if (dmax > epsilon) {
+				keep[imax] = true;
+				ranges.push_back({ range.first, imax });
+				ranges.push_back({ imax, range.second });
+			}
+		}
+
+		std::vector<V> reduced;
+		for (size_t i = 0; i < points.size(); i++) {
+			if (keep[i]) reduced.push_back(points[i]);
+		}
+		return reduced;
+	}
+}
+
+std::vector<vec2> reduce_RDP(std::vector<vec2> points, float epsilon, int depth) {
+	return reduce(points, epsilon);
+}
+
+std::vector<vec3> reduce_RDP(std::vector<vec3> points, float epsilon, int depth) {
+	return reduce(points, epsilon);
+}
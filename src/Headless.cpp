@@ -0,0 +1,295 @@
+#include "Headless.h"
+
+#include "Application.h"
+#include "Framebuffer.h"
+#include "GPUProfiler.h"
+#include "InputOutput.h"
+#include "Renderer.h"
+#include "ResourceRegistry.h"
+#include "ShaderCache.h"
+
+#include <GL/glew.h>
+#include "GLFW/glfw3.h"
+
+#include <stb/stb_image_write.h>
+
+namespace {
+	// Milliseconds summary of one series
+	json summarize(std::vector<double> values) {
+		json j = json::object();
+		if (values.empty()) return j;
+
+		std::sort(values.begin(), values.end());
+		double sum = 0.0;
+		for (double v : values) sum += v;
+
+		j["mean"] = sum / values.size();
+		j["median"] = values[values.size() / 2];
+		j["p95"] = values[std::min(values.size() - 1, (size_t)(values.size() * 0.95))];
+		j["min"] = values.front();
+		j["max"] = values.back();
+		return j;
+	}
+
+	// 0 for uncovered pixels, otherwise index + 1 across the RGB bytes, little end in red
+	void encodeIndex(uint8_t* out, const vec4& prim, int channel) {
+		uint32_t value = prim.w < 1.f ? 0u : (uint32_t)((int)prim[channel] + 1);
+		out[0] = value & 0xFF;
+		out[1] = (value >> 8) & 0xFF;
+		out[2] = (value >> 16) & 0xFF;
+		out[3] = 0xFF;
+	}
+}
+
+Headless& Headless::get()
+{
+	static Headless instance;
+	return instance;
+}
+
+bool Headless::parseArgs(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--headless") {
+			enabled = true;
+		}
+		else if (arg == "--frames" && hasValue) {
+			frames = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--dt" && hasValue) {
+			dt = atof(argv[++i]);
+		}
+		else if (arg == "--size" && hasValue) {
+			if (sscanf(argv[++i], "%dx%d", &size.x, &size.y) != 2 || size.x <= 0 || size.y <= 0) {
+				log("Headless: --size expects WxH, got {0}\n", argv[i]);
+				return false;
+			}
+		}
+		else if (arg == "--out" && hasValue) {
+			outputDir = argv[++i];
+		}
+		else if (arg == "--dump-every" && hasValue) {
+			dumpEvery = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--software" || arg == "--no-shader-cache") {
+			// Picked up by main, headless runs work with either renderer and a cold or warm cache
+		}
+		else if (arg == "--memory-budget" && hasValue) {
+			// Picked up by main
+			i++;
+		}
+		else if (arg.rfind("--", 0) == 0) {
+			log("Headless: ignoring unknown or incomplete option {0}\n", arg);
+		}
+	}
+
+	if (dt <= 0.0) {
+		log("Headless: --dt must be positive\n");
+		return false;
+	}
+
+	return true;
+}
+
+void Headless::init()
+{
+	auto& application = Application::get();
+	application.renderer->showImGui = false;
+
+	// Nothing is presented, so don't wait on the display
+	glfwSwapInterval(0);
+
+	IO::createPath(outputDir);
+
+	GPUProfiler::get().keepResolved = true;
+	timings.reserve(frames);
+
+	log("Headless: {0} frames at {1} s, {2}x{3}, writing to {4}\n", frames, dt, size.x, size.y, outputDir);
+}
+
+void Headless::beginFrame()
+{
+	frameStart = _clock::now();
+	clock = (frame + 1) * dt;
+}
+
+void Headless::endFrame()
+{
+	auto& application = Application::get();
+
+	FrameTiming timing;
+	timing.update = application.updateTime * 1000.0;
+	timing.render = application.renderTime * 1000.0;
+	timings.push_back(timing);
+
+	collectGPUTimes();
+
+	bool last = frame + 1 == frames;
+	if (last || (dumpEvery > 0 && frame % dumpEvery == 0)) {
+		dumpImages();
+	}
+
+	_elapsed elapsed = _clock::now() - frameStart;
+	timings.back().total = elapsed.count() * 1000.0;
+
+	frame++;
+}
+
+void Headless::collectGPUTimes()
+{
+	for (auto& resolved : GPUProfiler::get().takeResolved()) {
+		if (resolved.first >= timings.size()) continue;
+
+		auto& timing = timings[resolved.first];
+		for (const auto& stage : resolved.second) {
+			timing.gpu.push_back({ stage.path, stage.gpu });
+			timing.cpu.push_back({ stage.path, stage.cpu });
+		}
+	}
+}
+
+void Headless::dumpImages()
+{
+	s_ptr<Framebuffer> framebuffer;
+	if (auto ogl = Application::get().getRenderer<OpenGLRenderer>()) framebuffer = ogl->gbuffer;
+	else if (auto sr = Application::get().getRenderer<SoftwareRenderer>()) framebuffer = sr->gbuffer;
+	if (!framebuffer) return;
+
+	const auto& gbuffer = *framebuffer;
+	int width = gbuffer.width;
+	int height = gbuffer.height;
+	size_t count = (size_t)width * height;
+
+	std::vector<vec4> pixels(count);
+	std::vector<uint8_t> bytes(count * 4);
+
+	std::string prefix = IO::joinPath(outputDir, fmt::format("frame_{0:05d}", frame));
+
+	// GL rows start at the bottom
+	stbi_flip_vertically_on_write(1);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, gbuffer.framebuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, pixels.data());
+	for (size_t i = 0; i < count; i++) {
+		vec4 c = glm::clamp(pixels[i], vec4(0.f), vec4(1.f));
+		bytes[i * 4 + 0] = (uint8_t)(c.r * 255.f + 0.5f);
+		bytes[i * 4 + 1] = (uint8_t)(c.g * 255.f + 0.5f);
+		bytes[i * 4 + 2] = (uint8_t)(c.b * 255.f + 0.5f);
+		bytes[i * 4 + 3] = 0xFF;
+	}
+	stbi_write_png((prefix + "_color.png").c_str(), width, height, 4, bytes.data(), width * 4);
+	dumped.push_back(prefix + "_color.png");
+
+	if (gbuffer.numTextures > 1) {
+		glReadBuffer(GL_COLOR_ATTACHMENT1);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, pixels.data());
+
+		// Channel 0 is the object index, channel 2 the primitive index
+		for (size_t i = 0; i < count; i++) encodeIndex(&bytes[i * 4], pixels[i], 0);
+		stbi_write_png((prefix + "_object.png").c_str(), width, height, 4, bytes.data(), width * 4);
+		dumped.push_back(prefix + "_object.png");
+
+		for (size_t i = 0; i < count; i++) encodeIndex(&bytes[i * 4], pixels[i], 2);
+		stbi_write_png((prefix + "_primitive.png").c_str(), width, height, 4, bytes.data(), width * 4);
+		dumped.push_back(prefix + "_primitive.png");
+	}
+
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	stbi_flip_vertically_on_write(0);
+}
+
+void Headless::finish()
+{
+	GPUProfiler::get().flush();
+	collectGPUTimes();
+
+	json report;
+	report["frames"] = frames;
+	report["dt"] = dt;
+	report["resolution"] = { size.x, size.y };
+	report["renderer"] = (const char*)glGetString(GL_RENDERER);
+	report["version"] = (const char*)glGetString(GL_VERSION);
+	report["images"] = dumped;
+
+	// Startup cost, compare a run with --no-shader-cache against one with a warm cache
+	const auto& cache = ShaderCache::get();
+	report["timeToFirstFrame"] = Application::get().timeToFirstFrame * 1000.0;
+	report["shaderCache"] = {
+		{ "enabled", cache.enabled },
+		{ "parallelCompile", cache.parallelCompile() },
+		{ "hits", cache.stats.hits },
+		{ "misses", cache.stats.misses },
+		{ "rejected", cache.stats.rejected },
+		{ "loadTime", cache.stats.loadTime * 1000.0 },
+		{ "compileTime", cache.stats.compileTime * 1000.0 }
+	};
+
+	// Estimated MB per resource category, now and at the high-water mark
+	const auto& registry = ResourceRegistry::get();
+	json memory;
+	for (auto category : ResourceCategory::_values()) {
+		const auto& t = registry.totals(category);
+		memory[category._to_string()] = {
+			{ "count", t.count },
+			{ "gpu", t.gpu / (1024.0 * 1024.0) },
+			{ "gpuPeak", t.peakGPU / (1024.0 * 1024.0) },
+			{ "cpu", t.cpu / (1024.0 * 1024.0) },
+			{ "cpuPeak", t.peakCPU / (1024.0 * 1024.0) }
+		};
+	}
+	memory["gpuPeak"] = registry.total().peakGPU / (1024.0 * 1024.0);
+	memory["cpuPeak"] = registry.total().peakCPU / (1024.0 * 1024.0);
+	report["memory"] = memory;
+
+	std::vector<double> update, render, total;
+	std::map<std::string, std::vector<double>> gpu, cpu;
+
+	json perFrame = json::array();
+	for (size_t i = 0; i < timings.size(); i++) {
+		const auto& timing = timings[i];
+		update.push_back(timing.update);
+		render.push_back(timing.render);
+		total.push_back(timing.total);
+
+		json f;
+		f["frame"] = i;
+		f["update"] = timing.update;
+		f["render"] = timing.render;
+		f["total"] = timing.total;
+
+		json stages = json::object();
+		for (size_t s = 0; s < timing.gpu.size(); s++) {
+			const auto& path = timing.gpu[s].first;
+			stages[path] = { { "gpu", timing.gpu[s].second }, { "cpu", timing.cpu[s].second } };
+			gpu[path].push_back(timing.gpu[s].second);
+			cpu[path].push_back(timing.cpu[s].second);
+		}
+		f["stages"] = stages;
+
+		perFrame.push_back(f);
+	}
+
+	json summary;
+	summary["update"] = summarize(update);
+	summary["render"] = summarize(render);
+	summary["total"] = summarize(total);
+	for (const auto& stage : gpu) {
+		summary["stages"][stage.first] = { { "gpu", summarize(stage.second) }, { "cpu", summarize(cpu[stage.first]) } };
+	}
+
+	// Times are in milliseconds
+	report["summary"] = summary;
+	report["perFrame"] = perFrame;
+
+	std::string filename = IO::joinPath(outputDir, "timings.json");
+	IO::writeText(filename, report.dump(2));
+
+	log("Headless: wrote {0} ({1} frames, {2} images)\n", filename, timings.size(), dumped.size());
+}
@@ -0,0 +1,332 @@
+#include "IndirectRenderer.h"
+
+#include "AnimationObjectRenderer.h"
+#include "Application.h"
+#include "GLStateCache.h"
+#include "Shader.h"
+#include "Texture.h"
+
+#include "imgui.h"
+
+static_assert(sizeof(GPU::DrawData) == 112, "DrawData must match its std430 layout");
+
+IndirectRenderer& IndirectRenderer::get()
+{
+	static IndirectRenderer instance;
+	return instance;
+}
+
+bool IndirectRenderer::isSupported()
+{
+	return GLEW_VERSION_4_3;
+}
+
+bool IndirectRenderer::isAvailable()
+{
+	if (!enabled || !isSupported()) return false;
+
+	if (!initialized) {
+		initialized = true;
+		if (!init()) {
+			log("Multi-draw indirect shaders failed to build, falling back to regular draws\n");
+			enabled = false;
+			return false;
+		}
+	}
+
+	return shader && gltfShader && shadowShader;
+}
+
+bool IndirectRenderer::init()
+{
+	std::vector<ShaderFragOutputBindings> fragBindings = {
+		{0, "frag_color"},
+		{1, "frag_prim"}
+	};
+
+	auto vertText = Shader::LoadText("objects/staticmesh_indirect.vert");
+
+	shader = s_ptr<Shader>(new Shader(vertText, Shader::LoadText("objects/staticmesh.frag")));
+	if (!shader->init(false, fragBindings)) {
+		shader = nullptr;
+		return false;
+	}
+
+	// Defined right after the version line, which has to come first
+	auto gltfText = StringUtil::replaceAll(Shader::LoadText("objects/gltfmesh.frag"), Shader::VersionMacro, Shader::VersionMacro + "\n#define INDIRECT");
+	gltfShader = s_ptr<Shader>(new Shader(vertText, gltfText));
+	if (!gltfShader->init(false, fragBindings)) {
+		shader = nullptr;
+		gltfShader = nullptr;
+		return false;
+	}
+
+	shadowShader = s_ptr<Shader>(new Shader(Shader::LoadText("objects/staticshadow_indirect.vert"), Shader::LoadText("objects/staticshadow.frag")));
+	if (!shadowShader->init()) {
+		shader = nullptr;
+		gltfShader = nullptr;
+		shadowShader = nullptr;
+		return false;
+	}
+
+	// Room for the shadow and main pass of a few thousand draws before either grows
+	if (!drawStream) {
+		drawStream = u_ptr<StreamBuffer>(new StreamBuffer("Indirect draw data", GL_SHADER_STORAGE_BUFFER, sizeof(GPU::DrawData) * 4096));
+		commandStream = u_ptr<StreamBuffer>(new StreamBuffer("Indirect commands", GL_DRAW_INDIRECT_BUFFER,
+			sizeof(DrawElementsIndirectCommand) * 4096, sizeof(DrawElementsIndirectCommand)));
+	}
+
+	reserveDrawIDs(1024);
+
+	return true;
+}
+
+void IndirectRenderer::reserveDrawIDs(size_t count)
+{
+	if (count <= drawIDCapacity) return;
+
+	GLuint capacity = std::max<GLuint>(drawIDCapacity, 1024);
+	while (capacity < count) capacity *= 2;
+
+	std::vector<GLuint> ids(capacity);
+	for (GLuint i = 0; i < capacity; i++) ids[i] = i;
+
+	drawIDs = spBuffer(new Buffer(GL_ARRAY_BUFFER, sizeof(GLuint) * capacity, ids.data(), GL_STATIC_DRAW));
+	drawIDs->bufferData = nullptr;
+	drawIDCapacity = capacity;
+
+	GeometryPool::get().setDrawIDBuffer(drawIDs->buffer);
+}
+
+void IndirectRenderer::begin(bool _isShadow)
+{
+	isShadow = _isShadow;
+	draws.clear();
+}
+
+void IndirectRenderer::add(const AnimationObject& shape)
+{
+	auto& jr = AnimationObjectRenderer::get();
+	auto& renderData = jr.getRenderData(shape);
+
+	if (!renderData.slice.valid()) {
+		if (!renderData.vertexVBO || !renderData.indexVBO) return;
+		renderData.slice = GeometryPool::get().allocate(renderData.vertexVBO->data, renderData.indexVBO->data);
+		if (!renderData.slice.valid()) return;
+	}
+
+	GPU::DrawData data;
+	data.model = shape.transform;
+	data.color = shape.color;
+	data.data = ivec4(shape.index, AnimationObjectRenderer::getInstanceFlags(shape), renderData.slice.baseVertex, 0);
+	data.params = vec4(shape.size, 0.f, 0.f, 0.f);
+
+	IndirectTexture texture;
+	IndirectCull cull = IndirectCull::Default;
+
+	if (isShadow) {
+		// Same faces the shadow pass culls per shape type
+		if (!shape.cullFace) cull = IndirectCull::None;
+		else if (shape.shapeType == +AnimationObjectType::quad || shape.shapeType == +AnimationObjectType::tri) cull = IndirectCull::Back;
+		else cull = IndirectCull::Front;
+	}
+	else {
+		if (!shape.cullFace) cull = IndirectCull::None;
+
+		if (auto texptr = jr.getObjectTexture(shape, renderData)) {
+			texture.id = texptr->id;
+			texture.setParameters = true;
+			texture.magFilter = texptr->magFilter._to_integral();
+			texture.minFilter = texptr->minFilter._to_integral();
+			texture.wrapS = texptr->wrapS._to_integral();
+			texture.wrapT = texptr->wrapT._to_integral();
+		}
+	}
+
+	add(renderData.slice, data, texture, cull, shape.useFragmentTransform);
+}
+
+void IndirectRenderer::add(const GeometrySlice& slice, const GPU::DrawData& data, const IndirectTexture& texture, IndirectCull cull,
+	bool fragmentTransform, IndirectShading shading)
+{
+	if (!slice.valid()) return;
+
+	Draw draw;
+	draw.slice = slice;
+	draw.data = data;
+	draw.cull = cull;
+
+	// Textures, shading and the fragment transform don't matter for depth only draws
+	if (!isShadow) {
+		draw.texture = texture;
+		draw.fragmentTransform = fragmentTransform;
+		draw.shading = shading;
+	}
+
+	// Program first, then page so vertex arrays change least, then texture, then the cheaper state
+	draw.key = ((uint64_t)draw.shading._to_integral() << 63) | ((uint64_t)slice.page << 48) | ((uint64_t)draw.texture.id << 8)
+		| ((uint64_t)cull._to_integral() << 1) | (uint64_t)draw.fragmentTransform;
+
+	draws.push_back(draw);
+}
+
+void IndirectRenderer::startProgram(const s_ptr<Shader>& program)
+{
+	program->start();
+
+	GLint itLoc = program->uniform("iTime");
+	glUniform1f(itLoc, (float)Application::get().timeSinceStart);
+
+	if (!isShadow) {
+		GPU::Lighting::get().bind(program);
+		AnimationObjectRenderer::get().bindShadowMap(program);
+	}
+}
+
+void IndirectRenderer::applyState(const Draw& draw, const s_ptr<Shader>& program)
+{
+	switch (draw.cull) {
+	case IndirectCull::None:
+		GLState::disable(GL_CULL_FACE);
+		break;
+	case IndirectCull::Back:
+		GLState::enable(GL_CULL_FACE);
+		GLState::cullFace(GL_BACK);
+		break;
+	case IndirectCull::Front:
+		GLState::enable(GL_CULL_FACE);
+		GLState::cullFace(GL_FRONT);
+		break;
+	default:
+		GLState::setEnabled(GL_CULL_FACE, passCulling);
+		GLState::cullFace(passCullFace);
+		break;
+	}
+
+	if (isShadow) return;
+
+	GLint ftLoc = program->uniform("useFragmentTransform");
+	glUniform1i(ftLoc, draw.fragmentTransform ? 1 : 0);
+
+	GLState::activeTexture(GL_TEXTURE0);
+	GLint utLoc = program->uniform("useTexture");
+	if (draw.texture.id != 0) {
+		glUniform1i(utLoc, 1);
+		GLState::bindTexture(GL_TEXTURE_2D, draw.texture.id);
+		if (draw.texture.setParameters) {
+			GLState::SamplerState sampler;
+			sampler.magFilter = draw.texture.magFilter;
+			sampler.minFilter = draw.texture.minFilter;
+			sampler.wrapS = draw.texture.wrapS;
+			sampler.wrapT = draw.texture.wrapT;
+			GLState::bindSampler(0, GLState::getSampler(sampler));
+		}
+		else {
+			GLState::bindSampler(0, 0);
+		}
+	}
+	else {
+		glUniform1i(utLoc, 0);
+		GLState::bindTexture(GL_TEXTURE_2D, 0);
+	}
+}
+
+void IndirectRenderer::submit()
+{
+	if (draws.empty()) return;
+
+	order.resize(draws.size());
+	for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+	// Stable so draws with the same state keep the order they were queued in
+	std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+		return draws[a].key < draws[b].key;
+	});
+
+	auto dataRange = drawStream->allocate<GPU::DrawData>(draws.size());
+	auto commandRange = commandStream->allocate<DrawElementsIndirectCommand>(draws.size());
+	if (!dataRange.data || !commandRange.data) {
+		draws.clear();
+		return;
+	}
+
+	auto drawData = dataRange.as<GPU::DrawData>();
+	auto commands = commandRange.as<DrawElementsIndirectCommand>();
+
+	for (size_t i = 0; i < order.size(); i++) {
+		const auto& draw = draws[order[i]];
+		drawData[i] = draw.data;
+		commands[i] = { draw.slice.indexCount, 1, draw.slice.firstIndex, draw.slice.baseVertex, (GLuint)i };
+	}
+
+	drawStream->commit(dataRange);
+	commandStream->commit(commandRange);
+
+	reserveDrawIDs(draws.size());
+
+	// Draw ids index from the start of this submit's range
+	drawStream->bindRange(GPU_DRAW_BINDING_SPOT, dataRange);
+	commandStream->bind();
+
+	passCulling = GLState::isEnabled(GL_CULL_FACE);
+	passCullFace = GLState::getCullFace();
+
+	s_ptr<Shader> program;
+	auto& pool = GeometryPool::get();
+	int boundPage = -1;
+
+	size_t begin = 0;
+	while (begin < order.size()) {
+		const auto& first = draws[order[begin]];
+		size_t end = begin + 1;
+		while (end < order.size() && draws[order[end]].key == first.key) end++;
+
+		auto& firstProgram = isShadow ? shadowShader : first.shading == +IndirectShading::GLTF ? gltfShader : shader;
+		if (firstProgram != program) {
+			program = firstProgram;
+			startProgram(program);
+		}
+
+		if (first.slice.page != boundPage) {
+			boundPage = first.slice.page;
+			GLState::bindVertexArray(pool.getPage(boundPage).vao);
+		}
+
+		applyState(first, program);
+
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+			(const GLvoid*)(commandRange.offset + sizeof(DrawElementsIndirectCommand) * begin), (GLsizei)(end - begin), 0);
+
+		stats.multiDraws++;
+		begin = end;
+	}
+
+	stats.draws += draws.size();
+
+	GLState::setEnabled(GL_CULL_FACE, passCulling);
+	GLState::cullFace(passCullFace);
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	GLState::bindVertexArray(0);
+	GLState::activeTexture(GL_TEXTURE1);
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+	GLState::activeTexture(GL_TEXTURE0);
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+	GLState::unbindSamplers();
+	program->stop();
+
+	draws.clear();
+}
+
+void IndirectRenderer::renderUI()
+{
+	if (!isSupported()) {
+		ImGui::Text("Multi-draw indirect needs OpenGL 4.3");
+		return;
+	}
+
+	ImGui::Checkbox("Multi-draw indirect", &enabled);
+	if (enabled) {
+		ImGui::Text("%d draws in %d multi-draws", (int)stats.draws, (int)stats.multiDraws);
+		GeometryPool::get().renderUI();
+	}
+}
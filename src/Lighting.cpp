@@ -81,9 +81,7 @@ void Lighting::bind(s_ptr<Shader> shader)
 {	
 	//glBindBufferBase(GL_SHADER_STORAGE_BUFFER, bufferIndex, gpu->buffer);
 
-	unsigned int lights_index = glGetUniformBlockIndex(shader->program, "LightData");
-	glUniformBlockBinding(shader->program, lights_index, GPU_LIGHT_BINDING_SPOT);
-	
+	// Shader::link already put LightData on GPU_LIGHT_BINDING_SPOT
 	glBindBufferBase(GL_UNIFORM_BUFFER, GPU_LIGHT_BINDING_SPOT, gpu->buffer);
 }
 
@@ -116,8 +114,11 @@ Lighting& Lighting::get()
 void Lighting::renderUI(OpenGLRenderer* ogl) {
 	if (ImGui::CollapsingHeader("Lights"))
 	{
-		ImGui::Checkbox("Use shadow?", &ogl->useShadow);
-		if (ogl->shadowMap) ogl->shadowMap->renderUI("Shadow map");
+		// The software renderer passes null, it has no shadow map
+		if (ogl) {
+			ImGui::Checkbox("Use shadow?", &ogl->useShadow);
+			if (ogl->shadowMap) ogl->shadowMap->renderUI("Shadow map");
+		}
 		ImGui::Text("Shadow light projection type");
 		ImGui::SameLine();
 		renderEnumButton<ProjectionType>(projectionType);
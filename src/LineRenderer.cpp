@@ -2,10 +2,12 @@
 
 #include "Application.h"
 #include "Camera.h"
+#include "GLStateCache.h"
 #include "Renderer.h"
 #include "Lighting.h"
 #include "Texture.h"
 #include "Framebuffer.h"
+#include "StreamBuffer.h"
 #include "StringUtil.h"
 #include "InputOutput.h"
 
@@ -42,20 +44,45 @@ bool LineRenderData::initShader() {
 		glEnableVertexAttribArray(loc);
 		});
 
-	glBindVertexArray(vao);
+	auto addInstanceAttribute = [&binding](const std::string& name, size_t offset) {
+		binding.addVertexAttribute("vec4", name, [offset](GLint loc) {
+			LineRenderer::get().getStream().bind();
+			glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(LineInstance), (const GLvoid*)(LineRenderer::get().currentOffset + offset));
+			glEnableVertexAttribArray(loc);
+			glVertexAttribDivisor(loc, 1);
+			});
+	};
+
+	addInstanceAttribute("start", offsetof(LineInstance, start));
+	addInstanceAttribute("end", offsetof(LineInstance, end));
+	addInstanceAttribute("color", offsetof(LineInstance, color));
+
+	GLState::bindVertexArray(vao);
 	shader->bind(binding);
 	indexVBO->bind();
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 
 	return true;
 }
 
+LineRenderer::LineRenderer() { }
+
+LineRenderer::~LineRenderer() { }
+
 LineRenderer& LineRenderer::get()
 {
 	static LineRenderer instance;
 	return instance;
 }
 
+StreamBuffer& LineRenderer::getStream() {
+	if (!stream) {
+		stream = u_ptr<StreamBuffer>(new StreamBuffer("Line segments", GL_ARRAY_BUFFER,
+			sizeof(LineInstance) * 4096, sizeof(LineInstance)));
+	}
+	return *stream;
+}
+
 bool LineRenderer::init()
 {
 	renderData = std::make_shared<LineRenderData>();
@@ -69,10 +96,8 @@ void LineRenderer::begin() {
 		if (!initialized) return;
 	}
 
-	glBindVertexArray(renderData->vao);
-	renderData->indexVBO->bind();
-	renderData->shader->start();
-	renderData->shader->binding.refreshUniforms();
+	segments.clear();
+	batching = true;
 }
 
 
@@ -84,80 +109,69 @@ void LineRenderer::render(const vec3& p1, const vec3& p2, const vec4& color, flo
 }
 
 void LineRenderer::renderSingle(const vec3& p1, const vec3& p2, const vec4& color, float width) {
-	vec3 xr = p2 - p1;
-	float diffLength = glm::length(xr);
-	xr = glm::normalize(xr);
-
-	auto& cam = Application::get().getRenderer<OpenGLRenderer>()->camera;
-
-	vec3 zr = glm::normalize(cam.Position - cam.Lookat);
-
-	vec3 yr = glm::cross(zr, xr);
-
-	mat3 r;
-	r[0] = xr;
-	r[1] = yr;
-	r[2] = zr;
-
-	mat4 rotation = r;
-
+	if (!batching) return;
 
+	LineInstance segment;
+	segment.start = vec4(p1, width);
+	segment.end = vec4(p2, 0.f);
+	segment.color = color;
+	segments.push_back(segment);
+}
 
-	//auto rotation = glm::rotation(vec3(1.f, 0.f, 0.f), glm::normalize(diff));
-
-	mat4 model =
-		glm::translate(p1)
-		* rotation
-		* glm::scale(vec3(diffLength, globalWidth * width, 1.0f));
-
-
-	/*
-	vec3 rp1 = model * vec4{ 0.0, 1.0, 0.0, 1.0};
-	vec3 rp2 = model * vec4 { 0.0, -1.0, 0.0, 1.0 };
-	vec3 rp3 = model * vec4 { 1.0, -1.0, 0.0, 1.0 };
-
-	vec3 a = glm::normalize(rp2 - rp1);
-	vec3 b = glm::normalize(rp3 - rp2);
-	vec3 c = glm::normalize(glm::cross(a, b));
-
-	float angleDiff = glm::angle(c, toCam);
+void LineRenderer::flush() {
+	auto& frame = Application::get().frameCounter;
+	if (statsFrame != frame) {
+		lastFrameStats = frameStats;
+		frameStats = Stats();
+		statsFrame = frame;
+	}
 
-	auto toCamRotation = glm::angleAxis(angleDiff, glm::normalize(diff));
+	if (segments.empty()) return;
 
-	rotation = toCamRotation * rotation;
+	auto& instances = getStream();
+	auto range = instances.allocate<LineInstance>(segments.size());
+	if (!range.data) return;
+	std::memcpy(range.data, segments.data(), sizeof(LineInstance) * segments.size());
+	instances.commit(range);
 
-	model =
-		 glm::translate(p1)
-		* glm::toMat4(rotation)
-		* glm::scale(vec3(diffLength, globalWidth, 1.0f));
+	currentOffset = range.offset;
 
-	*/
+	auto& cam = Application::get().getRenderer<Renderer>()->camera;
+	auto& shader = renderData->shader;
 
-	mat4 viewproj = cam.viewproj;
+	GLState::bindVertexArray(renderData->vao);
+	renderData->indexVBO->bind();
+	shader->start();
+	shader->binding.refresh();
 
-	mat4 mvp = viewproj * model;
+	glUniformMatrix4fv(shader->uniform("vp"), 1, GL_FALSE, glm::value_ptr(cam.viewproj));
+	glUniform3fv(shader->uniform("toCamera"), 1, glm::value_ptr(glm::normalize(cam.Position - cam.Lookat)));
+	glUniform1f(shader->uniform("globalWidth"), globalWidth);
+	glUniform4fv(shader->uniform("globalColor"), 1, glm::value_ptr(globalColor));
 
-	auto mvpLoc = glGetUniformLocation(renderData->shader->program, "mvp");
-	if (mvpLoc != -1) {
-		glUniformMatrix4fv(mvpLoc, 1, false, glm::value_ptr(mvp));
-	}
+	glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)renderData->indexVBO->data.size(), GL_UNSIGNED_INT,
+		(const GLvoid*)0, (GLsizei)segments.size());
 
-	auto colorLoc = glGetUniformLocation(renderData->shader->program, "color");
-	if (colorLoc != -1) {
-		glUniform4fv(colorLoc, 1, glm::value_ptr(color));
-	}
+	shader->stop();
+	GLState::bindVertexArray(0);
 
-	glDrawElements(GL_TRIANGLES, renderData->indexVBO->data.size(), GL_UNSIGNED_INT, (const GLvoid*)0);
+	frameStats.segments += segments.size();
+	frameStats.draws++;
 }
 
 void LineRenderer::end() {
-	renderData->shader->stop();
-	glBindVertexArray(0);
+	if (!batching) return;
+
+	flush();
+
+	segments.clear();
+	batching = false;
 }
 
 void LineRenderer::renderUI() {
 	if (ImGui::CollapsingHeader("LineRenderer")) {
 		ImGui::ColorEdit4("Global color", glm::value_ptr(globalColor));
 		ImGui::InputFloat("Global width", &globalWidth);
+		ImGui::Text("Last frame: %d segments in %d draws", (int)lastFrameStats.segments, (int)lastFrameStats.draws);
 	}
-}
\ No newline at end of file
+}
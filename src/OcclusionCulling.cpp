@@ -0,0 +1,407 @@
+#include "OcclusionCulling.h"
+
+#include "AnimationObject.h"
+#include "AnimationObjectRenderer.h"
+#include "GLStateCache.h"
+#include "WorkerPool.h"
+
+#include "imgui.h"
+
+#include <GL/glew.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define OCCLUSION_SSE 1
+#include <xmmintrin.h>
+#endif
+
+OcclusionCulling& OcclusionCulling::get() {
+	static OcclusionCulling culling;
+	return culling;
+}
+
+bool OcclusionCulling::isOccluder(const AnimationObject& shape, const Bounds& bounds, size_t triangleCount) const {
+	if (shape.occluder) return true;
+
+	// Lights draw their own marker, and the vertex transform moves surfaces off their triangles
+	if (shape.lightIndex != -1 || shape.useVertexTransform) return false;
+
+	bool simple = shape.shapeType == +AnimationObjectType::box || shape.shapeType == +AnimationObjectType::quad
+		|| shape.shapeType == +AnimationObjectType::tri || (int)triangleCount <= maxOccluderTriangles;
+	if (!simple) return false;
+
+	vec3 extent = bounds.max - bounds.min;
+	return glm::max(extent.x, glm::max(extent.y, extent.z)) >= minOccluderSize;
+}
+
+void OcclusionCulling::addOccluder(const AnimationObject& shape) {
+	auto& data = AnimationObjectRenderer::get().getRenderData(shape);
+	if (!data.vertexVBO || !data.indexVBO) return;
+
+	const auto& vertices = data.vertexVBO->data;
+	const auto& indices = data.indexVBO->data;
+
+	mat4 mvp = viewproj * shape.transform * glm::scale(vec3(shape.size));
+
+	clipVertices.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		clipVertices[i] = mvp * vec4(vertices[i].position, 1.f);
+	}
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		if (indices[i] >= vertices.size() || indices[i + 1] >= vertices.size() || indices[i + 2] >= vertices.size()) continue;
+
+		vec4 v[3] = { clipVertices[indices[i]], clipVertices[indices[i + 1]], clipVertices[indices[i + 2]] };
+		clipAndAdd(v);
+	}
+
+	stats.occluders++;
+}
+
+void OcclusionCulling::clipAndAdd(const vec4 v[3]) {
+	// Everything outside one of the side planes can't cover a pixel
+	for (int axis = 0; axis < 3; axis++) {
+		if (v[0][axis] > v[0].w && v[1][axis] > v[1].w && v[2][axis] > v[2].w) return;
+		if (v[0][axis] < -v[0].w && v[1][axis] < -v[1].w && v[2][axis] < -v[2].w) return;
+	}
+
+	// Clip against the near plane, z >= -w
+	vec4 polygon[4];
+	int count = 0;
+	for (int i = 0; i < 3; i++) {
+		const vec4& a = v[i];
+		const vec4& b = v[(i + 1) % 3];
+		float da = a.z + a.w;
+		float db = b.z + b.w;
+
+		if (da >= 0.f) polygon[count++] = a;
+		if ((da >= 0.f) != (db >= 0.f)) {
+			polygon[count++] = glm::mix(a, b, da / (da - db));
+		}
+	}
+	if (count < 3) return;
+
+	vec3 screen[4];
+	for (int i = 0; i < count; i++) {
+		// The clip point can land exactly on w = 0 when the camera sits on the near plane
+		float w = glm::max(polygon[i].w, 1e-6f);
+		vec3 ndc = vec3(polygon[i]) / w;
+		screen[i] = vec3((ndc.x * 0.5f + 0.5f) * resolution.x, (ndc.y * 0.5f + 0.5f) * resolution.y, ndc.z * 0.5f + 0.5f);
+	}
+
+	for (int i = 1; i + 1 < count; i++) {
+		Triangle t;
+		t.v[0] = screen[0];
+		t.v[1] = screen[i];
+		t.v[2] = screen[i + 1];
+
+		// Both windings are drawn, so one-sided quads hide what's behind them from either side
+		float area = (t.v[1].x - t.v[0].x) * (t.v[2].y - t.v[0].y) - (t.v[2].x - t.v[0].x) * (t.v[1].y - t.v[0].y);
+		if (area == 0.f) continue;
+		if (area < 0.f) std::swap(t.v[1], t.v[2]);
+
+		float minY = glm::min(t.v[0].y, glm::min(t.v[1].y, t.v[2].y));
+		float maxY = glm::max(t.v[0].y, glm::max(t.v[1].y, t.v[2].y));
+
+		// Rows whose pixel centers fall inside the triangle's height
+		t.minY = glm::max(0, (int)std::ceil(minY - 0.5f));
+		t.maxY = glm::min(resolution.y - 1, (int)std::floor(maxY - 0.5f));
+		if (t.minY > t.maxY) continue;
+
+		triangles.push_back(t);
+	}
+}
+
+void OcclusionCulling::rasterizeBand(int y0, int y1) {
+	float* depth = levels[0].data();
+	int width = resolution.x;
+
+	for (const auto& t : triangles) {
+		if (t.maxY < y0 || t.minY >= y1) continue;
+
+		const vec3& a = t.v[0];
+		const vec3& b = t.v[1];
+		const vec3& c = t.v[2];
+
+		float minX = glm::min(a.x, glm::min(b.x, c.x));
+		float maxX = glm::max(a.x, glm::max(b.x, c.x));
+		int x0 = glm::max(0, (int)std::ceil(minX - 0.5f));
+		int x1 = glm::min(width - 1, (int)std::floor(maxX - 0.5f));
+		if (x0 > x1) continue;
+
+		// Edge functions e = A x + B y + C, positive inside
+		float A[3], B[3], C[3];
+		const vec3* p[4] = { &a, &b, &c, &a };
+		for (int e = 0; e < 3; e++) {
+			float dx = p[e + 1]->x - p[e]->x;
+			float dy = p[e + 1]->y - p[e]->y;
+			A[e] = -dy;
+			B[e] = dx;
+			C[e] = dy * p[e]->x - dx * p[e]->y;
+		}
+
+		float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+		float dzdx = ((b.z - a.z) * (c.y - a.y) - (c.z - a.z) * (b.y - a.y)) / area;
+		float dzdy = ((c.z - a.z) * (b.x - a.x) - (b.z - a.z) * (c.x - a.x)) / area;
+		float zC = a.z - dzdx * a.x - dzdy * a.y;
+
+		int rowBegin = glm::max(t.minY, y0);
+		int rowEnd = glm::min(t.maxY, y1 - 1);
+
+		// Four pixels at a time from a multiple of four. Pixels past x1 are tested like any
+		// other, and ones past the width land in the row padding.
+		int xStart = x0 & ~3;
+
+		for (int y = rowBegin; y <= rowEnd; y++) {
+			float py = y + 0.5f;
+			float* row = depth + (size_t)y * stride;
+
+#ifdef OCCLUSION_SSE
+			__m128 px = _mm_add_ps(_mm_set1_ps(xStart + 0.5f), _mm_set_ps(3.f, 2.f, 1.f, 0.f));
+			__m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[0]), px), _mm_set1_ps(B[0] * py + C[0]));
+			__m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[1]), px), _mm_set1_ps(B[1] * py + C[1]));
+			__m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[2]), px), _mm_set1_ps(B[2] * py + C[2]));
+			__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dzdx), px), _mm_set1_ps(dzdy * py + zC));
+
+			__m128 stepE0 = _mm_set1_ps(A[0] * 4.f);
+			__m128 stepE1 = _mm_set1_ps(A[1] * 4.f);
+			__m128 stepE2 = _mm_set1_ps(A[2] * 4.f);
+			__m128 stepZ = _mm_set1_ps(dzdx * 4.f);
+			__m128 zero = _mm_setzero_ps();
+
+			for (int x = xStart; x <= x1; x += 4) {
+				__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(e0, zero), _mm_cmpgt_ps(e1, zero)), _mm_cmpgt_ps(e2, zero));
+				if (_mm_movemask_ps(inside)) {
+					__m128 old = _mm_loadu_ps(row + x);
+					__m128 nearer = _mm_min_ps(old, z);
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+				}
+
+				e0 = _mm_add_ps(e0, stepE0);
+				e1 = _mm_add_ps(e1, stepE1);
+				e2 = _mm_add_ps(e2, stepE2);
+				z = _mm_add_ps(z, stepZ);
+			}
+#else
+			for (int x = xStart; x <= x1; x++) {
+				float px = x + 0.5f;
+				if (A[0] * px + B[0] * py + C[0] <= 0.f) continue;
+				if (A[1] * px + B[1] * py + C[1] <= 0.f) continue;
+				if (A[2] * px + B[2] * py + C[2] <= 0.f) continue;
+				row[x] = glm::min(row[x], dzdx * px + dzdy * py + zC);
+			}
+#endif
+		}
+	}
+}
+
+void OcclusionCulling::rasterize() {
+	const int bandHeight = 8;
+	int bands = (resolution.y + bandHeight - 1) / bandHeight;
+
+	// Bands own their rows, so threads never write the same pixel
+	WorkerPool::get().parallelFor(bands, [this, bandHeight](int band, int) {
+		rasterizeBand(band * bandHeight, glm::min(resolution.y, (band + 1) * bandHeight));
+	});
+}
+
+void OcclusionCulling::buildPyramid() {
+	for (size_t l = 1; l < levels.size(); l++) {
+		ivec2 src = levelSizes[l - 1];
+		ivec2 dst = levelSizes[l];
+		int srcStride = l == 1 ? stride : src.x;
+		const float* in = levels[l - 1].data();
+		float* out = levels[l].data();
+
+		for (int y = 0; y < dst.y; y++) {
+			int sy0 = y * 2;
+			int sy1 = glm::min(sy0 + 1, src.y - 1);
+			for (int x = 0; x < dst.x; x++) {
+				int sx0 = x * 2;
+				int sx1 = glm::min(sx0 + 1, src.x - 1);
+				float farthest = glm::max(glm::max(in[sy0 * srcStride + sx0], in[sy0 * srcStride + sx1]),
+					glm::max(in[sy1 * srcStride + sx0], in[sy1 * srcStride + sx1]));
+				out[y * dst.x + x] = farthest;
+			}
+		}
+	}
+}
+
+bool OcclusionCulling::isOccluded(const Bounds& bounds) const {
+	if (!enabled || !valid || !bounds.valid()) return false;
+
+	vec2 minXY = vec2(FLT_MAX);
+	vec2 maxXY = vec2(-FLT_MAX);
+	float minZ = FLT_MAX;
+
+	for (int i = 0; i < 8; i++) {
+		vec3 corner = vec3(i & 1 ? bounds.max.x : bounds.min.x, i & 2 ? bounds.max.y : bounds.min.y, i & 4 ? bounds.max.z : bounds.min.z);
+		vec4 clip = viewproj * vec4(corner, 1.f);
+
+		// Reaches behind the camera, so its projection isn't bounded
+		if (clip.w <= 1e-5f) return false;
+
+		vec3 ndc = vec3(clip) / clip.w;
+		vec2 screen = (vec2(ndc) * 0.5f + 0.5f) * vec2(resolution);
+		minXY = glm::min(minXY, screen);
+		maxXY = glm::max(maxXY, screen);
+		minZ = glm::min(minZ, ndc.z * 0.5f + 0.5f);
+	}
+
+	// Every pixel the rectangle touches, not just the ones whose centers it holds
+	ivec2 p0 = glm::max(ivec2(glm::floor(minXY)), ivec2(0));
+	ivec2 p1 = glm::min(ivec2(glm::floor(maxXY)), resolution - 1);
+	if (p0.x > p1.x || p0.y > p1.y) return false;
+
+	int level = 0;
+	while (level + 1 < (int)levels.size() && ((p1.x >> level) - (p0.x >> level) > 1 || (p1.y >> level) - (p0.y >> level) > 1)) {
+		level++;
+	}
+
+	const float* texels = levels[level].data();
+	int levelStride = level == 0 ? stride : levelSizes[level].x;
+
+	float farthest = 0.f;
+	for (int y = p0.y >> level; y <= (p1.y >> level); y++) {
+		for (int x = p0.x >> level; x <= (p1.x >> level); x++) {
+			farthest = glm::max(farthest, texels[y * levelStride + x]);
+		}
+	}
+
+	return minZ > farthest;
+}
+
+void OcclusionCulling::cull(const mat4& vp, const std::vector<AnimationObject>& objects, SceneCulling& culling) {
+	stats = Stats();
+	valid = false;
+
+	if (!enabled || !culling.enabled || resolution.x <= 0 || resolution.y <= 0) return;
+
+	viewproj = vp;
+
+	double start = getWallTime();
+
+	// Rows are padded so the last four-pixel group stays inside them
+	stride = (resolution.x + 3) & ~3;
+	if (levelSizes.empty() || levelSizes[0] != resolution) {
+		levels.clear();
+		levelSizes.clear();
+
+		ivec2 size = resolution;
+		levelSizes.push_back(size);
+		levels.emplace_back((size_t)stride * size.y);
+		while (size.x > 1 || size.y > 1) {
+			size = glm::max((size + 1) / 2, ivec2(1));
+			levelSizes.push_back(size);
+			levels.emplace_back((size_t)size.x * size.y);
+		}
+	}
+	std::fill(levels[0].begin(), levels[0].end(), 1.f);
+
+	triangles.clear();
+	candidates.clear();
+
+	auto& renderer = AnimationObjectRenderer::get();
+
+	for (size_t i = 0; i < objects.size(); i++) {
+		if (!culling.isVisible(i)) continue;
+
+		const auto& shape = objects[i];
+		const Bounds* bounds = culling.getBounds(shape.index);
+		if (!bounds) continue;
+
+		candidates.push_back(i);
+
+		auto& data = renderer.getRenderData(shape);
+		size_t triangleCount = data.indexVBO ? data.indexVBO->data.size() / 3 : 0;
+		if (isOccluder(shape, *bounds, triangleCount)) {
+			addOccluder(shape);
+		}
+	}
+
+	stats.triangles = triangles.size();
+
+	rasterize();
+	stats.rasterTime = getWallTime() - start;
+
+	start = getWallTime();
+	buildPyramid();
+	valid = true;
+	stats.pyramidTime = getWallTime() - start;
+
+	start = getWallTime();
+	hidden.assign(candidates.size(), 0);
+
+	// An occluder is tested like everything else, since its box is never behind its own surface
+	// One test is cheap, so each worker takes a contiguous run of them
+	auto& pool = WorkerPool::get();
+	int candidateCount = (int)candidates.size();
+	int chunks = glm::min(candidateCount, pool.loopThreads());
+	pool.parallelFor(chunks, [&](int chunk, int) {
+		int end = candidateCount * (chunk + 1) / chunks;
+		for (int k = candidateCount * chunk / chunks; k < end; k++) {
+			const Bounds* bounds = culling.getBounds(objects[candidates[k]].index);
+			hidden[k] = bounds && isOccluded(*bounds);
+		}
+	});
+
+	for (size_t k = 0; k < candidates.size(); k++) {
+		if (!hidden[k]) continue;
+		culling.hide(candidates[k]);
+		stats.occluded++;
+	}
+
+	stats.tested = candidates.size();
+	stats.testTime = getWallTime() - start;
+
+	if (showDepth) {
+		updateDebugTexture();
+	}
+}
+
+void OcclusionCulling::updateDebugTexture() {
+	if (levels.empty()) return;
+
+	std::vector<uint32_t> pixels((size_t)resolution.x * resolution.y);
+	for (int y = 0; y < resolution.y; y++) {
+		for (int x = 0; x < resolution.x; x++) {
+			// Depth is crowded near 1, so spread the far end out
+			float d = glm::clamp(levels[0][y * stride + x], 0.f, 1.f);
+			uint32_t v = (uint32_t)(glm::pow(d, 64.f) * 255.f);
+			pixels[y * resolution.x + x] = v | (v << 8) | (v << 16) | 0xFF000000u;
+		}
+	}
+
+	if (!debugTexture) {
+		glGenTextures(1, &debugTexture);
+	}
+
+	GLState::bindTexture(GL_TEXTURE_2D, debugTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, resolution.x, resolution.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+}
+
+void OcclusionCulling::renderUI() {
+	if (ImGui::CollapsingHeader("Occlusion culling")) {
+		ImGui::Checkbox("Enabled##occlusion", &enabled);
+		if (ImGui::InputInt2("Depth buffer size", glm::value_ptr(resolution))) {
+			resolution = glm::clamp(resolution, ivec2(16), ivec2(2048));
+		}
+		ImGui::SliderFloat("Min occluder size", &minOccluderSize, 0.f, 50.f);
+		ImGui::SliderInt("Max occluder triangles", &maxOccluderTriangles, 0, 4096);
+
+		ImGui::Text("%d occluders, %d triangles", (int)stats.occluders, (int)stats.triangles);
+		ImGui::Text("%d of %d tested objects occluded", (int)stats.occluded, (int)stats.tested);
+		ImGui::Text("Raster %.3f ms, pyramid %.3f ms, tests %.3f ms",
+			stats.rasterTime * 1000.0, stats.pyramidTime * 1000.0, stats.testTime * 1000.0);
+
+		ImGui::Checkbox("Show depth buffer", &showDepth);
+		if (showDepth && debugTexture) {
+			float width = ImGui::GetContentRegionAvail().x;
+			float height = width * resolution.y / glm::max(1.f, (float)resolution.x);
+			ImGui::Image((ImTextureID)(intptr_t)debugTexture, ImVec2(width, height), { 0, 1 }, { 1, 0 });
+		}
+	}
+}
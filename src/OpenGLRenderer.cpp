@@ -3,14 +3,28 @@
 #include "Application.h"
 #include "AnimationObjectRenderer.h"
 #include "Assignment.h"
+#include "ClusteredLighting.h"
+#include "Culling.h"
+#include "FrameUniforms.h"
+#include "GLStateCache.h"
 #include "GLTFImporter.h"
+#include "GPUProfiler.h"
+#include "IndirectRenderer.h"
 #include "Framebuffer.h"
+#include "FullscreenFilter.h"
 #include "Input.h"
 #include "InputOutput.h"
 #include "Lighting.h"
+#include "OcclusionCulling.h"
+#include "Picking.h"
+#include "ShaderCache.h"
+#include "ShadowCascades.h"
 #include "Texture.h"
 #include "Prompts.h"
 #include "Properties.h"
+#include "RenderGraph.h"
+#include "RenderTargetPool.h"
+#include "ResourceRegistry.h"
 #include "Textures.h"
 #include "Tool.h"
 
@@ -44,6 +58,12 @@ struct OpenGLRenderer::Settings : public IProperties
 	Property<GLenum> blitFilter = Property<GLenum>("blitFilter", GL_NEAREST)
 		.SetRange({ { "GL_NEAREST", GL_NEAREST}, {"GL_LINEAR", GL_LINEAR} });
 
+	// Waits for the GPU at the end of Render. Turn off to let the CPU run ahead.
+	BoolProp finishFrame = BoolProp("finishFrame", true);
+
+	// Frames the window size has to hold before the gbuffer is resized to it
+	IntProp resizeSettleFrames = IntProp("resizeSettleFrames", 3);
+
 	std::vector<Property<GLenum>> blendRange = {
 		Property<GLenum>("GL_ZERO", GL_ZERO),
 		Property<GLenum>("GL_ONE", GL_ONE),
@@ -101,6 +121,8 @@ struct OpenGLRenderer::Settings : public IProperties
 		glFrontFace.AddTo(this);
 		glCullFace.AddTo(this);
 		blitFilter.AddTo(this);
+		finishFrame.AddTo(this);
+		resizeSettleFrames.AddTo(this);
 	}
 };
 
@@ -124,13 +146,15 @@ void OpenGLRenderer::init()
 	glGetIntegerv(GL_VIEWPORT, glm::value_ptr(viewport));
 
 	gbuffer = std::make_shared<Framebuffer>(resolution.x, resolution.y, 2, std::vector<GBufferMode>{ GBufferMode::Rendered, GBufferMode::Rendered });
-	input = std::make_shared<Framebuffer>(resolution.x, resolution.y, 1, std::vector<GBufferMode>{}, false, false);
-	output = std::make_shared<Framebuffer>(resolution.x, resolution.y, 1, std::vector<GBufferMode>{}, false, false);
 	shadowMap = std::make_shared<Framebuffer>(4096, 4096, 0);
 	dummyInput = std::make_shared<Framebuffer>(1, 1);
 
 	settings = std::make_shared<OpenGLRenderer::Settings>();
 
+	renderGraph = std::make_shared<RenderGraph>();
+	addFilter("filters/postprocessingtest1.frag", false);
+	addFilter("filters/postprocessingtest2.frag", false);
+
 	glfwSwapInterval(settings->swapInterval);
 
 	glfwSetFramebufferSizeCallback(application.window, [](GLFWwindow* glfw, int newWidth, int newHeight) {
@@ -139,12 +163,7 @@ void OpenGLRenderer::init()
 		if (auto sr = OpenGLRenderer::instance) {
 			sr->resolution = ivec2(newWidth, newHeight);
 			sr->viewport = ivec4(0, 0, newWidth, newHeight);
-			if (sr->lockResolutionToWindow) {
-				//ogl->gbuffer = std::make_shared<Framebuffer> (newWidth, newHeight);
-				sr->gbuffer = std::make_shared<Framebuffer>(newWidth, newHeight, 2, std::vector<GBufferMode>{ GBufferMode::Rendered, GBufferMode::Rendered });
-				sr->input = std::make_shared<Framebuffer>(newWidth, newHeight);
-				sr->output = std::make_shared<Framebuffer>(newWidth, newHeight);
-			}
+			// The gbuffer follows in Render once the size settles
 			sr->refresh = true;
 		}
 		});
@@ -165,9 +184,51 @@ void OpenGLRenderer::init()
 
 	initImGui();
 
+	prewarmShaders();
+
 	initialized = true;
 }
 
+void OpenGLRenderer::prewarmShaders()
+{
+	std::vector<ShaderFragOutputBindings> gbufferOutputs = {
+		{0, "frag_color"},
+		{1, "frag_prim"}
+	};
+
+	auto objects = [](const std::string& name) { return Shader::Path + "objects/" + name; };
+
+	// Same sources and bindings the renderers init with, so their inits hit the cache
+	ShaderCache::get().prewarm({
+		{ objects("staticmesh.vert"), objects("staticmesh.frag"), gbufferOutputs },
+		{ objects("staticshadow.vert"), objects("staticshadow.frag"), {} },
+		{ objects("staticmesh_instanced.vert"), objects("staticmesh.frag"), gbufferOutputs, AnimationObjectRenderer::InstancedAttributes },
+		{ objects("staticshadow_instanced.vert"), objects("staticshadow.frag"), {} },
+		{ objects("gltfmesh.vert"), objects("gltfmesh.frag"), gbufferOutputs, GLTFRenderer::Attributes },
+		{ objects("line.vert"), objects("line.frag"), {} },
+		{ objects("quad.vert"), objects("quad.frag"), {} },
+		{ objects("quad_instance.vert"), objects("quad_instance.frag"), {} }
+	});
+
+	// Their variants build their common feature sets the same way
+	AnimationObjectRenderer::get().getInstancedVariants();
+	GLTFRenderer::get().getVariants();
+}
+
+s_ptr<FullscreenFilter> OpenGLRenderer::addFilter(const std::string& fragPath, bool enabled, int position)
+{
+	auto filter = std::make_shared<FullscreenFilter>(fragPath, enabled);
+
+	if (position < 0 || position >= (int)filters.size()) {
+		filters.push_back(filter);
+	}
+	else {
+		filters.insert(filters.begin() + position, filter);
+	}
+
+	return filter;
+}
+
 void OpenGLRenderer::ImGuiNewFrame() {
 	ImGui_ImplOpenGL3_NewFrame();
 	ImGui_ImplGlfw_NewFrame();
@@ -180,6 +241,8 @@ double OpenGLRenderer::Render(Application& application)
 {
 	_time nowish = _clock::now();
 
+	GPUProfiler::get().beginFrame();
+	GLState::beginFrame();
 
 	camera.update();
 
@@ -199,6 +262,17 @@ double OpenGLRenderer::Render(Application& application)
 				lighting.view = s.transform;
 			}
 		}
+		else if (s.lightIndex >= GPU_LIGHT_MAX_COUNT) {
+			// Indices past the LightData ones pick a clustered light
+			auto& clustered = GPU::LightClusters::get().lights;
+			size_t index = (size_t)s.lightIndex - GPU_LIGHT_MAX_COUNT;
+			if (index >= clustered.size()) continue;
+
+			auto& l = clustered[index];
+			l.position = vec4(s.position, 1.f);
+			l.direction = vec4(glm::toMat3(quaternion(glm::radians(s.rotation))) * vec3(1.f, 0.f, 0.f), 0.f);
+			l.diffuse = s.color;
+		}
 	}
 
 	// Tie shadow light with first GPU light
@@ -229,36 +303,33 @@ double OpenGLRenderer::Render(Application& application)
 
 	if (!renderThisFrame) return (_clock::now() - nowish).count();
 
-	// Render shadow map
-	if (shadowMap) {
+	AnimationObjectRenderer::get().instancingStats = AnimationObjectRenderer::InstancingStats();
+	IndirectRenderer::get().stats = IndirectRenderer::Stats();
 
-		/*
-		static s_ptr<FullscreenFilter>expWipeFilter = std::make_shared<FullscreenFilter>("filters/expdepthwipe.frag");
-		static bool expInitialized = false;
-
-		if (!expInitialized) {
-			expInitialized = true;
-			expWipeFilter->input = nullptr;
-			expWipeFilter->output = nullptr;
-			expWipeFilter->useOwnInputBuffer = false;
-			expWipeFilter->useOwnOutputBuffer = false;
-			expWipeFilter->setGBuffer(shadowMap);
-		}
+	// Shadow caching needs to know what moved even with culling off
+	auto& culling = SceneCulling::get();
+	if (culling.enabled || ShadowCascades::get().cacheStatic) {
+		culling.sync(Application::get().objects);
+	}
 
-		shadowMap->bind(GL_DRAW_FRAMEBUFFER);
-		shadowMap->setAllBuffers();
-		glDepthFunc(GL_ALWAYS);
-		expWipeFilter->render();
-		*/
+	// A window drag sends a size event per mouse move. Rather than reallocate the gbuffer
+	// for each, wait until the size holds for a few frames; the blit stretches the old one
+	// to the window meanwhile.
+	if (resolution != settlingResolution) {
+		settlingResolution = resolution;
+		framesSinceResize = 0;
+	}
+	else {
+		framesSinceResize++;
+	}
 
-		shadowMap->bind(GL_DRAW_FRAMEBUFFER);
-		glDepthFunc(GL_LESS);
-		glEnable(GL_DEPTH_TEST);
-		glClear(GL_DEPTH_BUFFER_BIT);
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_BACK);
-		auto shadowCam = camera;
+	if (lockResolutionToWindow && gbuffer->resolution != resolution && framesSinceResize >= settings->resizeSettleFrames) {
+		gbuffer->resize(resolution);
+	}
 
+	// Light camera for the shadow pass; lightViewProj is needed by the main pass either way
+	auto shadowCam = camera;
+	if (shadowMap) {
 		auto& l = GPU::Lighting::get();
 
 		if (l.projectionType == +ProjectionType::Orthographic) {
@@ -268,70 +339,137 @@ double OpenGLRenderer::Render(Application& application)
 			shadowCam.projection = glm::perspective(glm::radians(l.fov), (float)shadowMap->width / (float)shadowMap->height, l.nearFar.x, l.nearFar.y);
 		}
 
-
 		shadowCam.view = glm::lookAt(l.position, l.center, l.up);
 		shadowCam.viewproj = shadowCam.projection * shadowCam.view;
+		GPU::FrameUniforms::get().data.lightViewProj = shadowCam.viewproj;
 
-		if (useShadow) {
-			renderScene(shadowCam.projection, shadowCam.view, shadowMap);
-		}
-
+		auto& cascades = ShadowCascades::get();
+		cascades.update(camera, shadowCam, l.position, l.center, l.up, l.projectionType, shadowMap->resolution);
+		cascades.apply(GPU::FrameUniforms::get().data);
 	}
 
-	gbuffer->bind(GL_DRAW_FRAMEBUFFER);
-	gbuffer->setAllBuffers();
-	glClearColor(clearColor.r, clearColor.g, clearColor.b, clearColor.a);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	auto& graph = *renderGraph;
+	graph.reset();
 
-	if (settings->depthTest) {
-		glEnable(GL_DEPTH_TEST);
-	}
-	else {
-		glDisable(GL_DEPTH_TEST);
-	}
+	using Resource = RenderGraph::Resource;
 
-	if (settings->glEnableCulling) {
-		glEnable(GL_CULL_FACE);
-		glCullFace(settings->glCullFace);
+	Resource shadow = RenderGraph::None;
+	if (shadowMap) {
+		shadow = graph.importTexture("Shadow map", shadowMap->textures.front()->id, shadowMap->resolution);
 	}
-	else {
-		glDisable(GL_CULL_FACE);
+
+	Resource color = graph.importTexture("Color", gbuffer->textures[0]->id, gbuffer->resolution);
+	// Picker reads it back after the frame
+	Resource prim = graph.importTexture("Primitive IDs", gbuffer->textures[1]->id, gbuffer->resolution, true);
+	Resource depth = graph.importTexture("Depth", gbuffer->textures[gbuffer->depthIndex]->id, gbuffer->resolution);
+	Resource backbuffer = graph.importTexture("Backbuffer", 0, resolution, true);
+
+	if (shadowMap && useShadow) {
+		graph.addPass("Shadow pass", [this](RenderGraph&) {
+			renderShadows();
+			})
+			.write(shadow);
 	}
 
-	glFrontFace(settings->glFrontFace);
+	graph.addPass("Main pass", [this](RenderGraph&) {
+		gbuffer->bind(GL_DRAW_FRAMEBUFFER);
+		gbuffer->setAllBuffers();
+		glClearColor(clearColor.r, clearColor.g, clearColor.b, clearColor.a);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	if (settings->blend) {
-		glEnable(GL_BLEND);
-		glBlendFunc(settings->blendFuncSrc.value, settings->blendFuncDst.value);
-		glBlendEquation(settings->blendEquation.value);
-	}
-	else {
-		glDisable(GL_BLEND);
-	}
+		if (settings->depthTest) {
+			GLState::enable(GL_DEPTH_TEST);
+		}
+		else {
+			GLState::disable(GL_DEPTH_TEST);
+		}
 
-	renderScene(camera.projection, camera.view, gbuffer);
+		if (settings->glEnableCulling) {
+			GLState::enable(GL_CULL_FACE);
+			GLState::cullFace(settings->glCullFace);
+		}
+		else {
+			GLState::disable(GL_CULL_FACE);
+		}
 
-	//// Only render assignments that use OpenGL
-	//for (auto& assignment : application.assignments) {
-	//	if (assignment->useOpenGL) {
-	//		assignment->render(camera.projection, camera.view, gbuffer, false);
-	//	}
-	//}
+		GLState::frontFace(settings->glFrontFace);
 
-	if (!settings->runEveryFrame) {
-		refresh = false;
+		if (settings->blend) {
+			GLState::enable(GL_BLEND);
+			GLState::blendFunc(settings->blendFuncSrc.value, settings->blendFuncDst.value);
+			GLState::blendEquation(settings->blendEquation.value);
+		}
+		else {
+			GLState::disable(GL_BLEND);
+		}
+
+		auto& clusters = GPU::LightClusters::get();
+		clusters.begin(camera, gbuffer->resolution);
+
+		renderScene(camera.projection, camera.view, gbuffer);
+
+		clusters.end();
+
+		// Queued behind the main pass, collected by SelectTool once it lands
+		Picker::get().readback(*gbuffer);
+
+		gbuffer->unbind(GL_DRAW_FRAMEBUFFER);
+		})
+		.read(useShadow ? shadow : RenderGraph::None)
+		.write(color).write(prim).write(depth);
+
+	// Each enabled filter reads the last color and writes a new transient one. Targets
+	// two filters apart share a texture.
+	RenderGraph::TextureDesc colorDesc;
+	colorDesc.size = gbuffer->resolution;
+	colorDesc.internalFormat = Texture::rgbaTextureDescription.internalFormat;
+	colorDesc.format = Texture::rgbaTextureDescription.pixelDataFormat;
+	colorDesc.type = Texture::rgbaTextureDescription.pixelDataType;
+
+	Resource sceneColor = color;
+	for (auto& filter : filters) {
+		if (!filter->enabled) continue;
+
+		Resource filtered = graph.createTexture(filter->name, colorDesc);
+		graph.addPass(filter->name, [filter, color, depth](RenderGraph& g) {
+			g.bindTargets();
+			filter->render(g.getTexture(color), g.getTexture(depth), g.getSize(color));
+			})
+			.read(color).read(depth)
+			.write(filtered);
+
+		color = filtered;
 	}
 
-	gbuffer->unbind(GL_DRAW_FRAMEBUFFER);
-	gbuffer->bind(GL_READ_FRAMEBUFFER);
-	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	graph.addPass("Blit", [this, color, sceneColor](RenderGraph& g) {
+		// The gbuffer has its own framebuffer; one of the graph's would outlive a resize
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, color == sceneColor ? gbuffer->framebuffer : g.getFramebuffer({ color }));
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 
-	glBlitFramebuffer(0, 0, gbuffer->width, gbuffer->height,
-		0, 0, resolution.x, resolution.y, GL_COLOR_BUFFER_BIT, settings->blitFilter.value);
+		ivec2 size = g.getSize(color);
+		glBlitFramebuffer(0, 0, size.x, size.y,
+			0, 0, resolution.x, resolution.y, GL_COLOR_BUFFER_BIT, settings->blitFilter.value);
 
-	gbuffer->unbind(GL_READ_FRAMEBUFFER);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		})
+		.read(color)
+		.write(backbuffer);
 
-	glFinish();
+	graph.compile();
+	graph.execute();
+
+	RenderTargetPool::get().endFrame();
+	ResourceRegistry::get().endFrame();
+
+	// Keep rendering until a pending resize lands
+	if (!settings->runEveryFrame) {
+		refresh = lockResolutionToWindow && gbuffer->resolution != resolution;
+	}
+
+	if (settings->finishFrame) {
+		glFinish();
+	}
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
@@ -344,6 +482,8 @@ double OpenGLRenderer::Render(Application& application)
 void OpenGLRenderer::endRender() {
 	presentUI();
 
+	GPUProfiler::get().endFrame();
+
 	glfwSwapBuffers(Application::get().window);
 }
 
@@ -355,17 +495,81 @@ double OpenGLRenderer::renderScene(const mat4& projection, const mat4& view, s_p
 	camera.view = view;
 	camera.viewproj = projection * view;
 
+	GPU::FrameUniforms::get().update(camera);
+
 
 	auto& application = Application::get();
 	auto& jr = AnimationObjectRenderer::get();
 
-	bool isShadow = framebuffer == shadowMap;
+	bool isShadow = framebuffer == shadowMap || (framebuffer && framebuffer == staticShadowMap);
 
 	bool cullShadowFace = false;
 
+	auto& culling = SceneCulling::get();
+	if (culling.enabled) {
+		camera.updateFrustum();
+		culling.cull(Frustum(camera.frustumPlanes), isShadow);
+
+		// The orthographic projection swaps near and far, which the depth test would read backwards
+		if (!isShadow && camera.projectionType == +ProjectionType::Perspective) {
+			OcclusionCulling::get().cull(camera.viewproj, application.objects, culling);
+		}
+		else if (!isShadow) {
+			OcclusionCulling::get().reset();
+		}
+	}
+
+	// Shapes, meshes and glTF primitives all come out of the geometry pool in a few
+	// multi-draws when the context supports it
+	auto& indirect = IndirectRenderer::get();
+	bool useIndirect = indirect.isAvailable();
+	bool gltfQueued = false;
+
+	// Assignments and glTF scenes can animate without the scene knowing, so they're drawn
+	// with the dynamic casters
+	bool drawUntracked = !isShadow || culling.casters != +CasterSet::Static;
+
+	if (useIndirect) {
+		indirect.begin(isShadow);
+
+		for (size_t i = 0; i < application.objects.size(); i++) {
+			auto& shape = application.objects[i];
+			if (isShadow && shape.lightIndex != -1) continue;
+			if (!culling.isVisible(i)) continue;
+			indirect.add(shape);
+		}
+
+		if (application.gltf && drawUntracked) {
+			gltfQueued = GLTFRenderer::get().renderIndirect(projection, view, application.gltf, isShadow);
+		}
+
+		GPUScope scope("Indirect draws");
+		indirect.submit();
+	}
+
 	// Render all simple shapes
 	for (auto st : AnimationObjectType::_values()) {
+		if (useIndirect) break;
 		if (st == +AnimationObjectType::model) continue;
+
+		if (jr.useInstancing) {
+			static std::vector<const AnimationObject*> shapes;
+			shapes.clear();
+			for (size_t i = 0; i < application.objects.size(); i++) {
+				auto& shape = application.objects[i];
+				if (isShadow && shape.lightIndex != -1) continue;
+				if (shape.shapeType == st && culling.isVisible(i)) shapes.push_back(&shape);
+			}
+
+			if (isShadow) {
+				GLState::enable(GL_CULL_FACE);
+				GLState::cullFace(st == +AnimationObjectType::quad || st == +AnimationObjectType::tri ? GL_BACK : GL_FRONT);
+			}
+
+			jr.renderInstanced(st, shapes, isShadow);
+			continue;
+		}
+
 		jr.beginBatchRender(st, false, vec4(1.f), isShadow);
 
 		if (!isShadow) {
@@ -373,21 +577,23 @@ double OpenGLRenderer::renderScene(const mat4& projection, const mat4& view, s_p
 		}
 
 		if (isShadow) {
-			glEnable(GL_CULL_FACE);
+			GLState::enable(GL_CULL_FACE);
 			if (st == +AnimationObjectType::quad || st == +AnimationObjectType::tri) {
-				glCullFace(GL_BACK);
+				GLState::cullFace(GL_BACK);
 			}
 			else {
-				glCullFace(GL_FRONT);
+				GLState::cullFace(GL_FRONT);
 			}
 		}
 
 
 
 
-		for (auto& shape : application.objects) {
+		for (size_t i = 0; i < application.objects.size(); i++) {
+			auto& shape = application.objects[i];
 			if (isShadow && shape.lightIndex != -1) continue;
 			if (st == +AnimationObjectType::model) continue;
+			if (!culling.isVisible(i)) continue;
 			if (shape.shapeType == st) {
 				int tex = long(shape.texture);
 				//jr.renderBatchWithOwnColor(shape.transform, shape.color, (GLuint)tex, isShadow);
@@ -399,9 +605,27 @@ double OpenGLRenderer::renderScene(const mat4& projection, const mat4& view, s_p
 	}
 
 	// Render all mesh shapes
-	for (auto& shape : application.objects) {
+	if (jr.useInstancing && !useIndirect) {
+		std::map<std::string, std::vector<const AnimationObject*>> meshShapes;
+		for (size_t i = 0; i < application.objects.size(); i++) {
+			auto& shape = application.objects[i];
+			if (isShadow && shape.lightIndex != -1) continue;
+			if (shape.shapeType != +AnimationObjectType::model) continue;
+			if (!culling.isVisible(i)) continue;
+			meshShapes[shape.meshName].push_back(&shape);
+		}
+
+		for (auto& mesh : meshShapes) {
+			jr.renderInstanced(jr.getMeshData(*mesh.second.front()), mesh.second, isShadow);
+		}
+	}
+
+	for (size_t i = 0; i < application.objects.size(); i++) {
+		auto& shape = application.objects[i];
+		if (jr.useInstancing || useIndirect) break;
 		if (isShadow && shape.lightIndex != -1) continue;
 		if (shape.shapeType != +AnimationObjectType::model) continue;
+		if (!culling.isVisible(i)) continue;
 		jr.beginBatchRender(shape, false, shape.color, isShadow);
 		int tex = long(shape.texture);
 		jr.renderBatchWithOwnColor(shape, isShadow);
@@ -410,11 +634,13 @@ double OpenGLRenderer::renderScene(const mat4& projection, const mat4& view, s_p
 
 	// Render all assignments
 	for (auto& assignment: application.assignments) {
+		if (!drawUntracked) break;
 		assignment->render(projection, view, framebuffer, isShadow);
 	}
 
 	// Render all GLTF stuff
-	if (application.gltf) {
+	if (application.gltf && !gltfQueued && drawUntracked) {
+		GPUScope scope("glTF");
 		GLTFRenderer::get().render(projection, view, application.gltf, framebuffer, isShadow);
 	}
 
@@ -426,8 +652,8 @@ double OpenGLRenderer::renderScene(const mat4& projection, const mat4& view, s_p
 		vec3 aimDir = glm::normalize(l.center - l.position);
 		mat4 lightTf = glm::translate(l.position) * glm::toMat4(glm::rotation(vec3(1.f, 0.f, 0.f), aimDir));
 		//shadowCam.viewproj = shadowCam.projection * shadowCam.view;
-		glEnable(GL_DEPTH_TEST);
-		glDepthFunc(GL_LESS);
+		GLState::enable(GL_DEPTH_TEST);
+		GLState::depthFunc(GL_LESS);
 		jr.renderLight(lightTf);
 		*/
 
@@ -442,6 +668,76 @@ double OpenGLRenderer::renderScene(const mat4& projection, const mat4& view, s_p
 	return getTime() - nowish;
 }
 
+void OpenGLRenderer::renderShadows()
+{
+	auto& cascades = ShadowCascades::get();
+	auto& culling = SceneCulling::get();
+
+	GLState::depthFunc(GL_LESS);
+	GLState::enable(GL_DEPTH_TEST);
+	GLState::enable(GL_CULL_FACE);
+	GLState::cullFace(GL_BACK);
+
+	// Each view gets its own part of the map; clearing one leaves the others alone
+	auto drawViews = [this, &cascades](s_ptr<Framebuffer> target, bool onlyStale) {
+		target->bind(GL_DRAW_FRAMEBUFFER, false);
+
+		for (auto& v : cascades.views) {
+			if (onlyStale && v.cached) continue;
+
+			glViewport(v.viewport.x, v.viewport.y, v.viewport.z, v.viewport.w);
+			if (onlyStale) {
+				GLState::enable(GL_SCISSOR_TEST);
+				glScissor(v.viewport.x, v.viewport.y, v.viewport.z, v.viewport.w);
+				glClear(GL_DEPTH_BUFFER_BIT);
+				GLState::disable(GL_SCISSOR_TEST);
+			}
+
+			renderScene(v.projection, v.view, target);
+		}
+	};
+
+	// The static map is as big as the shadow map, so it only exists while caching is on
+	if (!cascades.cacheStatic) {
+		staticShadowMap = nullptr;
+	}
+	else if (!staticShadowMap) {
+		staticShadowMap = std::make_shared<Framebuffer>(shadowMap->width, shadowMap->height, 0);
+		cascades.invalidate();
+	}
+
+	if (staticShadowMap) {
+		if (staticShadowMap->resolution != shadowMap->resolution) {
+			staticShadowMap->resize(shadowMap->resolution);
+			cascades.invalidate();
+		}
+
+		culling.casters = CasterSet::Static;
+		{
+			GPUScope scope("Static casters");
+			drawViews(staticShadowMap, true);
+		}
+		cascades.markCached();
+
+		// Start from the static depth rather than a clear
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, staticShadowMap->framebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadowMap->framebuffer);
+		glBlitFramebuffer(0, 0, shadowMap->width, shadowMap->height, 0, 0, shadowMap->width, shadowMap->height,
+			GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+		culling.casters = CasterSet::Dynamic;
+	}
+	else {
+		shadowMap->bind(GL_DRAW_FRAMEBUFFER);
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
+
+	drawViews(shadowMap, false);
+
+	culling.casters = CasterSet::All;
+}
+
 void OpenGLRenderer::renderUI()
 {
 	if (ImGui::CollapsingHeader(name.c_str()))
@@ -452,6 +748,7 @@ void OpenGLRenderer::renderUI()
 				for (auto& sm : AnimationObjectRenderer::get().shapeCatalog) {
 					sm.second.initShader();
 				}
+				IndirectRenderer::get().reloadShaders();
 			});
 		}
 
@@ -466,6 +763,20 @@ void OpenGLRenderer::renderUI()
 		ImGui::ColorEdit4("Clear color", glm::value_ptr(clearColor));
 
 		GPU::Lighting::get().renderUI(this);
+		GPU::LightClusters::get().renderUI();
+		ShadowCascades::get().renderUI();
+
+		if (ImGui::CollapsingHeader("Post-processing")) {
+			IMDENT;
+			for (auto& filter : filters) {
+				filter->renderUI();
+			}
+			IMDONT;
+		}
+
+		if (renderGraph) renderGraph->renderUI();
+		RenderTargetPool::get().renderUI();
+		ResourceRegistry::get().renderUI();
 
 		camera.renderUI();
 
@@ -504,6 +815,7 @@ void OpenGLRenderer::presentUI() {
 
 	glViewport(0, 0, display_w, display_h);
 	ImVec4 clear_color = { 0, 0, 0, 0 };
+	GPUScope scope("ImGui");
 	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
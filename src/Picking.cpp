@@ -0,0 +1,320 @@
+#include "Picking.h"
+
+#include "AnimationObjectRenderer.h"
+#include "Application.h"
+#include "Culling.h"
+#include "Framebuffer.h"
+#include "Renderer.h"
+#include "UIHelpers.h"
+
+#include "imgui.h"
+
+namespace {
+	// Slab test, returns the entry distance or -1 on a miss
+	float rayBox(const vec3& origin, const vec3& invDir, const Bounds& b, float maxT) {
+		vec3 t0 = (b.min - origin) * invDir;
+		vec3 t1 = (b.max - origin) * invDir;
+		vec3 tmin = glm::min(t0, t1);
+		vec3 tmax = glm::max(t0, t1);
+		float enter = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.f));
+		float exit = std::min(std::min(tmax.x, tmax.y), std::min(tmax.z, maxT));
+		return enter <= exit ? enter : -1.f;
+	}
+
+	// Möller-Trumbore, both faces
+	bool rayTriangle(const vec3& origin, const vec3& dir, const vec3& a, const vec3& b, const vec3& c, float& t) {
+		vec3 e1 = b - a;
+		vec3 e2 = c - a;
+		vec3 p = glm::cross(dir, e2);
+		float det = glm::dot(e1, p);
+		if (std::abs(det) < 1e-12f) return false;
+
+		float invDet = 1.f / det;
+		vec3 s = origin - a;
+		float u = glm::dot(s, p) * invDet;
+		if (u < 0.f || u > 1.f) return false;
+
+		vec3 q = glm::cross(s, e1);
+		float v = glm::dot(dir, q) * invDet;
+		if (v < 0.f || u + v > 1.f) return false;
+
+		t = glm::dot(e2, q) * invDet;
+		return t > 0.f;
+	}
+
+	// Prefers the center pixel, then whichever covered pixel is closest to it
+	bool pickFromRegion(const vec4* colors, const vec4* prims, ivec2 size, ivec2 center, vec4& color, vec4& prim) {
+		int best = -1;
+		int bestDistance = INT_MAX;
+
+		for (int y = 0; y < size.y; y++) {
+			for (int x = 0; x < size.x; x++) {
+				int i = y * size.x + x;
+				// frag_prim writes 1 to alpha, the clear leaves it at the clear color's
+				if (prims[i].w < 1.f) continue;
+
+				int distance = (x - center.x) * (x - center.x) + (y - center.y) * (y - center.y);
+				if (distance < bestDistance) {
+					bestDistance = distance;
+					best = i;
+				}
+			}
+		}
+
+		if (best == -1) return false;
+
+		color = colors[best];
+		prim = prims[best];
+		return true;
+	}
+}
+
+Picker& Picker::get()
+{
+	static Picker instance;
+	return instance;
+}
+
+uint64_t Picker::request(ivec2 pixel, ivec2 windowSize, bool click)
+{
+	stats.requests++;
+	uint64_t id = ++requestId;
+
+	if (method == +PickMethod::RayCast) {
+		latest = rayCast(pixel, windowSize);
+		latest.id = id;
+		latest.click = click;
+		if (click) latestClick = latest;
+		changed = true;
+		return id;
+	}
+
+	// Hovers only ever replace hovers, so a click can't be lost to the cursor moving on
+	Request& target = click ? pendingClick : pending;
+	bool& waiting = click ? hasClick : hasRequest;
+	if (waiting) stats.superseded++;
+
+	target.pixel = pixel;
+	target.windowSize = glm::max(windowSize, ivec2(1));
+	target.frame = frame;
+	target.id = id;
+	target.click = click;
+	waiting = true;
+	return id;
+}
+
+void Picker::readback(const Framebuffer& gbuffer)
+{
+	frame++;
+
+	if ((!hasRequest && !hasClick) || gbuffer.numTextures < 2) return;
+
+	// Clicks go first; whatever doesn't find a free slot waits for next frame
+	for (auto& slot : slots) {
+		if (slot.fence) continue;
+
+		if (hasClick) {
+			hasClick = false;
+			startReadback(gbuffer, slot, pendingClick);
+		}
+		else if (hasRequest) {
+			hasRequest = false;
+			startReadback(gbuffer, slot, pending);
+		}
+		else {
+			break;
+		}
+	}
+}
+
+void Picker::startReadback(const Framebuffer& gbuffer, Slot& slot, const Request& request)
+{
+	ivec2 resolution(gbuffer.width, gbuffer.height);
+	vec2 uv = glm::clamp(vec2(request.pixel) / vec2(request.windowSize), vec2(0.f), vec2(1.f));
+	ivec2 pixel = glm::min(ivec2(uv * vec2(resolution)), resolution - 1);
+
+	ivec2 r = ivec2(std::max(radius, 0));
+	ivec2 lo = glm::max(pixel - r, ivec2(0));
+	ivec2 hi = glm::min(pixel + r, resolution - 1);
+
+	slot.request = request;
+	slot.origin = lo;
+	slot.size = hi - lo + 1;
+	slot.center = pixel - lo;
+	slot.sequence = ++sequence;
+
+	GLsizeiptr regionBytes = sizeof(vec4) * slot.size.x * slot.size.y;
+
+	if (slot.pbo == 0) {
+		glGenBuffers(1, &slot.pbo);
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	glBufferData(GL_PIXEL_PACK_BUFFER, regionBytes * 2, nullptr, GL_STREAM_READ);
+
+	// Both copies go into the buffer; nothing waits for them here
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, gbuffer.framebuffer);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glReadPixels(lo.x, lo.y, slot.size.x, slot.size.y, GL_RGBA, GL_FLOAT, (GLvoid*)0);
+	glReadBuffer(GL_COLOR_ATTACHMENT1);
+	glReadPixels(lo.x, lo.y, slot.size.x, slot.size.y, GL_RGBA, GL_FLOAT, (GLvoid*)regionBytes);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	stats.readbacks++;
+}
+
+void Picker::resolve(Slot& slot)
+{
+	size_t count = (size_t)slot.size.x * slot.size.y;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	auto data = (const vec4*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(vec4) * count * 2, GL_MAP_READ_BIT);
+
+	// An older hover finishing after a newer pick is already stale; clicks always count
+	bool newest = slot.sequence > latestSequence;
+	if (data && (newest || slot.request.click)) {
+		PickResult result;
+		result.valid = true;
+		result.pixel = slot.request.pixel;
+		result.latency = (int)(frame - slot.request.frame);
+		result.id = slot.request.id;
+		result.click = slot.request.click;
+
+		vec4 color, prim;
+		if (pickFromRegion(data, data + count, slot.size, slot.center, color, prim)) {
+			result.color = color;
+			result.primitive = ivec4(prim);
+			result.objectIndex = result.primitive.x;
+		}
+
+		if (newest) {
+			latest = result;
+			latestSequence = slot.sequence;
+		}
+		if (result.click) latestClick = result;
+		changed = true;
+		stats.resolved++;
+	}
+
+	if (data) glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+bool Picker::poll()
+{
+	for (auto& slot : slots) {
+		if (!slot.fence) continue;
+
+		GLenum status = glClientWaitSync(slot.fence, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED) continue;
+
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+
+		if (status != GL_WAIT_FAILED) {
+			resolve(slot);
+		}
+	}
+
+	bool result = changed;
+	changed = false;
+	return result;
+}
+
+PickResult Picker::rayCast(ivec2 pixel, ivec2 windowSize)
+{
+	double start = getWallTime();
+	stats.rayCasts++;
+
+	PickResult result;
+	result.valid = true;
+	result.pixel = pixel;
+
+	auto renderer = Application::get().getRenderer<Renderer>();
+	if (!renderer) return result;
+
+	vec2 ndc = vec2(pixel) / vec2(glm::max(windowSize, ivec2(1))) * 2.f - 1.f;
+	mat4 inv = glm::inverse(renderer->camera.viewproj);
+	vec4 nearPoint = inv * vec4(ndc, -1.f, 1.f);
+	vec4 farPoint = inv * vec4(ndc, 1.f, 1.f);
+	vec3 origin = vec3(nearPoint) / nearPoint.w;
+	vec3 dir = vec3(farPoint) / farPoint.w - origin;
+	vec3 invDir = 1.f / dir;
+
+	auto& objects = Application::get().objects;
+	auto& culling = SceneCulling::get();
+	auto& jr = AnimationObjectRenderer::get();
+
+	// Boxes first, then triangles nearest box first, so most objects cost one slab test
+	std::vector<std::pair<float, size_t>> candidates;
+	for (size_t i = 0; i < objects.size(); i++) {
+		const auto& shape = objects[i];
+		if (!shape.selectable) continue;
+
+		Bounds bounds;
+		if (auto tracked = culling.getBounds(shape.index)) {
+			bounds = *tracked;
+		}
+		else {
+			const Bounds& local = jr.getLocalBounds(shape);
+			bounds = Bounds(local.min * shape.size, local.max * shape.size).transformed(shape.transform);
+		}
+
+		float t = rayBox(origin, invDir, bounds, 1.f);
+		if (t >= 0.f) candidates.push_back({ t, i });
+	}
+
+	std::sort(candidates.begin(), candidates.end());
+
+	// Ray parameters are along the near-to-far segment, the same in object space
+	float bestT = 1.f;
+	for (const auto& candidate : candidates) {
+		if (candidate.first > bestT) break;
+
+		const auto& shape = objects[candidate.second];
+		auto& renderData = jr.getRenderData(shape);
+		if (!renderData.vertexVBO || !renderData.indexVBO) continue;
+
+		mat4 toLocal = glm::inverse(shape.transform * glm::scale(vec3(shape.size)));
+		vec3 localOrigin = vec3(toLocal * vec4(origin, 1.f));
+		vec3 localDir = vec3(toLocal * vec4(dir, 0.f));
+
+		const auto& vertices = renderData.vertexVBO->data;
+		const auto& indices = renderData.indexVBO->data;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			float t;
+			if (rayTriangle(localOrigin, localDir, vertices[indices[i]].position, vertices[indices[i + 1]].position,
+				vertices[indices[i + 2]].position, t) && t < bestT) {
+				bestT = t;
+				result.objectIndex = shape.index;
+				result.primitive = ivec4(shape.index, 0, (int)(i / 3), 1);
+				result.color = shape.color;
+			}
+		}
+	}
+
+	stats.rayCastTime += getWallTime() - start;
+	return result;
+}
+
+void Picker::renderUI()
+{
+	if (ImGui::CollapsingHeader("Picking")) {
+		renderEnumButton<PickMethod>(method);
+		ImGui::SliderInt("Readback radius", &radius, 0, 8);
+
+		ImGui::Text("%d requests, %d readbacks, %d resolved, %d superseded", (int)stats.requests,
+			(int)stats.readbacks, (int)stats.resolved, (int)stats.superseded);
+		if (stats.rayCasts > 0) {
+			ImGui::Text("%d ray casts, %.3f ms average", (int)stats.rayCasts, stats.rayCastTime * 1000.0 / stats.rayCasts);
+		}
+
+		if (latest.valid) {
+			ImGui::Text("Last pick: object %d at %d, %d, %d frames late", latest.objectIndex,
+				latest.pixel.x, latest.pixel.y, latest.latency);
+		}
+	}
+}
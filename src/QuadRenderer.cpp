@@ -2,10 +2,12 @@
 
 #include "Application.h"
 #include "Camera.h"
+#include "GLStateCache.h"
 #include "Renderer.h"
 #include "Lighting.h"
 #include "Texture.h"
 #include "Framebuffer.h"
+#include "StreamBuffer.h"
 #include "StringUtil.h"
 #include "InputOutput.h"
 #include "Renderer.h"
@@ -33,7 +35,7 @@ bool QuadRenderData::initShader() {
 	shader = s_ptr<Shader>(new Shader(vertText, fragText));
 
 	if (!shader->init()) {
-		log("Unable to load LineRenderData shader!\n");
+		log("Unable to load QuadRenderData shader!\n");
 		return false;
 	}
 
@@ -44,20 +46,47 @@ bool QuadRenderData::initShader() {
 		glEnableVertexAttribArray(loc);
 		});
 
-	glBindVertexArray(vao);
+	auto addInstanceAttribute = [&binding](const std::string& name, size_t offset) {
+		binding.addVertexAttribute("vec4", name, [offset](GLint loc) {
+			QuadRenderer::get().getStream().bind();
+			glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), (const GLvoid*)(QuadRenderer::get().currentOffset + offset));
+			glEnableVertexAttribArray(loc);
+			glVertexAttribDivisor(loc, 1);
+			});
+	};
+
+	addInstanceAttribute("instancePosition", offsetof(QuadInstance, position));
+	addInstanceAttribute("instanceRotation", offsetof(QuadInstance, rotation));
+	addInstanceAttribute("instanceScale", offsetof(QuadInstance, scale));
+	addInstanceAttribute("instanceColor", offsetof(QuadInstance, color));
+	addInstanceAttribute("instanceUV", offsetof(QuadInstance, uvRect));
+
+	GLState::bindVertexArray(vao);
 	shader->bind(binding);
 	indexVBO->bind();
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 
 	return true;
 }
 
+QuadRenderer::QuadRenderer() { }
+
+QuadRenderer::~QuadRenderer() { }
+
 QuadRenderer& QuadRenderer::get()
 {
 	static QuadRenderer instance;
 	return instance;
 }
 
+StreamBuffer& QuadRenderer::getStream() {
+	if (!stream) {
+		stream = u_ptr<StreamBuffer>(new StreamBuffer("Quad instances", GL_ARRAY_BUFFER,
+			sizeof(QuadInstance) * 4096, sizeof(QuadInstance)));
+	}
+	return *stream;
+}
+
 bool QuadRenderer::init()
 {
 	renderData = std::make_shared<QuadRenderData>();
@@ -71,30 +100,12 @@ void QuadRenderer::beginBatch(bool showBackface, unsigned int textureID, bool al
 		if (!initialized) return;
 	}
 
-	glBindVertexArray(renderData->vao);
-	renderData->indexVBO->bind();
-	renderData->shader->start();
-	renderData->shader->binding.refreshUniforms();
+	queue.clear();
+	batchTexture = textureID;
+	batchBlend = allowBlend;
 
 	if (showBackface) {
-		glDisable(GL_CULL_FACE);
-	}
-
-	if (allowBlend) {
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	}
-
-	GLint utLoc = glGetUniformLocation(renderData->shader->program, "useTexture");
-	glActiveTexture(GL_TEXTURE0);
-	if (textureID) {
-		glUniform1i(utLoc, 1);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-	}
-	else {
-		glUniform1i(utLoc, 0);
-		auto ogl = std::dynamic_pointer_cast<OpenGLRenderer>(Application::get().renderer);
-		glBindTexture(GL_TEXTURE_2D, ogl->dummyInput->textures[0]->id);
+		GLState::disable(GL_CULL_FACE);
 	}
 
 	readyToRender = true;
@@ -103,43 +114,125 @@ void QuadRenderer::beginBatch(bool showBackface, unsigned int textureID, bool al
 void QuadRenderer::render(const vec3& position, const vec3& rotation, const vec3& scale, const vec4& color) {
 	if (!readyToRender) beginBatch();
 
+	Quad quad;
+	quad.position = position;
+	quad.rotation = quaternion(glm::radians(rotation));
+	quad.scale = scale;
+	quad.color = color;
+	add(quad, batchTexture);
+}
 
+void QuadRenderer::add(const Quad& quad, unsigned int textureID, GLenum target) {
+	if (!readyToRender) beginBatch();
 
-	mat4 quadPos = glm::translate(position);
-	mat4 quadRot = glm::toMat4(quaternion(glm::radians(rotation)));
-	mat4 quadScale = glm::scale(scale);
-
+	Queued q;
+	q.instance.position = vec4(quad.position, (float)quad.billboard._to_integral());
+	q.instance.rotation = vec4(quad.rotation.x, quad.rotation.y, quad.rotation.z, quad.rotation.w);
+	q.instance.scale = vec4(quad.scale, (float)quad.layer);
+	q.instance.color = quad.color;
+	q.instance.uvRect = quad.uvRect;
+	q.texture = textureID;
+	q.target = textureID ? target : GL_TEXTURE_2D;
+	queue.push_back(q);
+}
 
-	//auto rotation = glm::rotation(vec3(1.f, 0.f, 0.f), glm::normalize(diff));
+void QuadRenderer::flush() {
+	auto& frame = Application::get().frameCounter;
+	if (statsFrame != frame) {
+		lastFrameStats = frameStats;
+		frameStats = Stats();
+		statsFrame = frame;
+	}
 
-	mat4 model = quadPos * quadRot * quadScale;
+	if (queue.empty()) return;
 
+	// Runs of the same texture draw together; the queue order holds within each run
+	std::stable_sort(queue.begin(), queue.end(), [](const Queued& a, const Queued& b) {
+		return std::tie(a.target, a.texture) < std::tie(b.target, b.texture);
+	});
 
-	auto& cam = Application::get().getRenderer<OpenGLRenderer>()->camera;
+	sorted.resize(queue.size());
+	for (size_t i = 0; i < queue.size(); i++) sorted[i] = queue[i].instance;
 
-	mat4 viewproj = cam.viewproj;
+	auto& instances = getStream();
+	auto range = instances.allocate<QuadInstance>(sorted.size());
+	if (!range.data) return;
+	std::memcpy(range.data, sorted.data(), sizeof(QuadInstance) * sorted.size());
+	instances.commit(range);
 
-	mat4 mvp = viewproj * model;
+	auto& cam = Application::get().getRenderer<Renderer>()->camera;
+	auto& shader = renderData->shader;
 
-	auto mvpLoc = glGetUniformLocation(renderData->shader->program, "mvp");
-	if (mvpLoc != -1) {
-		glUniformMatrix4fv(mvpLoc, 1, false, glm::value_ptr(mvp));
+	GLState::bindVertexArray(renderData->vao);
+	renderData->indexVBO->bind();
+	shader->start();
+	shader->binding.refreshUniforms();
+
+	// Camera basis for billboards, the rows of the view rotation
+	vec3 cameraRight = vec3(cam.view[0][0], cam.view[1][0], cam.view[2][0]);
+	vec3 cameraUp = vec3(cam.view[0][1], cam.view[1][1], cam.view[2][1]);
+
+	glUniformMatrix4fv(shader->uniform("vp"), 1, GL_FALSE, glm::value_ptr(cam.viewproj));
+	glUniform3fv(shader->uniform("cameraRight"), 1, glm::value_ptr(cameraRight));
+	glUniform3fv(shader->uniform("cameraUp"), 1, glm::value_ptr(cameraUp));
+	glUniform3fv(shader->uniform("cameraPosition"), 1, glm::value_ptr(cam.Position));
+	glUniform4fv(shader->uniform("globalColor"), 1, glm::value_ptr(globalColor));
+
+	// 2D and array textures sample from their own units, so neither sampler is ever left
+	// pointing at a unit holding the other kind
+	glUniform1i(shader->uniform("quadTexture"), 0);
+	glUniform1i(shader->uniform("quadTextureArray"), 1);
+
+	if (batchBlend) {
+		GLState::enable(GL_BLEND);
+		GLState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	}
 
-	auto colorLoc = glGetUniformLocation(renderData->shader->program, "color");
-	if (colorLoc != -1) {
-		glUniform4fv(colorLoc, 1, glm::value_ptr(color));
+	GLint utLoc = shader->uniform("useTexture");
+	GLint uaLoc = shader->uniform("useTextureArray");
+	GLsizei indexCount = (GLsizei)renderData->indexVBO->data.size();
+
+	size_t begin = 0;
+	while (begin < queue.size()) {
+		size_t end = begin;
+		while (end < queue.size() && queue[end].texture == queue[begin].texture && queue[end].target == queue[begin].target) end++;
+
+		GLuint texture = queue[begin].texture;
+		bool isArray = queue[begin].target == GL_TEXTURE_2D_ARRAY;
+
+		glUniform1i(utLoc, texture && !isArray);
+		glUniform1i(uaLoc, texture && isArray);
+		GLState::activeTexture(isArray ? GL_TEXTURE1 : GL_TEXTURE0);
+		GLState::bindTexture(isArray ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, texture);
+
+		// Point the instance attributes at this run
+		currentOffset = range.offset + (GLintptr)(sizeof(QuadInstance) * begin);
+		shader->binding.refresh();
+
+		glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (const GLvoid*)0, (GLsizei)(end - begin));
+		frameStats.draws++;
+
+		begin = end;
 	}
 
-	glDrawElements(GL_TRIANGLES, renderData->indexVBO->data.size(), GL_UNSIGNED_INT, (const GLvoid*)0);
+	frameStats.quads += queue.size();
+
+	GLState::activeTexture(GL_TEXTURE1);
+	GLState::bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	GLState::activeTexture(GL_TEXTURE0);
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+
+	shader->stop();
+	GLState::bindVertexArray(0);
 }
 
 void QuadRenderer::endBatch() {
-	glBindTexture(GL_TEXTURE_2D, 0);
-	renderData->shader->stop();
-	glBindVertexArray(0);
+	if (!readyToRender) return;
+
+	flush();
+	queue.clear();
 
-	glDisable(GL_BLEND);
+	GLState::disable(GL_BLEND);
 
 	readyToRender = false;
 }
@@ -148,6 +241,7 @@ void QuadRenderer::renderUI() {
 	if (ImGui::CollapsingHeader("QuadRenderer")) {
 		ImGui::ColorEdit4("Global color", glm::value_ptr(globalColor));
 		ImGui::InputFloat("Global width", &globalWidth);
+		ImGui::Text("Last frame: %d quads in %d draws", (int)lastFrameStats.quads, (int)lastFrameStats.draws);
 	}
 }
 
@@ -187,52 +281,52 @@ bool InstanceQuadRenderData::initShader() {
 		});
 
 	binding.addVertexAttribute("vec4", "m0", [this](GLint loc) {
-		InstanceQuadRenderer::get().currentParticles->bind();
-		glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleRenderData), (const GLvoid*)offsetof(ParticleRenderData, transform));
+		glBindBuffer(GL_ARRAY_BUFFER, InstanceQuadRenderer::get().currentBuffer);
+		glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleRenderData), (const GLvoid*)(InstanceQuadRenderer::get().currentOffset + offsetof(ParticleRenderData, transform)));
 		glEnableVertexAttribArray(loc);
 		glVertexAttribDivisor(loc, 1);
 		});
 
 	binding.addVertexAttribute("vec4", "m1", [this](GLint loc) {
-		InstanceQuadRenderer::get().currentParticles->bind();
-		glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleRenderData), (const GLvoid*)(offsetof(ParticleRenderData, transform) + sizeof(vec4)));
+		glBindBuffer(GL_ARRAY_BUFFER, InstanceQuadRenderer::get().currentBuffer);
+		glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleRenderData), (const GLvoid*)(InstanceQuadRenderer::get().currentOffset + offsetof(ParticleRenderData, transform) + sizeof(vec4)));
 		glEnableVertexAttribArray(loc);
 		glVertexAttribDivisor(loc, 1);
 		});
 
 	binding.addVertexAttribute("vec4", "m2", [this](GLint loc) {
-		InstanceQuadRenderer::get().currentParticles->bind();
-		glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleRenderData), (const GLvoid*)(offsetof(ParticleRenderData, transform) + sizeof(vec4) * 2));
+		glBindBuffer(GL_ARRAY_BUFFER, InstanceQuadRenderer::get().currentBuffer);
+		glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleRenderData), (const GLvoid*)(InstanceQuadRenderer::get().currentOffset + offsetof(ParticleRenderData, transform) + sizeof(vec4) * 2));
 		glEnableVertexAttribArray(loc);
 		glVertexAttribDivisor(loc, 1);
 		});
 
 	binding.addVertexAttribute("vec4", "m3", [this](GLint loc) {
-		InstanceQuadRenderer::get().currentParticles->bind();
-		glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleRenderData), (const GLvoid*)(offsetof(ParticleRenderData, transform) + sizeof(vec4) * 3));
+		glBindBuffer(GL_ARRAY_BUFFER, InstanceQuadRenderer::get().currentBuffer);
+		glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleRenderData), (const GLvoid*)(InstanceQuadRenderer::get().currentOffset + offsetof(ParticleRenderData, transform) + sizeof(vec4) * 3));
 		glEnableVertexAttribArray(loc);
 		glVertexAttribDivisor(loc, 1);
 		});
 
 
 	binding.addVertexAttribute("vec4", "color", [this](GLint loc) {
-		InstanceQuadRenderer::get().currentParticles->bind();
-		glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleRenderData), (const GLvoid*)offsetof(ParticleRenderData, color));
+		glBindBuffer(GL_ARRAY_BUFFER, InstanceQuadRenderer::get().currentBuffer);
+		glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleRenderData), (const GLvoid*)(InstanceQuadRenderer::get().currentOffset + offsetof(ParticleRenderData, color)));
 		glEnableVertexAttribArray(loc);
 		glVertexAttribDivisor(loc, 1);
 		});
 
 	binding.addVertexAttribute("vec4", "data", [this](GLint loc) {
-		InstanceQuadRenderer::get().currentParticles->bind();
-		glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleRenderData), (const GLvoid*)offsetof(ParticleRenderData, data));
+		glBindBuffer(GL_ARRAY_BUFFER, InstanceQuadRenderer::get().currentBuffer);
+		glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleRenderData), (const GLvoid*)(InstanceQuadRenderer::get().currentOffset + offsetof(ParticleRenderData, data)));
 		glEnableVertexAttribArray(loc);
 		glVertexAttribDivisor(loc, 1);
 		});
 
-	glBindVertexArray(vao);
+	GLState::bindVertexArray(vao);
 	shader->bind(binding);
 	indexVBO->bind();
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 
 	return true;
 }
@@ -240,11 +334,6 @@ bool InstanceQuadRenderData::initShader() {
 InstanceQuadRenderer& InstanceQuadRenderer::get()
 {
 	static InstanceQuadRenderer instance;
-	static int didItOnce = [&]() {
-		std::vector<ParticleRenderData> prd(1000, { mat4(1.f), vec4(1.f), vec4(0.f) });
-		instance.currentParticles = spVectorBuffer<ParticleRenderData>(new VectorBuffer<ParticleRenderData>(GL_ARRAY_BUFFER, prd, GL_DYNAMIC_DRAW));
-		return 1;
-		}();
 	return instance;
 }
 
@@ -256,8 +345,10 @@ bool InstanceQuadRenderer::init()
 
 void InstanceQuadRenderer::beginBatch(ParticleSystem* ps, bool showBackface, unsigned int textureID, bool allowBlend) {
 
-	currentParticles = ps->renderData;
-	currentParticleCount = ps->maxParticles;
+	// Set before init so the attributes first point at a real buffer
+	currentBuffer = ps->renderStream->getBuffer();
+	currentOffset = ps->renderRange.offset;
+	currentParticleCount = ps->renderCount;
 
 	if (!initialized) {
 		initialized = init();
@@ -265,30 +356,30 @@ void InstanceQuadRenderer::beginBatch(ParticleSystem* ps, bool showBackface, uns
 		if (!initialized) return;
 	}
 
-	glBindVertexArray(renderData->vao);
+	GLState::bindVertexArray(renderData->vao);
 	renderData->indexVBO->bind();
 	renderData->shader->start();
 	renderData->shader->binding.refresh();
 
 	if (showBackface) {
-		glDisable(GL_CULL_FACE);
+		GLState::disable(GL_CULL_FACE);
 	}
 
 	if (allowBlend) {
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		GLState::enable(GL_BLEND);
+		GLState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	}
 
-	GLint utLoc = glGetUniformLocation(renderData->shader->program, "useTexture");
-	glActiveTexture(GL_TEXTURE0);
+	GLint utLoc = renderData->shader->uniform("useTexture");
+	GLState::activeTexture(GL_TEXTURE0);
 	if (textureID) {
 		glUniform1i(utLoc, 1);
-		glBindTexture(GL_TEXTURE_2D, textureID);
+		GLState::bindTexture(GL_TEXTURE_2D, textureID);
 	}
 	else {
 		glUniform1i(utLoc, 0);
 		auto ogl = std::dynamic_pointer_cast<OpenGLRenderer>(Application::get().renderer);
-		glBindTexture(GL_TEXTURE_2D, ogl->dummyInput->textures[0]->id);
+		GLState::bindTexture(GL_TEXTURE_2D, ogl->dummyInput->textures[0]->id);
 	}
 
 	readyToRender = true;
@@ -297,21 +388,21 @@ void InstanceQuadRenderer::beginBatch(ParticleSystem* ps, bool showBackface, uns
 void InstanceQuadRenderer::render(const vec4& mainColor, const vec4 uvOffset) {
 	if (!readyToRender) return;
 
-	auto& cam = Application::get().getRenderer<OpenGLRenderer>()->camera;
+	auto& cam = Application::get().getRenderer<Renderer>()->camera;
 
 	mat4 viewproj = cam.viewproj;
 
-	auto mvpLoc = glGetUniformLocation(renderData->shader->program, "vp");
+	auto mvpLoc = renderData->shader->uniform("vp");
 	if (mvpLoc != -1) {
 		glUniformMatrix4fv(mvpLoc, 1, false, glm::value_ptr(viewproj));
 	}
 
-	auto mcLoc = glGetUniformLocation(renderData->shader->program, "mainColor");
+	auto mcLoc = renderData->shader->uniform("mainColor");
 	if (mcLoc != -1) {
 		glUniform4fv(mcLoc, 1, glm::value_ptr(mainColor));
 	}
 
-	glUniform4fv(glGetUniformLocation(renderData->shader->program, "uvOffset"), 1, glm::value_ptr(uvOffset));
+	glUniform4fv(renderData->shader->uniform("uvOffset"), 1, glm::value_ptr(uvOffset));
 
 	//glDrawElements(GL_TRIANGLES, renderData->indexVBO->data.size(), GL_UNSIGNED_INT, (const GLvoid*)0);
 	glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)renderData->indexVBO->data.size(), GL_UNSIGNED_INT,
@@ -319,11 +410,11 @@ void InstanceQuadRenderer::render(const vec4& mainColor, const vec4 uvOffset) {
 }
 
 void InstanceQuadRenderer::endBatch() {
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
 	renderData->shader->stop();
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 
-	glDisable(GL_BLEND);
+	GLState::disable(GL_BLEND);
 
 	readyToRender = false;
 }
@@ -0,0 +1,313 @@
+#include "RenderGraph.h"
+
+#include "GPUProfiler.h"
+#include "UIHelpers.h"
+
+#include "imgui.h"
+
+#include <algorithm>
+#include <set>
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::read(Resource resource)
+{
+	if (resource == None) return *this;
+	graph.passes[pass].reads.push_back(resource);
+	graph.resources[resource].readers.push_back(pass);
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::write(Resource resource)
+{
+	if (resource == None) return *this;
+	graph.passes[pass].writes.push_back(resource);
+	graph.resources[resource].writers.push_back(pass);
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::sideEffect()
+{
+	graph.passes[pass].sideEffect = true;
+	return *this;
+}
+
+void RenderGraph::reset()
+{
+	resources.clear();
+	passes.clear();
+	order.clear();
+	currentPass = -1;
+	compiled = false;
+}
+
+RenderGraph::Resource RenderGraph::importTexture(const std::string& name, GLuint texture, const ivec2& size, bool output)
+{
+	ResourceNode node;
+	node.name = name;
+	node.desc.size = size;
+	node.imported = true;
+	node.output = output;
+	node.texture = texture;
+	resources.push_back(node);
+	return (Resource)resources.size() - 1;
+}
+
+RenderGraph::Resource RenderGraph::createTexture(const std::string& name, const TextureDesc& desc)
+{
+	ResourceNode node;
+	node.name = name;
+	node.desc = desc;
+	resources.push_back(node);
+	return (Resource)resources.size() - 1;
+}
+
+void RenderGraph::markOutput(Resource resource)
+{
+	if (resource != None) resources[resource].output = true;
+}
+
+RenderGraph::PassBuilder RenderGraph::addPass(const std::string& name, ExecuteFunc execute)
+{
+	PassNode node;
+	node.name = name;
+	node.execute = execute;
+	passes.push_back(node);
+	return PassBuilder(*this, passes.size() - 1);
+}
+
+bool RenderGraph::compile()
+{
+	double start = getWallTime();
+
+	bool sorted = sortPasses();
+	cullPasses();
+	placeTransients();
+
+	compiled = true;
+	stats.compileTime = getWallTime() - start;
+	return sorted;
+}
+
+bool RenderGraph::sortPasses()
+{
+	// Every writer of a resource comes before its readers, and writers keep the order they
+	// were added in
+	std::vector<std::set<size_t>> after(passes.size());
+	std::vector<int> incoming(passes.size(), 0);
+
+	auto addEdge = [&](size_t from, size_t to) {
+		if (from != to && after[from].insert(to).second) incoming[to]++;
+	};
+
+	for (const auto& r : resources) {
+		for (size_t w = 0; w < r.writers.size(); w++) {
+			if (w > 0) addEdge(r.writers[w - 1], r.writers[w]);
+			for (size_t reader : r.readers) {
+				addEdge(r.writers[w], reader);
+			}
+		}
+	}
+
+	// Kahn's algorithm, taking the earliest added pass that's ready so an already valid
+	// order comes out unchanged
+	std::set<size_t> ready;
+	for (size_t i = 0; i < passes.size(); i++) {
+		if (incoming[i] == 0) ready.insert(i);
+	}
+
+	order.clear();
+	while (!ready.empty()) {
+		size_t pass = *ready.begin();
+		ready.erase(ready.begin());
+		order.push_back(pass);
+
+		for (size_t next : after[pass]) {
+			if (--incoming[next] == 0) ready.insert(next);
+		}
+	}
+
+	if (order.size() != passes.size()) {
+		log("RenderGraph: passes depend on each other in a cycle, running them in the order added\n");
+		order.clear();
+		for (size_t i = 0; i < passes.size(); i++) order.push_back(i);
+		return false;
+	}
+
+	return true;
+}
+
+void RenderGraph::cullPasses()
+{
+	std::vector<size_t> needed;
+	for (size_t i = 0; i < passes.size(); i++) {
+		auto& pass = passes[i];
+		pass.culled = !pass.sideEffect;
+		for (Resource w : pass.writes) {
+			if (resources[w].output) pass.culled = false;
+		}
+		if (!pass.culled) needed.push_back(i);
+	}
+
+	// Whatever a kept pass reads keeps its writers
+	while (!needed.empty()) {
+		size_t pass = needed.back();
+		needed.pop_back();
+
+		for (Resource r : passes[pass].reads) {
+			for (size_t writer : resources[r].writers) {
+				if (passes[writer].culled) {
+					passes[writer].culled = false;
+					needed.push_back(writer);
+				}
+			}
+		}
+	}
+
+	stats.passes = passes.size();
+	stats.culled = 0;
+	for (const auto& pass : passes) {
+		if (pass.culled) stats.culled++;
+	}
+}
+
+void RenderGraph::placeTransients()
+{
+	for (auto& r : resources) {
+		r.first = r.last = -1;
+		if (!r.imported) r.texture = 0;
+	}
+
+	for (int i = 0; i < (int)order.size(); i++) {
+		const auto& pass = passes[order[i]];
+		if (pass.culled) continue;
+
+		auto use = [this, i](Resource resource) {
+			auto& r = resources[resource];
+			if (r.first == -1) r.first = i;
+			r.last = i;
+		};
+		for (Resource r : pass.reads) use(r);
+		for (Resource r : pass.writes) use(r);
+	}
+
+	auto& pool = RenderTargetPool::get();
+
+	stats.transients = 0;
+	stats.bytes = 0;
+	stats.unaliasedBytes = 0;
+
+	std::set<GLuint> used;
+
+	// Acquired at first use, released after last use, so a later transient can take the
+	// same texture. Released textures stay in the pool for the next frame.
+	for (int i = 0; i < (int)order.size(); i++) {
+		for (auto& r : resources) {
+			if (r.imported || r.first != i) continue;
+
+			r.texture = pool.acquire(r.desc);
+			stats.transients++;
+			stats.unaliasedBytes += r.desc.bytes();
+			if (used.insert(r.texture).second) stats.bytes += r.desc.bytes();
+		}
+
+		for (auto& r : resources) {
+			if (!r.imported && r.last == i) pool.release(r.texture);
+		}
+	}
+
+	stats.texturesUsed = used.size();
+}
+
+void RenderGraph::execute()
+{
+	if (!compiled) compile();
+
+	for (size_t i : order) {
+		auto& pass = passes[i];
+		if (pass.culled || !pass.execute) continue;
+
+		currentPass = (int)i;
+		GPUScope scope(pass.name);
+		pass.execute(*this);
+	}
+
+	currentPass = -1;
+}
+
+GLuint RenderGraph::getTexture(Resource resource) const
+{
+	return resource == None ? 0 : resources[resource].texture;
+}
+
+ivec2 RenderGraph::getSize(Resource resource) const
+{
+	return resource == None ? ivec2(0) : resources[resource].desc.size;
+}
+
+const std::string& RenderGraph::getName(Resource resource) const
+{
+	static const std::string none = "None";
+	return resource == None ? none : resources[resource].name;
+}
+
+GLuint RenderGraph::getFramebuffer(const std::vector<Resource>& attachments)
+{
+	std::vector<GLuint> colors;
+	GLuint depth = 0;
+	for (Resource r : attachments) {
+		if (resources[r].imported && resources[r].texture == 0) return 0;
+		if (resources[r].desc.isDepth()) depth = resources[r].texture;
+		else colors.push_back(resources[r].texture);
+	}
+
+	return RenderTargetPool::get().getFramebuffer(colors, depth);
+}
+
+void RenderGraph::bindTargets()
+{
+	if (currentPass < 0) return;
+
+	const auto& writes = passes[currentPass].writes;
+	if (writes.empty()) return;
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, getFramebuffer(writes));
+
+	ivec2 size = getSize(writes.front());
+	glViewport(0, 0, size.x, size.y);
+}
+
+void RenderGraph::renderUI()
+{
+	if (ImGui::CollapsingHeader("Render graph")) {
+		IMDENT;
+
+		ImGui::Text("Passes: %zu (%zu culled)", stats.passes, stats.culled);
+		ImGui::Text("Transients: %zu in %zu textures", stats.transients, stats.texturesUsed);
+		ImGui::Text("Transient memory: %.1f MB (%.1f MB without aliasing)",
+			stats.bytes / (1024.0 * 1024.0), stats.unaliasedBytes / (1024.0 * 1024.0));
+		ImGui::Text("Compile: %.3f ms", stats.compileTime * 1000.0);
+
+		auto names = [this](const std::vector<Resource>& list) {
+			std::string text;
+			for (Resource r : list) {
+				text += text.empty() ? getName(r) : ", " + getName(r);
+			}
+			return text.empty() ? std::string("-") : text;
+		};
+
+		for (size_t i : order) {
+			const auto& pass = passes[i];
+			ImGui::Text("%s%s", pass.name.c_str(), pass.culled ? " (culled)" : "");
+			IMDENT;
+			ImGui::TextDisabled("Reads: %s", names(pass.reads).c_str());
+			ImGui::TextDisabled("Writes: %s", names(pass.writes).c_str());
+			IMDONT;
+		}
+
+		for (const auto& r : resources) {
+			if (r.imported || r.first == -1) continue;
+			ImGui::Text("%s: texture %u, passes %d-%d", r.name.c_str(), r.texture, r.first, r.last);
+		}
+
+		IMDONT;
+	}
+}
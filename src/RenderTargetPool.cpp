@@ -0,0 +1,252 @@
+#include "RenderTargetPool.h"
+
+#include "GLStateCache.h"
+#include "ResourceRegistry.h"
+#include "Texture.h"
+#include "UIHelpers.h"
+
+#include "imgui.h"
+
+#include <algorithm>
+
+RenderTargetPool& RenderTargetPool::get()
+{
+	// Never destroyed: the context is gone by the time statics are
+	static RenderTargetPool* instance = new RenderTargetPool();
+	return *instance;
+}
+
+RenderTargetPool::Desc RenderTargetPool::Desc::fromMode(GBufferMode mode, const ivec2& size, int samples)
+{
+	const auto& description = Texture::textureDescriptions[mode];
+
+	Desc desc;
+	desc.size = size;
+	desc.internalFormat = (GLenum)description.internalFormat;
+	desc.format = description.pixelDataFormat;
+	desc.type = description.pixelDataType;
+	desc.samples = samples;
+	return desc;
+}
+
+size_t RenderTargetPool::Desc::bytes() const
+{
+	return (size_t)size.x * (size_t)size.y * ResourceRegistry::texelSize(internalFormat) * (size_t)std::max(samples, 1);
+}
+
+RenderTargetPool::Entry* RenderTargetPool::find(GLuint texture)
+{
+	for (auto& e : entries) {
+		if (e.texture == texture) return &e;
+	}
+	return nullptr;
+}
+
+const RenderTargetPool::Desc* RenderTargetPool::describe(GLuint texture) const
+{
+	for (const auto& e : entries) {
+		if (e.texture == texture) return &e.desc;
+	}
+	return nullptr;
+}
+
+GLuint RenderTargetPool::acquire(const Desc& desc)
+{
+	// The most recently used match, so the others can age out
+	Entry* best = nullptr;
+	for (auto& e : entries) {
+		if (e.inUse || !(e.desc == desc)) continue;
+		if (!best || e.lastUsedFrame > best->lastUsedFrame) best = &e;
+	}
+
+	if (best) {
+		best->inUse = true;
+		best->lastUsedFrame = frame;
+		stats.reused++;
+		updateStats();
+		return best->texture;
+	}
+
+	Entry e;
+	e.desc = desc;
+	e.inUse = true;
+	e.lastUsedFrame = frame;
+
+	GLenum target = desc.target();
+	glGenTextures(1, &e.texture);
+	GLState::bindTexture(target, e.texture);
+
+	if (desc.samples > 1) {
+		glTexImage2DMultisample(target, desc.samples, desc.internalFormat, desc.size.x, desc.size.y, GL_TRUE);
+	}
+	else {
+		glTexImage2D(target, 0, desc.internalFormat, desc.size.x, desc.size.y, 0, desc.format, desc.type, nullptr);
+
+		// Integer formats can't be filtered
+		GLenum filter = desc.format == GL_RGBA_INTEGER ? GL_NEAREST : GL_LINEAR;
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, filter);
+		glTexParameteri(target, GL_TEXTURE_MAG_FILTER, filter);
+		glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+
+	GLState::bindTexture(target, 0);
+
+	e.memoryHandle = ResourceRegistry::get().add(ResourceCategory::RenderTarget,
+		fmt::format("Render target {0}x{1}", desc.size.x, desc.size.y), desc.bytes());
+
+	entries.push_back(e);
+	stats.created++;
+	updateStats();
+	return e.texture;
+}
+
+void RenderTargetPool::release(GLuint texture)
+{
+	if (auto e = find(texture)) {
+		e->inUse = false;
+		e->lastUsedFrame = frame;
+	}
+	updateStats();
+}
+
+GLuint RenderTargetPool::getFramebuffer(const std::vector<GLuint>& colors, GLuint depth)
+{
+	std::vector<GLuint> key = colors;
+	if (depth) key.push_back(depth);
+
+	auto cached = framebuffers.find(key);
+	if (cached != framebuffers.end()) return cached->second;
+
+	GLuint fbo = 0;
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+
+	std::vector<GLenum> drawBuffers;
+	for (size_t i = 0; i < colors.size(); i++) {
+		auto desc = describe(colors[i]);
+		GLenum target = desc ? desc->target() : GL_TEXTURE_2D;
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + (GLenum)i, target, colors[i], 0);
+		drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + (GLenum)i);
+	}
+
+	if (depth) {
+		auto desc = describe(depth);
+		GLenum target = desc ? desc->target() : GL_TEXTURE_2D;
+		GLenum attachment = desc && desc->format == GL_DEPTH_STENCIL ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, attachment, target, depth, 0);
+	}
+
+	if (drawBuffers.empty()) {
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+	else {
+		glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+	}
+
+	GLenum status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		log("RenderTargetPool: framebuffer is incomplete ({0:x})\n", status);
+	}
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+	framebuffers[key] = fbo;
+	updateStats();
+	return fbo;
+}
+
+void RenderTargetPool::endFrame()
+{
+	frame++;
+
+	PendingDelete evicted;
+	entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const Entry& e) {
+		if (e.inUse || frame - e.lastUsedFrame <= keepFrames) return false;
+		evicted.textures.push_back(e.texture);
+		evicted.memoryHandles.push_back(e.memoryHandle);
+		return true;
+	}), entries.end());
+
+	for (GLuint texture : evicted.textures) {
+		for (auto it = framebuffers.begin(); it != framebuffers.end();) {
+			if (std::find(it->first.begin(), it->first.end(), texture) != it->first.end()) {
+				evicted.framebuffers.push_back(it->second);
+				it = framebuffers.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+	}
+
+	if (!evicted.textures.empty()) {
+		stats.evicted += evicted.textures.size();
+		evicted.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		pending.push_back(evicted);
+	}
+
+	deletePending();
+	updateStats();
+}
+
+void RenderTargetPool::deletePending()
+{
+	pending.erase(std::remove_if(pending.begin(), pending.end(), [](PendingDelete& p) {
+		// Polls, never waits
+		GLenum status = glClientWaitSync(p.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return false;
+
+		glDeleteSync(p.fence);
+		if (!p.framebuffers.empty()) glDeleteFramebuffers((GLsizei)p.framebuffers.size(), p.framebuffers.data());
+		for (GLuint texture : p.textures) {
+			glDeleteTextures(1, &texture);
+			GLState::forgetTexture(texture);
+		}
+		for (auto handle : p.memoryHandles) {
+			ResourceRegistry::get().remove(handle);
+		}
+		return true;
+	}), pending.end());
+}
+
+void RenderTargetPool::updateStats()
+{
+	stats.textures = entries.size();
+	stats.framebuffers = framebuffers.size();
+	stats.pendingDeletes = 0;
+	for (const auto& p : pending) stats.pendingDeletes += p.textures.size();
+
+	stats.inUse = 0;
+	stats.bytes = 0;
+	stats.bytesInUse = 0;
+	for (const auto& e : entries) {
+		size_t bytes = e.desc.bytes();
+		stats.bytes += bytes;
+		if (e.inUse) {
+			stats.inUse++;
+			stats.bytesInUse += bytes;
+		}
+	}
+}
+
+void RenderTargetPool::renderUI()
+{
+	if (ImGui::CollapsingHeader("Render target pool")) {
+		IMDENT;
+
+		ImGui::Text("Textures: %zu (%zu in use), framebuffers: %zu", stats.textures, stats.inUse, stats.framebuffers);
+		ImGui::Text("Memory: %.1f MB (%.1f MB in use)", stats.bytes / (1024.0 * 1024.0), stats.bytesInUse / (1024.0 * 1024.0));
+		ImGui::Text("Created: %zu, reused: %zu, evicted: %zu, awaiting delete: %zu",
+			stats.created, stats.reused, stats.evicted, stats.pendingDeletes);
+		ImGui::SliderInt("Keep unused textures (frames)", &keepFrames, 0, 600);
+
+		for (const auto& e : entries) {
+			ImGui::TextDisabled("%u: %dx%d, format 0x%x, %d samples, %.1f MB%s", e.texture, e.desc.size.x, e.desc.size.y,
+				e.desc.internalFormat, e.desc.samples, e.desc.bytes() / (1024.0 * 1024.0), e.inUse ? ", in use" : "");
+		}
+
+		IMDONT;
+	}
+}
@@ -0,0 +1,222 @@
+#include "ResourceRegistry.h"
+
+#include "UIHelpers.h"
+
+#include "imgui.h"
+#include "implot.h"
+
+namespace {
+	double toMB(size_t bytes) {
+		return bytes / (1024.0 * 1024.0);
+	}
+
+	std::string siteName(const char* file, int line) {
+		std::string path = file ? file : "?";
+		size_t slash = path.find_last_of("/\\");
+		if (slash != std::string::npos) path = path.substr(slash + 1);
+		return fmt::format("{0}:{1}", path, line);
+	}
+}
+
+ResourceRegistry& ResourceRegistry::get()
+{
+	// Never destroyed, resources owned by other statics are still removing themselves at exit
+	static ResourceRegistry* instance = new ResourceRegistry();
+	return *instance;
+}
+
+size_t ResourceRegistry::texelSize(GLenum internalFormat)
+{
+	switch (internalFormat) {
+	case GL_RGBA32F: case GL_RGBA32I: case GL_RGBA32UI: return 16;
+	case GL_RGB32F: case GL_RGB32I: case GL_RGB32UI: return 12;
+	case GL_RGBA16F: case GL_RG32F: case GL_DEPTH32F_STENCIL8: return 8;
+	case GL_RGB16F: return 6;
+	case GL_RG16F: case GL_R32F: case GL_R32I: case GL_R32UI: return 4;
+	case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32F: case GL_DEPTH24_STENCIL8: return 4;
+	case GL_R16F: case GL_RG8: case GL_RG: case GL_DEPTH_COMPONENT16: return 2;
+	case GL_R8: case GL_RED: return 1;
+	// Three channel formats are usually padded to four
+	case GL_RGB: case GL_RGB8: case GL_RGBA: case GL_RGBA8: return 4;
+	default: return 4;
+	}
+}
+
+void ResourceRegistry::adjust(const Entry& entry, int64_t gpu, int64_t cpu)
+{
+	auto apply = [gpu, cpu](Totals& t) {
+		t.gpu = (size_t)std::max<int64_t>(0, (int64_t)t.gpu + gpu);
+		t.cpu = (size_t)std::max<int64_t>(0, (int64_t)t.cpu + cpu);
+		t.peakGPU = std::max(t.peakGPU, t.gpu);
+		t.peakCPU = std::max(t.peakCPU, t.cpu);
+	};
+
+	apply(categories[entry.category._to_index()]);
+	apply(all);
+}
+
+ResourceRegistry::Handle ResourceRegistry::add(ResourceCategory category, const std::string& name, size_t gpuBytes, size_t cpuBytes,
+	const char* file, int line)
+{
+	Entry entry;
+	entry.category = category;
+	entry.name = name;
+	entry.site = siteName(file, line);
+	entry.gpu = gpuBytes;
+	entry.cpu = cpuBytes;
+
+	categories[category._to_index()].count++;
+	all.count++;
+	adjust(entry, (int64_t)gpuBytes, (int64_t)cpuBytes);
+
+	Handle handle = next++;
+	entries[handle] = entry;
+	return handle;
+}
+
+void ResourceRegistry::update(Handle handle, size_t gpuBytes, size_t cpuBytes)
+{
+	auto it = entries.find(handle);
+	if (it == entries.end()) return;
+
+	auto& entry = it->second;
+	adjust(entry, (int64_t)gpuBytes - (int64_t)entry.gpu, (int64_t)cpuBytes - (int64_t)entry.cpu);
+	entry.gpu = gpuBytes;
+	entry.cpu = cpuBytes;
+}
+
+void ResourceRegistry::remove(Handle handle)
+{
+	auto it = entries.find(handle);
+	if (it == entries.end()) return;
+
+	const auto& entry = it->second;
+	adjust(entry, -(int64_t)entry.gpu, -(int64_t)entry.cpu);
+	categories[entry.category._to_index()].count--;
+	all.count--;
+
+	entries.erase(it);
+}
+
+void ResourceRegistry::endFrame()
+{
+	auto sample = [](std::vector<float>& values, size_t bytes) {
+		values.push_back((float)toMB(bytes));
+		if (values.size() > HistoryLength) values.erase(values.begin());
+	};
+
+	for (size_t c = 0; c < ResourceCategory::_size(); c++) {
+		sample(history[c], categories[c].gpu);
+	}
+	sample(totalHistory, all.gpu);
+
+	bool over = budgetMB > 0 && toMB(all.gpu) > budgetMB;
+	if (over && !overBudget) {
+		std::string largest;
+		size_t largestBytes = 0;
+		for (size_t c = 0; c < ResourceCategory::_size(); c++) {
+			if (categories[c].gpu > largestBytes) {
+				largestBytes = categories[c].gpu;
+				largest = ResourceCategory::_from_index(c)._to_string();
+			}
+		}
+		log("Warning: GPU memory {0:.1f} MB is over the {1} MB budget, most of it in {2} ({3:.1f} MB)\n",
+			toMB(all.gpu), budgetMB, largest, toMB(largestBytes));
+	}
+	overBudget = over;
+}
+
+void ResourceRegistry::renderUI()
+{
+	if (ImGui::CollapsingHeader("Memory")) {
+		IMDENT;
+
+		auto totalText = fmt::format("GPU: {0:.1f} MB (peak {1:.1f} MB), CPU: {2:.1f} MB (peak {3:.1f} MB), {4} resources",
+			toMB(all.gpu), toMB(all.peakGPU), toMB(all.cpu), toMB(all.peakCPU), all.count);
+		if (overBudget) {
+			ImGui::TextColored(ImVec4(1.f, 0.3f, 0.3f, 1.f), "%s, over budget", totalText.c_str());
+		}
+		else {
+			ImGui::Text("%s", totalText.c_str());
+		}
+
+		ImGui::InputInt("Budget (MB, 0 for none)", &budgetMB);
+		budgetMB = std::max(budgetMB, 0);
+
+		if (ImGui::BeginTable("Categories", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+			ImGui::TableSetupColumn("Category");
+			ImGui::TableSetupColumn("Count");
+			ImGui::TableSetupColumn("GPU MB");
+			ImGui::TableSetupColumn("GPU peak");
+			ImGui::TableSetupColumn("CPU MB");
+			ImGui::TableSetupColumn("CPU peak");
+			ImGui::TableHeadersRow();
+
+			for (size_t c = 0; c < ResourceCategory::_size(); c++) {
+				const auto& t = categories[c];
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn(); ImGui::Text("%s", ResourceCategory::_from_index(c)._to_string());
+				ImGui::TableNextColumn(); ImGui::Text("%zu", t.count);
+				ImGui::TableNextColumn(); ImGui::Text("%.1f", toMB(t.gpu));
+				ImGui::TableNextColumn(); ImGui::Text("%.1f", toMB(t.peakGPU));
+				ImGui::TableNextColumn(); ImGui::Text("%.1f", toMB(t.cpu));
+				ImGui::TableNextColumn(); ImGui::Text("%.1f", toMB(t.peakCPU));
+			}
+
+			ImGui::EndTable();
+		}
+
+		if (ImPlot::BeginPlot("GPU memory (MB)", ImVec2(-1, 200))) {
+			ImPlot::SetupAxes("Frame", "MB", ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
+
+			ImPlot::PlotLine("Total", totalHistory.data(), (int)totalHistory.size());
+			for (size_t c = 0; c < ResourceCategory::_size(); c++) {
+				if (history[c].empty()) continue;
+				ImPlot::PlotLine(ResourceCategory::_from_index(c)._to_string(), history[c].data(), (int)history[c].size());
+			}
+
+			ImPlot::EndPlot();
+		}
+
+		if (ImGui::TreeNode("Call sites")) {
+			struct Site {
+				size_t count = 0;
+				size_t gpu = 0, cpu = 0;
+			};
+
+			std::map<std::string, Site> sites;
+			for (const auto& e : entries) {
+				auto& site = sites[e.second.site];
+				site.count++;
+				site.gpu += e.second.gpu;
+				site.cpu += e.second.cpu;
+			}
+
+			std::vector<std::pair<std::string, Site>> sorted(sites.begin(), sites.end());
+			std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second.gpu > b.second.gpu; });
+
+			for (const auto& site : sorted) {
+				ImGui::Text("%s: %zu, GPU %.2f MB, CPU %.2f MB", site.first.c_str(), site.second.count,
+					toMB(site.second.gpu), toMB(site.second.cpu));
+			}
+
+			ImGui::TreePop();
+		}
+
+		if (ImGui::TreeNode("Largest resources")) {
+			std::vector<const Entry*> sorted;
+			for (const auto& e : entries) sorted.push_back(&e.second);
+			std::sort(sorted.begin(), sorted.end(), [](const Entry* a, const Entry* b) { return a->gpu > b->gpu; });
+
+			for (size_t i = 0; i < sorted.size() && i < 32; i++) {
+				const auto& e = *sorted[i];
+				ImGui::Text("%s %s: GPU %.2f MB, CPU %.2f MB (%s)", e.category._to_string(), e.name.c_str(),
+					toMB(e.gpu), toMB(e.cpu), e.site.c_str());
+			}
+
+			ImGui::TreePop();
+		}
+
+		IMDONT;
+	}
+}
@@ -0,0 +1,483 @@
+#include "SceneFile.h"
+
+namespace SceneFile
+{
+	const char Magic[8] = { '4', '4', '8', '0', 'S', 'C', 'N', '\0' };
+
+	// Flattened AnimationObject. Plain floats instead of glm types so the layout doesn't
+	// depend on glm's alignment settings.
+	struct ObjectRecord {
+		int32_t index;
+		int32_t shapeType;
+		int32_t lightIndex;
+		int32_t assetIndex;
+		int32_t forwardDirection;
+		uint32_t flags;
+		float size;
+		float color[4];
+		float localPosition[3];
+		float localRotation[3];
+		float localScale[3];
+		float localPivot[3];
+		float orbitRotation[3];
+		float constantRotation[3];
+	};
+
+	static_assert(sizeof(ObjectRecord) == 7 * 4 + 4 * 4 + 6 * 3 * 4, "ObjectRecord must not contain padding");
+	static_assert(sizeof(Track) == 7 * 4, "Track must not contain padding");
+
+	enum ObjectFlags : uint32_t {
+		Visible = 1 << 0,
+		Selectable = 1 << 1,
+		UseLighting = 1 << 2,
+		CullFace = 1 << 3,
+		Billboard = 1 << 4,
+		VertexTransform = 1 << 5,
+		FragmentTransform = 1 << 6,
+		Occluder = 1 << 7,
+	};
+
+	struct ChunkHeader {
+		uint32_t id = 0;
+		uint32_t version = 0;
+		uint64_t size = 0;
+	};
+
+	template<typename T>
+	void writePod(std::ostream& out, const T& value) {
+		out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template<typename T>
+	bool readPod(std::istream& in, T& value) {
+		return (bool)in.read(reinterpret_cast<char*>(&value), sizeof(T));
+	}
+
+	void writeString(std::ostream& out, const std::string& s) {
+		writePod(out, (uint32_t)s.size());
+		out.write(s.data(), s.size());
+	}
+
+	// Fails rather than allocating when the stored length runs past the end of the chunk
+	bool readString(std::istream& in, std::string& s, std::streampos end) {
+		uint32_t length = 0;
+		if (!readPod(in, length)) return false;
+		if ((std::streamoff)length > end - in.tellg()) {
+			in.setstate(std::ios::failbit);
+			return false;
+		}
+		s.resize(length);
+		return length == 0 || (bool)in.read(&s[0], length);
+	}
+
+	// Chunk payloads are built in memory first so the size field is known up front
+	void writeChunk(std::ostream& out, uint32_t id, const std::string& payload) {
+		writePod(out, id);
+		writePod(out, Version);
+		writePod(out, (uint64_t)payload.size());
+		out.write(payload.data(), payload.size());
+	}
+
+	template<int L>
+	void copyOut(float* dst, const glm::vec<L, float>& v) {
+		for (int i = 0; i < L; i++) dst[i] = v[i];
+	}
+
+	template<int L>
+	void copyIn(glm::vec<L, float>& v, const float* src) {
+		for (int i = 0; i < L; i++) v[i] = src[i];
+	}
+
+	bool isSceneFile(const std::string& filename) {
+		static const std::string json = ".json";
+		std::string name = StringUtil::lower(filename);
+		return name.size() < json.size() || name.compare(name.size() - json.size(), json.size(), json) != 0;
+	}
+
+	bool save(const std::string& filename, const Config& config, const std::vector<AnimationObject>& objects,
+		const std::vector<Track>& tracks, Stats* stats) {
+		double started = getWallTime();
+
+		std::ofstream fout(filename, std::ios::binary);
+		if (!fout) {
+			log("{0}: unable to write file at {1}\n", __FUNCTION__, filename);
+			return false;
+		}
+
+		// Asset table: every distinct mesh name is stored once
+		string_vector assets;
+		std::unordered_map<std::string, int32_t> assetSlots;
+
+		// Object index -> slot, used to flatten parent links
+		std::unordered_map<int, int32_t> objectSlots;
+		objectSlots.reserve(objects.size());
+
+		std::vector<ObjectRecord> records(objects.size());
+		for (size_t i = 0; i < objects.size(); i++) {
+			const auto& o = objects[i];
+			auto& r = records[i];
+			objectSlots[o.index] = (int32_t)i;
+
+			r.index = o.index;
+			r.shapeType = o.shapeType._to_integral();
+			r.lightIndex = o.lightIndex;
+			r.forwardDirection = o.forwardDirection._to_integral();
+			r.size = o.size;
+			r.assetIndex = -1;
+
+			if (!o.meshName.empty()) {
+				auto found = assetSlots.find(o.meshName);
+				if (found == assetSlots.end()) {
+					found = assetSlots.emplace(o.meshName, (int32_t)assets.size()).first;
+					assets.push_back(o.meshName);
+				}
+				r.assetIndex = found->second;
+			}
+
+			r.flags = (o.visible ? Visible : 0) | (o.selectable ? Selectable : 0) | (o.useLighting ? UseLighting : 0)
+				| (o.cullFace ? CullFace : 0) | (o.billboard ? Billboard : 0)
+				| (o.useVertexTransform ? VertexTransform : 0) | (o.useFragmentTransform ? FragmentTransform : 0)
+				| (o.occluder ? Occluder : 0);
+
+			copyOut(r.color, o.color);
+			copyOut(r.localPosition, o.localPosition);
+			copyOut(r.localRotation, o.localRotation);
+			copyOut(r.localScale, o.localScale);
+			copyOut(r.localPivot, o.localPivot);
+			copyOut(r.orbitRotation, o.orbitRotation);
+			copyOut(r.constantRotation, o.constantRotation);
+		}
+
+		// Parent slots, -1 for roots
+		std::vector<int32_t> parents(objects.size(), -1);
+		for (size_t i = 0; i < objects.size(); i++) {
+			const auto& o = objects[i];
+			int parentIndex = o.parent ? o.parent->index : o.parentIndex;
+			if (parentIndex < 0) continue;
+
+			auto found = objectSlots.find(parentIndex);
+			if (found != objectSlots.end() && found->second != (int32_t)i) {
+				parents[i] = found->second;
+			}
+		}
+
+		std::ostringstream conf(std::ios::binary);
+		writePod(conf, config.numFrames);
+		writePod(conf, config.fps);
+		writeString(conf, config.name);
+
+		std::ostringstream asst(std::ios::binary);
+		writePod(asst, (uint32_t)assets.size());
+		for (auto& a : assets) {
+			writeString(asst, a);
+		}
+
+		std::ostringstream objs(std::ios::binary);
+		writePod(objs, (uint32_t)records.size());
+		objs.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(ObjectRecord));
+
+		std::ostringstream hier(std::ios::binary);
+		writePod(hier, (uint32_t)parents.size());
+		hier.write(reinterpret_cast<const char*>(parents.data()), parents.size() * sizeof(int32_t));
+
+		std::ostringstream trak(std::ios::binary);
+		writePod(trak, (uint32_t)tracks.size());
+		trak.write(reinterpret_cast<const char*>(tracks.data()), tracks.size() * sizeof(Track));
+
+		fout.write(Magic, sizeof(Magic));
+		writePod(fout, Version);
+		writePod(fout, (uint32_t)5);
+		writeChunk(fout, ConfigChunk, conf.str());
+		writeChunk(fout, AssetChunk, asst.str());
+		writeChunk(fout, ObjectChunk, objs.str());
+		writeChunk(fout, HierarchyChunk, hier.str());
+		writeChunk(fout, TrackChunk, trak.str());
+
+		if (!fout) {
+			log("{0}: error while writing {1}\n", __FUNCTION__, filename);
+			return false;
+		}
+
+		if (stats) {
+			stats->bytes = (size_t)fout.tellp();
+			stats->objects = objects.size();
+			stats->tracks = tracks.size();
+			stats->seconds = getWallTime() - started;
+		}
+
+		return true;
+	}
+
+	bool load(const std::string& filename, Config& config, std::vector<AnimationObject>& objects,
+		std::vector<Track>& tracks, Stats* stats) {
+		double started = getWallTime();
+
+		std::ifstream fin(filename, std::ios::binary);
+		if (!fin) {
+			log("{0}: file not found at {1}\n", __FUNCTION__, filename);
+			return false;
+		}
+
+		fin.seekg(0, std::ios::end);
+		std::streampos fileEnd = fin.tellg();
+		fin.seekg(0, std::ios::beg);
+
+		char magic[sizeof(Magic)];
+		uint32_t version = 0, numChunks = 0;
+		fin.read(magic, sizeof(magic));
+		readPod(fin, version);
+		readPod(fin, numChunks);
+
+		if (!fin || memcmp(magic, Magic, sizeof(Magic)) != 0) {
+			log("{0}: {1} is not a scene file\n", __FUNCTION__, filename);
+			return false;
+		}
+
+		if (version > Version) {
+			log("{0}: {1} is version {2}, but only up to version {3} is supported\n", __FUNCTION__, filename, version, Version);
+			return false;
+		}
+
+		string_vector assets;
+		std::vector<ObjectRecord> records;
+		std::vector<int32_t> parents;
+		std::vector<Track> fileTracks;
+
+		for (uint32_t c = 0; c < numChunks; c++) {
+			ChunkHeader chunk;
+			if (!readPod(fin, chunk.id) || !readPod(fin, chunk.version) || !readPod(fin, chunk.size)) {
+				log("{0}: {1} is truncated\n", __FUNCTION__, filename);
+				return false;
+			}
+
+			if (chunk.size > (uint64_t)(fileEnd - fin.tellg())) {
+				log("{0}: {1} is truncated\n", __FUNCTION__, filename);
+				return false;
+			}
+
+			auto chunkEnd = fin.tellg() + (std::streamoff)chunk.size;
+			uint32_t count = 0;
+
+			// Counts come from the file, so check them against what's left of the chunk before
+			// sizing anything by them
+			auto readCount = [&](size_t elementSize) {
+				if (!readPod(fin, count)) return false;
+				if ((uint64_t)count * elementSize > (uint64_t)(chunkEnd - fin.tellg())) {
+					log("{0}: chunk {1} in {2} claims {3} entries but is only {4} bytes\n",
+						__FUNCTION__, chunk.id, filename, count, chunk.size);
+					return false;
+				}
+				return true;
+			};
+
+			switch (chunk.id) {
+			case ConfigChunk:
+				readPod(fin, config.numFrames);
+				readPod(fin, config.fps);
+				readString(fin, config.name, chunkEnd);
+				break;
+			case AssetChunk:
+				// Every string has at least its length in front of it
+				if (!readCount(sizeof(uint32_t))) return false;
+				assets.resize(count);
+				for (auto& a : assets) {
+					if (!readString(fin, a, chunkEnd)) break;
+				}
+				break;
+			case ObjectChunk:
+				if (!readCount(sizeof(ObjectRecord))) return false;
+				records.resize(count);
+				fin.read(reinterpret_cast<char*>(records.data()), count * sizeof(ObjectRecord));
+				break;
+			case HierarchyChunk:
+				if (!readCount(sizeof(int32_t))) return false;
+				parents.resize(count);
+				fin.read(reinterpret_cast<char*>(parents.data()), count * sizeof(int32_t));
+				break;
+			case TrackChunk:
+				if (!readCount(sizeof(Track))) return false;
+				fileTracks.resize(count);
+				fin.read(reinterpret_cast<char*>(fileTracks.data()), count * sizeof(Track));
+				break;
+			default:
+				break;
+			}
+
+			if (!fin) {
+				log("{0}: {1} is truncated\n", __FUNCTION__, filename);
+				return false;
+			}
+
+			// Always land on the next chunk, even if this one was unknown or only partially read
+			fin.seekg(chunkEnd);
+		}
+
+		// Reject the file before touching the scene if a record names a type this build doesn't have
+		for (size_t i = 0; i < records.size(); i++) {
+			const auto& r = records[i];
+			if (!AnimationObjectType::_from_integral_nothrow(r.shapeType) || !Axis::_from_integral_nothrow(r.forwardDirection)) {
+				log("{0}: object {1} in {2} has unknown shape type {3} or forward direction {4}\n",
+					__FUNCTION__, i, filename, r.shapeType, r.forwardDirection);
+				return false;
+			}
+		}
+
+		// Reserve first: parent pointers below point into this vector
+		objects.clear();
+		objects.reserve(records.size());
+
+		int maxIndex = AnimationObject::ObjectIndex;
+
+		for (const auto& r : records) {
+			objects.emplace_back();
+			auto& o = objects.back();
+
+			o.index = r.index;
+			o.shapeType = AnimationObjectType::_from_integral_unchecked(r.shapeType);
+			o.lightIndex = r.lightIndex;
+			o.forwardDirection = Axis::_from_integral_unchecked(r.forwardDirection);
+			o.size = r.size;
+
+			if (r.assetIndex >= 0 && r.assetIndex < (int32_t)assets.size()) {
+				o.meshName = assets[r.assetIndex];
+			}
+
+			o.visible = r.flags & Visible;
+			o.selectable = r.flags & Selectable;
+			o.useLighting = r.flags & UseLighting;
+			o.cullFace = r.flags & CullFace;
+			o.billboard = r.flags & Billboard;
+			o.occluder = r.flags & Occluder;
+			o.useVertexTransform = r.flags & VertexTransform;
+			o.useFragmentTransform = r.flags & FragmentTransform;
+
+			copyIn(o.color, r.color);
+			copyIn(o.localPosition, r.localPosition);
+			copyIn(o.localRotation, r.localRotation);
+			copyIn(o.localScale, r.localScale);
+			copyIn(o.localPivot, r.localPivot);
+			copyIn(o.orbitRotation, r.orbitRotation);
+			copyIn(o.constantRotation, r.constantRotation);
+
+			maxIndex = std::max(maxIndex, r.index + 1);
+		}
+
+		// Keep new objects from reusing indices that came from the file
+		AnimationObject::ObjectIndex = maxIndex;
+
+		for (size_t i = 0; i < parents.size() && i < objects.size(); i++) {
+			int32_t p = parents[i];
+			if (p >= 0 && p < (int32_t)objects.size() && p != (int32_t)i) {
+				objects[i].parent = &objects[p];
+				objects[i].parentIndex = objects[p].index;
+			}
+		}
+
+		for (auto& o : objects) {
+			o.transformUpdatedThisFrame = false;
+		}
+
+		for (auto& o : objects) {
+			o.updateMatrix();
+		}
+
+		tracks.clear();
+		tracks.reserve(fileTracks.size());
+		for (const auto& t : fileTracks) {
+			if (t.objectSlot >= 0 && t.objectSlot < (int32_t)objects.size()) {
+				tracks.push_back(t);
+			}
+		}
+
+		if (stats) {
+			stats->bytes = (size_t)fin.tellg();
+			stats->objects = objects.size();
+			stats->tracks = tracks.size();
+			stats->seconds = getWallTime() - started;
+		}
+
+		return true;
+	}
+
+	bool saveJSON(const std::string& filename, const Config& config, const std::vector<AnimationObject>& objects,
+		const json& interpolations) {
+		json saveData;
+		auto& configData = saveData["config"];
+		configData["name"] = config.name;
+		configData["numFrames"] = config.numFrames;
+		configData["FPS"] = config.fps;
+
+		auto& objectData = saveData["objects"];
+		for (auto& obj : objects) {
+			objectData.push_back(obj);
+		}
+
+		saveData["interpolations"] = interpolations;
+
+		std::ofstream fout(filename);
+		if (!fout) {
+			log("{0}: unable to write file at {1}\n", __FUNCTION__, filename);
+			return false;
+		}
+
+		fout << saveData.dump(4) << std::endl;
+		return true;
+	}
+
+	bool loadJSON(const std::string& filename, Config& config, std::vector<AnimationObject>& objects,
+		json& interpolations) {
+		std::ifstream fin(filename);
+		if (!fin) {
+			log("{0}: file not found at {1}\n", __FUNCTION__, filename);
+			return false;
+		}
+
+		json loadData;
+		try {
+			fin >> loadData;
+		}
+		catch (json::parse_error pe) {
+			log("{0}: {1}\n", __FUNCTION__, pe.what());
+			return false;
+		}
+
+		try {
+			auto& configData = loadData["config"];
+			configData.at("numFrames").get_to(config.numFrames);
+			configData.at("FPS").get_to(config.fps);
+		}
+		catch (json::type_error te) {
+			log("{0}\n", te.what());
+		}
+		catch (json::out_of_range oor) {
+			log("{0}\n", oor.what());
+		}
+
+		objects.clear();
+
+		// Reserve up front so parent and interpolation pointers stay valid
+		auto& objectData = loadData["objects"];
+		objects.reserve(objectData.size());
+
+		std::unordered_map<int, int> slots;
+		for (auto& js : objectData) {
+			objects.push_back(js);
+			slots[objects.back().index] = (int)objects.size() - 1;
+		}
+
+		// parentIndex is already set from the file, so link directly instead of going through setParent
+		for (auto& object : objects) {
+			auto slot = slots.find(object.parentIndex);
+			if (slot != slots.end() && object.parent == nullptr && &objects[slot->second] != &object) {
+				object.parent = &objects[slot->second];
+			}
+		}
+
+		for (auto& object : objects) {
+			object.updateMatrix();
+		}
+
+		interpolations = loadData["interpolations"];
+		return true;
+	}
+}
@@ -1,5 +1,7 @@
 #include "Shader.h"
 #include "InputOutput.h"
+#include "Lighting.h"
+#include "ShaderCache.h"
 
 #include <algorithm>
 #include <iostream>
@@ -10,11 +12,23 @@
 std::string Shader::Version = "#version 130";
 std::string Shader::VersionMacro = "__VERSION__";
 std::string Shader::Path = IO::assetPath("shaders/");
+
+const std::map<std::string, GLuint> Shader::UniformBlockBindings = {
+	{ "LightData", GPU_LIGHT_BINDING_SPOT },
+	{ "FrameBlock", GPU_FRAME_BINDING_SPOT },
+	{ "JointBlock", GPU_JOINT_BINDING_SPOT }
+};
+
+const std::map<std::string, GLint> Shader::SamplerBindings = {
+	{ "clusterGrid", GPU_CLUSTER_GRID_UNIT },
+	{ "clusterIndices", GPU_CLUSTER_INDEX_UNIT },
+	{ "clusterLights", GPU_CLUSTER_LIGHT_UNIT }
+};
 //std::string Shader::Path = "./shaders";
 
-bool Shader::GLshader::compile()
+void Shader::GLshader::beginCompile()
 {
-	if (text == "") return false;
+	if (text == "") return;
 
 	const char* shaderTextC = text.c_str();
 	int shaderLength = (int)text.length();
@@ -24,6 +38,11 @@ bool Shader::GLshader::compile()
 	glShaderSource(name, 1, &shaderTextC, &shaderLength);
 
 	glCompileShader(name);
+}
+
+bool Shader::GLshader::finishCompile()
+{
+	if (name == 0) return false;
 
 	int didCompile;
 	glGetShaderiv(name, GL_COMPILE_STATUS, &didCompile);
@@ -207,7 +226,7 @@ Shader::Shader(const std::string& src, ShaderType sType)
 	}
 }
 
-bool Shader::init(bool recompile, std::vector<ShaderFragOutputBindings> fragBindings)
+bool Shader::beginInit(bool recompile, const std::vector<ShaderFragOutputBindings>& fragBindings)
 {
 	if (program)
 	{
@@ -217,17 +236,22 @@ bool Shader::init(bool recompile, std::vector<ShaderFragOutputBindings> fragBind
 
 	program = glCreateProgram();
 
+	auto& cache = ShaderCache::get();
+	cacheKey = cache.key(*this, fragBindings);
+	fromCache = cache.load(program, cacheKey);
+
+	if (fromCache) return true;
+
+	double start = getWallTime();
+
+	// Start every stage before waiting on any, so a parallel compiler can overlap them
 	for (auto& shader : shaders)
 	{
-		if (shader.second.compile())
+		shader.second.beginCompile();
+		if (shader.second.name != 0)
 		{
 			glAttachShader(program, shader.second.name);
 		}
-		else
-		{
-			log("Error: {0} {1} failed to compile\n", shader.first._to_string(), shader.second.name);
-			return false;
-		}
 	}
 
 	if (!xfbParams.empty())
@@ -240,6 +264,7 @@ bool Shader::init(bool recompile, std::vector<ShaderFragOutputBindings> fragBind
 		}
 
 		glTransformFeedbackVaryings(program, (GLsizei)xfbParams.size(), feedbackParams, GL_INTERLEAVED_ATTRIBS);
+		delete[] feedbackParams;
 	}
 
 	// Call bindings before linking
@@ -247,13 +272,62 @@ bool Shader::init(bool recompile, std::vector<ShaderFragOutputBindings> fragBind
 		glBindFragDataLocation(program, fb.colorNumber, fb.name);
 	}
 
+	for (size_t i = 0; i < attributeLocations.size(); i++) {
+		glBindAttribLocation(program, (GLuint)i, attributeLocations[i].c_str());
+	}
+
+	if (cache.enabled && (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary))
+	{
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	// Linking after a failed compile just fails too, finishInit reports the compile
+	glLinkProgram(program);
+
+	cache.stats.compileTime += getWallTime() - start;
+
+	return true;
+}
+
+bool Shader::finishInit()
+{
+	if (!program) return false;
+
+	if (fromCache)
+	{
+		reflectUniforms();
+		bindUniformBlocks();
+		bindSamplers();
+		return true;
+	}
+
+	double start = getWallTime();
+
+	bool compiled = true;
+	for (auto& shader : shaders)
+	{
+		if (!shader.second.finishCompile())
+		{
+			log("Error: {0} {1} failed to compile\n", shader.first._to_string(), shader.second.name);
+			compiled = false;
+		}
+	}
+
 	// Make sure we can link!
-	if (!link())
+	bool linked = compiled && checkLink();
+
+	ShaderCache::get().stats.compileTime += getWallTime() - start;
+
+	if (!compiled) return false;
+
+	if (!linked)
 	{
 		log("Unable to link shader!\n");
 		return false;
 	}
 
+	ShaderCache::get().store(program, cacheKey);
+
 	return true;
 }
 
@@ -304,6 +378,11 @@ bool Shader::link()
 {
 	// Make sure we can link!
 	glLinkProgram(program);
+	return checkLink();
+}
+
+bool Shader::checkLink()
+{
 	GLint link_ok = GL_FALSE;
 	glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
 
@@ -321,9 +400,77 @@ bool Shader::link()
 		return false;
 	}
 
+	reflectUniforms();
+	bindUniformBlocks();
+	bindSamplers();
+
 	return true;
 }
 
+void Shader::reflectUniforms()
+{
+	uniformTable.clear();
+
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	std::vector<GLchar> nameBuffer((size_t)maxLength + 1);
+
+	for (GLint i = 0; i < count; i++)
+	{
+		GLsizei length = 0;
+		UniformInfo info;
+		glGetActiveUniform(program, (GLuint)i, maxLength, &length, &info.size, &info.type, nameBuffer.data());
+		info.name = std::string(nameBuffer.data(), length);
+
+		// Block members have no location of their own
+		info.location = glGetUniformLocation(program, info.name.c_str());
+		if (info.location == -1) continue;
+
+		uniformTable[HashName(info.name.c_str())] = info;
+
+		auto bracket = info.name.find('[');
+		if (bracket != std::string::npos)
+		{
+			UniformInfo base = info;
+			base.name = info.name.substr(0, bracket);
+			uniformTable[HashName(base.name.c_str())] = base;
+		}
+	}
+}
+
+void Shader::bindUniformBlocks()
+{
+	for (const auto& block : UniformBlockBindings)
+	{
+		GLuint index = glGetUniformBlockIndex(program, block.first.c_str());
+		if (index != GL_INVALID_INDEX)
+		{
+			glUniformBlockBinding(program, index, block.second);
+		}
+	}
+}
+
+void Shader::bindSamplers()
+{
+	bool started = false;
+	for (const auto& sampler : SamplerBindings)
+	{
+		GLint location = uniform(sampler.first.c_str());
+		if (location == -1) continue;
+
+		if (!started)
+		{
+			start();
+			started = true;
+		}
+		glUniform1i(location, sampler.second);
+	}
+
+	if (started) stop();
+}
+
 void Shader::destroy(bool clearGLshaders)
 {
 	stop();
@@ -345,7 +492,9 @@ void Shader::destroy(bool clearGLshaders)
 
 	binding.clear();
 	linkLog.clear();
+	uniformTable.clear();
 
+	GLState::forgetProgram(program);
 	glDeleteProgram(program);
 	program = 0;
 }
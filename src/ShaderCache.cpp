@@ -0,0 +1,244 @@
+#include "ShaderCache.h"
+
+#include "InputOutput.h"
+#include "UIHelpers.h"
+
+#include "imgui.h"
+
+#include <cstdio>
+
+namespace {
+	const uint32_t FileMagic = 0x43505352; // "RSPC"
+
+	struct FileHeader {
+		uint32_t magic;
+		uint32_t format;
+		uint64_t key;
+		uint64_t length;
+	};
+
+	uint64_t hashBytes(const void* data, size_t length, uint64_t hash) {
+		const uint8_t* bytes = (const uint8_t*)data;
+		for (size_t i = 0; i < length; i++) {
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	uint64_t hashString(const std::string& s, uint64_t hash) {
+		// Length first, so neighbouring strings can't trade characters
+		uint64_t length = s.size();
+		hash = hashBytes(&length, sizeof(length), hash);
+		return hashBytes(s.data(), s.size(), hash);
+	}
+
+	std::string glString(GLenum name) {
+		auto s = glGetString(name);
+		return s ? std::string((const char*)s) : std::string();
+	}
+}
+
+ShaderCache& ShaderCache::get()
+{
+	static ShaderCache instance;
+	return instance;
+}
+
+void ShaderCache::init()
+{
+	if (initialized) return;
+	initialized = true;
+
+	driver = glString(GL_VENDOR) + "|" + glString(GL_RENDERER) + "|" + glString(GL_VERSION);
+	directory = IO::joinPath(IO::getAssetRoot(), "shadercache");
+
+	GLint formats = 0;
+	if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary) {
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	}
+	supported = formats > 0;
+
+	// 0xFFFFFFFF lets the driver pick the thread count
+	if (GLEW_KHR_parallel_shader_compile) {
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		parallel = true;
+	}
+	else if (GLEW_ARB_parallel_shader_compile) {
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+		parallel = true;
+	}
+
+	if (supported) IO::createPath(directory);
+
+	log("Shader cache: program binaries {0}, parallel compile {1}\n",
+		supported ? "supported" : "unsupported", parallel ? "on" : "off");
+}
+
+uint64_t ShaderCache::key(const Shader& shader, const std::vector<ShaderFragOutputBindings>& fragBindings) const
+{
+	uint64_t hash = 14695981039346656037ull;
+	hash = hashString(driver, hash);
+
+	for (const auto& stage : shader.shaders) {
+		GLenum type = stage.first._to_integral();
+		hash = hashBytes(&type, sizeof(type), hash);
+		hash = hashString(stage.second.text, hash);
+	}
+
+	for (const auto& param : shader.xfbParams) {
+		hash = hashString(param.second, hash);
+	}
+
+	for (const auto& attribute : shader.attributeLocations) {
+		hash = hashString(attribute, hash);
+	}
+
+	for (const auto& binding : fragBindings) {
+		hash = hashBytes(&binding.colorNumber, sizeof(binding.colorNumber), hash);
+		hash = hashString(binding.name, hash);
+	}
+
+	return hash;
+}
+
+std::string ShaderCache::filename(uint64_t key) const
+{
+	return IO::joinPath(directory, fmt::format("{0:016x}.bin", key));
+}
+
+bool ShaderCache::read(uint64_t key, Binary& binary) const
+{
+	std::ifstream file(filename(key), std::ios::binary);
+	if (!file) return false;
+
+	FileHeader header;
+	if (!file.read((char*)&header, sizeof(header))) return false;
+	if (header.magic != FileMagic || header.key != key || header.length == 0) return false;
+
+	binary.format = header.format;
+	binary.data.resize(header.length);
+	return (bool)file.read((char*)binary.data.data(), header.length);
+}
+
+bool ShaderCache::load(GLuint program, uint64_t key)
+{
+	if (!enabled || !supported) return false;
+
+	double start = getWallTime();
+
+	auto cached = binaries.find(key);
+	if (cached == binaries.end()) {
+		Binary binary;
+		if (!read(key, binary)) {
+			stats.misses++;
+			return false;
+		}
+		cached = binaries.emplace(key, std::move(binary)).first;
+	}
+
+	const Binary& binary = cached->second;
+	glProgramBinary(program, binary.format, binary.data.data(), (GLsizei)binary.data.size());
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+	stats.loadTime += getWallTime() - start;
+
+	if (!linked) {
+		// Usually a driver update the version string didn't show
+		binaries.erase(cached);
+		std::remove(filename(key).c_str());
+		stats.rejected++;
+		stats.misses++;
+		return false;
+	}
+
+	stats.hits++;
+	return true;
+}
+
+void ShaderCache::store(GLuint program, uint64_t key)
+{
+	if (!enabled || !supported) return;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+
+	Binary binary;
+	binary.data.resize((size_t)length);
+	glGetProgramBinary(program, length, &length, &binary.format, binary.data.data());
+	if (length <= 0) return;
+	binary.data.resize((size_t)length);
+
+	FileHeader header = { FileMagic, binary.format, key, (uint64_t)length };
+	std::ofstream file(filename(key), std::ios::binary | std::ios::trunc);
+	if (file) {
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)binary.data.data(), length);
+	}
+	if (!file) {
+		log("Shader cache: unable to write {0}\n", filename(key));
+	}
+
+	binaries[key] = std::move(binary);
+	stats.stored++;
+}
+
+void ShaderCache::prewarm(const std::vector<Program>& programs)
+{
+	std::vector<u_ptr<Shader>> started;
+
+	double start = getWallTime();
+
+	for (const auto& program : programs) {
+		if (!IO::pathExists(program.vertPath) || !IO::pathExists(program.fragPath)) continue;
+
+		auto shader = std::make_unique<Shader>(IO::readText(program.vertPath), IO::readText(program.fragPath));
+		shader->attributeLocations = program.attributeLocations;
+		if (!shader->beginInit(false, program.fragBindings)) continue;
+
+		// Hits are already done, only misses need waiting on
+		if (shader->fromCache) continue;
+
+		started.push_back(std::move(shader));
+	}
+
+	for (auto& shader : started) {
+		if (!shader->finishInit()) {
+			log("Shader cache: prewarm failed to build a program\n");
+		}
+	}
+
+	if (!started.empty()) {
+		log("Shader cache: prewarmed {0} of {1} programs in {2:.1f} ms\n", started.size(), programs.size(), (getWallTime() - start) * 1000.0);
+	}
+}
+
+void ShaderCache::clear()
+{
+	binaries.clear();
+	if (!IO::pathExists(directory)) return;
+
+	for (const auto& file : IO::getFilenamesInFolder(directory, "*.bin")) {
+		std::remove(file.c_str());
+	}
+}
+
+void ShaderCache::renderUI()
+{
+	if (ImGui::CollapsingHeader("Shader cache")) {
+		IMDENT;
+
+		ImGui::Checkbox("Enabled", &enabled);
+		ImGui::Text("Program binaries: %s, parallel compile: %s", supported ? "yes" : "no", parallel ? "yes" : "no");
+		ImGui::Text("Hits: %zu, misses: %zu, rejected: %zu, stored: %zu", stats.hits, stats.misses, stats.rejected, stats.stored);
+		ImGui::Text("Load time: %.2f ms, compile time: %.2f ms", stats.loadTime * 1000.0, stats.compileTime * 1000.0);
+
+		if (ImGui::Button("Clear cache")) {
+			clear();
+		}
+
+		IMDONT;
+	}
+}
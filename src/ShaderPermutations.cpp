@@ -0,0 +1,105 @@
+#include "ShaderPermutations.h"
+
+ShaderPermutations::ShaderPermutations(const std::string& _vertText, const std::string& _fragText, const string_vector& _features,
+	const std::vector<ShaderFragOutputBindings>& _fragBindings, const string_vector& _attributes)
+	: vertText(Shader::ProcessShaderText(_vertText)), fragText(Shader::ProcessShaderText(_fragText)),
+	features(_features), fragBindings(_fragBindings), attributes(_attributes)
+{
+	if (features.size() > 32) {
+		log("ShaderPermutations: only the first 32 of {0} features can be used\n", features.size());
+		features.resize(32);
+	}
+}
+
+uint32_t ShaderPermutations::feature(const std::string& name) const
+{
+	for (size_t i = 0; i < features.size(); i++) {
+		if (features[i] == name) return 1u << i;
+	}
+	return 0;
+}
+
+std::string ShaderPermutations::describe(uint32_t featureSet) const
+{
+	std::string names;
+	for (size_t i = 0; i < features.size(); i++) {
+		if (featureSet & (1u << i)) {
+			names += names.empty() ? features[i] : " " + features[i];
+		}
+	}
+	return names.empty() ? "none" : names;
+}
+
+std::string ShaderPermutations::specialize(const std::string& text, uint32_t featureSet) const
+{
+	std::string defines = "#define PERMUTATION\n";
+	for (size_t i = 0; i < features.size(); i++) {
+		defines += fmt::format("#define {0} {1}\n", features[i], (featureSet & (1u << i)) ? "true" : "false");
+	}
+
+	// Defines have to come after #version, which has to be first
+	size_t version = text.find("#version");
+	if (version == std::string::npos) return defines + text;
+
+	size_t lineEnd = text.find('\n', version);
+	if (lineEnd == std::string::npos) return text + "\n" + defines;
+
+	return text.substr(0, lineEnd + 1) + defines + text.substr(lineEnd + 1);
+}
+
+s_ptr<Shader> ShaderPermutations::create(uint32_t featureSet) const
+{
+	// Already preprocessed, so skip the text constructors
+	auto shader = std::make_shared<Shader>();
+	shader->shaders[ShaderType::VertexShader] = Shader::GLshader(ShaderType::VertexShader, specialize(vertText, featureSet));
+	shader->shaders[ShaderType::FragmentShader] = Shader::GLshader(ShaderType::FragmentShader, specialize(fragText, featureSet));
+	shader->flags.hasVertexStage = true;
+	shader->flags.hasFragStage = true;
+	shader->attributeLocations = attributes;
+	return shader;
+}
+
+void ShaderPermutations::finish(uint32_t featureSet, s_ptr<Shader> shader)
+{
+	if (shader && !shader->finishInit()) {
+		log("Unable to build shader variant ({0})\n", describe(featureSet));
+		shader = nullptr;
+	}
+
+	if (shader && onBuild) onBuild(*shader);
+
+	variants[featureSet] = shader;
+}
+
+s_ptr<Shader> ShaderPermutations::get(uint32_t featureSet)
+{
+	auto variant = variants.find(featureSet);
+	if (variant != variants.end()) return variant->second;
+
+	auto shader = create(featureSet);
+	if (!shader->beginInit(false, fragBindings)) shader = nullptr;
+	finish(featureSet, shader);
+
+	return variants[featureSet];
+}
+
+void ShaderPermutations::warmUp(const std::vector<uint32_t>& featureSets)
+{
+	std::vector<std::pair<uint32_t, s_ptr<Shader>>> started;
+
+	for (uint32_t featureSet : featureSets) {
+		if (variants.find(featureSet) != variants.end()) continue;
+
+		bool duplicate = false;
+		for (const auto& s : started) duplicate = duplicate || s.first == featureSet;
+		if (duplicate) continue;
+
+		auto shader = create(featureSet);
+		if (!shader->beginInit(false, fragBindings)) shader = nullptr;
+		started.push_back({ featureSet, shader });
+	}
+
+	for (auto& s : started) {
+		finish(s.first, s.second);
+	}
+}
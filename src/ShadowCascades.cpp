@@ -0,0 +1,179 @@
+#include "ShadowCascades.h"
+
+#include "Camera.h"
+#include "Culling.h"
+#include "UIHelpers.h"
+
+#include "imgui.h"
+
+ShadowCascades& ShadowCascades::get()
+{
+	static ShadowCascades cascades;
+	return cascades;
+}
+
+void ShadowCascades::update(const Camera& camera, const Camera& lightCamera, const vec3& lightPosition,
+	const vec3& lightCenter, const vec3& lightUp, ProjectionType lightProjection, const ivec2& mapSize)
+{
+	double start = getWallTime();
+
+	auto& culling = SceneCulling::get();
+	bool staticChanged = culling.getStaticVersion() != staticVersion;
+	staticVersion = culling.getStaticVersion();
+
+	std::vector<View> previous = std::move(views);
+	views.clear();
+
+	vec3 direction = lightCenter - lightPosition;
+	cascaded = useCascades && lightProjection == +ProjectionType::Orthographic && glm::length(direction) > 0.f;
+
+	if (!cascaded) {
+		View v;
+		v.projection = lightCamera.projection;
+		v.view = lightCamera.view;
+		v.viewproj = lightCamera.viewproj;
+		v.viewport = ivec4(0, 0, mapSize);
+		views.push_back(v);
+	}
+	else {
+		int count = glm::clamp(cascadeCount, 1, GPU_SHADOW_MAX_CASCADES);
+		float nearDepth = std::max(std::min(camera.nearFar.x, camera.nearFar.y), 1e-3f);
+		float farDepth = std::min(std::max(camera.nearFar.x, camera.nearFar.y), shadowDistance);
+		farDepth = std::max(farDepth, nearDepth * 2.f);
+
+		// Lines through the view frustum's edges, from two points along each, which works for
+		// either camera projection
+		mat4 inverseProjection = glm::inverse(camera.projection);
+		mat4 inverseView = glm::inverse(camera.view);
+		const vec2 ndc[4] = { vec2(-1.f, -1.f), vec2(1.f, -1.f), vec2(-1.f, 1.f), vec2(1.f, 1.f) };
+		vec3 lineA[4], lineB[4];
+		for (int c = 0; c < 4; c++) {
+			vec4 a = inverseProjection * vec4(ndc[c], -1.f, 1.f);
+			vec4 b = inverseProjection * vec4(ndc[c], 0.f, 1.f);
+			lineA[c] = vec3(a) / (std::abs(a.w) > 1e-8f ? a.w : 1e-8f);
+			lineB[c] = vec3(b) / (std::abs(b.w) > 1e-8f ? b.w : 1e-8f);
+		}
+
+		auto corner = [&](int c, float depth) {
+			float dz = lineB[c].z - lineA[c].z;
+			float t = std::abs(dz) > 1e-8f ? (-depth - lineA[c].z) / dz : 0.f;
+			return vec3(inverseView * vec4(lineA[c] + t * (lineB[c] - lineA[c]), 1.f));
+		};
+
+		direction = glm::normalize(direction);
+		vec3 up = glm::length(lightUp) > 0.f ? glm::normalize(lightUp) : vec3(0.f, 1.f, 0.f);
+		if (std::abs(glm::dot(up, direction)) > 0.99f) {
+			up = std::abs(direction.y) < 0.99f ? vec3(0.f, 1.f, 0.f) : vec3(0.f, 0.f, 1.f);
+		}
+		mat4 lightRotation = glm::lookAt(vec3(0.f), direction, up);
+		mat4 inverseRotation = glm::inverse(lightRotation);
+
+		ivec2 quadrant = mapSize / 2;
+		float splitNear = nearDepth;
+
+		for (int i = 0; i < count; i++) {
+			float t = (i + 1) / (float)count;
+			float even = nearDepth + (farDepth - nearDepth) * t;
+			float logarithmic = nearDepth * std::pow(farDepth / nearDepth, t);
+			float splitFar = glm::mix(even, logarithmic, splitLambda);
+
+			vec3 corners[8];
+			vec3 center(0.f);
+			for (int c = 0; c < 4; c++) {
+				corners[c] = corner(c, splitNear);
+				corners[c + 4] = corner(c, splitFar);
+			}
+			for (const auto& p : corners) center += p / 8.f;
+
+			// The sphere only depends on the slice's shape, so turning the camera keeps the size
+			float radius = 0.f;
+			for (const auto& p : corners) radius = std::max(radius, glm::length(p - center));
+			radius = std::ceil(radius * 16.f) / 16.f;
+
+			// Step in whole texels, padded by one step so the snapped box still covers the slice
+			float texel = 2.f * radius / std::max(quadrant.x, 1);
+			float step = texel;
+			if (cacheStatic && cacheSteps > 0) {
+				step = std::max(texel, std::round(2.f * radius / cacheSteps / texel) * texel);
+			}
+			float extent = radius + step;
+
+			vec3 local = vec3(lightRotation * vec4(center, 1.f));
+			local = glm::floor(local / step) * step;
+			center = vec3(inverseRotation * vec4(local, 1.f));
+
+			View v;
+			v.view = glm::lookAt(center - direction * (extent + casterDistance), center, up);
+			v.projection = glm::ortho(-extent, extent, -extent, extent, 0.f, 2.f * extent + casterDistance);
+			v.viewproj = v.projection * v.view;
+			v.viewport = ivec4((i % 2) * quadrant.x, (i / 2) * quadrant.y, quadrant.x, quadrant.y);
+			v.splitFar = splitFar;
+			views.push_back(v);
+
+			splitNear = splitFar;
+		}
+	}
+
+	// A view keeps its cached static casters while neither it nor they changed
+	for (size_t i = 0; i < views.size(); i++) {
+		auto& v = views[i];
+		v.cached = cacheStatic && !staticChanged && i < previous.size() && previous[i].cached
+			&& previous[i].viewport == v.viewport && memcmp(&previous[i].viewproj, &v.viewproj, sizeof(mat4)) == 0;
+	}
+
+	stats.fitTime = getWallTime() - start;
+}
+
+void ShadowCascades::invalidate()
+{
+	for (auto& v : views) v.cached = false;
+	staticVersion = (uint64_t)-1;
+}
+
+void ShadowCascades::markCached()
+{
+	stats.staticRedraws = 0;
+	for (auto& v : views) {
+		if (!v.cached) stats.staticRedraws++;
+		v.cached = true;
+	}
+
+	stats.cachedFrames = stats.staticRedraws == 0 ? stats.cachedFrames + 1 : 0;
+}
+
+void ShadowCascades::apply(GPU::FrameData& frame) const
+{
+	frame.cascadeInfo = ivec4(cascaded ? (int)views.size() : 0, 0, 0, 0);
+	if (!cascaded) return;
+
+	for (size_t i = 0; i < views.size(); i++) {
+		frame.cascadeViewProj[i] = views[i].viewproj;
+		frame.cascadeSplits[(int)i] = views[i].splitFar;
+	}
+}
+
+void ShadowCascades::renderUI()
+{
+	if (ImGui::CollapsingHeader("Shadow cascades")) {
+		IMDENT;
+
+		ImGui::Checkbox("Cascades (orthographic light)", &useCascades);
+		ImGui::SliderInt("Cascade count", &cascadeCount, 1, GPU_SHADOW_MAX_CASCADES);
+		ImGui::DragFloat("Shadow distance", &shadowDistance, 1.f, 1.f, 1000.f);
+		ImGui::SliderFloat("Split lambda", &splitLambda, 0.f, 1.f);
+		ImGui::DragFloat("Caster distance", &casterDistance, 1.f, 0.f, 500.f);
+
+		if (ImGui::Checkbox("Cache static casters", &cacheStatic)) invalidate();
+		ImGui::SliderInt("Cache steps", &cacheSteps, 0, 64);
+
+		ImGui::Text("Static redraws: %zu views, cached for %zu frames", stats.staticRedraws, stats.cachedFrames);
+		ImGui::Text("Fit: %.3f ms", stats.fitTime * 1000.0);
+
+		for (size_t i = 0; i < views.size(); i++) {
+			const auto& v = views[i];
+			ImGui::TextDisabled("View %zu: to depth %.1f, %s", i, v.splitFar, v.cached ? "cached" : "redrawn");
+		}
+
+		IMDONT;
+	}
+}
@@ -0,0 +1,636 @@
+#include "SoftwareRasterizer.h"
+
+#include "WorkerPool.h"
+
+#include "imgui.h"
+
+#include <stb/stb_image_write.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFTWARE_RASTERIZER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+	const int SubPixelBits = 4;
+	const int SubPixels = 1 << SubPixelBits;
+
+	// Triangles are clipped to this many times the view on each axis, which keeps
+	// snapped coordinates small enough for the edge functions
+	const float GuardBand = 2.f;
+
+	const int BlocksPerTile = SoftwareRasterizer::TileSize / SoftwareRasterizer::BlockSize;
+
+	uint32_t packColor(const vec4& c) {
+		vec4 v = glm::clamp(c, vec4(0.f), vec4(1.f)) * 255.f + 0.5f;
+		return (uint32_t)v.r | ((uint32_t)v.g << 8) | ((uint32_t)v.b << 16) | ((uint32_t)v.a << 24);
+	}
+
+	// Signed distance-like value of a clip space point from a clipping plane, inside when >= 0
+	float planeDistance(const vec4& p, int plane) {
+		switch (plane) {
+		case 0: return p.z + p.w;
+		case 1: return GuardBand * p.w - p.x;
+		case 2: return GuardBand * p.w + p.x;
+		case 3: return GuardBand * p.w - p.y;
+		default: return GuardBand * p.w + p.y;
+		}
+	}
+	const int PlaneCount = 5;
+
+	// Edge from a to b of a counter-clockwise triangle, positive inside
+	struct Edge {
+		int64_t a, b, c;
+		int bias;
+
+		Edge(int xa, int ya, int xb, int yb) {
+			a = -(int64_t)(yb - ya);
+			b = (int64_t)(xb - xa);
+			c = -(a * xa + b * ya);
+
+			// Top-left rule: with y up and counter-clockwise winding, top edges run towards -x
+			// and left edges run down. Pixels exactly on other edges belong to the neighbour.
+			bool topLeft = (yb == ya && xb < xa) || yb < ya;
+			bias = topLeft ? 0 : -1;
+		}
+
+		// At the center of a pixel
+		int64_t at(int px, int py) const {
+			return a * (px * SubPixels + SubPixels / 2) + b * (py * SubPixels + SubPixels / 2) + c;
+		}
+	};
+}
+
+void SoftwareRasterizer::resize(ivec2 newSize)
+{
+	newSize = glm::max(newSize, ivec2(1));
+	if (newSize == size) return;
+
+	size = newSize;
+	tileCount = (size + TileSize - 1) / TileSize;
+
+	size_t count = (size_t)size.x * size.y;
+	color.assign(count, 0);
+	depth.assign(count, 1.f);
+	ids.assign(count, ivec2(-1));
+	tiles.assign((size_t)tileCount.x * tileCount.y, Tile());
+}
+
+void SoftwareRasterizer::submit(const Draw& draw)
+{
+	if (!draw.vertices || !draw.indices || draw.indexCount < 3) return;
+	draws.push_back(draw);
+}
+
+void SoftwareRasterizer::render(const mat4& viewproj)
+{
+	stats = Stats();
+	stats.threads = WorkerPool::get().loopThreads();
+	stats.draws = draws.size();
+
+	double start = getWallTime();
+	transformVertices(viewproj);
+	setupTriangles();
+
+	double binStart = getWallTime();
+	binTriangles();
+
+	double rasterStart = getWallTime();
+
+	auto& pool = WorkerPool::get();
+
+	// Counted per worker, summed after
+	struct Counts {
+		size_t full = 0, partial = 0, occluded = 0, tilesOccluded = 0;
+	};
+	std::vector<Counts> counts(pool.threadCount());
+
+	// Tiles share no pixels, so they need no locking
+	pool.parallelFor(tileCount.x * tileCount.y, [this, &counts](int i, int worker) {
+		auto& c = counts[worker];
+		rasterizeTile(i, c.full, c.partial, c.occluded, c.tilesOccluded);
+	});
+
+	stats.blocksFull = stats.blocksPartial = stats.blocksOccluded = stats.tilesOccluded = 0;
+	for (const auto& c : counts) {
+		stats.blocksFull += c.full;
+		stats.blocksPartial += c.partial;
+		stats.blocksOccluded += c.occluded;
+		stats.tilesOccluded += c.tilesOccluded;
+	}
+
+	double end = getWallTime();
+	stats.setupTime = binStart - start;
+	stats.binTime = rasterStart - binStart;
+	stats.rasterTime = end - rasterStart;
+
+	draws.clear();
+}
+
+void SoftwareRasterizer::transformVertices(const mat4& viewproj)
+{
+	vertexOffsets.assign(draws.size() + 1, 0);
+	triangleOffsets.assign(draws.size() + 1, 0);
+	for (size_t i = 0; i < draws.size(); i++) {
+		vertexOffsets[i + 1] = vertexOffsets[i] + draws[i].vertexCount;
+		triangleOffsets[i + 1] = triangleOffsets[i] + draws[i].indexCount / 3;
+	}
+	stats.triangles = triangleOffsets.back();
+
+	transformed.resize(vertexOffsets.back());
+
+	int drawCount = (int)draws.size();
+	WorkerPool::get().parallelFor(drawCount, [&](int d, int) {
+		const auto& draw = draws[d];
+		mat4 mvp = viewproj * draw.model;
+		mat3 normalMatrix = glm::transpose(glm::inverse(mat3(draw.model)));
+
+		ClipVertex* out = &transformed[vertexOffsets[d]];
+		for (size_t i = 0; i < draw.vertexCount; i++) {
+			const auto& v = draw.vertices[i];
+			out[i].position = mvp * vec4(v.position, 1.f);
+
+			vec3 n = normalMatrix * v.normal;
+			float length = glm::length(n);
+			if (length > 0.f) n /= length;
+
+			vec4 c = draw.color * v.color;
+			float* a = out[i].attributes;
+			a[0] = n.x; a[1] = n.y; a[2] = n.z;
+			a[3] = c.r; a[4] = c.g; a[5] = c.b; a[6] = c.a;
+		}
+	});
+}
+
+void SoftwareRasterizer::setupTriangles()
+{
+	int chunks = std::max(1, stats.threads);
+	threadTriangles.resize(chunks);
+	std::vector<size_t> culled(chunks, 0), clipped(chunks, 0);
+
+	size_t total = triangleOffsets.back();
+
+	// Contiguous ranges, so chunk order is submission order
+	WorkerPool::get().parallelFor(chunks, [&](int chunk, int) {
+		auto& out = threadTriangles[chunk];
+		out.clear();
+
+		size_t begin = total * chunk / chunks;
+		size_t end = total * (chunk + 1) / chunks;
+		if (begin == end) return;
+
+		size_t d = std::upper_bound(triangleOffsets.begin(), triangleOffsets.end(), begin) - triangleOffsets.begin() - 1;
+
+		for (size_t i = begin; i < end; i++) {
+			while (i >= triangleOffsets[d + 1]) d++;
+
+			const auto& draw = draws[d];
+			size_t primitive = i - triangleOffsets[d];
+			const uint32_t* index = draw.indices + primitive * 3;
+			if (index[0] >= draw.vertexCount || index[1] >= draw.vertexCount || index[2] >= draw.vertexCount) {
+				culled[chunk]++;
+				continue;
+			}
+
+			const ClipVertex* base = &transformed[vertexOffsets[d]];
+			ClipVertex v[3] = { base[index[0]], base[index[1]], base[index[2]] };
+			clipAndSetup(v, draw.objectIndex, (int)primitive, draw.cullBack, draw.lit, out, culled[chunk], clipped[chunk]);
+		}
+	});
+
+	for (int chunk = 0; chunk < chunks; chunk++) {
+		stats.culled += culled[chunk];
+		stats.clipped += clipped[chunk];
+	}
+}
+
+void SoftwareRasterizer::clipAndSetup(ClipVertex v[3], int objectIndex, int primitive, bool cullBack, bool lit,
+	std::vector<Triangle>& out, size_t& culled, size_t& clipped)
+{
+	// Which planes each vertex is outside of
+	int outside[3] = { 0, 0, 0 };
+	for (int i = 0; i < 3; i++) {
+		for (int p = 0; p < PlaneCount; p++) {
+			if (planeDistance(v[i].position, p) < 0.f) outside[i] |= 1 << p;
+		}
+	}
+
+	if (outside[0] & outside[1] & outside[2]) {
+		culled++;
+		return;
+	}
+
+	Triangle t;
+	if ((outside[0] | outside[1] | outside[2]) == 0) {
+		if (setup(v[0], v[1], v[2], objectIndex, primitive, cullBack, lit, t)) out.push_back(t);
+		else culled++;
+		return;
+	}
+
+	// Sutherland-Hodgman against the planes any vertex is outside of
+	ClipVertex buffers[2][3 + PlaneCount];
+	int count = 3;
+	for (int i = 0; i < 3; i++) buffers[0][i] = v[i];
+
+	int current = 0;
+	int planes = outside[0] | outside[1] | outside[2];
+	for (int p = 0; p < PlaneCount && count > 0; p++) {
+		if (!(planes & (1 << p))) continue;
+
+		const ClipVertex* in = buffers[current];
+		ClipVertex* result = buffers[1 - current];
+		int resultCount = 0;
+
+		for (int i = 0; i < count; i++) {
+			const ClipVertex& a = in[i];
+			const ClipVertex& b = in[(i + 1) % count];
+			float da = planeDistance(a.position, p);
+			float db = planeDistance(b.position, p);
+
+			if (da >= 0.f) result[resultCount++] = a;
+			if ((da >= 0.f) != (db >= 0.f)) {
+				float s = da / (da - db);
+				ClipVertex& mid = result[resultCount++];
+				mid.position = glm::mix(a.position, b.position, s);
+				for (int k = 0; k < AttributeCount; k++) {
+					mid.attributes[k] = a.attributes[k] + (b.attributes[k] - a.attributes[k]) * s;
+				}
+			}
+		}
+
+		count = resultCount;
+		current = 1 - current;
+	}
+
+	const ClipVertex* polygon = buffers[current];
+	int made = 0;
+	for (int i = 1; i + 1 < count; i++) {
+		if (setup(polygon[0], polygon[i], polygon[i + 1], objectIndex, primitive, cullBack, lit, t)) {
+			out.push_back(t);
+			made++;
+		}
+	}
+
+	if (made == 0) culled++;
+	else clipped += made - 1;
+}
+
+bool SoftwareRasterizer::setup(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, int objectIndex, int primitive,
+	bool cullBack, bool lit, Triangle& t)
+{
+	const ClipVertex* v[3] = { &a, &b, &c };
+
+	for (int i = 0; i < 3; i++) {
+		const vec4& p = v[i]->position;
+		float invW = 1.f / p.w;
+		vec3 ndc = vec3(p) * invW;
+
+		t.x[i] = (int)std::lround((ndc.x * 0.5f + 0.5f) * size.x * SubPixels);
+		t.y[i] = (int)std::lround((ndc.y * 0.5f + 0.5f) * size.y * SubPixels);
+		t.z[i] = ndc.z * 0.5f + 0.5f;
+		t.invW[i] = invW;
+		for (int k = 0; k < AttributeCount; k++) {
+			t.attributes[i][k] = v[i]->attributes[k] * invW;
+		}
+	}
+
+	int64_t area = (int64_t)(t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (int64_t)(t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+	if (area == 0) return false;
+
+	// Clockwise on screen is a back face
+	if (area < 0) {
+		if (cullBack) return false;
+
+		std::swap(t.x[1], t.x[2]);
+		std::swap(t.y[1], t.y[2]);
+		std::swap(t.z[1], t.z[2]);
+		std::swap(t.invW[1], t.invW[2]);
+		for (int k = 0; k < AttributeCount; k++) {
+			std::swap(t.attributes[1][k], t.attributes[2][k]);
+		}
+	}
+
+	// Pixels whose centers can fall inside
+	int minX = std::min(t.x[0], std::min(t.x[1], t.x[2]));
+	int maxX = std::max(t.x[0], std::max(t.x[1], t.x[2]));
+	int minY = std::min(t.y[0], std::min(t.y[1], t.y[2]));
+	int maxY = std::max(t.y[0], std::max(t.y[1], t.y[2]));
+
+	auto firstPixel = [](int fixed) { return (int)std::ceil((fixed - SubPixels / 2) / (float)SubPixels); };
+	auto lastPixel = [](int fixed) { return (int)std::floor((fixed - SubPixels / 2) / (float)SubPixels); };
+
+	t.bounds = ivec4(
+		std::max(firstPixel(minX), 0), std::max(firstPixel(minY), 0),
+		std::min(lastPixel(maxX), size.x - 1), std::min(lastPixel(maxY), size.y - 1));
+	if (t.bounds.x > t.bounds.z || t.bounds.y > t.bounds.w) return false;
+
+	t.minZ = std::min(t.z[0], std::min(t.z[1], t.z[2]));
+	t.maxZ = std::max(t.z[0], std::max(t.z[1], t.z[2]));
+	if (t.minZ > 1.f) return false;
+
+	t.objectIndex = objectIndex;
+	t.primitive = primitive;
+	t.lit = lit;
+	return true;
+}
+
+void SoftwareRasterizer::binTriangles()
+{
+	int chunks = (int)threadTriangles.size();
+	int count = tileCount.x * tileCount.y;
+	threadBins.resize(chunks);
+
+	std::vector<size_t> binned(chunks, 0);
+
+	WorkerPool::get().parallelFor(chunks, [&](int chunk, int) {
+		auto& bins = threadBins[chunk];
+		bins.resize(count);
+		for (auto& bin : bins) bin.clear();
+
+		const auto& triangles = threadTriangles[chunk];
+		for (uint32_t i = 0; i < (uint32_t)triangles.size(); i++) {
+			const auto& b = triangles[i].bounds;
+			for (int ty = b.y / TileSize; ty <= b.w / TileSize; ty++) {
+				for (int tx = b.x / TileSize; tx <= b.z / TileSize; tx++) {
+					bins[ty * tileCount.x + tx].push_back(i);
+					binned[chunk]++;
+				}
+			}
+		}
+	});
+
+	for (auto b : binned) stats.binned += b;
+}
+
+void SoftwareRasterizer::rasterizeTile(int tileIndex, size_t& full, size_t& partial, size_t& occluded, size_t& tilesOccluded)
+{
+	ivec2 tileMin = ivec2(tileIndex % tileCount.x, tileIndex / tileCount.x) * TileSize;
+	ivec2 tileMax = glm::min(tileMin + TileSize, size) - 1;
+
+	// Clear here so each tile's pixels stay with the thread that draws them
+	uint32_t clear = packColor(clearColor);
+	for (int y = tileMin.y; y <= tileMax.y; y++) {
+		size_t row = (size_t)y * size.x;
+		std::fill(color.begin() + row + tileMin.x, color.begin() + row + tileMax.x + 1, clear);
+		std::fill(depth.begin() + row + tileMin.x, depth.begin() + row + tileMax.x + 1, 1.f);
+		std::fill(ids.begin() + row + tileMin.x, ids.begin() + row + tileMax.x + 1, ivec2(-1));
+	}
+
+	Tile& tile = tiles[tileIndex];
+	for (int by = 0; by < BlocksPerTile; by++) {
+		for (int bx = 0; bx < BlocksPerTile; bx++) {
+			ivec2 blockMin = tileMin + ivec2(bx, by) * BlockSize;
+			// Blocks past the edge of the screen never get drawn to, so they can't hold the tile back
+			bool onScreen = blockMin.x <= tileMax.x && blockMin.y <= tileMax.y;
+			tile.blockMaxZ[by * BlocksPerTile + bx] = onScreen ? 1.f : 0.f;
+		}
+	}
+	tile.maxZ = 1.f;
+
+	for (size_t chunk = 0; chunk < threadBins.size(); chunk++) {
+		const auto& triangles = threadTriangles[chunk];
+
+		for (uint32_t triangleIndex : threadBins[chunk][tileIndex]) {
+			const Triangle& t = triangles[triangleIndex];
+
+			if (t.minZ >= tile.maxZ) {
+				tilesOccluded++;
+				continue;
+			}
+
+			Edge edges[3] = {
+				Edge(t.x[1], t.y[1], t.x[2], t.y[2]),
+				Edge(t.x[2], t.y[2], t.x[0], t.y[0]),
+				Edge(t.x[0], t.y[0], t.x[1], t.y[1]),
+			};
+
+			// Each edge function over twice the area is the barycentric weight of the opposite vertex
+			float area = (float)(edges[0].at(0, 0) + edges[1].at(0, 0) + edges[2].at(0, 0));
+			float baryDx[3], baryDy[3];
+			for (int e = 0; e < 3; e++) {
+				baryDx[e] = edges[e].a * SubPixels / area;
+				baryDy[e] = edges[e].b * SubPixels / area;
+			}
+
+			ivec2 lo = glm::max(tileMin, ivec2(t.bounds.x, t.bounds.y));
+			ivec2 hi = glm::min(tileMax, ivec2(t.bounds.z, t.bounds.w));
+
+			bool wroteAny = false;
+
+			for (int by = (lo.y - tileMin.y) / BlockSize; by <= (hi.y - tileMin.y) / BlockSize; by++) {
+				for (int bx = (lo.x - tileMin.x) / BlockSize; bx <= (hi.x - tileMin.x) / BlockSize; bx++) {
+					int blockIndex = by * BlocksPerTile + bx;
+					if (t.minZ >= tile.blockMaxZ[blockIndex]) {
+						occluded++;
+						continue;
+					}
+
+					ivec2 blockMin = tileMin + ivec2(bx, by) * BlockSize;
+					ivec2 blockMax = blockMin + BlockSize - 1;
+
+					// Only pixels inside the triangle's bounds, which also keeps to the screen
+					ivec2 validMin = glm::max(blockMin, lo);
+					ivec2 validMax = glm::min(blockMax, hi);
+					uint64_t rect = 0;
+					for (int y = validMin.y; y <= validMax.y; y++) {
+						uint64_t rowBits = ((1ull << (validMax.x - validMin.x + 1)) - 1) << (validMin.x - blockMin.x);
+						rect |= rowBits << ((y - blockMin.y) * BlockSize);
+					}
+
+					// Classify the block against each edge by its corner pixels
+					bool rejected = false;
+					int partialEdges[3];
+					int partialCount = 0;
+					for (int e = 0; e < 3; e++) {
+						const Edge& edge = edges[e];
+						int64_t c0 = edge.at(blockMin.x, blockMin.y) + edge.bias;
+						int64_t c1 = edge.at(blockMax.x, blockMin.y) + edge.bias;
+						int64_t c2 = edge.at(blockMin.x, blockMax.y) + edge.bias;
+						int64_t c3 = edge.at(blockMax.x, blockMax.y) + edge.bias;
+						int64_t lowest = std::min(std::min(c0, c1), std::min(c2, c3));
+						int64_t highest = std::max(std::max(c0, c1), std::max(c2, c3));
+
+						if (highest < 0) {
+							rejected = true;
+							break;
+						}
+						if (lowest < 0) partialEdges[partialCount++] = e;
+					}
+					if (rejected) continue;
+
+					uint64_t coverage = rect;
+					if (partialCount > 0) {
+						partial++;
+
+						// The edge crosses the block, so its values here fit in 32 bits
+						int32_t base[3], stepX[3], stepY[3];
+						for (int i = 0; i < partialCount; i++) {
+							const Edge& edge = edges[partialEdges[i]];
+							base[i] = (int32_t)(edge.at(blockMin.x, blockMin.y) + edge.bias);
+							stepX[i] = (int32_t)(edge.a * SubPixels);
+							stepY[i] = (int32_t)(edge.b * SubPixels);
+						}
+
+						uint64_t inside = 0;
+						for (int y = 0; y < BlockSize; y++) {
+							for (int x = 0; x < BlockSize; x += 4) {
+								unsigned negative = 0;
+#ifdef SOFTWARE_RASTERIZER_SSE2
+								__m128i any = _mm_setzero_si128();
+								for (int i = 0; i < partialCount; i++) {
+									__m128i row = _mm_set1_epi32(base[i] + stepX[i] * x + stepY[i] * y);
+									__m128i offsets = _mm_set_epi32(stepX[i] * 3, stepX[i] * 2, stepX[i], 0);
+									any = _mm_or_si128(any, _mm_add_epi32(row, offsets));
+								}
+								// Sign bits of the four pixels, set where any edge is negative
+								negative = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(any));
+#else
+								for (int lane = 0; lane < 4; lane++) {
+									for (int i = 0; i < partialCount; i++) {
+										if (base[i] + stepX[i] * (x + lane) + stepY[i] * y < 0) negative |= 1u << lane;
+									}
+								}
+#endif
+								inside |= (uint64_t)(~negative & 0xF) << (y * BlockSize + x);
+							}
+						}
+
+						coverage &= inside;
+					}
+					else {
+						full++;
+					}
+
+					if (!coverage) continue;
+
+					float baryBase[3];
+					for (int e = 0; e < 3; e++) {
+						baryBase[e] = edges[e].at(blockMin.x, blockMin.y) / area;
+					}
+
+					if (shadeBlock(t, blockMin, coverage, tile, blockIndex, baryBase, baryDx, baryDy)) {
+						wroteAny = true;
+					}
+				}
+			}
+
+			if (wroteAny) {
+				float farthest = 0.f;
+				for (float z : tile.blockMaxZ) farthest = std::max(farthest, z);
+				tile.maxZ = farthest;
+			}
+		}
+	}
+}
+
+bool SoftwareRasterizer::shadeBlock(const Triangle& t, ivec2 blockMin, uint64_t coverage, Tile& tile, int blockIndex,
+	const float baryBase[3], const float baryDx[3], const float baryDy[3])
+{
+	bool wrote = false;
+	vec3 toLight = -glm::normalize(lightDirection);
+
+	while (coverage) {
+		int bit = 0;
+		while (!(coverage & (1ull << bit))) bit++;
+		coverage &= coverage - 1;
+
+		int x = bit % BlockSize;
+		int y = bit / BlockSize;
+		ivec2 pixel = blockMin + ivec2(x, y);
+
+		float b[3];
+		for (int e = 0; e < 3; e++) {
+			b[e] = baryBase[e] + baryDx[e] * x + baryDy[e] * y;
+		}
+
+		float z = b[0] * t.z[0] + b[1] * t.z[1] + b[2] * t.z[2];
+		size_t index = (size_t)pixel.y * size.x + pixel.x;
+		if (!(z < depth[index]) || z < 0.f) continue;
+
+		// Perspective correct: interpolate attribute / w and 1 / w, then divide
+		float invW = b[0] * t.invW[0] + b[1] * t.invW[1] + b[2] * t.invW[2];
+		float a[AttributeCount];
+		for (int k = 0; k < AttributeCount; k++) {
+			a[k] = (b[0] * t.attributes[0][k] + b[1] * t.attributes[1][k] + b[2] * t.attributes[2][k]) / invW;
+		}
+
+		vec4 c(a[3], a[4], a[5], a[6]);
+		if (t.lit) {
+			vec3 n(a[0], a[1], a[2]);
+			float length = glm::length(n);
+			float diffuse = length > 0.f ? std::max(glm::dot(n / length, toLight), 0.f) : 1.f;
+			c = vec4(vec3(c) * (ambient + (1.f - ambient) * diffuse), c.a);
+		}
+
+		depth[index] = z;
+		color[index] = packColor(c);
+		ids[index] = ivec2(t.objectIndex, t.primitive);
+		wrote = true;
+	}
+
+	if (wrote) {
+		// Farthest depth left in the block, for the next triangle's occlusion test
+		ivec2 blockMax = glm::min(blockMin + BlockSize, size);
+		float farthest = 0.f;
+		for (int y = blockMin.y; y < blockMax.y; y++) {
+			const float* row = &depth[(size_t)y * size.x];
+			for (int x = blockMin.x; x < blockMax.x; x++) {
+				farthest = std::max(farthest, row[x]);
+			}
+		}
+		tile.blockMaxZ[blockIndex] = farthest;
+	}
+
+	return wrote;
+}
+
+bool SoftwareRasterizer::writeColor(const std::string& filename) const
+{
+	if (color.empty()) return false;
+
+	// Rows are stored bottom first
+	stbi_flip_vertically_on_write(1);
+	int result = stbi_write_png(filename.c_str(), size.x, size.y, 4, color.data(), size.x * 4);
+	stbi_flip_vertically_on_write(0);
+	return result != 0;
+}
+
+bool SoftwareRasterizer::writeIds(const std::string& objectFilename, const std::string& primitiveFilename) const
+{
+	if (ids.empty()) return false;
+
+	std::vector<uint32_t> encoded(ids.size());
+	bool ok = true;
+
+	stbi_flip_vertically_on_write(1);
+	for (int channel = 0; channel < 2; channel++) {
+		for (size_t i = 0; i < ids.size(); i++) {
+			uint32_t value = ids[i].x < 0 ? 0u : (uint32_t)(ids[i][channel] + 1);
+			encoded[i] = (value & 0xFFFFFF) | 0xFF000000;
+		}
+
+		const std::string& filename = channel == 0 ? objectFilename : primitiveFilename;
+		ok = stbi_write_png(filename.c_str(), size.x, size.y, 4, encoded.data(), size.x * 4) != 0 && ok;
+	}
+	stbi_flip_vertically_on_write(0);
+
+	return ok;
+}
+
+void SoftwareRasterizer::renderUI()
+{
+	if (ImGui::CollapsingHeader("Software rasterizer")) {
+		ImGui::Text("%dx%d, %dx%d tiles, %d threads", size.x, size.y, tileCount.x, tileCount.y, stats.threads);
+		ImGui::Text("%d draws, %d triangles, %d culled, %d from clipping", (int)stats.draws, (int)stats.triangles,
+			(int)stats.culled, (int)stats.clipped);
+		ImGui::Text("%d tile bin entries", (int)stats.binned);
+		ImGui::Text("Blocks: %d fully covered, %d partly, %d skipped by depth", (int)stats.blocksFull,
+			(int)stats.blocksPartial, (int)stats.blocksOccluded);
+		ImGui::Text("%d triangle-tile pairs skipped by depth", (int)stats.tilesOccluded);
+		ImGui::Text("Setup %.3f ms, binning %.3f ms, raster %.3f ms", stats.setupTime * 1000.0,
+			stats.binTime * 1000.0, stats.rasterTime * 1000.0);
+
+		ImGui::ColorEdit4("Clear color##software", glm::value_ptr(clearColor));
+		ImGui::SliderFloat("Ambient##software", &ambient, 0.f, 1.f);
+	}
+}
@@ -0,0 +1,223 @@
+#include "SplinePath.h"
+#include "GeometryUtils.h"
+
+namespace {
+	inline vec3 evalCubic(const vec3& a, const vec3& b, const vec3& c, const vec3& d, float t) {
+		return a + t * (b + t * (c + t * d));
+	}
+
+	inline vec3 evalCubicDerivative(const vec3& b, const vec3& c, const vec3& d, float t) {
+		return b + t * (2.f * c + t * 3.f * d);
+	}
+}
+
+SplinePath::SplinePath(const std::vector<vec3>& _points, SplineType _type, bool _closed)
+	: type(_type), closed(_closed) {
+	setPoints(_points);
+}
+
+SplinePath SplinePath::fromSamples(const std::vector<vec3>& samples, float epsilon, SplineType type) {
+	SplinePath path;
+	path.type = type;
+
+	auto reduced = reduce_RDP(samples, epsilon);
+
+	if (type == +SplineType::Bezier) {
+		// Place handles a third of the way along each reduced segment
+		std::vector<vec3> controls;
+		for (size_t i = 0; i + 1 < reduced.size(); i++) {
+			vec3 p0 = reduced[i], p1 = reduced[i + 1];
+			controls.push_back(p0);
+			controls.push_back(glm::mix(p0, p1, 1.f / 3.f));
+			controls.push_back(glm::mix(p0, p1, 2.f / 3.f));
+		}
+		if (!reduced.empty()) controls.push_back(reduced.back());
+		path.setPoints(controls);
+	}
+	else {
+		path.setPoints(reduced);
+	}
+
+	return path;
+}
+
+void SplinePath::setPoints(const std::vector<vec3>& _points) {
+	points = _points;
+	rebuild();
+}
+
+void SplinePath::rebuild() {
+	cubics.clear();
+	lengths.clear();
+
+	size_t n = points.size();
+
+	if (type == +SplineType::Bezier) {
+		for (size_t i = 0; i + 3 < n; i += 3) {
+			const vec3& p0 = points[i];
+			const vec3& p1 = points[i + 1];
+			const vec3& p2 = points[i + 2];
+			const vec3& p3 = points[i + 3];
+
+			cubics.push_back({ p0, 3.f * (p1 - p0), 3.f * (p0 - 2.f * p1 + p2), -p0 + 3.f * p1 - 3.f * p2 + p3 });
+		}
+	}
+	else if (n >= 2) {
+		// Uniform Catmull-Rom is alpha = 0, centripetal is alpha = 0.5
+		float alpha = type == +SplineType::Centripetal ? 0.5f : 0.f;
+
+		auto point = [&](int i) {
+			if (closed) return points[(i % (int)n + n) % n];
+			// Reflect past the ends so the first and last segments have a neighbor
+			if (i < 0) return 2.f * points[0] - points[1];
+			if (i >= (int)n) return 2.f * points[n - 1] - points[n - 2];
+			return points[i];
+		};
+
+		auto knot = [alpha](const vec3& a, const vec3& b) {
+			return glm::max(glm::pow(glm::length(b - a), alpha), 1e-4f);
+		};
+
+		size_t segments = closed ? n : n - 1;
+		for (size_t i = 0; i < segments; i++) {
+			vec3 p0 = point((int)i - 1), p1 = point((int)i), p2 = point((int)i + 1), p3 = point((int)i + 2);
+
+			float t01 = knot(p0, p1), t12 = knot(p1, p2), t23 = knot(p2, p3);
+
+			// Non-uniform Catmull-Rom tangents, scaled to the [0, 1] segment parameter
+			vec3 m1 = t12 * ((p1 - p0) / t01 - (p2 - p0) / (t01 + t12) + (p2 - p1) / t12);
+			vec3 m2 = t12 * ((p2 - p1) / t12 - (p3 - p1) / (t12 + t23) + (p3 - p2) / t23);
+
+			// Hermite basis to polynomial form
+			cubics.push_back({ p1, m1, -3.f * p1 + 3.f * p2 - 2.f * m1 - m2, 2.f * p1 - 2.f * p2 + m1 + m2 });
+		}
+	}
+
+	if (cubics.empty()) return;
+
+	int steps = std::max(1, samplesPerSegment);
+	lengths.reserve(cubics.size() * steps + 1);
+	lengths.push_back(0.f);
+
+	float total = 0.f;
+	for (const auto& cubic : cubics) {
+		vec3 last = cubic.a;
+		for (int j = 1; j <= steps; j++) {
+			vec3 next = evalCubic(cubic.a, cubic.b, cubic.c, cubic.d, (float)j / steps);
+			total += glm::length(next - last);
+			lengths.push_back(total);
+			last = next;
+		}
+	}
+}
+
+vec3 SplinePath::positionAtParameter(float u) const {
+	if (cubics.empty()) return points.empty() ? vec3(0.f) : points[0];
+
+	u = glm::clamp(u, 0.f, (float)cubics.size());
+	size_t segment = std::min((size_t)u, cubics.size() - 1);
+	const auto& c = cubics[segment];
+	return evalCubic(c.a, c.b, c.c, c.d, u - segment);
+}
+
+vec3 SplinePath::tangentAtParameter(float u) const {
+	if (cubics.empty()) return vec3(0.f);
+
+	u = glm::clamp(u, 0.f, (float)cubics.size());
+	size_t segment = std::min((size_t)u, cubics.size() - 1);
+	const auto& c = cubics[segment];
+	return evalCubicDerivative(c.b, c.c, c.d, u - segment);
+}
+
+float SplinePath::wrapDistance(float distance) const {
+	float total = length();
+	if (total <= 0.f) return 0.f;
+
+	if (closed) {
+		distance = glm::mod(distance, total);
+		return distance < 0.f ? distance + total : distance;
+	}
+	return glm::clamp(distance, 0.f, total);
+}
+
+size_t SplinePath::findStep(float distance) const {
+	// First table entry past the distance; the step is the interval ending there
+	auto it = std::upper_bound(lengths.begin(), lengths.end(), distance);
+	size_t index = (size_t)(it - lengths.begin());
+	return glm::clamp<size_t>(index, 1, lengths.size() - 1) - 1;
+}
+
+float SplinePath::parameterInStep(size_t step, float distance) const {
+	float l0 = lengths[step], l1 = lengths[step + 1];
+	float f = l1 > l0 ? (distance - l0) / (l1 - l0) : 0.f;
+	return ((float)step + glm::clamp(f, 0.f, 1.f)) / std::max(1, samplesPerSegment);
+}
+
+float SplinePath::parameterAtDistance(float distance) const {
+	if (lengths.size() < 2) return 0.f;
+
+	distance = wrapDistance(distance);
+	return parameterInStep(findStep(distance), distance);
+}
+
+vec3 SplinePath::positionAtDistance(float distance) const {
+	return positionAtParameter(parameterAtDistance(distance));
+}
+
+vec3 SplinePath::tangentAtDistance(float distance) const {
+	vec3 t = tangentAtParameter(parameterAtDistance(distance));
+	float l = glm::length(t);
+	return l > 0.f ? t / l : t;
+}
+
+void SplinePath::evaluate(const float* distances, vec3* positions, size_t count, vec3* tangents) const {
+	if (lengths.size() < 2) {
+		vec3 p = positionAtParameter(0.f);
+		for (size_t i = 0; i < count; i++) {
+			positions[i] = p;
+			if (tangents) tangents[i] = vec3(0.f);
+		}
+		return;
+	}
+
+	size_t step = 0;
+	float last = -FLT_MAX;
+
+	for (size_t i = 0; i < count; i++) {
+		float d = wrapDistance(distances[i]);
+
+		if (d >= last) {
+			// Walk forward a few entries before giving up and searching
+			int walked = 0;
+			while (step + 2 < lengths.size() && lengths[step + 1] < d && walked < 8) {
+				step++;
+				walked++;
+			}
+			if (lengths[step + 1] < d) step = findStep(d);
+		}
+		else {
+			step = findStep(d);
+		}
+		last = d;
+
+		float u = parameterInStep(step, d);
+		positions[i] = positionAtParameter(u);
+		if (tangents) {
+			vec3 t = tangentAtParameter(u);
+			float l = glm::length(t);
+			tangents[i] = l > 0.f ? t / l : t;
+		}
+	}
+}
+
+std::vector<vec3> SplinePath::sample(size_t count) const {
+	std::vector<float> distances(count);
+	float total = length();
+	for (size_t i = 0; i < count; i++) {
+		distances[i] = count > 1 ? total * i / (count - 1) : 0.f;
+	}
+
+	std::vector<vec3> positions(count);
+	evaluate(distances.data(), positions.data(), count);
+	return positions;
+}
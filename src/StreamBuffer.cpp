@@ -0,0 +1,229 @@
+#include "StreamBuffer.h"
+
+#include "imgui.h"
+
+namespace {
+	GLsizeiptr alignUp(GLsizeiptr value, GLsizeiptr alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	// Stalls logged before they're only counted
+	const size_t MaxLoggedStalls = 16;
+}
+
+std::vector<StreamBuffer*>& StreamBuffer::all()
+{
+	static std::vector<StreamBuffer*> buffers;
+	return buffers;
+}
+
+bool StreamBuffer::isPersistent()
+{
+	return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+}
+
+StreamBuffer::StreamBuffer(const std::string& _name, GLenum _target, GLsizeiptr _regionSize, GLsizeiptr _alignment)
+	: name(_name), target(_target), alignment(std::max<GLsizeiptr>(_alignment, 4))
+{
+	GLint offsetAlignment = 0;
+	if (target == GL_UNIFORM_BUFFER) {
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+	}
+	else if (target == GL_SHADER_STORAGE_BUFFER) {
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+	}
+	alignment = std::max<GLsizeiptr>(alignment, offsetAlignment);
+
+	regionSize = alignUp(std::max<GLsizeiptr>(_regionSize, alignment), alignment);
+
+	createStore();
+
+	all().push_back(this);
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	auto& buffers = all();
+	buffers.erase(std::remove(buffers.begin(), buffers.end(), this), buffers.end());
+
+	destroyStore(false);
+
+	if (glDeleteBuffers && !retired.empty()) {
+		glDeleteBuffers((GLsizei)retired.size(), retired.data());
+	}
+}
+
+void StreamBuffer::createStore()
+{
+	GLsizeiptr storeSize = regionSize * RegionCount;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+	if (isPersistent()) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, storeSize, nullptr, flags);
+		mapped = (uint8_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, storeSize, flags);
+		if (!mapped) {
+			log("StreamBuffer {0}: unable to map {1} bytes\n", name, storeSize);
+		}
+	}
+	else {
+		glBufferData(GL_COPY_WRITE_BUFFER, storeSize, nullptr, GL_STREAM_DRAW);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	memoryHandle = ResourceRegistry::get().add(ResourceCategory::StreamBuffer, name, (size_t)storeSize);
+
+	region = 0;
+	cursor = 0;
+	regionReady = true;
+}
+
+void StreamBuffer::destroyStore(bool retire)
+{
+	for (auto& fence : fences) {
+		if (fence) {
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+
+	if (buffer == 0) return;
+
+	ResourceRegistry::get().remove(memoryHandle);
+	memoryHandle = 0;
+
+	if (mapped) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		mapped = nullptr;
+	}
+
+	if (retire) {
+		retired.push_back(buffer);
+	}
+	else if (glDeleteBuffers) {
+		glDeleteBuffers(1, &buffer);
+	}
+
+	buffer = 0;
+}
+
+void StreamBuffer::waitForRegion()
+{
+	regionReady = true;
+
+	GLsync& fence = fences[region];
+	if (!fence) return;
+
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED) {
+		// The GPU is still reading what was written here RegionCount frames ago
+		double start = getWallTime();
+		do {
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		} while (result == GL_TIMEOUT_EXPIRED);
+		double waited = getWallTime() - start;
+
+		stats.stalls++;
+		stats.stallTime += waited;
+
+		if (stats.stalls <= MaxLoggedStalls) {
+			log("StreamBuffer {0}: waited {1:.3f} ms for region {2}{3}\n", name, waited * 1000.0, region,
+				stats.stalls == MaxLoggedStalls ? ", further stalls are only counted" : "");
+		}
+	}
+
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+StreamBuffer::Range StreamBuffer::allocate(GLsizeiptr size)
+{
+	Range range;
+	if (size <= 0) return range;
+
+	if (!regionReady) {
+		waitForRegion();
+	}
+
+	GLsizeiptr start = alignUp(cursor, alignment);
+	if (start + size > regionSize) {
+		// Grow rather than wrap into a region the GPU may still be reading
+		regionSize = alignUp(std::max(regionSize * 2, alignUp(size, alignment) * 2), alignment);
+		stats.grows++;
+		log("StreamBuffer {0}: growing regions to {1} bytes\n", name, regionSize);
+
+		destroyStore(true);
+		createStore();
+		start = 0;
+	}
+
+	range.offset = regionSize * region + start;
+	range.size = size;
+	cursor = start + size;
+
+	if (mapped) {
+		range.data = mapped + range.offset;
+	}
+	else {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		range.data = (uint8_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, range.offset, range.size,
+			GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	stats.allocations++;
+	stats.bytes += (size_t)size;
+
+	return range;
+}
+
+void StreamBuffer::commit(const Range& range)
+{
+	// Coherent mappings need nothing; ranges mapped on their own are unmapped
+	if (mapped || !range.data) return;
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void StreamBuffer::nextRegion()
+{
+	if (cursor > 0) {
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		region = (region + 1) % RegionCount;
+		cursor = 0;
+		regionReady = false;
+	}
+
+	if (!retired.empty()) {
+		glDeleteBuffers((GLsizei)retired.size(), retired.data());
+		retired.clear();
+	}
+}
+
+void StreamBuffer::endFrame()
+{
+	for (auto stream : all()) {
+		stream->nextRegion();
+	}
+}
+
+void StreamBuffer::renderUI()
+{
+	if (ImGui::CollapsingHeader("Stream buffers")) {
+		ImGui::Text(isPersistent() ? "Persistently mapped" : "Mapped per allocation (no ARB_buffer_storage)");
+
+		for (auto stream : all()) {
+			const auto& s = stream->stats;
+			ImGui::Text("%s: %d KB x %d regions", stream->name.c_str(), (int)(stream->regionSize / 1024), RegionCount);
+			ImGui::Text("  %d allocations, %.1f MB written, %d grows", (int)s.allocations, s.bytes / (1024.0 * 1024.0), (int)s.grows);
+			ImGui::Text("  %d stalls, %.2f ms waiting", (int)s.stalls, s.stallTime * 1000.0);
+		}
+	}
+}
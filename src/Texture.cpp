@@ -5,9 +5,11 @@
 
 #include "Application.h"
 #include "Framebuffer.h"
+#include "GLStateCache.h"
 #include "imgui.h"
 #include "UIHelpers.h"
 #include "Renderer.h"
+#include "ResourceRegistry.h"
 
 //std::map<GLuint, s_ptr<Texture>> Texture::_registry;
 
@@ -45,7 +47,7 @@ Texture::Texture(const std::string & fname) : filename(fname) {
         }
 
         glGenTextures(1, &id);
-        glBindTexture(bindTarget, id);
+        GLState::bindTexture(bindTarget, id);
 
         glTexParameteri(bindTarget, GL_TEXTURE_WRAP_S, wrapS._to_integral());
         glTexParameteri(bindTarget, GL_TEXTURE_WRAP_T, wrapT._to_integral());
@@ -66,7 +68,9 @@ Texture::Texture(const std::string & fname) : filename(fname) {
         log("Failed to load texture from file {0}. Not adding texture to registry - check for memleak\n", filename);
     }
 
-    glBindTexture(bindTarget, 0);
+    GLState::bindTexture(bindTarget, 0);
+
+    if (id) trackMemory(internalFormat);
 }
 
 Texture::Texture(const uint8_t* bytes, const uint32_t size) {
@@ -87,7 +91,7 @@ Texture::Texture(const uint8_t* bytes, const uint32_t size) {
         }
 
         glGenTextures(1, &id);
-        glBindTexture(bindTarget, id);
+        GLState::bindTexture(bindTarget, id);
 
         glTexParameteri(bindTarget, GL_TEXTURE_WRAP_S, wrapS._to_integral());
         glTexParameteri(bindTarget, GL_TEXTURE_WRAP_T, wrapT._to_integral());
@@ -106,7 +110,9 @@ Texture::Texture(const uint8_t* bytes, const uint32_t size) {
         log("Failed to load texture from bytes. Not adding texture to registry - check for memleak\n");
     }
 
-    glBindTexture(bindTarget, 0);
+    GLState::bindTexture(bindTarget, 0);
+
+    if (id) trackMemory(internalFormat);
 }
 
 Texture::Texture(Framebuffer* fb,  GBufferMode _usage, GLenum _attachment) 
@@ -117,7 +123,7 @@ Texture::Texture(Framebuffer* fb,  GBufferMode _usage, GLenum _attachment)
     //auto& reg = registry();
     
     glGenTextures(1, &id);
-    glBindTexture(bindTarget, id);
+    GLState::bindTexture(bindTarget, id);
 
     if (usage == +GBufferMode::Depth) {
         wrapS = TextureWrapMode::ClampToBorder;
@@ -146,6 +152,32 @@ Texture::Texture(Framebuffer* fb,  GBufferMode _usage, GLenum _attachment)
         nullptr);
 
     memory = std::make_shared<TextureMemory>(texDesc.pixelDataType, resolution.x, resolution.y, texDesc.stride);
+
+    trackMemory((GLenum)texDesc.internalFormat);
+}
+
+void Texture::trackMemory(GLenum sizedFormat) {
+    size_t texels = (size_t)resolution.x * (size_t)resolution.y;
+    // A full mip chain adds about a third
+    if (minFilter == +TextureFilterMode::LinearMipMap) {
+        texels += texels / 3;
+    }
+
+    auto category = framebuffer ? ResourceCategory::Framebuffer : ResourceCategory::Texture;
+    auto label = framebuffer ? fmt::format("Framebuffer {0} {1}", framebuffer->framebuffer, usage._to_string())
+        : (filename.empty() ? fmt::format("Texture {0}", id) : filename);
+
+    memoryHandle = ResourceRegistry::get().add(category, label, texels * ResourceRegistry::texelSize(sizedFormat),
+        memory ? memory->size : 0);
+}
+
+GLuint Texture::getSampler() const {
+	GLState::SamplerState state;
+	state.magFilter = magFilter._to_integral();
+	state.minFilter = minFilter._to_integral();
+	state.wrapS = wrapS._to_integral();
+	state.wrapT = wrapT._to_integral();
+	return GLState::getSampler(state);
 }
 
 Texture::~Texture() {
@@ -160,6 +192,10 @@ Texture::~Texture() {
         }
     }
 
+    ResourceRegistry::get().remove(memoryHandle);
+    memoryHandle = 0;
+
+    GLState::forgetTexture(id);
     glDeleteTextures(1, &id);
     id = 0;
     resolution = uvec2();
@@ -210,12 +246,12 @@ void Texture::copyToMemory()
 
         }
         else {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(bindTarget, id);
+            GLState::activeTexture(GL_TEXTURE0);
+            GLState::bindTexture(bindTarget, id);
 
             glGetTexImage(bindTarget, 0, format, pixelDataType, memory->value);
 
-            glBindTexture(bindTarget, 0);
+            GLState::bindTexture(bindTarget, 0);
         }
     }
 }
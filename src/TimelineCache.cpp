@@ -0,0 +1,295 @@
+#include "TimelineCache.h"
+
+#include "UIHelpers.h"
+
+#include "imgui.h"
+
+void TimelineCache::setCallbacks(Capture c, Restore r, Step s) {
+	capture = c;
+	restore = r;
+	step = s;
+}
+
+void TimelineCache::reset(int frame) {
+	checkpoints.clear();
+	stats = Stats();
+	currentFrame = frame;
+	store(frame);
+}
+
+void TimelineCache::advance() {
+	if (!step) return;
+
+	step();
+	currentFrame++;
+
+	if (currentFrame % interval == 0 && !hasCheckpoint(currentFrame)) {
+		store(currentFrame);
+		evict();
+	}
+}
+
+bool TimelineCache::seek(int frame) {
+	if (frame == currentFrame) return true;
+
+	double start = getWallTime();
+	int startFrame = currentFrame;
+
+	auto it = checkpoints.upper_bound(frame);
+	if (it == checkpoints.begin()) {
+		log("{0}: no checkpoint at or before frame {1}\n", __FUNCTION__, frame);
+		return false;
+	}
+	--it;
+
+	// Simulating on from where we are beats restoring when we're already past the checkpoint
+	if (frame < currentFrame || currentFrame < it->first) {
+		if (!load(it->first, scratch)) return false;
+
+		restore(scratch);
+		currentFrame = it->first;
+		startFrame = currentFrame;
+	}
+
+	if (currentFrame == frame) stats.hits++;
+	else stats.misses++;
+
+	while (currentFrame < frame) {
+		advance();
+	}
+
+	stats.lastSeekSteps = currentFrame - startFrame;
+	stats.lastSeekTime = getWallTime() - start;
+
+	return true;
+}
+
+void TimelineCache::invalidateAfter(int frame) {
+	std::vector<int> stale;
+	for (auto it = checkpoints.upper_bound(frame); it != checkpoints.end(); ++it) {
+		stale.push_back(it->first);
+	}
+	for (int f : stale) {
+		erase(f);
+	}
+}
+
+std::vector<int> TimelineCache::getCheckpointFrames() const {
+	std::vector<int> frames;
+	frames.reserve(checkpoints.size());
+	for (const auto& cp : checkpoints) {
+		frames.push_back(cp.first);
+	}
+	return frames;
+}
+
+void TimelineCache::store(int frame) {
+	if (!capture) return;
+
+	capture(scratch);
+
+	Checkpoint cp;
+	cp.rawSize = scratch.size();
+	cp.lastUsed = ++useCounter;
+
+	// Deltas go against the key at the start of this checkpoint's group, if it's still around
+	// and the state hasn't changed size since
+	int n = frame / interval;
+	int keyFrame = (n - n % keyInterval) * interval;
+	bool isKey = frame % interval != 0 || keyFrame == frame;
+
+	if (!isKey) {
+		auto key = checkpoints.find(keyFrame);
+		if (key == checkpoints.end() || key->second.keyFrame >= 0 || key->second.rawSize != cp.rawSize) {
+			isKey = true;
+		}
+		else {
+			decode(key->second.data, nullptr, key->second.rawSize, keyScratch);
+		}
+	}
+
+	if (isKey) {
+		encode(scratch, nullptr, cp.data);
+	}
+	else {
+		cp.keyFrame = keyFrame;
+		encode(scratch, &keyScratch, cp.data);
+	}
+
+	erase(frame);
+
+	stats.bytes += cp.data.size();
+	stats.rawBytes += cp.rawSize;
+	stats.checkpoints++;
+
+	checkpoints[frame] = std::move(cp);
+}
+
+bool TimelineCache::load(int frame, std::vector<uint8_t>& state) {
+	auto it = checkpoints.find(frame);
+	if (it == checkpoints.end()) return false;
+
+	auto& cp = it->second;
+	cp.lastUsed = ++useCounter;
+
+	if (cp.keyFrame < 0) {
+		decode(cp.data, nullptr, cp.rawSize, state);
+		return true;
+	}
+
+	auto key = checkpoints.find(cp.keyFrame);
+	if (key == checkpoints.end()) return false;
+
+	key->second.lastUsed = cp.lastUsed;
+	decode(key->second.data, nullptr, key->second.rawSize, keyScratch);
+	decode(cp.data, &keyScratch, cp.rawSize, state);
+	return true;
+}
+
+void TimelineCache::evict() {
+	while (stats.bytes > budgetBytes && checkpoints.size() > 1) {
+		// The earliest checkpoint is the only guaranteed way back to the start, so keep it
+		int first = checkpoints.begin()->first;
+		int oldest = first;
+		uint64_t oldestUse = UINT64_MAX;
+
+		for (const auto& cp : checkpoints) {
+			if (cp.first != first && cp.second.lastUsed < oldestUse) {
+				oldest = cp.first;
+				oldestUse = cp.second.lastUsed;
+			}
+		}
+
+		if (oldest == first) break;
+
+		erase(oldest);
+		stats.evictions++;
+	}
+}
+
+void TimelineCache::erase(int frame) {
+	auto it = checkpoints.find(frame);
+	if (it == checkpoints.end()) return;
+
+	stats.bytes -= it->second.data.size();
+	stats.rawBytes -= it->second.rawSize;
+	stats.checkpoints--;
+
+	bool isKey = it->second.keyFrame < 0;
+	checkpoints.erase(it);
+
+	if (!isKey) return;
+
+	// Deltas are useless without their key
+	std::vector<int> dependents;
+	for (const auto& cp : checkpoints) {
+		if (cp.second.keyFrame == frame) dependents.push_back(cp.first);
+	}
+	for (int f : dependents) {
+		erase(f);
+	}
+}
+
+namespace {
+	void writeVarint(std::vector<uint8_t>& out, size_t v) {
+		while (v >= 0x80) {
+			out.push_back(uint8_t(v) | 0x80);
+			v >>= 7;
+		}
+		out.push_back(uint8_t(v));
+	}
+
+	size_t readVarint(const std::vector<uint8_t>& in, size_t& pos) {
+		size_t v = 0;
+		int shift = 0;
+		while (pos < in.size()) {
+			uint8_t b = in[pos++];
+			v |= size_t(b & 0x7f) << shift;
+			if (!(b & 0x80)) break;
+			shift += 7;
+		}
+		return v;
+	}
+
+	// Position of byte i once bytes are grouped by lane: byte 0 of every 4-byte word, then
+	// byte 1, and so on. Floats that barely moved only differ in their low mantissa bytes,
+	// so grouping puts the unchanged high bytes into long zero runs.
+	inline size_t shuffled(size_t i, size_t words) {
+		size_t word = i / 4;
+		return word < words ? (i % 4) * words + word : i;
+	}
+}
+
+// The state is XORed with the key (when there is one), byte-shuffled by lane and then stored
+// as a series of (varint zero run, varint literal count, literal bytes).
+void TimelineCache::encode(const std::vector<uint8_t>& state, const std::vector<uint8_t>* key, std::vector<uint8_t>& out) {
+	size_t n = state.size();
+	size_t words = n / 4;
+
+	std::vector<uint8_t> plane(n);
+	for (size_t i = 0; i < n; i++) {
+		plane[shuffled(i, words)] = key ? state[i] ^ (*key)[i] : state[i];
+	}
+
+	out.clear();
+	out.reserve(n / 4 + 16);
+
+	size_t i = 0;
+	while (i < n) {
+		size_t zeroStart = i;
+		while (i < n && plane[i] == 0) i++;
+
+		size_t litStart = i;
+		while (i < n && plane[i] != 0) i++;
+
+		writeVarint(out, litStart - zeroStart);
+		writeVarint(out, i - litStart);
+		out.insert(out.end(), plane.begin() + litStart, plane.begin() + i);
+	}
+}
+
+void TimelineCache::decode(const std::vector<uint8_t>& in, const std::vector<uint8_t>* key, size_t rawSize, std::vector<uint8_t>& state) {
+	std::vector<uint8_t> plane(rawSize, 0);
+
+	size_t pos = 0, out = 0;
+	while (pos < in.size() && out < rawSize) {
+		out += readVarint(in, pos);
+		size_t literals = readVarint(in, pos);
+
+		size_t count = std::min(literals, rawSize - std::min(out, rawSize));
+		count = std::min(count, in.size() - pos);
+		memcpy(plane.data() + out, in.data() + pos, count);
+		out += literals;
+		pos += literals;
+	}
+
+	size_t words = rawSize / 4;
+	state.resize(rawSize);
+	for (size_t i = 0; i < rawSize; i++) {
+		state[i] = plane[shuffled(i, words)];
+		if (key) state[i] ^= (*key)[i];
+	}
+}
+
+void TimelineCache::renderUI() {
+	ImGui::PushID((void*)this);
+
+	int budgetMB = (int)(budgetBytes / (1024 * 1024));
+	if (ImGui::SliderInt("Cache budget (MB)", &budgetMB, 1, 1024)) {
+		budgetBytes = (size_t)budgetMB * 1024 * 1024;
+		evict();
+	}
+	ImGui::SliderInt("Checkpoint interval", &interval, 1, 120);
+	ImGui::SliderInt("Frames per key", &keyInterval, 1, 64);
+
+	float used = budgetBytes > 0 ? (float)stats.bytes / (float)budgetBytes : 0.f;
+	auto usedText = fmt::format("{0:.2f} / {1} MB", stats.bytes / (1024.0 * 1024.0), budgetMB);
+	ImGui::ProgressBar(used, ImVec2(-1, 0), usedText.c_str());
+
+	double ratio = stats.bytes > 0 ? (double)stats.rawBytes / (double)stats.bytes : 0.0;
+	ImGui::Text("%d checkpoints, %.1fx compression, %d evicted", (int)stats.checkpoints, ratio, (int)stats.evictions);
+	ImGui::Text("Seeks: %d exact, %d simulated. Last seek: %d frames in %.2f ms",
+		(int)stats.hits, (int)stats.misses, stats.lastSeekSteps, stats.lastSeekTime * 1000.0);
+
+	ImGui::PopID();
+}
@@ -6,6 +6,8 @@
 #include "Application.h"
 #include "Framebuffer.h"
 #include "Input.h"
+#include "Picking.h"
+#include "AnimationObjectRenderer.h"
 #include "Renderer.h"
 #include "Texture.h"
 #include "imgui.h"
@@ -44,36 +46,48 @@ Tool::EventActions SelectTool::defaultEvents() {
 void SelectTool::update(std::vector<InputEvent>& events) {
 	Tool::update(events);
 
-	if (!active) return;
+	auto& jr = AnimationObjectRenderer::get();
 
-	if (selecting && !lastFrameSelecting) {
+	if (!active) {
+		jr.hoveredIndex = -1;
+		return;
+	}
 
-		auto ogl = Application::get().getRenderer<OpenGLRenderer>();
-		auto& input = Input::get();
+	auto& picker = Picker::get();
 
-		ivec2 nextMousePos = input.current.mousePos;
+	int w = 0, h = 0;
+	glfwGetWindowSize(Application::get().window, &w, &h);
 
-		if (mousePos != nextMousePos) {
-			mousePos = nextMousePos;
-			int w = 0, h = 0;
-			glfwGetWindowSize(Application::get().window, &w, &h);
-			mousePos.y = h - mousePos.y;
+	// Picks are in window pixels with the origin at the bottom left, like the gbuffer
+	ivec2 cursor = Input::get().current.mousePos;
+	cursor.y = h - cursor.y;
 
-			vec2 texCoord = vec2((float)mousePos.x / w, (float)mousePos.y / h);
+	if (selecting && !lastFrameSelecting) {
+		mousePos = cursor;
+		clickPending = true;
+		clickRequest = picker.request(cursor, ivec2(w, h), true);
+	}
+	else if (hover && cursor != hoverPos) {
+		picker.request(cursor, ivec2(w, h));
+	}
+	hoverPos = cursor;
 
-			auto mainTex = ogl->gbuffer->textures[0];
-			mainTex->copyToMemory();
-			//currentColorData = mainTex->getColor(mousePos);
-			currentColorData = mainTex->getColorUV(texCoord);
+	// Results come back a frame or two after their request
+	if (picker.poll()) {
+		const auto& pick = picker.result();
 
-			auto primTex = ogl->gbuffer->textures[1];
-			primTex->copyToMemory();
-			//currentSelectData = primTex->getColor(mousePos);
-			currentSelectData = primTex->getColorUV(texCoord);
+		currentColorData = pick.color;
+		currentSelectData = pick.primitive;
 
-			int shapeID = (int)currentSelectData.x;
+		jr.hoveredIndex = hover ? pick.objectIndex : -1;
 
-			Application::get().selectObject(shapeID);
+		// A newer click replaces an older one still waiting, so only its id can match
+		const auto& click = picker.clickResult();
+		if (clickPending && click.id == clickRequest) {
+			clickPending = false;
+			if (click.objectIndex != -1) {
+				Application::get().selectObject(click.objectIndex);
+			}
 		}
 	}
 
@@ -83,6 +97,7 @@ void SelectTool::update(std::vector<InputEvent>& events) {
 void SelectTool::renderUI() {
 	ImGui::Checkbox("Active", &active);
 	ImGui::Checkbox("Selecting", &selecting);
+	ImGui::Checkbox("Highlight on hover", &hover);
 
 	ImGui::InputInt("Texture channel to read from", &textureToReadFrom);
 	ImGui::InputInt2("Mouse pos", glm::value_ptr(mousePos));
@@ -14,6 +14,14 @@ class SelectTool : public Tool {
 
 		bool selecting = false, lastFrameSelecting = false;
 
+		// Picks under the cursor every time it moves and tints what's found
+		bool hover = true;
+		ivec2 hoverPos = ivec2(-1);
+
+		// The click waiting on a pick result, by Picker::request id
+		bool clickPending = false;
+		uint64_t clickRequest = 0;
+
 		int textureToReadFrom = 1;
 
 		SelectTool() : Tool("SelectTool", defaultEvents()) {}
@@ -176,7 +176,7 @@ void TransformTool::activate() {
 	selectedOffsets.clear();
 
 	auto& app = Application::get();
-	auto& cam = app.getRenderer<OpenGLRenderer>()->camera;
+	auto& cam = app.getRenderer<Renderer>()->camera;
 	auto selectedShapes = app.getSelectedObjects();
 
 	for (auto s : selectedShapes) {
@@ -232,7 +232,7 @@ void TransformTool::update(std::vector<InputEvent>& events) {
 	auto selectedShapes = app.getSelectedObjects();
 	if (selectedShapes.empty()) return;
 
-	auto& cam = app.getRenderer<OpenGLRenderer>()->camera;
+	auto& cam = app.getRenderer<Renderer>()->camera;
 
 	vec2 dm = mousePos - lastMousePos;
 	vec2 d = dm / vec2(app.windowSize);
@@ -1,4 +1,5 @@
 #include "Uniform.h"
+#include "GLStateCache.h"
 #include "Textures.h"
 
 #include "Application.h"
@@ -37,8 +38,8 @@ void GLSLUniform<unsigned int>::updateGLUniform() {
             if (value > 0) {
 
                 GLenum boundSpot = bindingUnit - GL_TEXTURE0;
-                glActiveTexture(bindingUnit);
-                glBindTexture(GL_TEXTURE_2D, value);
+                GLState::activeTexture(bindingUnit);
+                GLState::bindTexture(GL_TEXTURE_2D, value);
                 glUniform1i(location, boundSpot);
                 if (s_ptr<Texture> texture = TextureRegistry::getTexture(value)) {
                     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, texture->wrapS._to_integral());
@@ -52,8 +53,8 @@ void GLSLUniform<unsigned int>::updateGLUniform() {
         else if (type == +GLSLUniformType::_sampler2DShadow) {
             if (value > 0) {
                 GLenum boundSpot = bindingUnit - GL_TEXTURE0;
-                glActiveTexture(bindingUnit);
-                glBindTexture(GL_TEXTURE_2D, value);
+                GLState::activeTexture(bindingUnit);
+                GLState::bindTexture(GL_TEXTURE_2D, value);
                 glUniform1i(location, boundSpot);
                 if (auto texture = TextureRegistry::getTexture(value)) {
                     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, texture->wrapS._to_integral());
@@ -0,0 +1,89 @@
+#include "WorkerPool.h"
+
+WorkerPool& WorkerPool::get()
+{
+	static WorkerPool pool;
+	return pool;
+}
+
+WorkerPool::WorkerPool()
+{
+	unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned i = 1; i < hardware; i++) {
+		threads.emplace_back(&WorkerPool::workerLoop, this, (int)i);
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+
+	for (auto& t : threads) {
+		if (t.joinable()) t.join();
+	}
+}
+
+void WorkerPool::parallelFor(int count, const Task& task)
+{
+	if (count <= 0) return;
+
+	// Nothing to share, or the workers are already busy with another loop. The caller may be
+	// one of that loop's workers, so it can't reuse its own index here.
+	if (threads.empty() || count == 1 || running.exchange(true)) {
+		int worker = threadCount() - 1;
+		for (int i = 0; i < count; i++) task(i, worker);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->task = &task;
+		this->count = count;
+		next = 0;
+		busy = (int)threads.size();
+		generation++;
+	}
+	wake.notify_all();
+
+	runTasks(0);
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [this] { return busy == 0; });
+		this->task = nullptr;
+	}
+
+	running = false;
+}
+
+void WorkerPool::runTasks(int worker)
+{
+	for (int i = next++; i < count; i = next++) {
+		(*task)(i, worker);
+	}
+}
+
+void WorkerPool::workerLoop(int worker)
+{
+	uint64_t seen = 0;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this, seen] { return quit || generation != seen; });
+			if (quit) return;
+			seen = generation;
+		}
+
+		runTasks(worker);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--busy == 0) finished.notify_one();
+		}
+	}
+}
@@ -16,10 +16,13 @@
 //#include <GL/gl.h>
 
 #include "Application.h"
+#include "Headless.h"
 #include "InputOutput.h"
 #include "UIHelpers.h"
 #include "Renderer.h"
+#include "ResourceRegistry.h"
 #include "Shader.h"
+#include "ShaderCache.h"
 
 static void GLAPIENTRY gl_error_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message,
 	const void* userParam)
@@ -31,6 +34,14 @@ static void GLAPIENTRY gl_error_callback(GLenum source, GLenum type, GLuint id,
 }
 
 double getTime()
+{
+	auto& headless = Headless::get();
+	if (headless.enabled) return headless.clock;
+
+	return glfwGetTime();
+}
+
+double getWallTime()
 {
 	return glfwGetTime();
 }
@@ -51,9 +62,11 @@ void logString(const std::string& s)
 
 GLFWwindow* createGlfwWindow(int major, int minor) 
 {
+	auto& headless = Headless::get();
+
 	GLFWmonitor* primary = glfwGetPrimaryMonitor();
 
-	const GLFWvidmode* mode = glfwGetVideoMode(primary);
+	const GLFWvidmode* mode = primary ? glfwGetVideoMode(primary) : nullptr;
 
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
@@ -77,9 +90,13 @@ GLFWwindow* createGlfwWindow(int major, int minor)
 	glfwWindowHint(GLFW_BLUE_BITS, mode->blueBits);
 	glfwWindowHint(GLFW_REFRESH_RATE, mode->refreshRate)*/;
 
+	// Headless runs draw into a hidden window at a fixed size, so results don't depend on the display
+	glfwWindowHint(GLFW_VISIBLE, headless.enabled ? GLFW_FALSE : GLFW_TRUE);
+	ivec2 size = headless.enabled || !mode ? headless.size : ivec2(mode->width - 100, mode->height - 100);
+
 	GLFWwindow* window = glfwCreateWindow(
-		mode->width - 100,
-		mode->height - 100,
+		size.x,
+		size.y,
 		"4480 main",
 		nullptr,
 		//primary, // Use primary instead of nullptr when you want to initialize borderless fullscreen.
@@ -90,6 +107,12 @@ GLFWwindow* createGlfwWindow(int major, int minor)
 
 int main(int argc, char** argv)
 {
+	auto& headless = Headless::get();
+	if (!headless.parseArgs(argc, argv))
+	{
+		exit(1);
+	}
+
 	if (!glfwInit())
 	{
 		log("Could not create GLFW window\n");
@@ -225,10 +248,32 @@ int main(int argc, char** argv)
 	//fmt::print("Located asset directory at {0}\n", IO::getAssetRoot());
 
 	Application& application = Application::get();
+	auto& shaderCache = ShaderCache::get();
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--software") application.useSoftwareRenderer = true;
+		if (std::string(argv[i]) == "--no-shader-cache") shaderCache.enabled = false;
+		if (std::string(argv[i]) == "--memory-budget" && i + 1 < argc) ResourceRegistry::get().budgetMB = std::max(0, atoi(argv[++i]));
+	}
+	shaderCache.init();
 	application.init(window);
 
+	if (headless.enabled)
+	{
+		headless.init();
+
+		while (!application.quit && !headless.done())
+		{
+			headless.beginFrame();
+			application.update();
+			application.render();
+			headless.endFrame();
+		}
+
+		headless.finish();
+	}
 
-	while (!application.quit && !glfwWindowShouldClose(window))
+	while (!headless.enabled && !application.quit && !glfwWindowShouldClose(window))
 	{
 		application.update();
 		application.render();